@@ -12,6 +12,7 @@
 
 #include "string.h"
 #include "dbprint.h"
+#include "cmd.h"
 
 // BigBuf is the large multi-purpose buffer, typically used to hold A/D samples or traces.
 // Also used to hold various smaller buffers and the Mifare Emulator Memory.
@@ -35,6 +36,10 @@ static uint8_t *emulator_memory = NULL;
 // trace related variables
 static uint32_t traceLen = 0;
 static bool tracing = true; //todo static?
+// part of the trace already shipped to the client while streaming
+static uint32_t traceStreamed = 0;
+// bytes streamed since the trace was cleared, the stream offset of the next chunk
+static uint32_t traceStreamOffset = 0;
 
 // get the address of BigBuf
 uint8_t *BigBuf_get_addr(void) {
@@ -114,6 +119,8 @@ uint16_t BigBuf_max_traceLen(void) {
 
 void clear_trace(void) {
     traceLen = 0;
+    traceStreamed = 0;
+    traceStreamOffset = 0;
 }
 void set_tracelen(uint32_t value) {
     traceLen = value;
@@ -134,6 +141,28 @@ uint32_t BigBuf_get_traceLen(void) {
     return traceLen;
 }
 
+// Ship the next chunk of not yet sent trace records to the client as a 'cmd' reply.
+// arg0 is the offset of the chunk in the stream, so the client can tell when one got lost.
+// Once everything logged so far has left the device the trace area is recycled,
+// so a sniffer can keep logging for as long as the client keeps up.
+// Returns the number of bytes sent.
+uint16_t BigBuf_stream_trace(uint16_t cmd) {
+    uint32_t pending = traceLen - traceStreamed;
+    if (pending == 0)
+        return 0;
+
+    uint16_t len = MIN(pending, PM3_CMD_DATA_SIZE_MIX);
+    reply_mix(cmd, traceStreamOffset, 0, 0, BigBuf_get_addr() + traceStreamed, len);
+    traceStreamed += len;
+    traceStreamOffset += len;
+
+    if (traceStreamed == traceLen) {
+        traceLen = 0;
+        traceStreamed = 0;
+    }
+    return len;
+}
+
 /**
   This is a function to store traces. All protocols can use this generic tracer-function.
   The traces produced by calling this function can be fetched on the client-side
@@ -38,6 +38,7 @@ void clear_trace(void);
 void set_tracing(bool enable);
 void set_tracelen(uint32_t value);
 bool get_tracing(void);
+uint16_t BigBuf_stream_trace(uint16_t cmd);
 bool RAMFUNC LogTrace(const uint8_t *btBytes, uint16_t iLen, uint32_t timestamp_start, uint32_t timestamp_end, uint8_t *parity, bool readerToTag);
 uint8_t emlSet(uint8_t *data, uint32_t offset, uint32_t length);
 
@@ -32,9 +32,6 @@ from the client to view the stored quadlets.
 #include "BigBuf.h"
 #include "string.h"
 
-#define DELAY_READER_AIR2ARM_AS_SNIFFER (2 + 3 + 8)
-#define DELAY_TAG_AIR2ARM_AS_SNIFFER (3 + 14 + 8)
-
 // Maximum number of auth attempts per standalone session
 #define MAX_PWDS_PER_SESSION 64
 
@@ -37,6 +37,20 @@ static bool bAuthenticating;
 static bool bPwd;
 static bool bSuccessful;
 
+struct hitag2_tag {
+    uint32_t uid;
+    enum {
+        TAG_STATE_RESET      = 0x01,       // Just powered up, awaiting GetSnr
+        TAG_STATE_ACTIVATING = 0x02,       // In activation phase (password mode), sent UID, awaiting reader password
+        TAG_STATE_ACTIVATED  = 0x03,       // Activation complete, awaiting read/write commands
+        TAG_STATE_WRITING    = 0x04,       // In write command, awaiting sector contents to be written
+    } state;
+    uint16_t active_sector;
+    uint8_t crypto_active;
+    uint64_t cs;
+    uint8_t sectors[12][4];
+};
+
 static struct hitag2_tag tag = {
     .state = TAG_STATE_RESET,
     .sectors = {                         // Password mode:               | Crypto mode:
@@ -55,6 +69,24 @@ static struct hitag2_tag tag = {
     },
 };
 
+static void hitag2_cipher_reset(struct hitag2_tag *tag, const uint8_t *iv) {
+    uint64_t key = ((uint64_t)tag->sectors[2][2]) |
+                   ((uint64_t)tag->sectors[2][3] << 8) |
+                   ((uint64_t)tag->sectors[1][0] << 16) |
+                   ((uint64_t)tag->sectors[1][1] << 24) |
+                   ((uint64_t)tag->sectors[1][2] << 32) |
+                   ((uint64_t)tag->sectors[1][3] << 40);
+    uint32_t uid = ((uint32_t)tag->sectors[0][0]) |
+                   ((uint32_t)tag->sectors[0][1] << 8) |
+                   ((uint32_t)tag->sectors[0][2] << 16) |
+                   ((uint32_t)tag->sectors[0][3] << 24);
+    uint32_t iv_ = (((uint32_t)(iv[0]))) |
+                   (((uint32_t)(iv[1])) << 8) |
+                   (((uint32_t)(iv[2])) << 16) |
+                   (((uint32_t)(iv[3])) << 24);
+    tag->cs = _hitag2_init(REV64(key), REV32(uid), REV32(iv_));
+}
+
 static enum {
     WRITE_STATE_START = 0x0,
     WRITE_STATE_PAGENUM_WRITTEN,
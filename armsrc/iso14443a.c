@@ -81,23 +81,6 @@ uint16_t FpgaSendQueueDelay;
 // + a varying number of ticks in the FPGA Delay Queue (mod_sig_buf)
 #define DELAY_ARM2AIR_AS_TAG (4*16 + 8 + 8*16 + 8 + 16 + 1 + DELAY_FPGA_QUEUE)
 
-// When the PM acts as sniffer and is receiving tag data, it takes
-// 3 ticks A/D conversion
-// 14 ticks to complete the modulation detection
-// 8 ticks (on average) until the result is stored in to_arm
-// + the delays in transferring data - which is the same for
-// sniffing reader and tag data and therefore not relevant
-#define DELAY_TAG_AIR2ARM_AS_SNIFFER (3 + 14 + 8)
-
-// When the PM acts as sniffer and is receiving reader data, it takes
-// 2 ticks delay in analogue RF receiver (for the falling edge of the
-// start bit, which marks the start of the communication)
-// 3 ticks A/D conversion
-// 8 ticks on average until the data is stored in to_arm.
-// + the delays in transferring data - which is the same for
-// sniffing reader and tag data and therefore not relevant
-#define DELAY_READER_AIR2ARM_AS_SNIFFER (2 + 3 + 8)
-
 //variables used for timing purposes:
 //these are in ssp_clk cycles:
 static uint32_t NextTransferTime;
@@ -161,321 +144,43 @@ void GetParity(const uint8_t *pbtCmd, uint16_t len, uint8_t *par) {
 
 
 //=============================================================================
-// ISO 14443 Type A - Miller decoder
+// ISO 14443 Type A - Miller / Manchester decoders
 //=============================================================================
-// Basics:
-// This decoder is used when the PM3 acts as a tag.
-// The reader will generate "pauses" by temporarily switching of the field.
-// At the PM3 antenna we will therefore measure a modulated antenna voltage.
-// The FPGA does a comparison with a threshold and would deliver e.g.:
-// ........  1 1 1 1 1 1 0 0 1 1 1 1 1 1 1 1 1 1 0 0 1 1 1 1 1 1 1 1 1 1  .......
-// The Miller decoder needs to identify the following sequences:
-// 2 (or 3) ticks pause followed by 6 (or 5) ticks unmodulated: pause at beginning - Sequence Z ("start of communication" or a "0")
-// 8 ticks without a modulation:                                no pause - Sequence Y (a "0" or "end of communication" or "no information")
-// 4 ticks unmodulated followed by 2 (or 3) ticks pause:        pause in second half - Sequence X (a "1")
-// Note 1: the bitstream may start at any time. We therefore need to sync.
-// Note 2: the interpretation of Sequence Y and Z depends on the preceding sequence.
-//-----------------------------------------------------------------------------
+// The decoders live in common/iso14443a_decode.c, these are the instances the
+// firmware works with.
 static tUart14a Uart;
-
-// Lookup-Table to decide if 4 raw bits are a modulation.
-// We accept the following:
-// 0001  -   a 3 tick wide pause
-// 0011  -   a 2 tick wide pause, or a three tick wide pause shifted left
-// 0111  -   a 2 tick wide pause shifted left
-// 1001  -   a 2 tick wide pause shifted right
-const bool Mod_Miller_LUT[] = {
-    false,  true, false, true,  false, false, false, true,
-    false,  true, false, false, false, false, false, false
-};
-#define IsMillerModulationNibble1(b) (Mod_Miller_LUT[(b & 0x000000F0) >> 4])
-#define IsMillerModulationNibble2(b) (Mod_Miller_LUT[(b & 0x0000000F)])
+tDemod14a Demod;
 
 tUart14a *GetUart14a() {
     return &Uart;
 }
 
 void Uart14aReset(void) {
-    Uart.state = STATE_14A_UNSYNCD;
-    Uart.bitCount = 0;
-    Uart.len = 0;                       // number of decoded data bytes
-    Uart.parityLen = 0;                 // number of decoded parity bytes
-    Uart.shiftReg = 0;                  // shiftreg to hold decoded data bits
-    Uart.parityBits = 0;                // holds 8 parity bits
-    Uart.startTime = 0;
-    Uart.endTime = 0;
-    Uart.fourBits = 0x00000000;         // clear the buffer for 4 Bits
-    Uart.posCnt = 0;
-    Uart.syncBit = 9999;
+    Uart14aResetEx(&Uart);
 }
 
 void Uart14aInit(uint8_t *data, uint8_t *par) {
-    Uart.output = data;
-    Uart.parity = par;
-    Uart14aReset();
+    Uart14aInitEx(&Uart, data, par);
 }
 
-// use parameter non_real_time to provide a timestamp. Set to 0 if the decoder should measure real time
 RAMFUNC bool MillerDecoding(uint8_t bit, uint32_t non_real_time) {
-    Uart.fourBits = (Uart.fourBits << 8) | bit;
-
-    if (Uart.state == STATE_14A_UNSYNCD) {                                           // not yet synced
-        Uart.syncBit = 9999;                                                 // not set
-
-        // 00x11111 2|3 ticks pause followed by 6|5 ticks unmodulated         Sequence Z (a "0" or "start of communication")
-        // 11111111 8 ticks unmodulation                                      Sequence Y (a "0" or "end of communication" or "no information")
-        // 111100x1 4 ticks unmodulated followed by 2|3 ticks pause           Sequence X (a "1")
-
-        // The start bit is one ore more Sequence Y followed by a Sequence Z (... 11111111 00x11111). We need to distinguish from
-        // Sequence X followed by Sequence Y followed by Sequence Z     (111100x1 11111111 00x11111)
-        // we therefore look for a ...xx1111 11111111 00x11111xxxxxx... pattern
-        // (12 '1's followed by 2 '0's, eventually followed by another '0', followed by 5 '1's)
-#define ISO14443A_STARTBIT_MASK       0x07FFEF80                            // mask is    00000111 11111111 11101111 10000000
-#define ISO14443A_STARTBIT_PATTERN    0x07FF8F80                            // pattern is 00000111 11111111 10001111 10000000
-        if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 0)) == ISO14443A_STARTBIT_PATTERN >> 0) Uart.syncBit = 7;
-        else if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 1)) == ISO14443A_STARTBIT_PATTERN >> 1) Uart.syncBit = 6;
-        else if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 2)) == ISO14443A_STARTBIT_PATTERN >> 2) Uart.syncBit = 5;
-        else if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 3)) == ISO14443A_STARTBIT_PATTERN >> 3) Uart.syncBit = 4;
-        else if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 4)) == ISO14443A_STARTBIT_PATTERN >> 4) Uart.syncBit = 3;
-        else if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 5)) == ISO14443A_STARTBIT_PATTERN >> 5) Uart.syncBit = 2;
-        else if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 6)) == ISO14443A_STARTBIT_PATTERN >> 6) Uart.syncBit = 1;
-        else if ((Uart.fourBits & (ISO14443A_STARTBIT_MASK >> 7)) == ISO14443A_STARTBIT_PATTERN >> 7) Uart.syncBit = 0;
-
-        if (Uart.syncBit != 9999) {                                              // found a sync bit
-            Uart.startTime = non_real_time ? non_real_time : (GetCountSspClk() & 0xfffffff8);
-            Uart.startTime -= Uart.syncBit;
-            Uart.endTime = Uart.startTime;
-            Uart.state = STATE_14A_START_OF_COMMUNICATION;
-        }
-    } else {
-
-        if (IsMillerModulationNibble1(Uart.fourBits >> Uart.syncBit)) {
-            if (IsMillerModulationNibble2(Uart.fourBits >> Uart.syncBit)) {      // Modulation in both halves - error
-                Uart14aReset();
-            } else {                                                             // Modulation in first half = Sequence Z = logic "0"
-                if (Uart.state == STATE_14A_MILLER_X) {                              // error - must not follow after X
-                    Uart14aReset();
-                } else {
-                    Uart.bitCount++;
-                    Uart.shiftReg = (Uart.shiftReg >> 1);                        // add a 0 to the shiftreg
-                    Uart.state = STATE_14A_MILLER_Z;
-                    Uart.endTime = Uart.startTime + 8 * (9 * Uart.len + Uart.bitCount + 1) - 6;
-                    if (Uart.bitCount >= 9) {                                    // if we decoded a full byte (including parity)
-                        Uart.output[Uart.len++] = (Uart.shiftReg & 0xff);
-                        Uart.parityBits <<= 1;                                   // make room for the parity bit
-                        Uart.parityBits |= ((Uart.shiftReg >> 8) & 0x01);        // store parity bit
-                        Uart.bitCount = 0;
-                        Uart.shiftReg = 0;
-                        if ((Uart.len & 0x0007) == 0) {                          // every 8 data bytes
-                            Uart.parity[Uart.parityLen++] = Uart.parityBits;     // store 8 parity bits
-                            Uart.parityBits = 0;
-                        }
-                    }
-                }
-            }
-        } else {
-            if (IsMillerModulationNibble2(Uart.fourBits >> Uart.syncBit)) {      // Modulation second half = Sequence X = logic "1"
-                Uart.bitCount++;
-                Uart.shiftReg = (Uart.shiftReg >> 1) | 0x100;                    // add a 1 to the shiftreg
-                Uart.state = STATE_14A_MILLER_X;
-                Uart.endTime = Uart.startTime + 8 * (9 * Uart.len + Uart.bitCount + 1) - 2;
-                if (Uart.bitCount >= 9) {                                        // if we decoded a full byte (including parity)
-                    Uart.output[Uart.len++] = (Uart.shiftReg & 0xff);
-                    Uart.parityBits <<= 1;                                       // make room for the new parity bit
-                    Uart.parityBits |= ((Uart.shiftReg >> 8) & 0x01);            // store parity bit
-                    Uart.bitCount = 0;
-                    Uart.shiftReg = 0;
-                    if ((Uart.len & 0x0007) == 0) {                              // every 8 data bytes
-                        Uart.parity[Uart.parityLen++] = Uart.parityBits;         // store 8 parity bits
-                        Uart.parityBits = 0;
-                    }
-                }
-            } else {                                                             // no modulation in both halves - Sequence Y
-                if (Uart.state == STATE_14A_MILLER_Z || Uart.state == STATE_14A_MILLER_Y) {    // Y after logic "0" - End of Communication
-                    Uart.state = STATE_14A_UNSYNCD;
-                    Uart.bitCount--;                                             // last "0" was part of EOC sequence
-                    Uart.shiftReg <<= 1;                                         // drop it
-                    if (Uart.bitCount > 0) {                                     // if we decoded some bits
-                        Uart.shiftReg >>= (9 - Uart.bitCount);                   // right align them
-                        Uart.output[Uart.len++] = (Uart.shiftReg & 0xff);        // add last byte to the output
-                        Uart.parityBits <<= 1;                                   // add a (void) parity bit
-                        Uart.parityBits <<= (8 - (Uart.len & 0x0007));           // left align parity bits
-                        Uart.parity[Uart.parityLen++] = Uart.parityBits;         // and store it
-                        return true;
-                    } else if (Uart.len & 0x0007) {                              // there are some parity bits to store
-                        Uart.parityBits <<= (8 - (Uart.len & 0x0007));           // left align remaining parity bits
-                        Uart.parity[Uart.parityLen++] = Uart.parityBits;         // and store them
-                    }
-                    if (Uart.len) {
-                        return true;                                             // we are finished with decoding the raw data sequence
-                    } else {
-                        Uart14aReset();                                             // Nothing received - start over
-                    }
-                }
-                if (Uart.state == STATE_14A_START_OF_COMMUNICATION) {                // error - must not follow directly after SOC
-                    Uart14aReset();
-                } else {                                                         // a logic "0"
-                    Uart.bitCount++;
-                    Uart.shiftReg = (Uart.shiftReg >> 1);                        // add a 0 to the shiftreg
-                    Uart.state = STATE_14A_MILLER_Y;
-                    if (Uart.bitCount >= 9) {                                    // if we decoded a full byte (including parity)
-                        Uart.output[Uart.len++] = (Uart.shiftReg & 0xff);
-                        Uart.parityBits <<= 1;                                   // make room for the parity bit
-                        Uart.parityBits |= ((Uart.shiftReg >> 8) & 0x01);        // store parity bit
-                        Uart.bitCount = 0;
-                        Uart.shiftReg = 0;
-                        if ((Uart.len & 0x0007) == 0) {                          // every 8 data bytes
-                            Uart.parity[Uart.parityLen++] = Uart.parityBits;     // store 8 parity bits
-                            Uart.parityBits = 0;
-                        }
-                    }
-                }
-            }
-        }
-    }
-    return false;    // not finished yet, need more data
+    return MillerDecodingEx(&Uart, bit, non_real_time);
 }
 
-//=============================================================================
-// ISO 14443 Type A - Manchester decoder
-//=============================================================================
-// Basics:
-// This decoder is used when the PM3 acts as a reader.
-// The tag will modulate the reader field by asserting different loads to it. As a consequence, the voltage
-// at the reader antenna will be modulated as well. The FPGA detects the modulation for us and would deliver e.g. the following:
-// ........ 0 0 1 1 1 1 0 0 0 0 0 0 0 0 1 1 1 1 1 1 1 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 .......
-// The Manchester decoder needs to identify the following sequences:
-// 4 ticks modulated followed by 4 ticks unmodulated:     Sequence D = 1 (also used as "start of communication")
-// 4 ticks unmodulated followed by 4 ticks modulated:     Sequence E = 0
-// 8 ticks unmodulated:                                   Sequence F = end of communication
-// 8 ticks modulated:                                     A collision. Save the collision position and treat as Sequence D
-// Note 1: the bitstream may start at any time. We therefore need to sync.
-// Note 2: parameter offset is used to determine the position of the parity bits (required for the anticollision command only)
-tDemod14a Demod;
-
-// Lookup-Table to decide if 4 raw bits are a modulation.
-// We accept three or four "1" in any position
-const bool Mod_Manchester_LUT[] = {
-    false, false, false, false, false, false, false, true,
-    false, false, false, true,  false, true,  true,  true
-};
-
-#define IsManchesterModulationNibble1(b) (Mod_Manchester_LUT[(b & 0x00F0) >> 4])
-#define IsManchesterModulationNibble2(b) (Mod_Manchester_LUT[(b & 0x000F)])
-
 tDemod14a *GetDemod14a() {
     return &Demod;
 }
+
 void Demod14aReset(void) {
-    Demod.state = DEMOD_14A_UNSYNCD;
-    Demod.len = 0;                       // number of decoded data bytes
-    Demod.parityLen = 0;
-    Demod.shiftReg = 0;                  // shiftreg to hold decoded data bits
-    Demod.parityBits = 0;                //
-    Demod.collisionPos = 0;              // Position of collision bit
-    Demod.twoBits = 0xFFFF;              // buffer for 2 Bits
-    Demod.highCnt = 0;
-    Demod.startTime = 0;
-    Demod.endTime = 0;
-    Demod.bitCount = 0;
-    Demod.syncBit = 0xFFFF;
-    Demod.samples = 0;
+    Demod14aResetEx(&Demod);
 }
 
 void Demod14aInit(uint8_t *data, uint8_t *par) {
-    Demod.output = data;
-    Demod.parity = par;
-    Demod14aReset();
+    Demod14aInitEx(&Demod, data, par);
 }
 
-// use parameter non_real_time to provide a timestamp. Set to 0 if the decoder should measure real time
 RAMFUNC int ManchesterDecoding(uint8_t bit, uint16_t offset, uint32_t non_real_time) {
-    Demod.twoBits = (Demod.twoBits << 8) | bit;
-
-    if (Demod.state == DEMOD_14A_UNSYNCD) {
-
-        if (Demod.highCnt < 2) {                                            // wait for a stable unmodulated signal
-            if (Demod.twoBits == 0x0000) {
-                Demod.highCnt++;
-            } else {
-                Demod.highCnt = 0;
-            }
-        } else {
-            Demod.syncBit = 0xFFFF;            // not set
-            if ((Demod.twoBits & 0x7700) == 0x7000) Demod.syncBit = 7;
-            else if ((Demod.twoBits & 0x3B80) == 0x3800) Demod.syncBit = 6;
-            else if ((Demod.twoBits & 0x1DC0) == 0x1C00) Demod.syncBit = 5;
-            else if ((Demod.twoBits & 0x0EE0) == 0x0E00) Demod.syncBit = 4;
-            else if ((Demod.twoBits & 0x0770) == 0x0700) Demod.syncBit = 3;
-            else if ((Demod.twoBits & 0x03B8) == 0x0380) Demod.syncBit = 2;
-            else if ((Demod.twoBits & 0x01DC) == 0x01C0) Demod.syncBit = 1;
-            else if ((Demod.twoBits & 0x00EE) == 0x00E0) Demod.syncBit = 0;
-            if (Demod.syncBit != 0xFFFF) {
-                Demod.startTime = non_real_time ? non_real_time : (GetCountSspClk() & 0xfffffff8);
-                Demod.startTime -= Demod.syncBit;
-                Demod.bitCount = offset;            // number of decoded data bits
-                Demod.state = DEMOD_14A_MANCHESTER_DATA;
-            }
-        }
-    } else {
-
-        if (IsManchesterModulationNibble1(Demod.twoBits >> Demod.syncBit)) {      // modulation in first half
-            if (IsManchesterModulationNibble2(Demod.twoBits >> Demod.syncBit)) {  // ... and in second half = collision
-                if (!Demod.collisionPos) {
-                    Demod.collisionPos = (Demod.len << 3) + Demod.bitCount;
-                }
-            }                                                           // modulation in first half only - Sequence D = 1
-            Demod.bitCount++;
-            Demod.shiftReg = (Demod.shiftReg >> 1) | 0x100;             // in both cases, add a 1 to the shiftreg
-            if (Demod.bitCount == 9) {                                  // if we decoded a full byte (including parity)
-                Demod.output[Demod.len++] = (Demod.shiftReg & 0xff);
-                Demod.parityBits <<= 1;                                 // make room for the parity bit
-                Demod.parityBits |= ((Demod.shiftReg >> 8) & 0x01);     // store parity bit
-                Demod.bitCount = 0;
-                Demod.shiftReg = 0;
-                if ((Demod.len & 0x0007) == 0) {                        // every 8 data bytes
-                    Demod.parity[Demod.parityLen++] = Demod.parityBits; // store 8 parity bits
-                    Demod.parityBits = 0;
-                }
-            }
-            Demod.endTime = Demod.startTime + 8 * (9 * Demod.len + Demod.bitCount + 1) - 4;
-        } else {                                                        // no modulation in first half
-            if (IsManchesterModulationNibble2(Demod.twoBits >> Demod.syncBit)) {    // and modulation in second half = Sequence E = 0
-                Demod.bitCount++;
-                Demod.shiftReg = (Demod.shiftReg >> 1);                 // add a 0 to the shiftreg
-                if (Demod.bitCount >= 9) {                              // if we decoded a full byte (including parity)
-                    Demod.output[Demod.len++] = (Demod.shiftReg & 0xff);
-                    Demod.parityBits <<= 1;                             // make room for the new parity bit
-                    Demod.parityBits |= ((Demod.shiftReg >> 8) & 0x01); // store parity bit
-                    Demod.bitCount = 0;
-                    Demod.shiftReg = 0;
-                    if ((Demod.len & 0x0007) == 0) {                    // every 8 data bytes
-                        Demod.parity[Demod.parityLen++] = Demod.parityBits;    // store 8 parity bits1
-                        Demod.parityBits = 0;
-                    }
-                }
-                Demod.endTime = Demod.startTime + 8 * (9 * Demod.len + Demod.bitCount + 1);
-            } else {                                                    // no modulation in both halves - End of communication
-                if (Demod.bitCount > 0) {                               // there are some remaining data bits
-                    Demod.shiftReg >>= (9 - Demod.bitCount);            // right align the decoded bits
-                    Demod.output[Demod.len++] = Demod.shiftReg & 0xff;  // and add them to the output
-                    Demod.parityBits <<= 1;                             // add a (void) parity bit
-                    Demod.parityBits <<= (8 - (Demod.len & 0x0007));    // left align remaining parity bits
-                    Demod.parity[Demod.parityLen++] = Demod.parityBits; // and store them
-                    return true;
-                } else if (Demod.len & 0x0007) {                        // there are some parity bits to store
-                    Demod.parityBits <<= (8 - (Demod.len & 0x0007));    // left align remaining parity bits
-                    Demod.parity[Demod.parityLen++] = Demod.parityBits; // and store them
-                }
-                if (Demod.len) {
-                    return true;                                        // we are finished with decoding the raw data sequence
-                } else {                                                // nothing received. Start over
-                    Demod14aReset();
-                }
-            }
-        }
-    }
-    return false;    // not finished yet, need more data
+    return ManchesterDecodingEx(&Demod, bit, offset, non_real_time);
 }
 
 
@@ -565,11 +270,24 @@ RAMFUNC int ManchesterDecoding_Thinfilm(uint8_t bit) {
 // near the reader.
 // "hf 14a sniff"
 //-----------------------------------------------------------------------------
+// While streaming, trace chunks are sent over USB from inside the loop. The larger
+// DMA buffer (~19ms of samples) covers the time the FPGA keeps delivering meanwhile.
+#define SNIFF_STREAM_DMA_SIZE 4096
+
+static bool sniff_log_trace(void *ctx, const uint8_t *data, uint16_t len, uint32_t start, uint32_t end, uint8_t *par, bool reader) {
+    return LogTrace(data, len, start, end, par, reader);
+}
+
 void RAMFUNC SniffIso14443a(uint8_t param) {
     LEDsoff();
     // param:
     // bit 0 - trigger from first card answer
     // bit 1 - trigger from first reader 7-bit request
+    // bit 2 - stream the trace to the client while sniffing
+    bool stream = (param & 0x04);
+    uint16_t dma_size = stream ? SNIFF_STREAM_DMA_SIZE : DMA_BUFFER_SIZE;
+    int res = PM3_SUCCESS;
+
     iso14443a_setup(FPGA_HF_ISO14443A_SNIFFER);
 
     // Allocate memory from BigBuf for some buffers
@@ -588,13 +306,10 @@ void RAMFUNC SniffIso14443a(uint8_t param) {
     uint8_t *receivedRespPar = BigBuf_malloc(MAX_PARITY_SIZE);
 
     // The DMA buffer, used to stream samples from the FPGA
-    uint8_t *dmaBuf = BigBuf_malloc(DMA_BUFFER_SIZE);
+    uint8_t *dmaBuf = BigBuf_malloc(dma_size);
     uint8_t *data = dmaBuf;
 
-    uint8_t previous_data = 0;
     int maxDataLen = 0, dataLen;
-    bool TagIsActive = false;
-    bool ReaderIsActive = false;
 
     // Set up the demodulator for tag -> reader responses.
     Demod14aInit(receivedResp, receivedRespPar);
@@ -602,117 +317,79 @@ void RAMFUNC SniffIso14443a(uint8_t param) {
     // Set up the demodulator for the reader -> tag commands
     Uart14aInit(receivedCmd, receivedCmdPar);
 
+    tSniff14a sniff;
+    Sniff14aInit(&sniff, &Uart, &Demod, MAX_FRAME_SIZE, param, sniff_log_trace, NULL);
+
     DbpString("Starting to sniff");
 
     // Setup and start DMA.
-    if (!FpgaSetupSscDma((uint8_t *) dmaBuf, DMA_BUFFER_SIZE)) {
+    if (!FpgaSetupSscDma((uint8_t *) dmaBuf, dma_size)) {
         if (DBGLEVEL > 1) Dbprintf("FpgaSetupSscDma failed. Exiting");
+        if (stream) reply_ng(CMD_HF_ISO14443A_SNIFF, PM3_EMALLOC, NULL, 0);
         return;
     }
 
-    // We won't start recording the frames that we acquire until we trigger;
-    // a good trigger condition to get started is probably when we see a
-    // response from the tag.
-    // triggered == false -- to wait first for card
-    bool triggered = !(param & 0x03);
-
-    uint32_t rx_samples = 0;
-
     // loop and listen
     while (!BUTTON_PRESS()) {
         WDT_HIT();
         LED_A_ON();
 
         int register readBufDataP = data - dmaBuf;
-        int register dmaBufDataP = DMA_BUFFER_SIZE - AT91C_BASE_PDC_SSC->PDC_RCR;
+        int register dmaBufDataP = dma_size - AT91C_BASE_PDC_SSC->PDC_RCR;
         if (readBufDataP <= dmaBufDataP)
             dataLen = dmaBufDataP - readBufDataP;
         else
-            dataLen = DMA_BUFFER_SIZE - readBufDataP + dmaBufDataP;
+            dataLen = dma_size - readBufDataP + dmaBufDataP;
 
         // test for length of buffer
         if (dataLen > maxDataLen) {
             maxDataLen = dataLen;
-            if (dataLen > (9 * DMA_BUFFER_SIZE / 10)) {
+            if (dataLen > (9 * dma_size / 10)) {
                 Dbprintf("[!] blew circular buffer! | datalen %u", dataLen);
+                res = PM3_EOVFLOW;
                 break;
             }
         }
+
+        if (stream) {
+            // the client stops a streaming sniff by sending any command
+            if (!(sniff.rx_samples & 0xFF) && data_available()) break;
+            // ship finished records only while there is enough slack in the DMA buffer
+            if (dataLen < dma_size / 4) BigBuf_stream_trace(CMD_HF_ISO14443A_SNIFF_STREAM);
+        }
+
         if (dataLen < 1) continue;
 
         // primary buffer was stopped( <-- we lost data!
         if (!AT91C_BASE_PDC_SSC->PDC_RCR) {
             AT91C_BASE_PDC_SSC->PDC_RPR = (uint32_t) dmaBuf;
-            AT91C_BASE_PDC_SSC->PDC_RCR = DMA_BUFFER_SIZE;
+            AT91C_BASE_PDC_SSC->PDC_RCR = dma_size;
             Dbprintf("[-] RxEmpty ERROR | data length %d", dataLen); // temporary
         }
         // secondary buffer sets as primary, secondary buffer was stopped
         if (!AT91C_BASE_PDC_SSC->PDC_RNCR) {
             AT91C_BASE_PDC_SSC->PDC_RNPR = (uint32_t) dmaBuf;
-            AT91C_BASE_PDC_SSC->PDC_RNCR = DMA_BUFFER_SIZE;
+            AT91C_BASE_PDC_SSC->PDC_RNCR = dma_size;
         }
 
         LED_A_OFF();
 
-        // Need two samples to feed Miller and Manchester-Decoder
-        if (rx_samples & 0x01) {
-
-            if (!TagIsActive) {        // no need to try decoding reader data if the tag is sending
-                uint8_t readerdata = (previous_data & 0xF0) | (*data >> 4);
-                if (MillerDecoding(readerdata, (rx_samples - 1) * 4)) {
-                    LED_C_ON();
-
-                    // check - if there is a short 7bit request from reader
-                    if ((!triggered) && (param & 0x02) && (Uart.len == 1) && (Uart.bitCount == 7)) triggered = true;
-
-                    if (triggered) {
-                        if (!LogTrace(receivedCmd,
-                                      Uart.len,
-                                      Uart.startTime * 16 - DELAY_READER_AIR2ARM_AS_SNIFFER,
-                                      Uart.endTime * 16 - DELAY_READER_AIR2ARM_AS_SNIFFER,
-                                      Uart.parity,
-                                      true)) break;
-                    }
-                    /* ready to receive another command. */
-                    Uart14aReset();
-                    /* reset the demod code, which might have been */
-                    /* false-triggered by the commands from the reader. */
-                    Demod14aReset();
-                    LED_B_OFF();
-                }
-                ReaderIsActive = (Uart.state != STATE_14A_UNSYNCD);
-            }
-
-            // no need to try decoding tag data if the reader is sending - and we cannot afford the time
-            if (!ReaderIsActive) {
-                uint8_t tagdata = (previous_data << 4) | (*data & 0x0F);
-                if (ManchesterDecoding(tagdata, 0, (rx_samples - 1) * 4)) {
-                    LED_B_ON();
-
-                    if (!LogTrace(receivedResp,
-                                  Demod.len,
-                                  Demod.startTime * 16 - DELAY_TAG_AIR2ARM_AS_SNIFFER,
-                                  Demod.endTime * 16 - DELAY_TAG_AIR2ARM_AS_SNIFFER,
-                                  Demod.parity,
-                                  false)) break;
-
-                    if ((!triggered) && (param & 0x01)) triggered = true;
-
-                    // ready to receive another response.
-                    Demod14aReset();
-                    // reset the Miller decoder including its (now outdated) input buffer
-                    Uart14aReset();
-                    //Uart14aInit(receivedCmd, receivedCmdPar);
-                    LED_C_OFF();
-                }
-                TagIsActive = (Demod.state != DEMOD_14A_UNSYNCD);
-            }
+        uint8_t frames = Sniff14aDecode(&sniff, *data);
+        if (frames & SNIFF14A_LOG_FAILED) {
+            res = PM3_EOVFLOW;
+            break;
+        }
+        if (frames & SNIFF14A_READER_FRAME) {
+            LED_C_ON();
+            LED_B_OFF();
+        }
+        if (frames & SNIFF14A_TAG_FRAME) {
+            LED_B_ON();
+            LED_C_OFF();
         }
 
-        previous_data = *data;
-        rx_samples++;
         data++;
-        if (data == dmaBuf + DMA_BUFFER_SIZE) {
+        if (data == dmaBuf + dma_size) {
             data = dmaBuf;
         }
     } // end main loop
@@ -722,6 +399,12 @@ void RAMFUNC SniffIso14443a(uint8_t param) {
         Dbprintf("traceLen=" _YELLOW_("%d")", Uart.output[0]="_YELLOW_("%08x"), BigBuf_get_traceLen(), (uint32_t)Uart.output[0]);
     }
     switch_off();
+
+    if (stream) {
+        // drain what is left, then tell the client we are done
+        while (BigBuf_stream_trace(CMD_HF_ISO14443A_SNIFF_STREAM) > 0) {};
+        reply_ng(CMD_HF_ISO14443A_SNIFF, res, NULL, 0);
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -17,6 +17,7 @@
 #include "mifare.h" // struct
 #include "pm3_cmd.h"
 #include "crc16.h"  // compute_crc
+#include "iso14443a_decode.h"
 
 // When the PM acts as tag and is receiving it takes
 // 2 ticks delay in the RF part (for the first falling edge),
@@ -29,61 +30,6 @@
 // - 8*16 ticks because we measure the time of the previous transfer
 #define DELAY_AIR2ARM_AS_TAG (2 + 3 + 8 + 8 + 7*16 + 8 + 4*16 - 8*16)
 
-typedef struct {
-    enum {
-        DEMOD_14A_UNSYNCD,
-        // DEMOD_14A_HALF_SYNCD,
-        // DEMOD_14A_MOD_FIRST_HALF,
-        // DEMOD_14A_NOMOD_FIRST_HALF,
-        DEMOD_14A_MANCHESTER_DATA
-    } state;
-    uint16_t twoBits;
-    uint16_t highCnt;
-    uint16_t bitCount;
-    uint16_t collisionPos;
-    uint16_t syncBit;
-    uint8_t  parityBits;
-    uint8_t  parityLen;
-    uint16_t shiftReg;
-    uint16_t samples;
-    uint16_t len;
-    uint32_t startTime, endTime;
-    uint8_t  *output;
-    uint8_t  *parity;
-} tDemod14a;
-/*
-typedef enum {
-    MOD_NOMOD = 0,
-    MOD_SECOND_HALF,
-    MOD_FIRST_HALF,
-    MOD_BOTH_HALVES
-    } Modulation_t;
-*/
-
-typedef struct {
-    enum {
-        STATE_14A_UNSYNCD,
-        STATE_14A_START_OF_COMMUNICATION,
-        STATE_14A_MILLER_X,
-        STATE_14A_MILLER_Y,
-        STATE_14A_MILLER_Z,
-        // DROP_NONE,
-        // DROP_FIRST_HALF,
-    } state;
-    uint16_t shiftReg;
-    int16_t bitCount;
-    uint16_t len;
-    //uint16_t byteCntMax;
-    uint16_t posCnt;
-    uint16_t syncBit;
-    uint8_t  parityBits;
-    uint8_t  parityLen;
-    uint32_t fourBits;
-    uint32_t startTime, endTime;
-    uint8_t *output;
-    uint8_t *parity;
-} tUart14a;
-
 #ifndef AddCrc14A
 # define AddCrc14A(data, len) compute_crc(CRC_14443_A, (data), (len), (data)+(len), (data)+(len)+1)
 #endif
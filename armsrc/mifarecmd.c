@@ -872,7 +872,9 @@ void MifareNested(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datain)
     uint8_t keyType = (arg0 >> 8) & 0xff;
     uint8_t targetBlockNo = arg1 & 0xff;
     uint8_t targetKeyType = (arg1 >> 8) & 0xff;
-    // calibrate = arg2
+    bool calibrate = arg2 & NESTED_CALIBRATE;
+    // a third nonce lets the client check its key candidates offline
+    uint8_t ntcount = (arg2 & NESTED_EXTRA_NONCE) ? 3 : 2;
     uint64_t ui64Key = 0;
 
     ui64Key = bytes_to_num(datain, 6);
@@ -883,7 +885,7 @@ void MifareNested(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datain)
     uint8_t uid[10] = {0x00};
     uint32_t cuid = 0, nt1, nt2, nttest, ks1;
     uint8_t par[1] = {0x00};
-    uint32_t target_nt[2] = {0x00}, target_ks[2] = {0x00};
+    uint32_t target_nt[3] = {0x00}, target_ks[3] = {0x00};
 
     uint8_t par_array[4] = {0x00};
     uint16_t ncount = 0;
@@ -903,13 +905,13 @@ void MifareNested(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datain)
     BigBuf_free();
     BigBuf_Clear_ext(false);
 
-    if (arg2) clear_trace();
+    if (calibrate) clear_trace();
     set_tracing(true);
 
     // statistics on nonce distance
     int16_t isOK = 0;
 #define NESTED_MAX_TRIES 12
-    if (arg2) { // calibrate: for first call only. Otherwise reuse previous calibration
+    if (calibrate) { // calibrate: for first call only. Otherwise reuse previous calibration
         LED_B_ON();
         WDT_HIT();
 
@@ -991,7 +993,7 @@ void MifareNested(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datain)
     LED_C_ON();
 
     //  get crypted nonces for target sector
-    for (i = 0; i < 2 && !isOK; i++) { // look for exactly two different nonces
+    for (i = 0; i < ntcount && !isOK; i++) { // look for two or three different nonces
 
         target_nt[i] = 0;
         while (target_nt[i] == 0) { // continue until we have an unambiguous nonce
@@ -1045,9 +1047,9 @@ void MifareNested(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datain)
                     target_nt[i] = nttest;
                     target_ks[i] = ks1;
                     ncount++;
-                    if (i == 1 && target_nt[1] == target_nt[0]) { // we need two different nonces
+                    if ((i >= 1 && target_nt[i] == target_nt[0]) || (i == 2 && target_nt[2] == target_nt[1])) { // we need different nonces
                         target_nt[i] = 0;
-                        if (DBGLEVEL >= 3) Dbprintf("Nonce#2: dismissed (= nonce#1), ntdist=%d", j);
+                        if (DBGLEVEL >= 3) Dbprintf("Nonce#%d: dismissed (seen before), ntdist=%d", i + 1, j);
                         break;
                     }
                     if (DBGLEVEL >= 3) Dbprintf("Nonce#%d: valid, ntdist=%d", i + 1, j);
@@ -1061,12 +1063,14 @@ void MifareNested(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint8_t *datain)
 
     crypto1_destroy(pcs);
 
-    uint8_t buf[4 + 4 * 4] = {0};
+    uint8_t buf[4 + 4 * 6] = {0};
     memcpy(buf, &cuid, 4);
     memcpy(buf + 4, &target_nt[0], 4);
     memcpy(buf + 8, &target_ks[0], 4);
     memcpy(buf + 12, &target_nt[1], 4);
     memcpy(buf + 16, &target_ks[1], 4);
+    memcpy(buf + 20, &target_nt[2], 4);
+    memcpy(buf + 24, &target_ks[2], 4);
 
     LED_B_ON();
     reply_mix(CMD_ACK, isOK, 0, targetBlockNo + (targetKeyType * 0x100), buf, sizeof(buf));
@@ -21,9 +21,13 @@
 #include "crc16.h"        // crc16 ccitt
 #include "tea.h"
 #include "legic_prng.h"
+#include "fileutils.h"    // searchFile, loadFileDICTIONARY_safe
+#include "dictionary.h"
 
 static int CmdHelp(const char *Cmd);
 
+#define ANALYSE_DICT_MAX_FILES 32
+
 static int usage_analyse_lcr(void) {
     PrintAndLogEx(NORMAL, "Specifying the bytes of a UID with a known LRC will find the last byte value");
     PrintAndLogEx(NORMAL, "needed to generate that LRC with a rolling XOR. All bytes should be specified in HEX.");
@@ -78,6 +82,30 @@ static int usage_analyse_nuid(void) {
     PrintAndLogEx(NORMAL, "      analyse nuid 11223344556677");
     return 0;
 }
+static int usage_analyse_dict(void) {
+    PrintAndLogEx(NORMAL, "Merge key dictionaries into one compiled dictionary (" DICTIONARY_SUFFIX ").");
+    PrintAndLogEx(NORMAL, "Keys are deduplicated and keep the order of their first appearance, list the most");
+    PrintAndLogEx(NORMAL, "probable dictionary first. Each key counts a hit per input it appears in.");
+    PrintAndLogEx(NORMAL, "Inputs may be text or compiled dictionaries.");
+    PrintAndLogEx(NORMAL, "A compiled dictionary is picked up instead of a text one of the same name, if not older.");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Usage:  analyse dict [h] [k <4|6|8>] o <output> f <file> [f <file> ...]");
+    PrintAndLogEx(NORMAL, "        analyse dict [h] i <file>");
+    PrintAndLogEx(NORMAL, "        analyse dict [h] t");
+    PrintAndLogEx(NORMAL, "Options:");
+    PrintAndLogEx(NORMAL, "           h          This help");
+    PrintAndLogEx(NORMAL, "           k <len>    key length in bytes, 4 (t55xx), 6 (mifare, default) or 8 (iclass)");
+    PrintAndLogEx(NORMAL, "           o <file>   compiled dictionary to write");
+    PrintAndLogEx(NORMAL, "           f <file>   dictionary to merge, up to %d", ANALYSE_DICT_MAX_FILES);
+    PrintAndLogEx(NORMAL, "           i <file>   show a compiled dictionary and its first keys, check its index");
+    PrintAndLogEx(NORMAL, "           t          self test, save / open / find / dedupe round trips");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Examples:");
+    PrintAndLogEx(NORMAL, "      analyse dict o mfc_all f mfc_default_keys f mfc_keys_bmp_sorted f mfc_keys_icbmp_sorted f mfc_keys_mrzd_sorted");
+    PrintAndLogEx(NORMAL, "      analyse dict i mfc_all" DICTIONARY_SUFFIX);
+    PrintAndLogEx(NORMAL, "      hf mf fchk 1 mfc_all" DICTIONARY_SUFFIX);
+    return 0;
+}
 static int usage_analyse_a(void) {
     PrintAndLogEx(NORMAL, "Iceman's personal garbage test command");
     PrintAndLogEx(NORMAL, "");
@@ -878,6 +906,295 @@ static int CmdAnalyseNuid(const char *Cmd) {
     PrintAndLogEx(NORMAL, "NUID | %s \n", sprint_hex(nuid, 4));
     return 0;
 }
+typedef struct {
+    uint64_t key;
+    uint32_t hits;
+    uint32_t pos;
+} dict_merge_t;
+
+static int cmp_merge_key(const void *a, const void *b) {
+    const dict_merge_t *x = a, *y = b;
+    if (x->key != y->key)
+        return (x->key > y->key) ? 1 : -1;
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+static int cmp_merge_pos(const void *a, const void *b) {
+    const dict_merge_t *x = a, *y = b;
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+static int analyse_dict_info(const char *name) {
+    char *path = NULL;
+    if (searchFile(&path, DICTIONARIES_SUBDIR, name, DICTIONARY_SUFFIX) != PM3_SUCCESS)
+        return PM3_EFILE;
+
+    dictionary_t dict;
+    int res = dictionary_open(path, &dict);
+    if (res != PM3_SUCCESS) {
+        PrintAndLogEx(FAILED, "file not a valid compiled dictionary. '" _YELLOW_("%s")"'", path);
+        free(path);
+        return res;
+    }
+
+    PrintAndLogEx(SUCCESS, "file      " _YELLOW_("%s"), path);
+    PrintAndLogEx(SUCCESS, "keys      " _YELLOW_("%u") " x %u bytes", dict.keycount, dict.keylen);
+    PrintAndLogEx(SUCCESS, "sources   " _YELLOW_("%u"), dict.sources);
+    res = dictionary_verify(&dict);
+    PrintAndLogEx((res == PM3_SUCCESS) ? SUCCESS : FAILED, "index     %s", (res == PM3_SUCCESS) ? _GREEN_("ok") : _RED_("damaged, rebuild it with analyse dict"));
+    for (uint32_t i = 0; i < dict.keycount && i < 10; i++)
+        PrintAndLogEx(NORMAL, "[%2u] %s  hits %u", i, sprint_hex_inrow(dict.keys + i * dict.keylen, dict.keylen), dict.hits[i]);
+
+    dictionary_close(&dict);
+    free(path);
+    return PM3_SUCCESS;
+}
+
+#define ANALYSE_DICT_TEST_FILE "analyse_dict_test" DICTIONARY_SUFFIX
+
+static bool analyse_dict_check(bool ok, const char *what) {
+    if (ok == false)
+        PrintAndLogEx(FAILED, "dictionary test failed: %s", what);
+    return ok;
+}
+
+static int analyse_dict_test(void) {
+    uint8_t keys[] = {
+        0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xd3, 0xf7, 0xd3, 0xf7, 0xd3, 0xf7,
+    };
+    const uint8_t unique[] = {
+        0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xd3, 0xf7, 0xd3, 0xf7, 0xd3, 0xf7,
+    };
+    const uint32_t hits[] = {5, 4, 3, 2};
+    const uint8_t absent[6] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+    bool ok = true;
+
+    // dedupe keeps the first occurrence, in order
+    uint32_t n = dictionary_dedupe(keys, 6, 6);
+    ok &= analyse_dict_check(n == 4 && memcmp(keys, unique, sizeof(unique)) == 0, "dedupe");
+
+    // save refuses duplicates, round trip of a good one
+    ok &= analyse_dict_check(dictionary_save(ANALYSE_DICT_TEST_FILE, keys, hits, 5, 6, 1) == PM3_EINVARG, "save with duplicates");
+    ok &= analyse_dict_check(dictionary_save(ANALYSE_DICT_TEST_FILE, unique, hits, 4, 6, 2) == PM3_SUCCESS, "save");
+
+    dictionary_t dict;
+    if (analyse_dict_check(dictionary_open(ANALYSE_DICT_TEST_FILE, &dict) == PM3_SUCCESS, "open")) {
+        ok &= analyse_dict_check(dict.keylen == 6 && dict.keycount == 4 && dict.sources == 2, "header");
+        ok &= analyse_dict_check(memcmp(dict.keys, unique, sizeof(unique)) == 0, "keys");
+        ok &= analyse_dict_check(memcmp(dict.hits, hits, sizeof(hits)) == 0, "hits");
+        ok &= analyse_dict_check(dictionary_verify(&dict) == PM3_SUCCESS, "verify");
+        for (uint32_t i = 0; i < 4; i++)
+            ok &= analyse_dict_check(dictionary_find(&dict, unique + i * 6) == (int32_t)i, "find");
+        ok &= analyse_dict_check(dictionary_find(&dict, absent) == -1, "find absent key");
+        dictionary_close(&dict);
+    } else {
+        ok = false;
+    }
+
+    // keys loaded into a caller buffer, which must be large enough
+    uint8_t buf[sizeof(unique)];
+    size_t datalen = 0;
+    uint16_t keycnt = 0;
+    ok &= analyse_dict_check(loadFileDICTIONARY(ANALYSE_DICT_TEST_FILE, buf, sizeof(buf), &datalen, 6, &keycnt) == PM3_SUCCESS
+                             && keycnt == 4 && datalen == sizeof(unique) && memcmp(buf, unique, sizeof(unique)) == 0, "load");
+    ok &= analyse_dict_check(loadFileDICTIONARY(ANALYSE_DICT_TEST_FILE, buf, sizeof(buf) - 1, &datalen, 6, &keycnt) == PM3_EOVFLOW, "load overflow");
+
+    // a damaged index is reported by verify and never leads find out of bounds
+    FILE *f = fopen(ANALYSE_DICT_TEST_FILE, "r+b");
+    if (analyse_dict_check(f != NULL, "reopen")) {
+        dictionary_header_t h;
+        uint32_t bad = 0xffffffff;
+        bool written = fread(&h, sizeof(h), 1, f) == 1
+                       && fseek(f, h.index_offset + 2 * sizeof(uint32_t), SEEK_SET) == 0
+                       && fwrite(&bad, sizeof(bad), 1, f) == 1;
+        fclose(f);
+        ok &= analyse_dict_check(written, "damage index");
+        if (written && analyse_dict_check(dictionary_open(ANALYSE_DICT_TEST_FILE, &dict) == PM3_SUCCESS, "open damaged")) {
+            ok &= analyse_dict_check(dictionary_verify(&dict) != PM3_SUCCESS, "verify damaged");
+            for (uint32_t i = 0; i < 4; i++)
+                dictionary_find(&dict, unique + i * 6);
+            dictionary_close(&dict);
+        }
+    } else {
+        ok = false;
+    }
+    remove(ANALYSE_DICT_TEST_FILE);
+
+    if (ok)
+        PrintAndLogEx(SUCCESS, "dictionary tests " _GREEN_("ok"));
+    return ok ? PM3_SUCCESS : PM3_ESOFT;
+}
+
+static int CmdAnalyseDict(const char *Cmd) {
+
+    char files[ANALYSE_DICT_MAX_FILES][FILE_PATH_SIZE];
+    char output[FILE_PATH_SIZE] = {0};
+    char info[FILE_PATH_SIZE] = {0};
+    int nfiles = 0;
+    uint8_t keylen = 6;
+    bool errors = false;
+    uint8_t cmdp = 0;
+
+    while (param_getchar(Cmd, cmdp) != 0x00 && !errors) {
+        switch (tolower(param_getchar(Cmd, cmdp))) {
+            case 'h':
+                return usage_analyse_dict();
+            case 't':
+                return analyse_dict_test();
+            case 'k':
+                keylen = param_get8(Cmd, cmdp + 1);
+                if (keylen != 4 && keylen != 6 && keylen != 8) {
+                    PrintAndLogEx(WARNING, "key length must be 4, 6 or 8");
+                    errors = true;
+                }
+                cmdp += 2;
+                break;
+            case 'o':
+                if (param_getstr(Cmd, cmdp + 1, output, sizeof(output) - strlen(DICTIONARY_SUFFIX)) == 0)
+                    errors = true;
+                cmdp += 2;
+                break;
+            case 'i':
+                if (param_getstr(Cmd, cmdp + 1, info, sizeof(info)) == 0)
+                    errors = true;
+                cmdp += 2;
+                break;
+            case 'f':
+                if (nfiles == ANALYSE_DICT_MAX_FILES) {
+                    PrintAndLogEx(WARNING, "too many dictionaries, max %d", ANALYSE_DICT_MAX_FILES);
+                    errors = true;
+                } else if (param_getstr(Cmd, cmdp + 1, files[nfiles], FILE_PATH_SIZE) == 0) {
+                    errors = true;
+                } else {
+                    nfiles++;
+                }
+                cmdp += 2;
+                break;
+            default:
+                PrintAndLogEx(WARNING, "unknown parameter '%c'", param_getchar(Cmd, cmdp));
+                errors = true;
+                break;
+        }
+    }
+    if (info[0])
+        return analyse_dict_info(info);
+    if (errors || nfiles == 0 || output[0] == 0) return usage_analyse_dict();
+
+    dict_merge_t *entries = NULL;
+    uint32_t count = 0;
+
+    for (int i = 0; i < nfiles; i++) {
+        uint8_t *keys = NULL;
+        uint32_t *hits = NULL;
+        uint32_t loaded = 0;
+        dictionary_t dict = {0};
+        int res;
+
+        if (str_endswith(files[i], DICTIONARY_SUFFIX)) {
+            // keep the hit counts of a compiled input
+            char *path = NULL;
+            res = searchFile(&path, DICTIONARIES_SUBDIR, files[i], DICTIONARY_SUFFIX);
+            if (res == PM3_SUCCESS) {
+                res = dictionary_open(path, &dict);
+                if (res != PM3_SUCCESS)
+                    PrintAndLogEx(FAILED, "file not a valid compiled dictionary. '" _YELLOW_("%s")"'", path);
+                else if (dict.keylen != keylen) {
+                    PrintAndLogEx(FAILED, "compiled dictionary holds %u byte keys, expected %u. '" _YELLOW_("%s")"'", dict.keylen, keylen, path);
+                    dictionary_close(&dict);
+                    res = PM3_EINVARG;
+                }
+                free(path);
+            }
+            if (res == PM3_SUCCESS) {
+                keys = (uint8_t *)dict.keys;
+                hits = (uint32_t *)dict.hits;
+                loaded = dict.keycount;
+                PrintAndLogEx(SUCCESS, "loaded " _GREEN_("%2u") "keys from compiled dictionary file " _YELLOW_("%s"), loaded, files[i]);
+            }
+        } else {
+            res = loadFileDICTIONARY_safe(files[i], (void **)&keys, keylen, &loaded);
+        }
+        if (res != PM3_SUCCESS) {
+            free(entries);
+            if (dict.map == NULL)
+                free(keys);
+            return res;
+        }
+
+        dict_merge_t *tmp = realloc(entries, ((size_t)count + loaded + 1) * sizeof(dict_merge_t));
+        if (tmp == NULL) {
+            PrintAndLogEx(FAILED, "failed to allocate memory");
+            free(entries);
+            if (dict.map)
+                dictionary_close(&dict);
+            else
+                free(keys);
+            return PM3_EMALLOC;
+        }
+        entries = tmp;
+        for (uint32_t k = 0; k < loaded; k++, count++) {
+            entries[count].key = bytes_to_num(keys + (size_t)k * keylen, keylen);
+            entries[count].hits = hits ? hits[k] : 1;
+            entries[count].pos = count;
+        }
+
+        if (dict.map)
+            dictionary_close(&dict);
+        else
+            free(keys);
+    }
+
+    // equal keys add up their hits and keep their first position
+    qsort(entries, count, sizeof(dict_merge_t), cmp_merge_key);
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (unique && entries[unique - 1].key == entries[i].key) {
+            uint64_t sum = (uint64_t)entries[unique - 1].hits + entries[i].hits;
+            entries[unique - 1].hits = (sum > UINT32_MAX) ? UINT32_MAX : sum;
+            continue;
+        }
+        entries[unique++] = entries[i];
+    }
+    // try order is the order of first appearance, like the text dictionaries
+    qsort(entries, unique, sizeof(dict_merge_t), cmp_merge_pos);
+
+    uint8_t *keys = calloc((size_t)unique + 1, keylen);
+    uint32_t *hits = calloc((size_t)unique + 1, sizeof(uint32_t));
+    if (keys == NULL || hits == NULL) {
+        PrintAndLogEx(FAILED, "failed to allocate memory");
+        free(keys);
+        free(hits);
+        free(entries);
+        return PM3_EMALLOC;
+    }
+    for (uint32_t i = 0; i < unique; i++) {
+        num_to_bytes(entries[i].key, keylen, keys + (size_t)i * keylen);
+        hits[i] = entries[i].hits;
+    }
+    free(entries);
+
+    if (str_endswith(output, DICTIONARY_SUFFIX) == false)
+        strcat(output, DICTIONARY_SUFFIX);
+
+    int res = dictionary_save(output, keys, hits, unique, keylen, nfiles);
+    free(keys);
+    free(hits);
+    if (res != PM3_SUCCESS) {
+        PrintAndLogEx(FAILED, "failed to write " _YELLOW_("%s"), output);
+        return res;
+    }
+    PrintAndLogEx(SUCCESS, "saved " _GREEN_("%u") " unique keys of %u to " _YELLOW_("%s"), unique, count, output);
+    return PM3_SUCCESS;
+}
+
 static command_t CommandTable[] = {
     {"help",    CmdHelp,            AlwaysAvailable, "This help"},
     {"lcr",     CmdAnalyseLCR,      AlwaysAvailable, "Generate final byte for XOR LRC"},
@@ -888,6 +1205,7 @@ static command_t CommandTable[] = {
     {"lfsr",    CmdAnalyseLfsr,     AlwaysAvailable, "LFSR tests"},
     {"a",       CmdAnalyseA,        AlwaysAvailable, "num bits test"},
     {"nuid",    CmdAnalyseNuid,     AlwaysAvailable, "create NUID from 7byte UID"},
+    {"dict",    CmdAnalyseDict,     AlwaysAvailable, "Merge key dictionaries into a compiled dictionary"},
     {NULL, NULL, NULL, NULL}
 };
 
@@ -23,8 +23,10 @@
 #endif /* _WIN32 */
 
 #include "reveng/reveng.h"
+#include "reveng/fastcrc.h"
 #include "ui.h"
 #include "util.h"
+#include "commonutil.h"  // reflect8
 
 #define MAX_ARGS 20
 
@@ -207,7 +209,7 @@ int GetModels(char *Models[], int *count, uint8_t *width) {
         pass = 0;
         int args = 0;
         do {
-            model_t *candmods = reveng(&model, qpoly, rflags, args, apolys);
+            model_t *candmods = fastcrc_reveng(&model, qpoly, rflags, args, apolys);
             model_t *mptr = candmods;
             if (mptr && plen(mptr->spoly)) {
                 uflags |= C_RESULT;
@@ -399,6 +401,89 @@ static char *SwapEndianStr(const char *inStr, const size_t len, const uint8_t bl
 }
 
 // takes hex string in and searches for a matching result (hex string must include checksum)
+// CRC bits as ptostr() prints them with 8 bits per hex pair, see pxsubs()
+static void fastcrc_tostr(uint64_t crc, int width, int flags, char *out) {
+    const char *fmt = (flags & P_UPPER) ? "%02X" : "%02x";
+    int part = width % 8;
+    int bits = width;
+
+    if (part && flags & P_RTJUST) {
+        uint8_t accu = (crc >> (width - part)) & ((1 << part) - 1);
+        if (flags & P_REFOUT)
+            accu = reflect8(accu);
+        out += sprintf(out, fmt, accu);
+        bits -= part;
+    }
+    for (; bits >= 8; bits -= 8) {
+        uint8_t accu = (crc >> (bits - 8)) & 0xFF;
+        if (flags & P_REFOUT)
+            accu = reflect8(accu);
+        out += sprintf(out, fmt, accu);
+    }
+    if (bits) {
+        uint8_t accu = crc & ((1 << bits) - 1);
+        if (flags & P_REFOUT)
+            accu = fastcrc_reflect(accu, bits);
+        else
+            accu <<= (8 - bits);
+        out += sprintf(out, fmt, accu);
+    }
+    *out = '\0';
+}
+
+// RunModel() without endian override, on raw bytes through the table driven engine.
+// returns false if the model must go through RunModel() instead
+static bool fastcrc_run_model(const model_t *model, const uint8_t *data, size_t len, bool reverse, char *result) {
+    static fastcrc_t crc;
+    int width = plen(model->spoly);
+    if (width < 1 || width > FASTCRC_MAXWIDTH)
+        return false;
+
+    uint64_t mask = (width == 64) ? UINT64_MAX : ((UINT64_C(1) << width) - 1);
+    uint64_t poly = fastcrc_ptou(model->spoly);
+    uint64_t init = plen(model->init) ? fastcrc_ptou(model->init) : 0;
+    uint64_t xorout = plen(model->xorout) ? fastcrc_ptou(model->xorout) : 0;
+    bool refin = model->flags & P_REFIN;
+    bool refout = model->flags & P_REFOUT;
+    uint64_t bits;
+
+    if (reverse == false) {
+        fastcrc_init(&crc, width, poly, init, xorout, refin, refout);
+        bits = fastcrc_calc(&crc, data, len);
+        // ptostr() applies RefOut itself
+        if (refout)
+            bits = fastcrc_reflect(bits, width);
+    } else {
+        // reciprocal poly, only the same width when the poly is odd
+        if ((poly & 1) == 0)
+            return false;
+
+        uint64_t rpoly = ((fastcrc_reflect(poly, width) << 1) | 1) & mask;
+        if (refout == false) {
+            init = fastcrc_reflect(init, width);
+            xorout = fastcrc_reflect(xorout, width);
+        }
+        // swapped, XorOut reflected for RefOut as in RunModel()
+        uint64_t rinit = xorout;
+        uint64_t rxorout = refout ? fastcrc_reflect(init, width) : init;
+
+        // the whole message is mirrored: bytes in reverse order, RefIn toggled
+        uint8_t *rdata = calloc(len + 1, sizeof(uint8_t));
+        if (rdata == NULL)
+            return false;
+        for (size_t i = 0; i < len; i++)
+            rdata[i] = data[len - 1 - i];
+
+        fastcrc_init(&crc, width, rpoly, rinit, rxorout, !refin, false);
+        bits = fastcrc_reflect(fastcrc_calc(&crc, rdata, len), width);
+        free(rdata);
+    }
+
+    fastcrc_tostr(bits, width, model->flags, result);
+    return true;
+}
+
+// test each preset model against a hex string with the crc at the end (hex string must include checksum)
 static int CmdrevengSearch(const char *Cmd) {
 
 #define NMODELS 106
@@ -407,6 +492,10 @@ static int CmdrevengSearch(const char *Cmd) {
     int dataLen = param_getstr(Cmd, 0, inHexStr, sizeof(inHexStr));
     if (dataLen < 4) return 0;
 
+    // models print lowercase hex
+    for (int i = 0; i < dataLen; i++)
+        inHexStr[i] = tolower(inHexStr[i]);
+
     // these two arrays, must match preset size.
     char *Models[NMODELS];
     uint8_t width[NMODELS] = {0};
@@ -418,17 +507,18 @@ static int CmdrevengSearch(const char *Cmd) {
     bool found = false;
     if (!ans) return 0;
 
+    model_t model = MZERO;
+    uint8_t data[sizeof(inHexStr) / 2];
+
     // try each model and get result
     for (int i = 0; i < count; i++) {
-        /*if (found) {
-            free(Models[i]);
-            continue;
-        }*/
         // round up to # of characters in this model's crc
         uint8_t crcChars = ((width[i] + 7) / 8) * 2;
         // can't test a model that has more crc digits than our data
-        if (crcChars >= dataLen)
+        if (crcChars >= dataLen || crcChars == 0) {
+            free(Models[i]);
             continue;
+        }
 
         PrintAndLogEx(DEBUG
                       , "DEBUG: dataLen %d, crcChars %u,  width[i] %u"
@@ -437,17 +527,38 @@ static int CmdrevengSearch(const char *Cmd) {
                       , width[i]
                      );
 
-        if (crcChars == 0)
-            continue;
-
-        memset(result, 0, 30);
+        memset(result, 0, sizeof(result));
+        memset(revResult, 0, sizeof(revResult));
         char *inCRC = calloc(crcChars + 1, sizeof(char));
         memcpy(inCRC, inHexStr + (dataLen - crcChars), crcChars);
 
         char *outHex = calloc(dataLen - crcChars + 1, sizeof(char));
         memcpy(outHex, inHexStr, dataLen - crcChars);
 
-        ans = RunModel(Models[i], outHex, false, 0, result);
+        // whole bytes go through the table driven engine, the rest through RunModel()
+        bool fast = false;
+        size_t len = (dataLen - crcChars) / 2;
+        if (((dataLen - crcChars) & 1) == 0) {
+            fast = true;
+            for (size_t j = 0; j < len * 2; j++) {
+                if (isxdigit((unsigned char)outHex[j]) == 0) {
+                    fast = false;
+                    break;
+                }
+            }
+            for (size_t j = 0; fast && j < len; j++) {
+                unsigned int byte;
+                sscanf(outHex + j * 2, "%2x", &byte);
+                data[j] = byte & 0xFF;
+            }
+        }
+        if (fast) {
+            SETBMP();
+            mbynum(&model, i);
+            mcanon(&model);
+        }
+
+        ans = (fast && fastcrc_run_model(&model, data, len, false, result)) ? 1 : RunModel(Models[i], outHex, false, 0, result);
         if (ans) {
             // test for match
             if (memcmp(result, inCRC, crcChars) == 0) {
@@ -466,7 +577,7 @@ static int CmdrevengSearch(const char *Cmd) {
                 }
             }
         }
-        ans = RunModel(Models[i], outHex, true, 0, revResult);
+        ans = (fast && fastcrc_run_model(&model, data, len, true, revResult)) ? 1 : RunModel(Models[i], outHex, true, 0, revResult);
         if (ans) {
             // test for match
             if (memcmp(revResult, inCRC, crcChars) == 0) {
@@ -489,6 +600,7 @@ static int CmdrevengSearch(const char *Cmd) {
         free(outHex);
         free(Models[i]);
     }
+    mfree(&model);
 
     if (!found) PrintAndLogEx(FAILED, "\nno matches found\n");
     return 1;
@@ -496,9 +608,9 @@ static int CmdrevengSearch(const char *Cmd) {
 
 int CmdCrc(const char *Cmd) {
     char name[] = {"reveng "};
-    char Cmd2[100 + 7];
+    char Cmd2[100 + 7] = {0};
     memcpy(Cmd2, name, 7);
-    memcpy(Cmd2 + 7, Cmd, 100);
+    memcpy(Cmd2 + 7, Cmd, MIN(strlen(Cmd), 99));
     char *argv[MAX_ARGS];
     int argc = split(Cmd2, argv);
 
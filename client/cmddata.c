@@ -10,6 +10,7 @@
 #include "cmddata.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <limits.h>   // for CmdNorm INT_MIN && INT_MAX
 #include <math.h>     // pow
@@ -23,11 +24,7 @@
 #include "lfdemod.h"  // for demod code
 #include "loclass/cipherutils.h" // for decimating samples in getsamples
 #include "cmdlfem4x.h" // askem410xdecode
-
-uint8_t DemodBuffer[MAX_DEMOD_BUF_LEN];
-size_t DemodBufferLen = 0;
-size_t g_DemodStartIdx = 0;
-int g_DemodClock = 0;
+#include "fft.h"      // autocorrelation
 
 static int CmdHelp(const char *Cmd);
 
@@ -275,6 +272,164 @@ bool getDemodBuff(uint8_t *buff, size_t *size) {
     return true;
 }
 
+// Demod result cache.
+// lf search runs ~25 decoders against the same GraphBuffer and many of them ask for the
+// same ASK/FSK/PSK/NRZ demodulation. An entry keeps a copy of the samples handed to
+// lfdemod, the signal properties it reads and the demod parameters. The hash only picks
+// the candidate, a hit needs all of them to be equal, so any change to the GraphBuffer
+// simply misses the cache. Every LF workspace has its own.
+#define DEMOD_CACHE_SIZE 16
+#define DEMOD_CACHE_ARGS 8
+
+enum {
+    DEMOD_CACHE_ASK = 1,    // DetectST + askdemod_ext
+    DEMOD_CACHE_ASKRAW,     // askdemod_ext only (biphase)
+    DEMOD_CACHE_FSK,
+    DEMOD_CACHE_PSK,
+    DEMOD_CACHE_NRZ,
+};
+
+// the input of one demodulation
+typedef struct {
+    uint64_t key;
+    uint8_t kind;
+    int args[DEMOD_CACHE_ARGS];
+    size_t nargs;
+    signal_t signal;
+    uint8_t *samples;
+    size_t len;
+} demod_cache_query_t;
+
+typedef struct {
+    demod_cache_query_t in;
+    uint8_t *bits;
+    size_t len;
+    int out[8];
+} demod_cache_t;
+
+typedef struct {
+    demod_cache_t entries[DEMOD_CACHE_SIZE];
+    uint8_t next;
+} demod_cache_set_t;
+
+// the cache of the current workspace, created on first use
+static demod_cache_set_t *demod_cache_get(void) {
+    if (g_lf_workspace->demod_cache == NULL)
+        g_lf_workspace->demod_cache = calloc(1, sizeof(demod_cache_set_t));
+    return g_lf_workspace->demod_cache;
+}
+
+void freeDemodCache(lf_workspace_t *ws) {
+    demod_cache_set_t *set = ws->demod_cache;
+    if (set == NULL)
+        return;
+    for (int i = 0; i < DEMOD_CACHE_SIZE; i++) {
+        free(set->entries[i].in.samples);
+        free(set->entries[i].bits);
+    }
+    free(set);
+    ws->demod_cache = NULL;
+}
+
+static uint64_t demod_cache_key(const demod_cache_query_t *q, const uint8_t *samples) {
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    h = (h ^ q->kind) * prime;
+    for (size_t i = 0; i < q->nargs; i++)
+        h = (h ^ (uint32_t)q->args[i]) * prime;
+
+    h = (h ^ (uint32_t)q->signal.low) * prime;
+    h = (h ^ (uint32_t)q->signal.high) * prime;
+    h = (h ^ (uint32_t)q->signal.mean) * prime;
+    h = (h ^ (uint32_t)q->signal.amplitude) * prime;
+    h = (h ^ q->signal.isnoise) * prime;
+    h = (h ^ q->len) * prime;
+
+    // eight samples per round, this runs on every demod call
+    size_t i = 0;
+    for (; i + 8 <= q->len; i += 8) {
+        uint64_t w;
+        memcpy(&w, samples + i, sizeof(w));
+        h = (h ^ w) * prime;
+        h ^= h >> 29;
+    }
+    for (; i < q->len; i++)
+        h = (h ^ samples[i]) * prime;
+
+    return h;
+}
+
+static bool demod_cache_equal(const demod_cache_query_t *a, const demod_cache_query_t *b, const uint8_t *samples) {
+    return a->key == b->key
+           && a->kind == b->kind
+           && a->nargs == b->nargs
+           && memcmp(a->args, b->args, a->nargs * sizeof(int)) == 0
+           && a->signal.low == b->signal.low
+           && a->signal.high == b->signal.high
+           && a->signal.mean == b->signal.mean
+           && a->signal.amplitude == b->signal.amplitude
+           && a->signal.isnoise == b->signal.isnoise
+           && a->len == b->len
+           && memcmp(a->samples, samples, a->len) == 0;
+}
+
+// Fills q with the input about to be demodulated and returns the matching entry, NULL on
+// miss. On a miss q holds a copy of the samples for demod_cache_store, which takes it over.
+// Bypassed in debug mode so lfdemod still prints its traces.
+static demod_cache_t *demod_cache_find(demod_cache_query_t *q, uint8_t kind, const int *args, size_t nargs, const uint8_t *samples, size_t len) {
+    memset(q, 0, sizeof(demod_cache_query_t));
+    demod_cache_set_t *set = demod_cache_get();
+    if (g_debugMode || nargs > DEMOD_CACHE_ARGS || set == NULL)
+        return NULL;
+
+    q->kind = kind;
+    q->nargs = nargs;
+    memcpy(q->args, args, nargs * sizeof(int));
+    q->signal = *getSignalProperties_ctx(LF_DEMOD_CTX);
+    q->len = len;
+    q->key = demod_cache_key(q, samples);
+
+    for (int i = 0; i < DEMOD_CACHE_SIZE; i++) {
+        if (set->entries[i].bits && demod_cache_equal(&set->entries[i].in, q, samples))
+            return &set->entries[i];
+    }
+
+    q->samples = malloc(len ? len : 1);
+    if (q->samples)
+        memcpy(q->samples, samples, len);
+    return NULL;
+}
+
+static void demod_cache_store(demod_cache_query_t *q, const uint8_t *bits, size_t len, const int *out, size_t nout) {
+    demod_cache_set_t *set = g_lf_workspace->demod_cache;
+    if (q->samples == NULL || set == NULL) {
+        free(q->samples);
+        q->samples = NULL;
+        return;
+    }
+
+    demod_cache_t *e = &set->entries[set->next];
+    set->next = (set->next + 1) % DEMOD_CACHE_SIZE;
+
+    free(e->in.samples);
+    free(e->bits);
+    memset(e, 0, sizeof(demod_cache_t));
+
+    e->bits = calloc(len ? len : 1, sizeof(uint8_t));
+    if (e->bits == NULL) {
+        free(q->samples);
+        q->samples = NULL;
+        return;
+    }
+
+    e->in = *q;
+    q->samples = NULL;
+    memcpy(e->bits, bits, len);
+    e->len = len;
+    memcpy(e->out, out, nout * sizeof(int));
+}
+
 // include <math.h>
 // Root mean square
 /*
@@ -353,30 +508,6 @@ static double compute_autoc(const int *data, size_t n, int lag) {
 }
 */
 
-// option '1' to save DemodBuffer any other to restore
-void save_restoreDB(uint8_t saveOpt) {
-    static uint8_t SavedDB[MAX_DEMOD_BUF_LEN];
-    static size_t SavedDBlen;
-    static bool DB_Saved = false;
-    static size_t savedDemodStartIdx = 0;
-    static int savedDemodClock = 0;
-
-    if (saveOpt == GRAPH_SAVE) { //save
-
-        memcpy(SavedDB, DemodBuffer, sizeof(DemodBuffer));
-        SavedDBlen = DemodBufferLen;
-        DB_Saved = true;
-        savedDemodStartIdx = g_DemodStartIdx;
-        savedDemodClock = g_DemodClock;
-    } else if (DB_Saved) { //restore
-
-        memcpy(DemodBuffer, SavedDB, sizeof(DemodBuffer));
-        DemodBufferLen = SavedDBlen;
-        g_DemodClock = savedDemodClock;
-        g_DemodStartIdx = savedDemodStartIdx;
-    }
-}
-
 static int CmdSetDebugMode(const char *Cmd) {
     int demod = 0;
     sscanf(Cmd, "%i", &demod);
@@ -510,33 +641,55 @@ int ASKDemod_ext(const char *Cmd, bool verbose, bool emSearch, uint8_t askType,
     if (maxLen < BitLen && maxLen != 0) BitLen = maxLen;
 
     int foundclk = 0;
-
-    //amplify signal before ST check
-    if (amp == 'a') {
-        askAmp(bits, BitLen);
-    }
-
     size_t ststart = 0, stend = 0;
-//    if (*stCheck)
-    bool st = DetectST(bits, &BitLen, &foundclk, &ststart, &stend);
+    bool st = false;
+    int startIdx = 0;
+    int errCnt;
+
+    int cache_args[] = {clk, invert, maxErr, amp == 'a', askamp, askType};
+    demod_cache_query_t cache_q;
+    demod_cache_t *cached = demod_cache_find(&cache_q, DEMOD_CACHE_ASK, cache_args, ARRAYLEN(cache_args), bits, BitLen);
+    if (cached) {
+        memcpy(bits, cached->bits, cached->len);
+        BitLen = cached->len;
+        errCnt = cached->out[0];
+        clk = cached->out[1];
+        invert = cached->out[2];
+        startIdx = cached->out[3];
+        st = cached->out[4];
+        ststart = cached->out[5];
+        stend = cached->out[6];
+    } else {
+        //amplify signal before ST check
+        if (amp == 'a') {
+            askAmp(bits, BitLen);
+        }
+
+//        if (*stCheck)
+        st = DetectST_ctx(LF_DEMOD_CTX, bits, &BitLen, &foundclk, &ststart, &stend);
 
-    if (clk == 0) {
-        if (foundclk == 32 || foundclk == 64) {
-            clk = foundclk;
+        if (clk == 0) {
+            if (foundclk == 32 || foundclk == 64) {
+                clk = foundclk;
+            }
         }
+
+        errCnt = askdemod_ext_ctx(LF_DEMOD_CTX, bits, &BitLen, &clk, &invert, maxErr, askamp, askType, &startIdx);
+
+        int out[] = {errCnt, clk, invert, startIdx, st, ststart, stend};
+        demod_cache_store(&cache_q, bits, BitLen, out, ARRAYLEN(out));
     }
 
     if (st) {
         *stCheck = st;
-        CursorCPos = ststart;
-        CursorDPos = stend;
+        if (IsLFWorkspaceShown()) {
+            CursorCPos = ststart;
+            CursorDPos = stend;
+        }
         if (verbose)
             PrintAndLogEx(DEBUG, "Found Sequence Terminator - First one is shown by orange / blue graph markers");
     }
 
-    int startIdx = 0;
-    int errCnt = askdemod_ext(bits, &BitLen, &clk, &invert, maxErr, askamp, askType, &startIdx);
-
     if (errCnt < 0 || BitLen < 16) { //if fatal error (or -1)
         PrintAndLogEx(DEBUG, "DEBUG: (ASKDemod_ext) No data found errors:%d, invert:%c, bitlen:%d, clock:%d", errCnt, (invert) ? 'Y' : 'N', BitLen, clk);
         return PM3_ESOFT;
@@ -702,15 +855,30 @@ int ASKbiphaseDemod(const char *Cmd, bool verbose) {
     int offset = 0, clk = 0, invert = 0, maxErr = 50;
     sscanf(Cmd, "%i %i %i %i", &offset, &clk, &invert, &maxErr);
 
-    uint8_t BitStream[MAX_DEMOD_BUF_LEN];
+    uint8_t BitStream[MAX_GRAPH_TRACE_LEN];
     size_t size = getFromGraphBuf(BitStream);
     if (size == 0) {
         PrintAndLogEx(DEBUG, "DEBUG: no data in graphbuf");
         return PM3_ESOFT;
     }
     int startIdx = 0;
-    //invert here inverts the ask raw demoded bits which has no effect on the demod, but we need the pointer
-    int errCnt = askdemod_ext(BitStream, &size, &clk, &invert, maxErr, 0, 0, &startIdx);
+    int errCnt;
+    int cache_args[] = {clk, invert, maxErr};
+    demod_cache_query_t cache_q;
+    demod_cache_t *cached = demod_cache_find(&cache_q, DEMOD_CACHE_ASKRAW, cache_args, ARRAYLEN(cache_args), BitStream, size);
+    if (cached) {
+        memcpy(BitStream, cached->bits, cached->len);
+        size = cached->len;
+        errCnt = cached->out[0];
+        clk = cached->out[1];
+        invert = cached->out[2];
+        startIdx = cached->out[3];
+    } else {
+        //invert here inverts the ask raw demoded bits which has no effect on the demod, but we need the pointer
+        errCnt = askdemod_ext_ctx(LF_DEMOD_CTX, BitStream, &size, &clk, &invert, maxErr, 0, 0, &startIdx);
+        int out[] = {errCnt, clk, invert, startIdx};
+        demod_cache_store(&cache_q, BitStream, size, out, ARRAYLEN(out));
+    }
     if (errCnt < 0 || errCnt > maxErr) {
         PrintAndLogEx(DEBUG, "DEBUG: no data or error found %d, clock: %d", errCnt, clk);
         return PM3_ESOFT;
@@ -768,13 +936,30 @@ int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveG
     // Computed variance
     double variance = compute_variance(in, len);
 
-    static int CorrelBuffer[MAX_GRAPH_TRACE_LEN];
+    // one spare zero entry, the peak search below looks at CorrelBuffer[window] and window may be len
+    int *CorrelBuffer = calloc(len + 1, sizeof(int));
 
-    for (size_t i = 0; i < len - window; ++i) {
+    // lag sums for every i at once via FFT, the direct double loop is O(n^2).
+    // A window covering the whole trace leaves no lags to compute.
+    size_t lags = len - window;
+    double *lagsum = (lags) ? calloc(lags, sizeof(double)) : NULL;
+    if (CorrelBuffer == NULL || (lags && lagsum == NULL)) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        free(CorrelBuffer);
+        free(lagsum);
+        return 0;
+    }
 
-        for (size_t j = 0; j < (len - i); j++) {
-            autocv += (in[j] - mean) * (in[j + i] - mean);
-        }
+    if (lags && fft_autocovariance(in, len, mean, lagsum, lags) != PM3_SUCCESS) {
+        PrintAndLogEx(WARNING, "Failed to compute correlation");
+        free(CorrelBuffer);
+        free(lagsum);
+        return 0;
+    }
+
+    for (size_t i = 0; i < lags; ++i) {
+
+        autocv += lagsum[i];
         autocv = (1.0 / (len - i)) * autocv;
 
         CorrelBuffer[i] = autocv;
@@ -789,11 +974,12 @@ int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveG
             lastmax = i;
         }
     }
+    free(lagsum);
 
     //
     int hi = 0, idx = 0;
     int distance = 0, hi_1 = 0, idx_1 = 0;
-    for (size_t i = 0; i <= len; ++i) {
+    for (size_t i = 0; i < len; ++i) {
         if (CorrelBuffer[i] > hi) {
             hi = CorrelBuffer[i];
             idx = i;
@@ -835,6 +1021,7 @@ int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveG
         RepaintGraphWindow();
     }
 
+    free(CorrelBuffer);
     return retval;
 }
 
@@ -885,6 +1072,9 @@ static int CmdBitsamples(const char *Cmd) {
         return PM3_ETIMEOUT;
     }
 
+    if (GraphReserve(ARRAYLEN(got) * 8) != PM3_SUCCESS)
+        return PM3_EMALLOC;
+
     for (size_t j = 0; j < ARRAYLEN(got); j++) {
         for (uint8_t k = 0; k < 8; k++) {
             if (got[j] & (1 << (7 - k)))
@@ -930,19 +1120,15 @@ static int CmdUndec(const char *Cmd) {
 
     uint8_t factor = param_get8ex(Cmd, 0, 2, 10);
 
-    //We have memory, don't we?
-    int swap[MAX_GRAPH_TRACE_LEN] = {0};
-    uint32_t g_index = 0, s_index = 0;
-    while (g_index < GraphTraceLen && s_index + factor < MAX_GRAPH_TRACE_LEN) {
-        int count = 0;
-        for (count = 0; count < factor && s_index + count < MAX_GRAPH_TRACE_LEN; count++)
-            swap[s_index + count] = GraphBuffer[g_index];
-        s_index += count;
-        g_index++;
-    }
+    size_t newlen = MIN(GraphTraceLen * factor, MAX_GRAPH_STORE_LEN);
+    if (GraphReserve(newlen) != PM3_SUCCESS)
+        return PM3_EMALLOC;
+
+    // expand in place, back to front
+    for (size_t s_index = newlen; s_index > 0; s_index--)
+        GraphBuffer[s_index - 1] = GraphBuffer[(s_index - 1) / factor];
 
-    memcpy(GraphBuffer, swap, s_index * sizeof(int));
-    GraphTraceLen = s_index;
+    GraphTraceLen = newlen;
     RepaintGraphWindow();
     return PM3_SUCCESS;
 }
@@ -1023,29 +1209,14 @@ static int CmdDetectClockRate(const char *Cmd) {
     return clock1;
 }
 
-static char *GetFSKType(uint8_t fchigh, uint8_t fclow, uint8_t invert) {
-    static char fType[8];
-    memset(fType, 0x00, 8);
-    char *fskType = fType;
-
-    if (fchigh == 10 && fclow == 8) {
-
-        if (invert)
-            memcpy(fskType, "FSK2a", 5);
-        else
-            memcpy(fskType, "FSK2", 4);
-
-    } else if (fchigh == 8 && fclow == 5) {
+static const char *GetFSKType(uint8_t fchigh, uint8_t fclow, uint8_t invert) {
+    if (fchigh == 10 && fclow == 8)
+        return (invert) ? "FSK2a" : "FSK2";
 
-        if (invert)
-            memcpy(fskType, "FSK1", 4);
-        else
-            memcpy(fskType, "FSK1a", 5);
+    if (fchigh == 8 && fclow == 5)
+        return (invert) ? "FSK1" : "FSK1a";
 
-    } else {
-        memcpy(fskType, "FSK??", 5);
-    }
-    return fskType;
+    return "FSK??";
 }
 
 //by marshmellow
@@ -1070,32 +1241,47 @@ int FSKrawDemod(const char *Cmd, bool verbose) {
         }
     }
 
-    if (getSignalProperties()->isnoise)
+    if (getSignalProperties_ctx(LF_DEMOD_CTX)->isnoise)
         return PM3_ESOFT;
 
     uint8_t bits[MAX_GRAPH_TRACE_LEN] = {0};
     size_t BitLen = getFromGraphBuf(bits);
     if (BitLen == 0) return PM3_ESOFT;
 
-    //get field clock lengths
-    if (!fchigh || !fclow) {
-        uint16_t fcs = countFC(bits, BitLen, true);
-        if (!fcs) {
-            fchigh = 10;
-            fclow = 8;
-        } else {
-            fchigh = (fcs >> 8) & 0x00FF;
-            fclow = fcs & 0x00FF;
+    int startIdx = 0;
+    int size;
+    int cache_args[] = {rfLen, invert, fchigh, fclow};
+    demod_cache_query_t cache_q;
+    demod_cache_t *cached = demod_cache_find(&cache_q, DEMOD_CACHE_FSK, cache_args, ARRAYLEN(cache_args), bits, BitLen);
+    if (cached) {
+        memcpy(bits, cached->bits, cached->len);
+        size = cached->out[0];
+        rfLen = cached->out[1];
+        fchigh = cached->out[2];
+        fclow = cached->out[3];
+        startIdx = cached->out[4];
+    } else {
+        //get field clock lengths
+        if (!fchigh || !fclow) {
+            uint16_t fcs = countFC(bits, BitLen, true);
+            if (!fcs) {
+                fchigh = 10;
+                fclow = 8;
+            } else {
+                fchigh = (fcs >> 8) & 0x00FF;
+                fclow = fcs & 0x00FF;
+            }
         }
+        //get bit clock length
+        if (!rfLen) {
+            int firstClockEdge = 0; //todo - align grid on graph with this...
+            rfLen = detectFSKClk(bits, BitLen, fchigh, fclow, &firstClockEdge);
+            if (!rfLen) rfLen = 50;
+        }
+        size = fskdemod_ctx(LF_DEMOD_CTX, bits, BitLen, rfLen, invert, fchigh, fclow, &startIdx);
+        int out[] = {size, rfLen, fchigh, fclow, startIdx};
+        demod_cache_store(&cache_q, bits, (size > 0) ? size : 0, out, ARRAYLEN(out));
     }
-    //get bit clock length
-    if (!rfLen) {
-        int firstClockEdge = 0; //todo - align grid on graph with this...
-        rfLen = detectFSKClk(bits, BitLen, fchigh, fclow, &firstClockEdge);
-        if (!rfLen) rfLen = 50;
-    }
-    int startIdx = 0;
-    int size = fskdemod(bits, BitLen, rfLen, invert, fchigh, fclow, &startIdx);
     if (size > 0) {
         setDemodBuff(bits, size, 0);
         setClockGrid(rfLen, startIdx);
@@ -1140,7 +1326,7 @@ int PSKDemod(const char *Cmd, bool verbose) {
         return PM3_EINVARG;
     }
 
-    if (getSignalProperties()->isnoise)
+    if (getSignalProperties_ctx(LF_DEMOD_CTX)->isnoise)
         return PM3_ESOFT;
 
     uint8_t bits[MAX_GRAPH_TRACE_LEN] = {0};
@@ -1149,7 +1335,22 @@ int PSKDemod(const char *Cmd, bool verbose) {
         return PM3_ESOFT;
 
     int startIdx = 0;
-    int errCnt = pskRawDemod_ext(bits, &bitlen, &clk, &invert, &startIdx);
+    int errCnt;
+    int cache_args[] = {clk, invert};
+    demod_cache_query_t cache_q;
+    demod_cache_t *cached = demod_cache_find(&cache_q, DEMOD_CACHE_PSK, cache_args, ARRAYLEN(cache_args), bits, bitlen);
+    if (cached) {
+        memcpy(bits, cached->bits, cached->len);
+        bitlen = cached->len;
+        errCnt = cached->out[0];
+        clk = cached->out[1];
+        invert = cached->out[2];
+        startIdx = cached->out[3];
+    } else {
+        errCnt = pskRawDemod_ext_ctx(LF_DEMOD_CTX, bits, &bitlen, &clk, &invert, &startIdx);
+        int out[] = {errCnt, clk, invert, startIdx};
+        demod_cache_store(&cache_q, bits, bitlen, out, ARRAYLEN(out));
+    }
     if (errCnt > maxErr) {
         if (g_debugMode || verbose) PrintAndLogEx(DEBUG, "DEBUG: (PSKdemod) Too many errors found, clk: %d, invert: %d, numbits: %d, errCnt: %d", clk, invert, bitlen, errCnt);
         return PM3_ESOFT;
@@ -1180,7 +1381,7 @@ static int CmdIdteckDemod(const char *Cmd) {
     size_t size = DemodBufferLen;
 
     //get binary from PSK1 wave
-    int idx = detectIdteck(DemodBuffer, &size);
+    int idx = detectIdteck_ctx(LF_DEMOD_CTX, DemodBuffer, &size);
     if (idx < 0) {
 
         if (idx == -1)
@@ -1199,7 +1400,7 @@ static int CmdIdteckDemod(const char *Cmd) {
             PrintAndLogEx(DEBUG, "DEBUG: Error - Idteck PSKDemod failed");
             return PM3_ESOFT;
         }
-        idx = detectIdteck(DemodBuffer, &size);
+        idx = detectIdteck_ctx(LF_DEMOD_CTX, DemodBuffer, &size);
         if (idx < 0) {
 
             if (idx == -1)
@@ -1255,7 +1456,7 @@ int NRZrawDemod(const char *Cmd, bool verbose) {
         return PM3_EINVARG;
     }
 
-    if (getSignalProperties()->isnoise)
+    if (getSignalProperties_ctx(LF_DEMOD_CTX)->isnoise)
         return PM3_ESOFT;
 
     uint8_t bits[MAX_GRAPH_TRACE_LEN] = {0};
@@ -1263,7 +1464,21 @@ int NRZrawDemod(const char *Cmd, bool verbose) {
 
     if (BitLen == 0) return PM3_ESOFT;
 
-    errCnt = nrzRawDemod(bits, &BitLen, &clk, &invert, &clkStartIdx);
+    int cache_args[] = {clk, invert};
+    demod_cache_query_t cache_q;
+    demod_cache_t *cached = demod_cache_find(&cache_q, DEMOD_CACHE_NRZ, cache_args, ARRAYLEN(cache_args), bits, BitLen);
+    if (cached) {
+        memcpy(bits, cached->bits, cached->len);
+        BitLen = cached->len;
+        errCnt = cached->out[0];
+        clk = cached->out[1];
+        invert = cached->out[2];
+        clkStartIdx = cached->out[3];
+    } else {
+        errCnt = nrzRawDemod_ctx(LF_DEMOD_CTX, bits, &BitLen, &clk, &invert, &clkStartIdx);
+        int out[] = {errCnt, clk, invert, clkStartIdx};
+        demod_cache_store(&cache_q, bits, BitLen, out, ARRAYLEN(out));
+    }
     if (errCnt > maxErr) {
         PrintAndLogEx(DEBUG, "DEBUG: (NRZrawDemod) Too many errors found, clk: %d, invert: %d, numbits: %d, errCnt: %d", clk, invert, BitLen, errCnt);
         return PM3_ESOFT;
@@ -1361,6 +1576,9 @@ void setClockGrid(uint32_t clk, int offset) {
     else
         PrintAndLogEx(DEBUG, "DEBUG: (setClockGrid) demodoffset %d, clk %d", offset, clk);
 
+    // the plot grid belongs to the graph window
+    if (IsLFWorkspaceShown() == false) return;
+
     if (offset > clk) offset %= clk;
     if (offset < 0) offset += clk;
 
@@ -1446,13 +1664,13 @@ static int CmdHide(const char *Cmd) {
 //zero mean GraphBuffer
 int CmdHpf(const char *Cmd) {
     (void)Cmd; // Cmd is not used so far
-    uint8_t bits[GraphTraceLen];
+    uint8_t bits[MAX_GRAPH_TRACE_LEN];
     size_t size = getFromGraphBuf(bits);
     removeSignalOffset(bits, size);
     // push it back to graph
     setGraphBuf(bits, size);
     // set signal properties low/high/mean/amplitude and is_noise detection
-    computeSignalProperties(bits, size);
+    computeSignalProperties_ctx(LF_DEMOD_CTX, bits, size);
 
     RepaintGraphWindow();
     return PM3_SUCCESS;
@@ -1501,6 +1719,9 @@ int getSamples(uint32_t n, bool silent) {
         bits_per_sample = sc->bits_per_sample;
     }
 
+    if (GraphReserve(n) != PM3_SUCCESS)
+        return PM3_EMALLOC;
+
     if (bits_per_sample < 8) {
 
         if (!silent) PrintAndLogEx(NORMAL, "Unpacking...");
@@ -1522,10 +1743,10 @@ int getSamples(uint32_t n, bool silent) {
         GraphTraceLen = n;
     }
 
-    uint8_t bits[GraphTraceLen];
+    uint8_t bits[MAX_GRAPH_TRACE_LEN];
     size_t size = getFromGraphBuf(bits);
     // set signal properties low/high/mean/amplitude and is_noise detection
-    computeSignalProperties(bits, size);
+    computeSignalProperties_ctx(LF_DEMOD_CTX, bits, size);
 
     setClockGrid(0, 0);
     DemodBufferLen = 0;
@@ -1619,6 +1840,9 @@ int CmdTuneSamples(const char *Cmd) {
 
     // graph LF measurements
     // even here, these values has 3% error.
+    if (GraphReserve(256) != PM3_SUCCESS)
+        return PM3_EMALLOC;
+
     uint16_t test1 = 0;
     for (int i = 0; i < 256; i++) {
         GraphBuffer[i] = resp.data.asBytes[i] - 128;
@@ -1638,14 +1862,8 @@ int CmdTuneSamples(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
-static int CmdLoad(const char *Cmd) {
-    char filename[FILE_PATH_SIZE] = {0x00};
-    int len = 0;
-
-    len = strlen(Cmd);
-    if (len > FILE_PATH_SIZE) len = FILE_PATH_SIZE;
-    memcpy(filename, Cmd, len);
-
+// load a text file with one sample per line into the GraphBuffer
+int loadGraphFile(const char *filename) {
     FILE *f = fopen(filename, "r");
     if (!f) {
         PrintAndLogEx(WARNING, "couldn't open '%s'", filename);
@@ -1655,23 +1873,29 @@ static int CmdLoad(const char *Cmd) {
     GraphTraceLen = 0;
     char line[80];
     while (fgets(line, sizeof(line), f)) {
+        if (GraphReserve(GraphTraceLen + 1) != PM3_SUCCESS)
+            break;
+
         GraphBuffer[GraphTraceLen] = atoi(line);
         GraphTraceLen++;
-
-        if (GraphTraceLen >= MAX_GRAPH_TRACE_LEN)
-            break;
     }
 
     fclose(f);
 
-    PrintAndLogEx(SUCCESS, "loaded %d samples", GraphTraceLen);
+    PrintAndLogEx(SUCCESS, "loaded %zu samples", GraphTraceLen);
 
-    uint8_t bits[GraphTraceLen];
-    size_t size = getFromGraphBuf(bits);
+    // normalize the whole capture, not only the demod window
+    uint8_t *bits = calloc(GraphTraceLen + 1, sizeof(uint8_t));
+    if (bits == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+    size_t size = getFromGraphBufEx(bits, GraphTraceLen);
 
     removeSignalOffset(bits, size);
     setGraphBuf(bits, size);
-    computeSignalProperties(bits, size);
+    computeSignalProperties_ctx(LF_DEMOD_CTX, bits, size);
+    free(bits);
 
     setClockGrid(0, 0);
     DemodBufferLen = 0;
@@ -1679,6 +1903,17 @@ static int CmdLoad(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+static int CmdLoad(const char *Cmd) {
+    char filename[FILE_PATH_SIZE] = {0x00};
+    int len = 0;
+
+    len = strlen(Cmd);
+    if (len > FILE_PATH_SIZE) len = FILE_PATH_SIZE;
+    memcpy(filename, Cmd, len);
+
+    return loadGraphFile(filename);
+}
+
 // trim graph from the end
 int CmdLtrim(const char *Cmd) {
 
@@ -1742,10 +1977,10 @@ int CmdNorm(const char *Cmd) {
         }
     }
 
-    uint8_t bits[GraphTraceLen];
+    uint8_t bits[MAX_GRAPH_TRACE_LEN];
     size_t size = getFromGraphBuf(bits);
     // set signal properties low/high/mean/amplitude and is_noise detection
-    computeSignalProperties(bits, size);
+    computeSignalProperties_ctx(LF_DEMOD_CTX, bits, size);
 
     RepaintGraphWindow();
     return PM3_SUCCESS;
@@ -1829,10 +2064,10 @@ static int CmdDirectionalThreshold(const char *Cmd) {
     directionalThreshold(GraphBuffer, GraphBuffer, GraphTraceLen, up, down);
 
     // set signal properties low/high/mean/amplitude and isnoice detection
-    uint8_t bits[GraphTraceLen];
+    uint8_t bits[MAX_GRAPH_TRACE_LEN];
     size_t size = getFromGraphBuf(bits);
     // set signal properties low/high/mean/amplitude and is_noice detection
-    computeSignalProperties(bits, size);
+    computeSignalProperties_ctx(LF_DEMOD_CTX, bits, size);
 
     RepaintGraphWindow();
     return PM3_SUCCESS;
@@ -1861,10 +2096,10 @@ static int CmdZerocrossings(const char *Cmd) {
         }
     }
 
-    uint8_t bits[GraphTraceLen];
+    uint8_t bits[MAX_GRAPH_TRACE_LEN];
     size_t size = getFromGraphBuf(bits);
     // set signal properties low/high/mean/amplitude and is_noise detection
-    computeSignalProperties(bits, size);
+    computeSignalProperties_ctx(LF_DEMOD_CTX, bits, size);
 
     RepaintGraphWindow();
     return PM3_SUCCESS;
@@ -2115,10 +2350,10 @@ static int CmdDataIIR(const char *Cmd) {
     //iceIIR_Butterworth(GraphBuffer, GraphTraceLen);
     iceSimple_Filter(GraphBuffer, GraphTraceLen, k);
 
-    uint8_t bits[GraphTraceLen];
+    uint8_t bits[MAX_GRAPH_TRACE_LEN];
     size_t size = getFromGraphBuf(bits);
     // set signal properties low/high/mean/amplitude and is_noise detection
-    computeSignalProperties(bits, size);
+    computeSignalProperties_ctx(LF_DEMOD_CTX, bits, size);
     RepaintGraphWindow();
     return PM3_SUCCESS;
 }
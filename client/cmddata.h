@@ -12,6 +12,7 @@
 #define CMDDATA_H__
 
 #include "common.h"
+#include "graph.h"    // lf_workspace_t, DemodBuffer
 
 //#include <stdlib.h>  //size_t
 
@@ -65,21 +66,17 @@ int NRZrawDemod(const char *Cmd, bool verbose);
 void printDemodBuff(void);
 void setDemodBuff(uint8_t *buff, size_t size, size_t start_idx);
 bool getDemodBuff(uint8_t *buff, size_t *size);
-void save_restoreDB(uint8_t saveOpt);// option '1' to save DemodBuffer any other to restore
+void freeDemodCache(lf_workspace_t *ws);
 int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveGrph, bool verbose);
 int getSamples(uint32_t n, bool silent);
+int loadGraphFile(const char *filename);
 void setClockGrid(uint32_t clk, int offset);
 int directionalThreshold(const int *in, int *out, size_t len, int8_t up, int8_t down);
 int AskEdgeDetect(const int *in, int *out, int len, int threshold);
 int demodIdteck(void);
 
-#define MAX_DEMOD_BUF_LEN (1024*128)
 #define BIGBUF_SIZE 40000
-extern uint8_t DemodBuffer[MAX_DEMOD_BUF_LEN];
-extern size_t DemodBufferLen;
 
-extern int g_DemodClock;
-extern size_t g_DemodStartIdx;
 extern uint8_t g_debugMode;
 
 #endif
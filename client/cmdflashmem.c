@@ -177,7 +177,7 @@ static int CmdFlashMemLoad(const char *Cmd) {
     switch (d) {
         case DICTIONARY_MIFARE:
             start_index = DEFAULT_MF_KEYS_OFFSET;
-            res = loadFileDICTIONARY(filename, data + 2, &datalen, 6, &keycount);
+            res = loadFileDICTIONARY(filename, data + 2, FLASH_MEM_MAX_SIZE - 2, &datalen, 6, &keycount);
             if (res || !keycount) {
                 free(data);
                 return PM3_EFILE;
@@ -188,7 +188,7 @@ static int CmdFlashMemLoad(const char *Cmd) {
             break;
         case DICTIONARY_T55XX:
             start_index = DEFAULT_T55XX_KEYS_OFFSET;
-            res = loadFileDICTIONARY(filename, data + 2, &datalen, 4, &keycount);
+            res = loadFileDICTIONARY(filename, data + 2, FLASH_MEM_MAX_SIZE - 2, &datalen, 4, &keycount);
             if (res || !keycount) {
                 free(data);
                 return PM3_EFILE;
@@ -199,7 +199,7 @@ static int CmdFlashMemLoad(const char *Cmd) {
             break;
         case DICTIONARY_ICLASS:
             start_index = DEFAULT_ICLASS_KEYS_OFFSET;
-            res = loadFileDICTIONARY(filename, data + 2, &datalen, 8, &keycount);
+            res = loadFileDICTIONARY(filename, data + 2, FLASH_MEM_MAX_SIZE - 2, &datalen, 8, &keycount);
             if (res || !keycount) {
                 free(data);
                 return PM3_EFILE;
@@ -237,7 +237,7 @@ static int CmdFlashMemLoad(const char *Cmd) {
     uint32_t bytes_remaining = datalen;
 
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
 
     while (bytes_remaining > 0) {
         uint32_t bytes_in_packet = MIN(FLASH_MEM_BLOCK_SIZE, bytes_remaining);
@@ -252,20 +252,20 @@ static int CmdFlashMemLoad(const char *Cmd) {
         PacketResponseNG resp;
         if (!WaitForResponseTimeout(CMD_ACK, &resp, 2000)) {
             PrintAndLogEx(WARNING, "timeout while waiting for reply.");
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
             free(data);
             return PM3_ETIMEOUT;
         }
 
         uint8_t isok  = resp.oldarg[0] & 0xFF;
         if (!isok) {
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
             PrintAndLogEx(FAILED, "Flash write fail [offset %u]", bytes_sent);
             return PM3_EFLASH;
         }
     }
 
-    conn.block_after_ACK = false;
+    GetConn()->block_after_ACK = false;
     free(data);
     PrintAndLogEx(SUCCESS, "Wrote "_GREEN_("%u")"bytes to offset "_GREEN_("%u"), datalen, start_index);
     return PM3_SUCCESS;
@@ -316,6 +316,29 @@ static int CmdFlashMemDump(const char *Cmd) {
         return PM3_EINVARG;
     }
 
+    if (filename[0] != '\0' && print == false) {
+        // write chunks to the files as they arrive, no need to hold the whole dump in memory
+        fileStream_t fbin, feml;
+        if (openFileStream(&fbin, filename, ".bin", BIN, 0) != PM3_SUCCESS)
+            return PM3_EFILE;
+        if (openFileStream(&feml, filename, ".eml", EML, 16) != PM3_SUCCESS) {
+            closeFileStream(&fbin);
+            return PM3_EFILE;
+        }
+        fbin.next = &feml;
+
+        dl_sink_t sink = {writeFileStream, dl_print_progress, &fbin};
+        PrintAndLogEx(INFO, "downloading "_YELLOW_("%u")"bytes from flashmem", len);
+        bool isok = GetFromDeviceStream(FLASH_MEM, len, start_index, NULL, 0, &sink, NULL, 2500, true);
+        closeFileStream(&fbin);
+        closeFileStream(&feml);
+        if (!isok) {
+            PrintAndLogEx(FAILED, "ERROR; downloading from flashmemory");
+            return PM3_EFLASH;
+        }
+        return PM3_SUCCESS;
+    }
+
     uint8_t *dump = calloc(len, sizeof(uint8_t));
     if (!dump) {
         PrintAndLogEx(ERR, "error, cannot allocate memory ");
@@ -286,6 +286,32 @@ static int CmdFlashMemSpiFFSDump(const char *Cmd) {
 
     len = resp.oldarg[0];
 
+    if (filename[0] != '\0' && print == false) {
+        // write chunks to the files as they arrive, no need to hold the whole file in memory
+        fileStream_t fbin, feml;
+        if (openFileStream(&fbin, filename, "", BIN, 0) != PM3_SUCCESS)
+            return PM3_EFILE;
+        if (eml) {
+            if (openFileStream(&feml, filename, ".eml", EML, 16) != PM3_SUCCESS) {
+                closeFileStream(&fbin);
+                return PM3_EFILE;
+            }
+            fbin.next = &feml;
+        }
+
+        dl_sink_t sink = {writeFileStream, dl_print_progress, &fbin};
+        PrintAndLogEx(INFO, "downloading "_YELLOW_("%u") "bytes from spiffs (flashmem)", len);
+        bool isok = GetFromDeviceStream(SPIFFS, len, start_index, (uint8_t *)destfilename, 32, &sink, NULL, 2500, true);
+        closeFileStream(&fbin);
+        if (eml)
+            closeFileStream(&feml);
+        if (!isok) {
+            PrintAndLogEx(FAILED, "ERROR; downloading from spiffs(flashmemory)");
+            return PM3_EFLASH;
+        }
+        return PM3_SUCCESS;
+    }
+
     uint8_t *dump = calloc(len, sizeof(uint8_t));
     if (!dump) {
         PrintAndLogEx(ERR, "error, cannot allocate memory ");
@@ -390,7 +416,7 @@ static int CmdFlashMemSpiFFSLoad(const char *Cmd) {
     uint32_t bytes_remaining = datalen;
 
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
 
     // SendCommandMIX(CMD_SPIFFS_COPY, 0, 0, 0, (uint8_t *)data, 65);
 
@@ -416,20 +442,20 @@ static int CmdFlashMemSpiFFSLoad(const char *Cmd) {
         PacketResponseNG resp;
         if (!WaitForResponseTimeout(CMD_ACK, &resp, 2000)) {
             PrintAndLogEx(WARNING, "timeout while waiting for reply.");
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
             free(data);
             return PM3_ETIMEOUT;
         }
 
         uint8_t isok = resp.oldarg[0] & 0xFF;
         if (!isok) {
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
             PrintAndLogEx(FAILED, "Flash write fail [offset %u]", bytes_sent);
             return PM3_EFLASH;
         }
     }
 
-    conn.block_after_ACK = false;
+    GetConn()->block_after_ACK = false;
     free(data);
     PrintAndLogEx(SUCCESS, "Wrote "_GREEN_("%u") "bytes to file "_GREEN_("%s"), datalen, destfilename);
 
@@ -26,6 +26,7 @@
 #include "ui.h"
 #include "crc16.h"
 #include "util_posix.h"  // msclock
+#include "iso14443a_decode.h"
 
 bool APDUInFramingEnable = true;
 
@@ -197,11 +198,29 @@ static int usage_hf_14a_sim(void) {
 static int usage_hf_14a_sniff(void) {
     PrintAndLogEx(NORMAL, "It get data from the field and saves it into command buffer.");
     PrintAndLogEx(NORMAL, "Buffer accessible from command 'hf list 14a'");
-    PrintAndLogEx(NORMAL, "Usage:  hf 14a sniff [c][r]");
+    PrintAndLogEx(NORMAL, "With 's' the trace is streamed to the client while sniffing and appended to <file>,");
+    PrintAndLogEx(NORMAL, "so the capture is not limited by the device trace buffer. Press Enter or the pm3 button to stop.");
+    PrintAndLogEx(NORMAL, "Usage:  hf 14a sniff [c][r][s <file>]");
     PrintAndLogEx(NORMAL, "c - triggered by first data from card");
     PrintAndLogEx(NORMAL, "r - triggered by first 7-bit request from reader (REQ,WUP,...)");
+    PrintAndLogEx(NORMAL, "s - stream the trace to <file>, view it with 'trace load <file>' and 'trace list 14a 1'");
     PrintAndLogEx(NORMAL, "Examples:");
     PrintAndLogEx(NORMAL, "        hf 14a sniff c r");
+    PrintAndLogEx(NORMAL, "        hf 14a sniff s sniff14a.trace");
+    return 0;
+}
+static int usage_hf_14a_decode(void) {
+    PrintAndLogEx(NORMAL, "Decodes recorded sniffer samples with the same decoders as 'hf 14a sniff' and appends");
+    PrintAndLogEx(NORMAL, "the frames to a trace file. No Proxmark3 needed.");
+    PrintAndLogEx(NORMAL, "The sample file holds the raw bytes the FPGA sniffer delivers, reader data in the");
+    PrintAndLogEx(NORMAL, "high nibble and tag data in the low nibble, four ssp_clk ticks per byte.");
+    PrintAndLogEx(NORMAL, "Usage:  hf 14a decode [c][r] f <samples> s <file>");
+    PrintAndLogEx(NORMAL, "c - triggered by first data from card");
+    PrintAndLogEx(NORMAL, "r - triggered by first 7-bit request from reader (REQ,WUP,...)");
+    PrintAndLogEx(NORMAL, "f - sample file to decode");
+    PrintAndLogEx(NORMAL, "s - trace file to append to");
+    PrintAndLogEx(NORMAL, "Examples:");
+    PrintAndLogEx(NORMAL, "        hf 14a decode f samples.bin s sniff14a.trace");
     return 0;
 }
 static int usage_hf_14a_raw(void) {
@@ -517,16 +536,319 @@ int CmdHF14ASim(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+// Only complete trace records are written, so a lost chunk or an early stop never leaves
+// half a record in the file. The largest record plus one chunk fits in the pending buffer.
+#define SNIFF_STREAM_HDR_LEN    (sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint16_t))
+#define SNIFF_STREAM_PEND_SIZE  (PM3_CMD_DATA_SIZE + SNIFF_STREAM_HDR_LEN + 0x7FFF + 0x1000)
+
+// length of the complete trace records at the start of buf
+static size_t sniff_stream_complete(const uint8_t *buf, size_t len) {
+    size_t pos = 0;
+    while (len - pos >= SNIFF_STREAM_HDR_LEN) {
+        uint16_t data_len = (buf[pos + 6] | (buf[pos + 7] << 8)) & 0x7FFF;
+        size_t record = SNIFF_STREAM_HDR_LEN + data_len + (data_len - 1) / 8 + 1;
+        if (len - pos < record)
+            break;
+        pos += record;
+    }
+    return pos;
+}
+
+// collect the trace chunks a streaming sniff sends until the device reports it is done
+static int sniff_stream_to_file(const char *filename) {
+
+    uint8_t *pending = calloc(SNIFF_STREAM_PEND_SIZE, sizeof(uint8_t));
+    if (pending == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        SendCommandNG(CMD_PING, NULL, 0);
+        return PM3_EMALLOC;
+    }
+
+    FILE *f = fopen(filename, "ab");
+    if (f == NULL) {
+        PrintAndLogEx(ERR, "could not open " _YELLOW_("%s"), filename);
+        SendCommandNG(CMD_PING, NULL, 0);
+        free(pending);
+        return PM3_EFILE;
+    }
+
+    PrintAndLogEx(INFO, "Streaming trace to " _YELLOW_("%s") ", press Enter or the pm3 button to stop", filename);
+
+    // the chunks arrive faster than anybody else reads replies, don't let them be dropped
+    SetRxBackpressure(true);
+
+    int res = PM3_SUCCESS;
+    uint64_t received = 0, bytes = 0, shown = 0;
+    size_t pending_len = 0;
+    bool stopping = false, broken = false;
+    uint8_t timeouts = 0;
+    PacketResponseNG resp;
+
+    for (;;) {
+        if (stopping == false && kbd_enter_pressed()) {
+            // any command ends the sniff loop on the device
+            SendCommandNG(CMD_PING, NULL, 0);
+            stopping = true;
+        }
+
+        if (WaitForResponseTimeout(CMD_UNKNOWN, &resp, 500) == false) {
+            // the device keeps quiet while nothing is sniffed, only give up once we asked it to stop
+            if (stopping && ++timeouts > 6) {
+                PrintAndLogEx(WARNING, "timeout while waiting for the end of the stream");
+                res = PM3_ETIMEOUT;
+                break;
+            }
+            continue;
+        }
+
+        if (resp.cmd == CMD_HF_ISO14443A_SNIFF_STREAM) {
+            // after a lost chunk the rest of the stream can't be used, just wait for the end
+            if (broken)
+                continue;
+
+            uint32_t offset = resp.oldarg[0];
+            if (offset != (uint32_t)received || pending_len + resp.length > SNIFF_STREAM_PEND_SIZE) {
+                if (offset != (uint32_t)received)
+                    PrintAndLogEx(WARNING, "lost " _YELLOW_("%u") " bytes of trace at offset %" PRIu64 ", stopping", offset - (uint32_t)received, received);
+                else
+                    PrintAndLogEx(WARNING, "invalid trace record at offset %" PRIu64 ", stopping", received - pending_len);
+                res = PM3_ESOFT;
+                broken = true;
+                if (stopping == false)
+                    SendCommandNG(CMD_PING, NULL, 0);
+                stopping = true;
+                continue;
+            }
+
+            memcpy(pending + pending_len, resp.data.asBytes, resp.length);
+            pending_len += resp.length;
+            received += resp.length;
+
+            size_t complete = sniff_stream_complete(pending, pending_len);
+            if (fwrite(pending, 1, complete, f) != complete) {
+                PrintAndLogEx(ERR, "write to " _YELLOW_("%s") " failed", filename);
+                res = PM3_EFILE;
+                if (stopping == false)
+                    SendCommandNG(CMD_PING, NULL, 0);
+                break;
+            }
+            memmove(pending, pending + complete, pending_len - complete);
+            pending_len -= complete;
+
+            bytes += complete;
+            if (bytes - shown >= 4096) {
+                PrintAndLogEx(INPLACE, "%" PRIu64 " bytes", bytes);
+                shown = bytes;
+            }
+        } else if (resp.cmd == CMD_HF_ISO14443A_SNIFF) {
+            if (broken == false)
+                res = resp.status;
+            break;
+        }
+    }
+    SetRxBackpressure(false);
+    fclose(f);
+
+    PrintAndLogEx(NORMAL, "");
+    if (res == PM3_EOVFLOW)
+        PrintAndLogEx(WARNING, "device could not keep up, sniffing stopped early");
+    if (pending_len)
+        PrintAndLogEx(WARNING, "dropped %zu bytes of an incomplete trace record", pending_len);
+    free(pending);
+
+    PrintAndLogEx(SUCCESS, "appended " _YELLOW_("%" PRIu64) " bytes of trace to " _YELLOW_("%s"), bytes, filename);
+    PrintAndLogEx(INFO, "try 'trace load %s' and 'trace list 14a 1'", filename);
+    return res;
+}
+
 int CmdHF14ASniff(const char *Cmd) {
     uint8_t param = 0;
-    for (uint8_t i = 0; i < 2; i++) {
-        uint8_t ctmp = tolower(param_getchar(Cmd, i));
-        if (ctmp == 'h') return usage_hf_14a_sniff();
-        if (ctmp == 'c') param |= 0x01;
-        if (ctmp == 'r') param |= 0x02;
+    char filename[FILE_PATH_SIZE] = {0};
+    bool errors = false;
+    uint8_t cmdp = 0;
+    while (param_getchar(Cmd, cmdp) != 0x00 && !errors) {
+        switch (tolower(param_getchar(Cmd, cmdp))) {
+            case 'h':
+                return usage_hf_14a_sniff();
+            case 'c':
+                param |= 0x01;
+                cmdp++;
+                break;
+            case 'r':
+                param |= 0x02;
+                cmdp++;
+                break;
+            case 's':
+                if (param_getstr(Cmd, cmdp + 1, filename, sizeof(filename)) == 0) {
+                    errors = true;
+                    break;
+                }
+                param |= 0x04;
+                cmdp += 2;
+                break;
+            default:
+                PrintAndLogEx(WARNING, "Unknown parameter '%c'", param_getchar(Cmd, cmdp));
+                errors = true;
+                break;
+        }
     }
+    if (errors) return usage_hf_14a_sniff();
+
     clearCommandBuffer();
     SendCommandNG(CMD_HF_ISO14443A_SNIFF, (uint8_t *)&param, sizeof(uint8_t));
+
+    if (param & 0x04)
+        return sniff_stream_to_file(filename);
+
+    return PM3_SUCCESS;
+}
+
+// append one record in the BigBuf trace format, see LogTrace() in armsrc/BigBuf.c
+static bool trace_append(FILE *f, const uint8_t *data, uint16_t len, uint32_t start, uint32_t end, const uint8_t *par, bool reader) {
+    uint8_t hdr[8];
+    uint32_t duration = end - start;
+    uint16_t num_paritybytes = (len - 1) / 8 + 1;
+
+    hdr[0] = start & 0xff;
+    hdr[1] = (start >> 8) & 0xff;
+    hdr[2] = (start >> 16) & 0xff;
+    hdr[3] = (start >> 24) & 0xff;
+    hdr[4] = duration & 0xff;
+    hdr[5] = (duration >> 8) & 0xff;
+    hdr[6] = len & 0xff;
+    hdr[7] = (len >> 8) & 0xff;
+    if (!reader)
+        hdr[7] |= 0x80;
+
+    if (fwrite(hdr, 1, sizeof(hdr), f) != sizeof(hdr))
+        return false;
+    if (len && fwrite(data, 1, len, f) != len)
+        return false;
+    return fwrite(par, 1, num_paritybytes, f) == num_paritybytes;
+}
+
+typedef struct {
+    FILE *f;
+    uint32_t reader_frames;
+    uint32_t tag_frames;
+} sniff_decode_out_t;
+
+static bool sniff_decode_log(void *ctx, const uint8_t *data, uint16_t len, uint32_t start, uint32_t end, uint8_t *par, bool reader) {
+    sniff_decode_out_t *out = ctx;
+    if (!trace_append(out->f, data, len, start, end, par, reader))
+        return false;
+    if (reader)
+        out->reader_frames++;
+    else
+        out->tag_frames++;
+    return true;
+}
+
+// runs the SniffIso14443a() decoder over a sample file instead of the DMA buffer
+static int sniff_decode_samples(const uint8_t *samples, size_t len, uint8_t param, FILE *f, uint32_t *reader_frames, uint32_t *tag_frames) {
+
+    // same sizes as MAX_FRAME_SIZE / MAX_PARITY_SIZE on the device
+    uint8_t cmd[256], cmd_par[32];
+    uint8_t resp[256], resp_par[32];
+    tUart14a uart;
+    tDemod14a demod;
+    Uart14aInitEx(&uart, cmd, cmd_par);
+    Demod14aInitEx(&demod, resp, resp_par);
+
+    sniff_decode_out_t out = { f, 0, 0 };
+    tSniff14a sniff;
+    Sniff14aInit(&sniff, &uart, &demod, sizeof(cmd), param, sniff_decode_log, &out);
+
+    int res = PM3_SUCCESS;
+    for (size_t i = 0; i < len; i++) {
+        if (Sniff14aDecode(&sniff, samples[i]) & SNIFF14A_LOG_FAILED) {
+            res = PM3_EFILE;
+            break;
+        }
+    }
+    *reader_frames = out.reader_frames;
+    *tag_frames = out.tag_frames;
+    return res;
+}
+
+static int CmdHF14ADecode(const char *Cmd) {
+    uint8_t param = 0;
+    char samplefile[FILE_PATH_SIZE] = {0};
+    char tracefile[FILE_PATH_SIZE] = {0};
+    bool errors = false;
+    uint8_t cmdp = 0;
+    while (param_getchar(Cmd, cmdp) != 0x00 && !errors) {
+        switch (tolower(param_getchar(Cmd, cmdp))) {
+            case 'h':
+                return usage_hf_14a_decode();
+            case 'c':
+                param |= 0x01;
+                cmdp++;
+                break;
+            case 'r':
+                param |= 0x02;
+                cmdp++;
+                break;
+            case 'f':
+                if (param_getstr(Cmd, cmdp + 1, samplefile, sizeof(samplefile)) == 0)
+                    errors = true;
+                cmdp += 2;
+                break;
+            case 's':
+                if (param_getstr(Cmd, cmdp + 1, tracefile, sizeof(tracefile)) == 0)
+                    errors = true;
+                cmdp += 2;
+                break;
+            default:
+                PrintAndLogEx(WARNING, "Unknown parameter '%c'", param_getchar(Cmd, cmdp));
+                errors = true;
+                break;
+        }
+    }
+    if (errors || samplefile[0] == '\0' || tracefile[0] == '\0') return usage_hf_14a_decode();
+
+    FILE *in = fopen(samplefile, "rb");
+    if (in == NULL) {
+        PrintAndLogEx(ERR, "could not open " _YELLOW_("%s"), samplefile);
+        return PM3_EFILE;
+    }
+    fseek(in, 0, SEEK_END);
+    long fsize = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    if (fsize <= 0) {
+        PrintAndLogEx(ERR, "error, when getting filesize");
+        fclose(in);
+        return PM3_EFILE;
+    }
+
+    uint8_t *samples = calloc(fsize, sizeof(uint8_t));
+    if (samples == NULL) {
+        PrintAndLogEx(ERR, "error, cannot allocate memory");
+        fclose(in);
+        return PM3_EMALLOC;
+    }
+    size_t bytes_read = fread(samples, 1, fsize, in);
+    fclose(in);
+
+    FILE *out = fopen(tracefile, "ab");
+    if (out == NULL) {
+        PrintAndLogEx(ERR, "could not open " _YELLOW_("%s"), tracefile);
+        free(samples);
+        return PM3_EFILE;
+    }
+
+    uint32_t reader_frames = 0, tag_frames = 0;
+    int res = sniff_decode_samples(samples, bytes_read, param, out, &reader_frames, &tag_frames);
+    fclose(out);
+    free(samples);
+
+    if (res != PM3_SUCCESS) {
+        PrintAndLogEx(ERR, "write to " _YELLOW_("%s") " failed", tracefile);
+        return res;
+    }
+
+    PrintAndLogEx(SUCCESS, "decoded " _YELLOW_("%u") " reader and " _YELLOW_("%u") " tag frames from %zu samples", reader_frames, tag_frames, bytes_read);
+    PrintAndLogEx(INFO, "try 'trace load %s' and 'trace list 14a 1'", tracefile);
     return PM3_SUCCESS;
 }
 
@@ -1207,6 +1529,7 @@ static command_t CommandTable[] = {
     {"cuids",       CmdHF14ACUIDs,        IfPm3Iso14443a,  "<n> Collect n>0 ISO14443-a UIDs in one go"},
     {"sim",         CmdHF14ASim,          IfPm3Iso14443a,  "<UID> -- Simulate ISO 14443-a tag"},
     {"sniff",       CmdHF14ASniff,        IfPm3Iso14443a,  "sniff ISO 14443-a traffic"},
+    {"decode",      CmdHF14ADecode,       AlwaysAvailable, "decode recorded ISO 14443-a sniffer samples into a trace file"},
     {"apdu",        CmdHF14AAPDU,         IfPm3Iso14443a,  "Send ISO 14443-4 APDU to tag"},
     {"chaining",    CmdHF14AChaining,     IfPm3Iso14443a,  "Control ISO 14443-4 input chaining"},
     {"raw",         CmdHF14ACmdRaw,       IfPm3Iso14443a,  "Send raw hex data to tag"},
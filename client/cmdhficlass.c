@@ -767,7 +767,7 @@ static int CmdHFiClassELoad(const char *Cmd) {
     printIclassDumpInfo(dump);
 
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
 
     //Send to device
     uint32_t bytes_sent = 0;
@@ -777,7 +777,7 @@ static int CmdHFiClassELoad(const char *Cmd) {
         uint32_t bytes_in_packet = MIN(PM3_CMD_DATA_SIZE, bytes_remaining);
         if (bytes_in_packet == bytes_remaining) {
             // Disable fast mode on last packet
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
         }
         clearCommandBuffer();
         SendCommandOLD(CMD_HF_ICLASS_EML_MEMSET, bytes_sent, bytes_in_packet, 0, dump + bytes_sent, bytes_in_packet);
@@ -2103,7 +2103,7 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
 
 
     uint8_t *keyBlock = NULL;
-    uint16_t keycount = 0;
+    uint32_t keycount = 0;
 
     // load keys
     int res = loadFileDICTIONARY_safe(filename, (void**)&keyBlock, 8, &keycount);
@@ -2151,7 +2151,7 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
     bool lastChunk = false;
 
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
 
     // keep track of position of found key
     uint8_t found_offset = 0;
@@ -2173,7 +2173,7 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
         if (keys == keycount - key_offset) {
             lastChunk = true;
             // Disable fast mode on last command
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
         }
         uint32_t flags = lastChunk << 8;
         // bit 16
@@ -2365,7 +2365,7 @@ static int CmdHFiClassLookUp(const char *Cmd) {
     PrintAndLogEx(SUCCESS, "MAC_TAG | %s", sprint_hex(MAC_TAG, sizeof(MAC_TAG)));
 
     uint8_t *keyBlock = NULL;
-    uint16_t keycount = 0;
+    uint32_t keycount = 0;
 
     // load keys
 	int res = loadFileDICTIONARY_safe(filename, (void**)&keyBlock, 8, &keycount);
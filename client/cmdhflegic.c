@@ -843,13 +843,13 @@ void legic_chk_iv(uint32_t *iv) {
 }
 void legic_seteml(uint8_t *src, uint32_t offset, uint32_t numofbytes) {
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
     for (size_t i = offset; i < numofbytes; i += PM3_CMD_DATA_SIZE) {
 
         size_t len = MIN((numofbytes - i), PM3_CMD_DATA_SIZE);
         if (len == numofbytes - i) {
             // Disable fast mode on last packet
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
         }
         clearCommandBuffer();
         SendCommandOLD(CMD_HF_LEGIC_ESET, i, len, 0, src + i, len);
@@ -1055,7 +1055,7 @@ static int CmdLegicRestore(const char *Cmd) {
     PrintAndLogEx(SUCCESS, "Restoring to card");
 
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
 
     // transfer to device
     PacketResponseNG resp;
@@ -1064,7 +1064,7 @@ static int CmdLegicRestore(const char *Cmd) {
         size_t len = MIN((numofbytes - i), PM3_CMD_DATA_SIZE);
         if (len == numofbytes - i) {
             // Disable fast mode on last packet
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
         }
         clearCommandBuffer();
         SendCommandOLD(CMD_HF_LEGIC_WRITER, i, len, 0x55, data + i, len);
@@ -1250,7 +1250,7 @@ static int CmdLegicWipe(const char *Cmd) {
 
     PrintAndLogEx(SUCCESS, "Erasing");
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
 
     // transfer to device
     PacketResponseNG resp;
@@ -1261,7 +1261,7 @@ static int CmdLegicWipe(const char *Cmd) {
         size_t len = MIN((card.cardsize - i), PM3_CMD_DATA_SIZE);
         if (len == card.cardsize - i) {
             // Disable fast mode on last packet
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
         }
         clearCommandBuffer();
         SendCommandOLD(CMD_HF_LEGIC_WRITER, i, len, 0x55, data + i, len);
@@ -16,11 +16,15 @@
 #include "commonutil.h"  // ARRAYLEN
 #include "comms.h"        // clearCommandBuffer
 #include "fileutils.h"
+#include "dictionary.h"     // dictionary_dedupe
+#include "mifare/keystats.h"
 #include "cmdtrace.h"
 #include "emv/dump.h"
 #include "mifare/mifaredefault.h"          // mifare default key array
 #include "cliparser/cliparser.h"           // argtable
+#include "cmdhfmfhard.h"     // SetBitflipCache
 #include "hardnested/hardnested_bf_core.h" // SetSIMDInstr
+#include "hardnested/hardnested_bruteforce.h" // brute_force_benchmark_all
 #include "mifare/mad.h"
 #include "mifare/ndef.h"
 #include "protocols.h"
@@ -117,36 +121,41 @@ static int usage_hf14_mfsim(void) {
 */
 static int usage_hf14_nested(void) {
     PrintAndLogEx(NORMAL, "Usage:");
-    PrintAndLogEx(NORMAL, " all sectors:  hf mf nested  <card memory> <block number> <key A/B> <key (12 hex symbols)> [t,d]");
+    PrintAndLogEx(NORMAL, " all sectors:  hf mf nested  <card memory> <block number> <key A/B> <key (12 hex symbols)> [t,d,f]");
     PrintAndLogEx(NORMAL, " one sector:   hf mf nested  o <block number> <key A/B> <key (12 hex symbols)>");
-    PrintAndLogEx(NORMAL, "               <target block number> <target key A/B> [t]");
+    PrintAndLogEx(NORMAL, "               <target block number> <target key A/B> [t,f]");
     PrintAndLogEx(NORMAL, "Options:");
     PrintAndLogEx(NORMAL, "      h    this help");
     PrintAndLogEx(NORMAL, "      card memory - 0 - MINI(320 bytes), 1 - 1K, 2 - 2K, 4 - 4K, <other> - 1K");
     PrintAndLogEx(NORMAL, "      t    transfer keys into emulator memory");
     PrintAndLogEx(NORMAL, "      d    write keys to binary file `hf-mf-<UID>-key.bin`");
+    PrintAndLogEx(NORMAL, "      f    collect a third nonce and filter key candidates offline before testing them on the card");
     PrintAndLogEx(NORMAL, "");
     PrintAndLogEx(NORMAL, "Examples:");
     PrintAndLogEx(NORMAL, "      hf mf nested 1 0 A FFFFFFFFFFFF     -- nested attack against 1k,block 0, Key A using key FFFFFFFFFFFF");
     PrintAndLogEx(NORMAL, "      hf mf nested 1 0 A FFFFFFFFFFFF t   -- and transfer keys into emulator memory");
     PrintAndLogEx(NORMAL, "      hf mf nested 1 0 A FFFFFFFFFFFF d   -- or write keys to binary file ");
+    PrintAndLogEx(NORMAL, "      hf mf nested 1 0 A FFFFFFFFFFFF f   -- usually test only one key candidate per sector on the card");
     PrintAndLogEx(NORMAL, "      hf mf nested o 0 A FFFFFFFFFFFF 4 A");
     return 0;
 }
 static int usage_hf14_hardnested(void) {
     PrintAndLogEx(NORMAL, "Usage:");
     PrintAndLogEx(NORMAL, "      hf mf hardnested <block number> <key A|B> <key (12 hex symbols)>");
-    PrintAndLogEx(NORMAL, "                       <target block number> <target key A|B> [known target key (12 hex symbols)] [w] [s]");
+    PrintAndLogEx(NORMAL, "                       <target block number> <target key A|B> [known target key (12 hex symbols)] [w] [s] [c]");
     PrintAndLogEx(NORMAL, "  or  hf mf hardnested r [known target key]");
+    PrintAndLogEx(NORMAL, "  or  hf mf hardnested b");
     PrintAndLogEx(NORMAL, "");
     PrintAndLogEx(NORMAL, "Options:");
     PrintAndLogEx(NORMAL, "      h         this help");
     PrintAndLogEx(NORMAL, "      w         acquire nonces and UID, and write them to binary file with default name hf-mf-<UID>-nonces.bin");
     PrintAndLogEx(NORMAL, "      s         slower acquisition (required by some non standard cards)");
+    PrintAndLogEx(NORMAL, "      c         cache the uncompressed tables in ~/.proxmark3/hardnested_bitflips.cache (about 480 MB, written on first use)");
     PrintAndLogEx(NORMAL, "      r         read hf-mf-<UID>-nonces.bin if tag present, otherwise read nonces.bin, then start attack");
     PrintAndLogEx(NORMAL, "      u <UID>   read/write hf-mf-<UID>-nonces.bin instead of default name");
     PrintAndLogEx(NORMAL, "      f <name>  read/write <name> instead of default name");
     PrintAndLogEx(NORMAL, "      t         tests?");
+    PrintAndLogEx(NORMAL, "      b         benchmark the brute force with each SIMD core, on one and on all CPUs");
     PrintAndLogEx(NORMAL, "      i <X>     set type of SIMD instructions. Without this flag programs autodetect it.");
     PrintAndLogEx(NORMAL, "        i 5   = AVX512");
     PrintAndLogEx(NORMAL, "        i 2   = AVX2");
@@ -161,6 +170,7 @@ static int usage_hf14_hardnested(void) {
     PrintAndLogEx(NORMAL, "      hf mf hardnested 0 A FFFFFFFFFFFF 4 A f nonces.bin w s");
     PrintAndLogEx(NORMAL, "      hf mf hardnested r");
     PrintAndLogEx(NORMAL, "      hf mf hardnested r a0a1a2a3a4a5");
+    PrintAndLogEx(NORMAL, "      hf mf hardnested b");
     PrintAndLogEx(NORMAL, "");
     PrintAndLogEx(NORMAL, "Add the known target key to check if it is present in the remaining key space:");
     PrintAndLogEx(NORMAL, "      hf mf hardnested 0 A A0A1A2A3A4A5 4 A FFFFFFFFFFFF");
@@ -169,7 +179,7 @@ static int usage_hf14_hardnested(void) {
 static int usage_hf14_autopwn(void) {
     PrintAndLogEx(NORMAL, "Usage:");
     PrintAndLogEx(NORMAL, "      hf mf autopwn [k] <sector number> <key A|B> <key (12 hex symbols)>");
-    PrintAndLogEx(NORMAL, "                    [* <card memory>] [f <dictionary>[.dic]] [s] [i <simd type>] [l] [v]");
+    PrintAndLogEx(NORMAL, "                    [* <card memory>] [f <dictionary>[.dic]] [s] [c] [r] [i <simd type>] [l] [v]");
     PrintAndLogEx(NORMAL, "");
     PrintAndLogEx(NORMAL, "Description:");
     PrintAndLogEx(NORMAL, "      This command automates the key recovery process on Mifare classic cards.");
@@ -180,8 +190,10 @@ static int usage_hf14_autopwn(void) {
     PrintAndLogEx(NORMAL, "      k <sector> <key A|B> <key> known key is supplied");
     PrintAndLogEx(NORMAL, "      f <dictionary>[.dic]       key dictionary file");
     PrintAndLogEx(NORMAL, "      s                          slower acquisition for hardnested (required by some non standard cards)");
+    PrintAndLogEx(NORMAL, "      c                          cache the uncompressed hardnested tables in ~/.proxmark3 (about 480 MB)");
     PrintAndLogEx(NORMAL, "      v                          verbose output (statistics)");
     PrintAndLogEx(NORMAL, "      l                          legacy mode (use the slow 'mf chk' for the key enumeration)");
+    PrintAndLogEx(NORMAL, "      r                          try keys that opened this card type before first, record the hits in ~/.proxmark3");
     PrintAndLogEx(NORMAL, "      * <card memory>            all sectors based on card memory");
     PrintAndLogEx(NORMAL, "        * 0   = MINI(320 bytes)");
     PrintAndLogEx(NORMAL, "        * 1   = 1k  (default)");
@@ -203,7 +215,7 @@ static int usage_hf14_autopwn(void) {
     return 0;
 }
 static int usage_hf14_chk(void) {
-    PrintAndLogEx(NORMAL, "Usage:  hf mf chk [h] <block number>|<*card memory> <key type (A/B/?)> [t|d] [<key (12 hex symbols)>] [<dic (*.dic)>]");
+    PrintAndLogEx(NORMAL, "Usage:  hf mf chk [h] <block number>|<*card memory> <key type (A/B/?)> [t|d] [<key (12 hex symbols)>] [<dic (*.dic|*.bdic)>]");
     PrintAndLogEx(NORMAL, "Options:");
     PrintAndLogEx(NORMAL, "      h    this help");
     PrintAndLogEx(NORMAL, "      *    all sectors based on card memory, other values then below defaults to 1k");
@@ -223,7 +235,7 @@ static int usage_hf14_chk(void) {
 }
 static int usage_hf14_chk_fast(void) {
     PrintAndLogEx(NORMAL, "This is a improved checkkeys method speedwise. It checks Mifare Classic tags sector keys against a dictionary file with keys");
-    PrintAndLogEx(NORMAL, "Usage:  hf mf fchk [h] <card memory> [t|d|f] [<key (12 hex symbols)>] [<dic (*.dic)>]");
+    PrintAndLogEx(NORMAL, "Usage:  hf mf fchk [h] <card memory> [t|d|f|r] [<key (12 hex symbols)>] [<dic (*.dic|*.bdic)>]");
     PrintAndLogEx(NORMAL, "Options:");
     PrintAndLogEx(NORMAL, "      h    this help");
     PrintAndLogEx(NORMAL, "      <cardmem> all sectors based on card memory, other values than below defaults to 1k");
@@ -233,13 +245,15 @@ static int usage_hf14_chk_fast(void) {
     PrintAndLogEx(NORMAL, "                 4 - 4K");
     PrintAndLogEx(NORMAL, "      d    write keys to binary file");
     PrintAndLogEx(NORMAL, "      t    write keys to emulator memory");
-    PrintAndLogEx(NORMAL, "      m    use dictionary from flashmemory\n");
+    PrintAndLogEx(NORMAL, "      m    use dictionary from flashmemory");
+    PrintAndLogEx(NORMAL, "      r    try keys that opened this card type (ATQA/SAK) before first, record the hits in ~/.proxmark3\n");
     PrintAndLogEx(NORMAL, "");
     PrintAndLogEx(NORMAL, "Examples:");
     PrintAndLogEx(NORMAL, "      hf mf fchk 1 1234567890ab         -- target 1K using key 1234567890ab");
     PrintAndLogEx(NORMAL, "      hf mf fchk 1 mfc_default_keys.dic -- target 1K using default dictionary file");
     PrintAndLogEx(NORMAL, "      hf mf fchk 1 t                    -- target 1K, write to emulator memory");
     PrintAndLogEx(NORMAL, "      hf mf fchk 1 d                    -- target 1K, write to file");
+    PrintAndLogEx(NORMAL, "      hf mf fchk 1 r mfc_default_keys   -- target 1K, use and update the key statistics");
     if (IfPm3Flash())
         PrintAndLogEx(NORMAL, "      hf mf fchk 1 m                    -- target 1K, use dictionary from flashmemory");
     return 0;
@@ -464,6 +478,29 @@ static int GetHFMF14AUID(uint8_t *uid, int *uidlen) {
     return 1;
 }
 
+static bool GetHFMF14ACardType(uint8_t *atqa, uint8_t *sak) {
+    clearCommandBuffer();
+    SendCommandMIX(CMD_HF_ISO14443A_READER, ISO14A_CONNECT, 0, 0, NULL, 0);
+    PacketResponseNG resp;
+    if (!WaitForResponseTimeout(CMD_ACK, &resp, 2500) || resp.oldarg[0] == 0) {
+        DropField();
+        return false;
+    }
+
+    iso14a_card_select_t card;
+    memcpy(&card, (iso14a_card_select_t *)resp.data.asBytes, sizeof(iso14a_card_select_t));
+    memcpy(atqa, card.atqa, 2);
+    *sak = card.sak;
+    return true;
+}
+
+// keys that opened this card type before go into the first chunk
+static void OrderKeysByStats(const uint8_t *atqa, uint8_t sak, uint8_t *keyBlock, uint32_t keycnt) {
+    uint32_t moved = mf_keystats_order(atqa, sak, keyBlock, keycnt);
+    if (moved)
+        PrintAndLogEx(INFO, "trying " _YELLOW_("%u") " keys with earlier hits on ATQA %02x %02x SAK %02x first", moved, atqa[1], atqa[0], sak);
+}
+
 static char *GenerateFilename(const char *prefix, const char *suffix) {
     uint8_t uid[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
     int uidlen = 0;
@@ -1175,6 +1212,7 @@ static int CmdHF14AMfNested(const char *Cmd) {
     uint64_t key64 = 0;
     bool transferToEml = false;
     bool createDumpFile = false;
+    bool filterCandidates = false;
 
     if (strlen(Cmd) < 3) return usage_hf14_nested();
 
@@ -1217,6 +1255,7 @@ static int CmdHF14AMfNested(const char *Cmd) {
         ctmp = tolower(param_getchar(Cmd, j));
         transferToEml |= (ctmp == 't');
         createDumpFile |= (ctmp == 'd');
+        filterCandidates |= (ctmp == 'f');
 
         j++;
     }
@@ -1228,7 +1267,7 @@ static int CmdHF14AMfNested(const char *Cmd) {
     }
 
     if (cmdp == 'o') {
-        int16_t isOK = mfnested(blockNo, keyType, key, trgBlockNo, trgKeyType, keyBlock, true);
+        int16_t isOK = mfnested(blockNo, keyType, key, trgBlockNo, trgKeyType, keyBlock, true, filterCandidates);
         switch (isOK) {
             case -1 :
                 PrintAndLogEx(ERR, "Error: No response from Proxmark3.\n");
@@ -1263,6 +1302,9 @@ static int CmdHF14AMfNested(const char *Cmd) {
                     PrintAndLogEx(SUCCESS, "Key transferred to emulator memory.");
                 }
                 return PM3_SUCCESS;
+            case PM3_EMALLOC :
+                PrintAndLogEx(ERR, "Error: not enough memory to intersect the key candidates.\n");
+                return PM3_EMALLOC;
             default :
                 PrintAndLogEx(ERR, "Unknown Error.\n");
         }
@@ -1307,7 +1349,7 @@ static int CmdHF14AMfNested(const char *Cmd) {
 
                     if (e_sector[sectorNo].foundKey[trgKeyType]) continue;
 
-                    int16_t isOK = mfnested(blockNo, keyType, key, FirstBlockOfSector(sectorNo), trgKeyType, keyBlock, calibrate);
+                    int16_t isOK = mfnested(blockNo, keyType, key, FirstBlockOfSector(sectorNo), trgKeyType, keyBlock, calibrate, filterCandidates);
                     switch (isOK) {
                         case -1 :
                             PrintAndLogEx(ERR, "error: No response from Proxmark3.\n");
@@ -1330,6 +1372,10 @@ static int CmdHF14AMfNested(const char *Cmd) {
 
                             mfCheckKeys_fast(SectorsCnt, true, true, 2, 1, keyBlock, e_sector, false);
                             continue;
+                        case PM3_EMALLOC :
+                            PrintAndLogEx(ERR, "error: not enough memory to intersect the key candidates.\n");
+                            free(e_sector);
+                            return PM3_EMALLOC;
 
                         default :
                             PrintAndLogEx(ERR, "unknown Error.\n");
@@ -1386,7 +1432,7 @@ jumptoend:
         // transfer them to the emulator
         if (transferToEml) {
             // fast push mode
-            conn.block_after_ACK = true;
+            GetConn()->block_after_ACK = true;
             for (int i = 0; i < SectorsCnt; i++) {
                 mfEmlGetMem(keyBlock, FirstBlockOfSector(i) + NumBlocksPerSector(i) - 1, 1);
 
@@ -1398,7 +1444,7 @@ jumptoend:
 
                 if (i == SectorsCnt - 1) {
                     // Disable fast mode on last packet
-                    conn.block_after_ACK = false;
+                    GetConn()->block_after_ACK = false;
                 }
                 mfEmlSetMem(keyBlock, FirstBlockOfSector(i) + NumBlocksPerSector(i) - 1, 1);
             }
@@ -1462,6 +1508,7 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
     bool nonce_file_read = false;
     bool nonce_file_write = false;
     bool slow = false;
+    bool bitflip_cache = false;
     int tests = 0;
 
     switch (tolower(param_getchar(Cmd, cmdp))) {
@@ -1480,6 +1527,8 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
             }
             cmdp++;
             break;
+        case 'b':
+            return brute_force_benchmark_all();
         case 't':
             tests = param_get32ex(Cmd, cmdp + 1, 100, 10);
             if (!param_gethex(Cmd, cmdp + 2, trgkey, 12)) {
@@ -1536,6 +1585,9 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
             case 's':
                 slow = true;
                 break;
+            case 'c':
+                bitflip_cache = true;
+                break;
             case 'w':
                 nonce_file_write = true;
                 fptr = GenerateFilename("hf-mf-", "-nonces.bin");
@@ -1608,6 +1660,7 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
                   tests);
 
     uint64_t foundkey = 0;
+    SetBitflipCache(bitflip_cache);
     int16_t isOK = mfnestedhard(blockNo, keyType, key, trgBlockNo, trgKeyType, know_target_key ? trgkey : NULL, nonce_file_read, nonce_file_write, slow, tests, &foundkey, filename);
 
     DropField();
@@ -1636,7 +1689,7 @@ static int CmdHF14AMfAutoPWN(const char *Cmd) {
     bool calibrate = true;
     // Attack key storage variables
     uint8_t *keyBlock = NULL;
-    uint16_t key_cnt = 0;
+    uint32_t key_cnt = 0;
     sector_t *e_sector;
     uint8_t sectors_cnt = MIFARE_1K_MAXSECTOR;
     int block_cnt = MIFARE_1K_MAXBLOCK;
@@ -1659,11 +1712,16 @@ static int CmdHF14AMfAutoPWN(const char *Cmd) {
     char *fnameptr = filename;
     // Settings
     bool slow = false;
+    bool bitflip_cache = false;
     bool legacy_mfchk = false;
     bool prng_type = false;
     bool verbose = false;
     bool has_filename = false;
 	bool errors = false;
+    // Card type for the key statistics
+    bool keystats = false;
+    iso14a_card_select_t card;
+    memset(&card, 0, sizeof(card));
 
     // Parse the options given by the user
     while ( (ctmp = param_getchar(Cmd, cmdp)) && !errors ) {
@@ -1687,6 +1745,10 @@ static int CmdHF14AMfAutoPWN(const char *Cmd) {
                 verbose = true;
 				cmdp++;
                 break;
+            case 'r':
+                keystats = true;
+                cmdp++;
+                break;
             case '*':
                 // Get the number of sectors
                 sectors_cnt = NumOfSectors(param_getchar(Cmd, cmdp + 1));
@@ -1726,6 +1788,10 @@ static int CmdHF14AMfAutoPWN(const char *Cmd) {
                 slow = true;
 				cmdp++;
                 break;
+            case 'c':
+                bitflip_cache = true;
+                cmdp++;
+                break;
             case 'i':
                 SetSIMDInstr(SIMD_AUTO);
                 ctmp = tolower(param_getchar(Cmd, cmdp + 1));
@@ -1777,7 +1843,8 @@ static int CmdHF14AMfAutoPWN(const char *Cmd) {
     }
 
     // card prng type (weak=true / hard=false)
-    prng_type = detect_classic_prng();
+    prng_type = detect_classic_prng_ex(&card);
+    bool has_cardtype = keystats && card.uidlen != 0;
 
     // print parameters
     if (verbose) {
@@ -1908,6 +1975,9 @@ static int CmdHF14AMfAutoPWN(const char *Cmd) {
         fflush(stdout);
     } else {
 
+        if (has_cardtype)
+            OrderKeysByStats(card.atqa, card.sak, keyBlock, key_cnt);
+
         int chunksize = key_cnt > (PM3_CMD_DATA_SIZE / 6) ? (PM3_CMD_DATA_SIZE / 6) : key_cnt;
         bool firstChunk = true, lastChunk = false;
 
@@ -1944,6 +2014,9 @@ static int CmdHF14AMfAutoPWN(const char *Cmd) {
     if (verbose) PrintAndLogEx(INFO, _YELLOW_("======================= STOP  DICTIONARY ATTACK ======================="));
 
 
+    if (has_cardtype)
+        mf_keystats_update(card.atqa, card.sak, e_sector, sectors_cnt);
+
     // Analyse the dictionary attack
     for (int i = 0; i < sectors_cnt; i++) {
         for (int j = 0; j < 2; j++) {
@@ -2114,7 +2187,7 @@ skipReadBKey:
                                           current_key_type_i ? 'B' : 'A');
                         }
 tryNested:
-                        isOK = mfnested(FirstBlockOfSector(blockNo), keyType, key, FirstBlockOfSector(current_sector_i), current_key_type_i, tmp_key, calibrate);
+                        isOK = mfnested(FirstBlockOfSector(blockNo), keyType, key, FirstBlockOfSector(current_sector_i), current_key_type_i, tmp_key, calibrate, false);
                         switch (isOK) {
                             case -1 :
                                 PrintAndLogEx(ERR, "\nError: No response from Proxmark3.");
@@ -2145,6 +2218,10 @@ tryNested:
                                 e_sector[current_sector_i].Key[current_key_type_i] = bytes_to_num(tmp_key, 6);
                                 e_sector[current_sector_i].foundKey[current_key_type_i] = 'N';
                                 break;
+                            case PM3_EMALLOC :
+                                PrintAndLogEx(ERR, "\nError: not enough memory to intersect the key candidates.");
+                                free(e_sector);
+                                return PM3_EMALLOC;
                             default :
                                 PrintAndLogEx(ERR, "unknown Error.\n");
                                 free(e_sector);
@@ -2161,6 +2238,7 @@ tryHardnested: // If the nested attack fails then we try the hardnested attack
                                           slow ? "Yes" : "No");
                         }
 
+                        SetBitflipCache(bitflip_cache);
                         isOK = mfnestedhard(FirstBlockOfSector(blockNo), keyType, key, FirstBlockOfSector(current_sector_i), current_key_type_i, NULL, false, false, slow, 0, &foundkey, NULL);
                         DropField();
                         if (isOK) {
@@ -2324,17 +2402,17 @@ static int CmdHF14AMfChk_fast(const char *Cmd) {
     ctmp = tolower(param_getchar(Cmd, 0));
     if (strlen(Cmd) < 1 || ctmp == 'h') return usage_hf14_chk_fast();
 
-    FILE *f;
     char filename[FILE_PATH_SIZE] = {0};
-    char buf[13];
     char *fptr;
     uint8_t *keyBlock, *p;
     uint8_t sectorsCnt = 1;
     int i, keycnt = 0;
+    int sources = 0;     // keys on the command line and dictionaries
     int clen = 0;
     int transferToEml = 0, createDumpFile = 0;
     uint32_t keyitems = ARRAYLEN(g_mifare_default_keys);
     bool use_flashmemory = false;
+    bool keystats = false;
 
     sector_t *e_sector = NULL;
 
@@ -2385,10 +2463,12 @@ static int CmdHF14AMfChk_fast(const char *Cmd) {
             }
             PrintAndLogEx(NORMAL, "[%2d] key %s", keycnt, sprint_hex((keyBlock + 6 * keycnt), 6));
             keycnt++;
+            sources++;
         } else if (clen == 1) {
             if (ctmp == 't') { transferToEml = 1; continue; }
             if (ctmp == 'd') { createDumpFile = 1; continue; }
             if ((ctmp == 'm') && (IfPm3Flash())) { use_flashmemory = true; continue; }
+            if (ctmp == 'r') { keystats = true; continue; }
         } else {
             // May be a dic file
             if (param_getstr(Cmd, i, filename, FILE_PATH_SIZE) >= FILE_PATH_SIZE) {
@@ -2397,57 +2477,40 @@ static int CmdHF14AMfChk_fast(const char *Cmd) {
                 return PM3_EINVARG;
             }
 
-            char *dict_path;
-            int res = searchFile(&dict_path, DICTIONARIES_SUBDIR, filename, ".dic");
+            // a compiled dictionary is copied straight from its mapping
+            dictionary_keys_t dk;
+            int res = openFileDICTIONARY(filename, 6, &dk);
             if (res != PM3_SUCCESS) {
                 free(keyBlock);
                 return res;
             }
-            f = fopen(dict_path, "r");
-            if (!f) {
-                PrintAndLogEx(FAILED, "File: " _YELLOW_("%s") ": not found or locked.", dict_path);
-                free(dict_path);
-                free(keyBlock);
-                return PM3_EFILE;
-            }
-            free(dict_path);
-
-            // read file
-            while (fgets(buf, sizeof(buf), f)) {
-                if (strlen(buf) < 12 || buf[11] == '\n')
-                    continue;
-
-                while (fgetc(f) != '\n' && !feof(f)) ;  //goto next line
-
-                if (buf[0] == '#') continue; //The line start with # is comment, skip
-
-                if (!isxdigit(buf[0])) {
-                    PrintAndLogEx(FAILED, "File content error. '" _YELLOW_("%s")"' must include 12 HEX symbols", buf);
-                    continue;
-                }
 
-                buf[12] = 0;
-                if (keyitems - keycnt < 2) {
-                    p = realloc(keyBlock, 6 * (keyitems += 64));
-                    if (!p) {
-                        PrintAndLogEx(FAILED, "Cannot allocate memory for default keys");
-                        free(keyBlock);
-                        fclose(f);
-                        return PM3_EMALLOC;
-                    }
-                    keyBlock = p;
+            if (keyitems - keycnt < dk.keycnt + 2) {
+                p = realloc(keyBlock, 6 * (keyitems = keycnt + dk.keycnt + 64));
+                if (!p) {
+                    PrintAndLogEx(FAILED, "Cannot allocate memory for Keys");
+                    closeFileDICTIONARY(&dk);
+                    free(keyBlock);
+                    return PM3_EMALLOC;
                 }
-                int pos = 6 * keycnt;
-                memset(keyBlock + pos, 0, 6);
-                num_to_bytes(strtoll(buf, NULL, 16), 6, keyBlock + pos);
-                keycnt++;
-                memset(buf, 0, sizeof(buf));
+                keyBlock = p;
             }
-            fclose(f);
-            PrintAndLogEx(SUCCESS, "Loaded %2d keys from " _YELLOW_("%s"), keycnt, filename);
+            memcpy(keyBlock + 6 * keycnt, dk.keys, 6 * dk.keycnt);
+            keycnt += dk.keycnt;
+            closeFileDICTIONARY(&dk);
+            sources++;
         }
     }
 
+    // the same key from several dictionaries or the command line is only tried once,
+    // a single dictionary is deduplicated already
+    if (sources > 1) {
+        int unique = dictionary_dedupe(keyBlock, keycnt, 6);
+        if (unique != keycnt)
+            PrintAndLogEx(INFO, "skipped " _YELLOW_("%d") " duplicate keys", keycnt - unique);
+        keycnt = unique;
+    }
+
     if (keycnt == 0 && !use_flashmemory) {
         PrintAndLogEx(SUCCESS, "No key specified, trying default keys");
         for (; keycnt < ARRAYLEN(g_mifare_default_keys); keycnt++)
@@ -2456,6 +2519,16 @@ static int CmdHF14AMfChk_fast(const char *Cmd) {
                           (keyBlock + 6 * keycnt)[3], (keyBlock + 6 * keycnt)[4], (keyBlock + 6 * keycnt)[5]);
     }
 
+    uint8_t atqa[2] = {0};
+    uint8_t sak = 0;
+    bool has_cardtype = false;
+    if (keystats) {
+        has_cardtype = GetHFMF14ACardType(atqa, &sak);
+        // the flash dictionary is read on the device, only record its hits
+        if (has_cardtype && use_flashmemory == false)
+            OrderKeysByStats(atqa, sak, keyBlock, keycnt);
+    }
+
     // // initialize storage for found keys
     e_sector = calloc(sectorsCnt, sizeof(sector_t));
     if (e_sector == NULL) {
@@ -2526,6 +2599,9 @@ out:
 
         printKeyTable(sectorsCnt, e_sector);
 
+        if (has_cardtype)
+            mf_keystats_update(atqa, sak, e_sector, sectorsCnt);
+
 		if ( use_flashmemory && found_keys == (sectorsCnt << 1) ) {
 			PrintAndLogEx(SUCCESS, "Card dumped aswell. run " _YELLOW_("`%s %c`"),
 			"hf mf esave",
@@ -2535,7 +2611,7 @@ out:
 
         if (transferToEml) {
             // fast push mode
-            conn.block_after_ACK = true;
+            GetConn()->block_after_ACK = true;
             uint8_t block[16] = {0x00};
             for (i = 0; i < sectorsCnt; ++i) {
                 uint8_t blockno = FirstBlockOfSector(i) + NumBlocksPerSector(i) - 1;
@@ -2546,7 +2622,7 @@ out:
                     num_to_bytes(e_sector[i].Key[1], 6, block + 10);
                 if (i == sectorsCnt - 1) {
                     // Disable fast mode on last packet
-                    conn.block_after_ACK = false;
+                    GetConn()->block_after_ACK = false;
                 }
                 mfEmlSetMem(block, blockno, 1);
             }
@@ -2574,9 +2650,7 @@ static int CmdHF14AMfChk(const char *Cmd) {
     char ctmp = tolower(param_getchar(Cmd, 0));
     if (strlen(Cmd) < 3 || ctmp == 'h') return usage_hf14_chk();
 
-    FILE *f;
     char filename[FILE_PATH_SIZE] = {0};
-    char buf[13];
     uint8_t *keyBlock, *p;
     sector_t *e_sector = NULL;
 
@@ -2590,6 +2664,7 @@ static int CmdHF14AMfChk(const char *Cmd) {
     int transferToEml = 0;
     int createDumpFile = 0;
     int i, keycnt = 0;
+    int sources = 0;     // keys on the command line and dictionaries
 
     keyBlock = calloc(ARRAYLEN(g_mifare_default_keys), 6);
     if (keyBlock == NULL) return PM3_EMALLOC;
@@ -2648,6 +2723,7 @@ static int CmdHF14AMfChk(const char *Cmd) {
             }
             PrintAndLogEx(NORMAL, "[%2d] key %s", keycnt, sprint_hex((keyBlock + 6 * keycnt), 6));;
             keycnt++;
+            sources++;
         } else if (clen == 1) {
             if (ctmp == 't') { transferToEml = 1; continue; }
             if (ctmp == 'd') { createDumpFile = 1; continue; }
@@ -2659,59 +2735,40 @@ static int CmdHF14AMfChk(const char *Cmd) {
                 return PM3_EINVARG;
             }
 
-            char *dict_path;
-            int res = searchFile(&dict_path, DICTIONARIES_SUBDIR, filename, ".dic");
+            // a compiled dictionary is copied straight from its mapping
+            dictionary_keys_t dk;
+            int res = openFileDICTIONARY(filename, 6, &dk);
             if (res != PM3_SUCCESS) {
                 free(keyBlock);
-                return PM3_EFILE;
-            }
-            f = fopen(dict_path, "r");
-            if (!f) {
-                PrintAndLogEx(FAILED, "File: " _YELLOW_("%s") ": not found or locked.", dict_path);
-                free(dict_path);
-                free(keyBlock);
-                return PM3_EFILE;
+                return res;
             }
-            free(dict_path);
 
-            // load keys from dictionary file
-            while (fgets(buf, sizeof(buf), f)) {
-                if (strlen(buf) < 12 || buf[11] == '\n')
-                    continue;
-
-                while (fgetc(f) != '\n' && !feof(f)) ;  //goto next line
-
-                if (buf[0] == '#') continue; //The line start with # is comment, skip
-
-                // codesmell, only checks first char?
-                if (!isxdigit(buf[0])) {
-                    PrintAndLogEx(FAILED, "File content error. '" _YELLOW_("%s")"' must include 12 HEX symbols", buf);
-                    continue;
-                }
-
-                buf[12] = 0;
-
-                if (keyitems - keycnt < 2) {
-                    p = realloc(keyBlock, 6 * (keyitems += 64));
-                    if (!p) {
-                        PrintAndLogEx(FAILED, "Cannot allocate memory for defKeys");
-                        free(keyBlock);
-                        fclose(f);
-                        return PM3_EMALLOC;
-                    }
-                    keyBlock = p;
+            if (keyitems - keycnt < dk.keycnt + 2) {
+                p = realloc(keyBlock, 6 * (keyitems = keycnt + dk.keycnt + 64));
+                if (!p) {
+                    PrintAndLogEx(FAILED, "Cannot allocate memory for Keys");
+                    closeFileDICTIONARY(&dk);
+                    free(keyBlock);
+                    return PM3_EMALLOC;
                 }
-                memset(keyBlock + 6 * keycnt, 0, 6);
-                num_to_bytes(strtoll(buf, NULL, 16), 6, keyBlock + 6 * keycnt);
-                //PrintAndLogEx(NORMAL, "check key[%2d] %012" PRIx64, keycnt, bytes_to_num(keyBlock + 6*keycnt, 6));
-                keycnt++;
-                memset(buf, 0, sizeof(buf));
+                keyBlock = p;
             }
-            fclose(f);
-            PrintAndLogEx(SUCCESS, "Loaded %2d keys from " _YELLOW_("%s"), keycnt, filename);
+            memcpy(keyBlock + 6 * keycnt, dk.keys, 6 * dk.keycnt);
+            keycnt += dk.keycnt;
+            closeFileDICTIONARY(&dk);
+            sources++;
         }
     }
 
+    // the same key from several dictionaries or the command line is only tried once,
+    // a single dictionary is deduplicated already
+    if (sources > 1) {
+        int unique = dictionary_dedupe(keyBlock, keycnt, 6);
+        if (unique != keycnt)
+            PrintAndLogEx(INFO, "skipped " _YELLOW_("%d") " duplicate keys", keycnt - unique);
+        keycnt = unique;
+    }
+
     if (keycnt == 0) {
         PrintAndLogEx(INFO, "No key specified, trying default keys");
         for (; keycnt < ARRAYLEN(g_mifare_default_keys); keycnt++)
@@ -2737,13 +2794,12 @@ static int CmdHF14AMfChk(const char *Cmd) {
 
 
     uint8_t trgKeyType = 0;
-    uint16_t max_keys = keycnt > KEYS_IN_BLOCK ? KEYS_IN_BLOCK : keycnt;
 
     // time
     uint64_t t1 = msclock();
 
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
 
     // clear trace log by first check keys call only
     bool clearLog = true;
@@ -2756,25 +2812,18 @@ static int CmdHF14AMfChk(const char *Cmd) {
             // skip already found keys.
             if (e_sector[i].foundKey[trgKeyType]) continue;
 
-            for (uint16_t c = 0; c < keycnt; c += max_keys) {
-
-                printf(".");
-                fflush(stdout);
-                if (kbd_enter_pressed()) {
-                    PrintAndLogEx(INFO, "\naborted via keyboard!\n");
-                    goto out;
-                }
-
-                uint16_t size = keycnt - c > max_keys ? max_keys : keycnt - c;
+            printf(".");
+            fflush(stdout);
+            if (kbd_enter_pressed()) {
+                PrintAndLogEx(INFO, "\naborted via keyboard!\n");
+                goto out;
+            }
 
-                if (mfCheckKeys(b, trgKeyType, clearLog, size, &keyBlock[6 * c], &key64) == PM3_SUCCESS) {
-                    e_sector[i].Key[trgKeyType] = key64;
-                    e_sector[i].foundKey[trgKeyType] = true;
-                    clearLog = false;
-                    break;
-                }
-                clearLog = false;
+            if (mfCheckKeysList(b, trgKeyType, clearLog, keycnt, keyBlock, &key64) == PM3_SUCCESS) {
+                e_sector[i].Key[trgKeyType] = key64;
+                e_sector[i].foundKey[trgKeyType] = true;
             }
+            clearLog = false;
             b < 127 ? (b += 4) : (b += 16);
         }
     }
@@ -2824,7 +2873,7 @@ out:
 
     if (transferToEml) {
         // fast push mode
-        conn.block_after_ACK = true;
+        GetConn()->block_after_ACK = true;
         uint8_t block[16] = {0x00};
         for (i = 0; i < SectorsCnt; ++i) {
             uint8_t blockno = FirstBlockOfSector(i) + NumBlocksPerSector(i) - 1;
@@ -2835,7 +2884,7 @@ out:
                 num_to_bytes(e_sector[i].Key[1], 6, block + 10);
             if (i == SectorsCnt - 1) {
                 // Disable fast mode on last packet
-                conn.block_after_ACK = false;
+                GetConn()->block_after_ACK = false;
             }
             mfEmlSetMem(block, blockno, 1);
         }
@@ -2843,7 +2892,7 @@ out:
     }
 
     // Disable fast mode and send a dummy command to make it effective
-    conn.block_after_ACK = false;
+    GetConn()->block_after_ACK = false;
     SendCommandNG(CMD_PING, NULL, 0);
     WaitForResponseTimeout(CMD_PING, NULL, 1000);
 
@@ -2894,6 +2943,22 @@ void readerAttack(nonces_t data, bool setEmulatorMem, bool verbose) {
         emptySectorTable();
 
     success = mfkey32_moebius(data, &key);
+
+    // same line format as tools/mfkey, so logs can be fed to mfkey_batch
+    if (verbose || success == false) {
+        PrintAndLogEx(INFO, "mfkey32v2 %02d:%c %08x %08x %08x %08x %08x %08x %08x"
+                      , data.sector
+                      , data.keytype ? 'B' : 'A'
+                      , data.cuid
+                      , data.nonce
+                      , data.nr
+                      , data.ar
+                      , data.nonce2
+                      , data.nr2
+                      , data.ar2
+                     );
+    }
+
     if (success) {
         uint8_t sector = data.sector;
         uint8_t keytype = data.keytype;
@@ -3416,12 +3481,12 @@ int CmdHF14AMfELoad(const char *Cmd) {
     PrintAndLogEx(INFO, "Copying to emulator memory");
 
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
     blockNum = 0;
     while (datalen) {
         if (datalen == blockWidth) {
             // Disable fast mode on last packet
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
         }
 
         if (mfEmlSetMem_xt(data + counter, blockNum, 1, blockWidth) != PM3_SUCCESS) {
@@ -3933,11 +3998,11 @@ static int CmdHF14AMfCSave(const char *Cmd) {
     if (fillEmulator) {
         PrintAndLogEx(INFO, "uploading to emulator memory");
         // fast push mode
-        conn.block_after_ACK = true;
+        GetConn()->block_after_ACK = true;
         for (i = 0; i < numblocks; i += 5) {
             if (i == numblocks - 1) {
                 // Disable fast mode on last packet
-                conn.block_after_ACK = false;
+                GetConn()->block_after_ACK = false;
             }
             if (mfEmlSetMem(dump + (i * MFBLOCK_SIZE), i, 5) != PM3_SUCCESS) {
                 PrintAndLogEx(WARNING, "Cant set emul block: %d", i);
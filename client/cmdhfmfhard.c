@@ -37,6 +37,13 @@
 #include "hardnested/hardnested_bitarray_core.h"
 #include "zlib.h"
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #define NUM_CHECK_BITFLIPS_THREADS      (num_CPUs())
 #define NUM_REDUCTION_WORKING_THREADS   (num_CPUs())
 
@@ -191,6 +198,8 @@ static inline uint32_t next_state(uint32_t *bitarray, uint32_t state) {
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // bitflip property bitarrays
 
+#define BITFLIP_BITARRAY_SIZE           (sizeof(uint32_t) * (1 << 19))
+
 static uint32_t *bitflip_bitarrays[2][0x400];
 static uint32_t count_bitflip_bitarrays[2][0x400];
 
@@ -231,6 +240,188 @@ static void init_inflate(z_streamp compressed_stream, uint8_t *input_buffer, uin
 }
 
 
+static void get_state_file_path(char *state_files_path, odd_even_t odd_even, uint16_t bitflip) {
+    char state_file_name[strlen(STATE_FILE_TEMPLATE) + 1];
+    sprintf(state_file_name, STATE_FILE_TEMPLATE, odd_even, bitflip);
+    strcpy(state_files_path, get_my_executable_directory());
+    strcat(state_files_path, STATE_FILES_DIRECTORY);
+    strcat(state_files_path, state_file_name);
+}
+
+
+// off unless asked for with SetBitflipCache(), see below
+static bool use_bitflip_cache = false;
+
+void SetBitflipCache(bool enable) {
+    use_bitflip_cache = enable;
+}
+
+#ifndef _WIN32
+//----------------------------------------------------------------------------
+// Uncompressed bitflip table cache, opt-in (hf mf hardnested / autopwn option c).
+// The first run writes all effective bitarrays into ~/.proxmark3/BITFLIP_CACHE_FILE,
+// about 480 MB (237 tables of 2 MB). Subsequent runs mmap() it read-only instead of
+// inflating every table again, and concurrent clients share the same page cache.
+// Delete the file to reclaim the space, it is rebuilt when the tables change.
+//----------------------------------------------------------------------------
+#define BITFLIP_CACHE_FILE              "hardnested_bitflips.cache"
+#define BITFLIP_CACHE_MAGIC             0x43424d50  // "PMBC"
+#define BITFLIP_CACHE_VERSION           1
+#define BITFLIP_CACHE_ALIGN             4096
+
+typedef struct {
+    uint16_t odd_even;
+    uint16_t bitflip;
+    uint32_t count;
+    uint64_t offset;
+} bitflip_cache_entry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t bitarray_size;
+    uint32_t num_entries;
+    uint64_t tables_signature;
+    bitflip_cache_entry_t entries[2 * 0x400];
+} bitflip_cache_header_t;
+
+static void *bitflip_cache_map = NULL;
+static size_t bitflip_cache_map_size = 0;
+
+// FNV-1a over size and mtime of all table files, so that a changed table set invalidates the cache
+static uint64_t bitflip_tables_signature(void) {
+    char state_files_path[strlen(get_my_executable_directory()) + strlen(STATE_FILES_DIRECTORY) + strlen(STATE_FILE_TEMPLATE) + 1];
+    uint64_t signature = 0xcbf29ce484222325ULL;
+    for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+        for (uint16_t bitflip = 0x001; bitflip < 0x400; bitflip++) {
+            get_state_file_path(state_files_path, odd_even, bitflip);
+            struct stat st;
+            if (stat(state_files_path, &st) != 0) {
+                continue;
+            }
+            uint64_t item[3] = {(uint64_t)odd_even << 16 | bitflip, (uint64_t)st.st_size, (uint64_t)st.st_mtime};
+            for (size_t k = 0; k < sizeof(item); k++) {
+                signature ^= ((uint8_t *)item)[k];
+                signature *= 0x100000001b3ULL;
+            }
+        }
+    }
+    signature ^= (uint64_t)(IGNORE_BITFLIP_THRESHOLD * 1000000);
+    return signature;
+}
+
+
+static bool load_bitflip_cache(uint64_t signature) {
+    char *path = NULL;
+    if (searchHomeFilePath(&path, BITFLIP_CACHE_FILE, false) != PM3_SUCCESS) {
+        return false;
+    }
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(bitflip_cache_header_t)) {
+        close(fd);
+        return false;
+    }
+    size_t map_size = (size_t)st.st_size;
+    void *map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    const bitflip_cache_header_t *header = (const bitflip_cache_header_t *)map;
+    if (header->magic != BITFLIP_CACHE_MAGIC
+            || header->version != BITFLIP_CACHE_VERSION
+            || header->bitarray_size != BITFLIP_BITARRAY_SIZE
+            || header->tables_signature != signature
+            || header->num_entries > 2 * 0x400) {
+        munmap(map, map_size);
+        return false;
+    }
+
+    // entries must be sorted (even before odd, ascending bitflip) and lie completely within the file
+    uint32_t prev_key = 0;
+    for (uint32_t i = 0; i < header->num_entries; i++) {
+        const bitflip_cache_entry_t *e = &header->entries[i];
+        uint32_t key = (uint32_t)e->odd_even << 16 | e->bitflip;
+        if (e->odd_even > ODD_STATE || e->bitflip == 0 || e->bitflip >= 0x400 || key <= prev_key
+                || e->offset % BITFLIP_CACHE_ALIGN != 0 || e->offset + BITFLIP_BITARRAY_SIZE > map_size) {
+            munmap(map, map_size);
+            return false;
+        }
+        prev_key = key;
+    }
+
+    for (uint32_t i = 0; i < header->num_entries; i++) {
+        const bitflip_cache_entry_t *e = &header->entries[i];
+        effective_bitflip[e->odd_even][num_effective_bitflips[e->odd_even]++] = e->bitflip;
+        bitflip_bitarrays[e->odd_even][e->bitflip] = (uint32_t *)((uint8_t *)map + e->offset);
+        count_bitflip_bitarrays[e->odd_even][e->bitflip] = e->count;
+    }
+    bitflip_cache_map = map;
+    bitflip_cache_map_size = map_size;
+    return true;
+}
+
+
+static void save_bitflip_cache(uint64_t signature) {
+    bitflip_cache_header_t *header = calloc(1, sizeof(bitflip_cache_header_t));
+    if (header == NULL) {
+        return;
+    }
+    header->magic = BITFLIP_CACHE_MAGIC;
+    header->version = BITFLIP_CACHE_VERSION;
+    header->bitarray_size = BITFLIP_BITARRAY_SIZE;
+    header->tables_signature = signature;
+    uint64_t data_start = (sizeof(bitflip_cache_header_t) + BITFLIP_CACHE_ALIGN - 1) / BITFLIP_CACHE_ALIGN * BITFLIP_CACHE_ALIGN;
+    uint64_t offset = data_start;
+    for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+        for (uint16_t i = 0; i < num_effective_bitflips[odd_even]; i++) {
+            uint16_t bitflip = effective_bitflip[odd_even][i];
+            bitflip_cache_entry_t *e = &header->entries[header->num_entries++];
+            e->odd_even = odd_even;
+            e->bitflip = bitflip;
+            e->count = count_bitflip_bitarrays[odd_even][bitflip];
+            e->offset = offset;
+            offset += BITFLIP_BITARRAY_SIZE;
+        }
+    }
+
+    char *path = NULL;
+    if (searchHomeFilePath(&path, BITFLIP_CACHE_FILE, true) != PM3_SUCCESS) {
+        free(header);
+        return;
+    }
+    // write to a private temp file and rename it into place, so concurrent clients never see a partial cache
+    char tmp_path[strlen(path) + 16];
+    sprintf(tmp_path, "%s.%d", path, (int)getpid());
+    FILE *cachefile = fopen(tmp_path, "wb");
+    if (cachefile == NULL) {
+        free(path);
+        free(header);
+        return;
+    }
+    static const uint8_t padding[BITFLIP_CACHE_ALIGN] = {0};
+    bool ok = fwrite(header, sizeof(bitflip_cache_header_t), 1, cachefile) == 1
+              && fwrite(padding, data_start - sizeof(bitflip_cache_header_t), 1, cachefile) == 1;
+    for (uint32_t i = 0; ok && i < header->num_entries; i++) {
+        const bitflip_cache_entry_t *e = &header->entries[i];
+        ok = fwrite(bitflip_bitarrays[e->odd_even][e->bitflip], BITFLIP_BITARRAY_SIZE, 1, cachefile) == 1;
+    }
+    ok = (fclose(cachefile) == 0) && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+    }
+    free(path);
+    free(header);
+}
+#endif
+
+
 static void init_bitflip_bitarrays(void) {
 #if defined (DEBUG_REDUCTION)
     uint8_t line = 0;
@@ -247,10 +438,20 @@ static void init_bitflip_bitarrays(void) {
         for (uint16_t bitflip = 0x001; bitflip < 0x400; bitflip++) {
             bitflip_bitarrays[odd_even][bitflip] = NULL;
             count_bitflip_bitarrays[odd_even][bitflip] = 1 << 24;
+        }
+    }
+
+#ifndef _WIN32
+    uint64_t signature = use_bitflip_cache ? bitflip_tables_signature() : 0;
+    bool cached = use_bitflip_cache && load_bitflip_cache(signature);
+#else
+    bool cached = false;
+#endif
+
+    for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE && !cached; odd_even++) {
+        for (uint16_t bitflip = 0x001; bitflip < 0x400; bitflip++) {
             sprintf(state_file_name, STATE_FILE_TEMPLATE, odd_even, bitflip);
-            strcpy(state_files_path, get_my_executable_directory());
-            strcat(state_files_path, STATE_FILES_DIRECTORY);
-            strcat(state_files_path, state_file_name);
+            get_state_file_path(state_files_path, odd_even, bitflip);
             FILE *statesfile = fopen(state_files_path, "rb");
             if (statesfile == NULL) {
                 continue;
@@ -277,14 +478,14 @@ static void init_bitflip_bitarrays(void) {
                 init_inflate(&compressed_stream, input_buffer, filesize, (uint8_t *)&count, sizeof(count));
                 inflate(&compressed_stream, Z_SYNC_FLUSH);
                 if ((float)count / (1 << 24) < IGNORE_BITFLIP_THRESHOLD) {
-                    uint32_t *bitset = (uint32_t *)malloc_bitarray(sizeof(uint32_t) * (1 << 19));
+                    uint32_t *bitset = (uint32_t *)malloc_bitarray(BITFLIP_BITARRAY_SIZE);
                     if (bitset == NULL) {
                         PrintAndLogEx(ERR, "Out of memory error in init_bitflip_statelists(). Aborting...\n");
                         inflateEnd(&compressed_stream);
                         exit(4);
                     }
                     compressed_stream.next_out = (uint8_t *)bitset;
-                    compressed_stream.avail_out = sizeof(uint32_t) * (1 << 19);
+                    compressed_stream.avail_out = BITFLIP_BITARRAY_SIZE;
                     inflate(&compressed_stream, Z_SYNC_FLUSH);
                     effective_bitflip[odd_even][num_effective_bitflips[odd_even]++] = bitflip;
                     bitflip_bitarrays[odd_even][bitflip] = bitset;
@@ -301,6 +502,16 @@ static void init_bitflip_bitarrays(void) {
                 inflateEnd(&compressed_stream);
             }
         }
+    }
+
+#ifndef _WIN32
+    if (use_bitflip_cache && !cached) {
+        PrintAndLogEx(INFO, "Writing the bitflip table cache " _YELLOW_("~/.proxmark3/" BITFLIP_CACHE_FILE) " (about 480 MB)");
+        save_bitflip_cache(signature);
+    }
+#endif
+
+    for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
         effective_bitflip[odd_even][num_effective_bitflips[odd_even]] = 0x400; // EndOfList marker
     }
 
@@ -345,6 +556,13 @@ static void init_bitflip_bitarrays(void) {
 
 
 static void free_bitflip_bitarrays(void) {
+#ifndef _WIN32
+    if (bitflip_cache_map != NULL) {
+        munmap(bitflip_cache_map, bitflip_cache_map_size);
+        bitflip_cache_map = NULL;
+        return;
+    }
+#endif
     for (int16_t bitflip = 0x3ff; bitflip > 0x000; bitflip--) {
         free_bitarray(bitflip_bitarrays[ODD_STATE][bitflip]);
     }
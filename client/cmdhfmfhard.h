@@ -41,6 +41,8 @@ typedef struct noncelist {
 } noncelist_t;
 
 int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *trgkey, bool nonce_file_read, bool nonce_file_write, bool slow, int tests, uint64_t *foundkey, char *filename);
+// use the uncompressed bitflip table cache in ~/.proxmark3 (about 480 MB, built on first use)
+void SetBitflipCache(bool enable);
 void hardnested_print_progress(uint32_t nonces, const char *activity, float brute_force, uint64_t min_diff_print_time);
 
 #endif
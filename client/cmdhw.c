@@ -13,6 +13,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <inttypes.h>
+#include <jansson.h>
+#include <pthread.h>
 
 #include "cmdparser.h"    // command_t
 #include "comms.h"
@@ -20,6 +23,9 @@
 #include "ui.h"
 #include "cmdhw.h"
 #include "cmddata.h"
+#include "cmdmain.h"      // CommandReceived
+#include "util.h"          // kbd_share_enter
+#include "util_posix.h"   // msclock
 
 static int CmdHelp(const char *Cmd);
 
@@ -82,6 +88,85 @@ static int usage_hw_connect(void) {
     return PM3_SUCCESS;
 }
 
+static int usage_hw_attach(void) {
+    PrintAndLogEx(NORMAL, "Connects to one more Proxmark3 device and selects it, the other devices stay connected");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Usage:  hw attach [h] p <port> [b <baudrate>]");
+    PrintAndLogEx(NORMAL, "Options:");
+    PrintAndLogEx(NORMAL, "       h              This help");
+    PrintAndLogEx(NORMAL, "       p <port>       Serial port to connect to");
+    PrintAndLogEx(NORMAL, "       b <baudrate>   Baudrate");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Examples:");
+    PrintAndLogEx(NORMAL, "      hw attach p "SERIAL_PORT_EXAMPLE_H);
+    return PM3_SUCCESS;
+}
+
+static int usage_hw_detach(void) {
+    PrintAndLogEx(NORMAL, "Disconnects a Proxmark3 device, see " _YELLOW_("hw devices"));
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Usage:  hw detach [h] [<index>]");
+    PrintAndLogEx(NORMAL, "Options:");
+    PrintAndLogEx(NORMAL, "       h              This help");
+    PrintAndLogEx(NORMAL, "       <index>        Device to disconnect, else the selected one");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Examples:");
+    PrintAndLogEx(NORMAL, "      hw detach 1");
+    return PM3_SUCCESS;
+}
+
+static int usage_hw_select(void) {
+    PrintAndLogEx(NORMAL, "Selects the Proxmark3 device all following commands are sent to, see " _YELLOW_("hw devices"));
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Usage:  hw select [h] <index>");
+    PrintAndLogEx(NORMAL, "Options:");
+    PrintAndLogEx(NORMAL, "       h              This help");
+    PrintAndLogEx(NORMAL, "       <index>        Device to select");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Examples:");
+    PrintAndLogEx(NORMAL, "      hw select 1");
+    return PM3_SUCCESS;
+}
+
+static int usage_hw_fanout(void) {
+    PrintAndLogEx(NORMAL, "Runs a client command on every connected Proxmark3 device.");
+    PrintAndLogEx(NORMAL, "hw ping, hw status, hw version, hf mf fchk and lf search run on all devices at the same time, one thread per device.");
+    PrintAndLogEx(NORMAL, "Other commands share client state and run on one device after the other.");
+    PrintAndLogEx(NORMAL, "Commands changing the devices or their connection (hw connect, attach, detach, select, reset, ...) are refused.");
+    PrintAndLogEx(NORMAL, "Each device's output is printed once all are done, followed by a summary.");
+    PrintAndLogEx(NORMAL, "LF commands demodulate on a private graph per device, the plot is left alone.");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Usage:  hw fanout [h] <command>");
+    PrintAndLogEx(NORMAL, "Options:");
+    PrintAndLogEx(NORMAL, "       h              This help");
+    PrintAndLogEx(NORMAL, "       <command>      Command to run");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Examples:");
+    PrintAndLogEx(NORMAL, "      hw fanout hw version");
+    PrintAndLogEx(NORMAL, "      hw fanout hf 14a info");
+    PrintAndLogEx(NORMAL, "      hw fanout hf mf fchk 1");
+    PrintAndLogEx(NORMAL, "      hw fanout lf search");
+    return PM3_SUCCESS;
+}
+
+static int usage_hw_stats(void) {
+    PrintAndLogEx(NORMAL, "Shows statistics of the link to the selected Proxmark3 since it was connected or the last reset:");
+    PrintAndLogEx(NORMAL, "round-trip latencies per command id, throughput per direction, errors and queue depths");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Usage:  hw stats [h] [r] [j] [f <filename>]");
+    PrintAndLogEx(NORMAL, "Options:");
+    PrintAndLogEx(NORMAL, "       h              This help");
+    PrintAndLogEx(NORMAL, "       r              Reset the statistics afterwards");
+    PrintAndLogEx(NORMAL, "       j              Print as JSON instead of a table");
+    PrintAndLogEx(NORMAL, "       f <filename>   Save as JSON to file");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Examples:");
+    PrintAndLogEx(NORMAL, "      hw stats");
+    PrintAndLogEx(NORMAL, "      hw stats r");
+    PrintAndLogEx(NORMAL, "      hw stats f linkstats.json");
+    return PM3_SUCCESS;
+}
+
 static void lookupChipID(uint32_t iChipID, uint32_t mem_used) {
     char asBuff[120];
     memset(asBuff, 0, sizeof(asBuff));
@@ -564,42 +649,594 @@ static int CmdConnect(const char *Cmd) {
 
     // default back to previous used serial port
     if (strlen(port) == 0) {
-        if (strlen((char *)conn.serial_port_name) == 0) {
+        if (strlen((char *)GetConn()->serial_port_name) == 0) {
             return usage_hw_connect();
         }
-        memcpy(port, conn.serial_port_name, sizeof(port));
+        memcpy(port, GetConn()->serial_port_name, sizeof(port));
     }
 
     printf("Port:: %s  Baud:: %u\n", port, baudrate);
 
-    if (session.pm3_present) {
+    if (IsPm3Present()) {
         CloseProxmark();
     }
 
     // 10 second timeout
     OpenProxmark(port, false, 10, false, baudrate);
 
-    if (session.pm3_present && (TestProxmark() != PM3_SUCCESS)) {
+    if (IsPm3Present() && (TestProxmark() != PM3_SUCCESS)) {
         PrintAndLogEx(ERR, _RED_("ERROR:") "cannot communicate with the Proxmark3\n");
         CloseProxmark();
     }
     return PM3_SUCCESS;
 }
 
+// set while hw fanout runs its workers
+static bool fanout_running = false;
+
+static int CmdAttach(const char *Cmd) {
+
+    uint32_t baudrate = USART_BAUD_RATE;
+    uint8_t cmdp = 0;
+    char port[FILE_PATH_SIZE] = {0};
+
+    while (param_getchar(Cmd, cmdp) != 0x00) {
+        switch (tolower(param_getchar(Cmd, cmdp))) {
+            case 'h':
+                return usage_hw_attach();
+            case 'p': {
+                param_getstr(Cmd, cmdp + 1, port, sizeof(port));
+                cmdp += 2;
+                break;
+            }
+            case 'b':
+                baudrate = param_get32ex(Cmd, cmdp + 1, USART_BAUD_RATE, 10);
+                if (baudrate == 0)
+                    return usage_hw_attach();
+                cmdp += 2;
+                break;
+            default:
+                usage_hw_attach();
+                return PM3_EINVARG;
+        }
+    }
+
+    if (strlen(port) == 0)
+        return usage_hw_attach();
+
+    if (fanout_running) {
+        PrintAndLogEx(WARNING, "Devices can't be changed from hw fanout");
+        return PM3_EINVARG;
+    }
+
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        pm3_device_info_t info;
+        if (GetDeviceInfo(i, &info) && info.present && strcmp(info.port, port) == 0) {
+            PrintAndLogEx(WARNING, "Port " _YELLOW_("%s") " is already connected as device %d", port, i);
+            return PM3_EINVARG;
+        }
+    }
+
+    // reuse the selected slot if it isn't connected
+    int prev = GetSelectedDevice();
+    int idx = prev;
+    if (IsPm3Present()) {
+        idx = AddDevice();
+        if (idx < 0) {
+            PrintAndLogEx(WARNING, "Too many devices, max %d", MAX_DEVICES);
+            return PM3_EMALLOC;
+        }
+        SelectDevice(idx);
+    }
+
+    OpenProxmark(port, false, 10, false, baudrate);
+
+    if (IsPm3Present() && (TestProxmark() != PM3_SUCCESS)) {
+        PrintAndLogEx(ERR, _RED_("ERROR:") "cannot communicate with the Proxmark3\n");
+        CloseProxmark();
+    }
+
+    if (IsPm3Present() == false) {
+        if (idx != prev) {
+            RemoveDevice(idx);
+            SelectDevice(prev);
+        }
+        return PM3_ENOTTY;
+    }
+
+    PrintAndLogEx(SUCCESS, "Device " _YELLOW_("%d") " selected", idx);
+    return PM3_SUCCESS;
+}
+
+static int CmdDetach(const char *Cmd) {
+    char ctmp = tolower(param_getchar(Cmd, 0));
+    if (ctmp == 'h')
+        return usage_hw_detach();
+
+    if (fanout_running) {
+        PrintAndLogEx(WARNING, "Devices can't be changed from hw fanout");
+        return PM3_EINVARG;
+    }
+
+    int idx = GetSelectedDevice();
+    if (ctmp != 0x00)
+        idx = param_get32ex(Cmd, 0, MAX_DEVICES, 10);
+
+    if (RemoveDevice(idx) != PM3_SUCCESS) {
+        PrintAndLogEx(WARNING, "No device %d, see " _YELLOW_("hw devices"), idx);
+        return PM3_EINVARG;
+    }
+    PrintAndLogEx(SUCCESS, "Device %d detached, device " _YELLOW_("%d") " selected", idx, GetSelectedDevice());
+    return PM3_SUCCESS;
+}
+
+static int CmdDevices(const char *Cmd) {
+    (void)Cmd; // Cmd is not used so far
+
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "   # | state   | link     | port");
+    PrintAndLogEx(NORMAL, "-----+---------+----------+------------------------");
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        pm3_device_info_t info;
+        if (GetDeviceInfo(i, &info) == false)
+            continue;
+
+        const char *state = info.present ? (info.dead ? _RED_("dead   ") : _GREEN_("online ")) : "offline";
+        PrintAndLogEx(NORMAL, " %c %d | %s | %-8s | %s",
+                      info.selected ? '*' : ' ',
+                      i,
+                      state,
+                      info.present ? (info.via_fpc ? "FPC UART" : "USB-CDC") : "",
+                      info.port
+                     );
+    }
+    PrintAndLogEx(NORMAL, "");
+    return PM3_SUCCESS;
+}
+
+static int CmdSelect(const char *Cmd) {
+    char ctmp = tolower(param_getchar(Cmd, 0));
+    if (ctmp == 'h' || ctmp == 0x00)
+        return usage_hw_select();
+
+    if (fanout_running) {
+        PrintAndLogEx(WARNING, "Devices can't be changed from hw fanout");
+        return PM3_EINVARG;
+    }
+
+    int idx = param_get32ex(Cmd, 0, MAX_DEVICES, 10);
+    if (SelectDevice(idx) != PM3_SUCCESS) {
+        PrintAndLogEx(WARNING, "No device %d, see " _YELLOW_("hw devices"), idx);
+        return PM3_EINVARG;
+    }
+    PrintAndLogEx(SUCCESS, "Device " _YELLOW_("%d") " selected", idx);
+    return PM3_SUCCESS;
+}
+
+// output kept per device while hw fanout runs, the rest is dropped
+#define FANOUT_CAPTURE_SIZE (64 * 1024)
+// LF commands keep a few 100 kB of samples on the stack, more than some platforms give a thread
+#define FANOUT_STACK_SIZE (4 * 1024 * 1024)
+
+// Commands which only use their own device, LF workspace and output, hw fanout runs them
+// on all devices at once. Whole words only, abbreviated ones run one device after the other.
+// Shared files and the keyboard are serialised by keystats.c and kbd_enter_pressed.
+static const char *fanout_concurrent[] = {
+    "hw ping",
+    "hw status",
+    "hw version",
+    "hf mf fchk",
+    "lf search",
+    NULL
+};
+
+// Commands changing the devices or their connection, refused by hw fanout, abbreviated or not
+static const char *fanout_refused[] = {
+    "exit",
+    "quit",
+    "hw attach",
+    "hw connect",
+    "hw detach",
+    "hw fanout",
+    "hw reset",
+    "hw select",
+    "hw standalone",
+    NULL
+};
+
+// true if cmd starts with the words of pattern, with abbrev a word of cmd may be a prefix of the pattern one
+static bool fanout_match(const char *cmd, const char *pattern, bool abbrev) {
+    while (*pattern) {
+        while (*cmd == ' ')
+            cmd++;
+
+        size_t clen = strcspn(cmd, " ");
+        size_t plen = strcspn(pattern, " ");
+        if (clen == 0 || clen > plen || (clen < plen && abbrev == false))
+            return false;
+
+        for (size_t i = 0; i < clen; i++) {
+            if (tolower((uint8_t)cmd[i]) != pattern[i])
+                return false;
+        }
+
+        cmd += clen;
+        pattern += plen;
+        while (*pattern == ' ')
+            pattern++;
+    }
+    return true;
+}
+
+static bool fanout_listed(const char *cmd, const char **list, bool abbrev) {
+    for (int i = 0; list[i]; i++) {
+        if (fanout_match(cmd, list[i], abbrev))
+            return true;
+    }
+    return false;
+}
+
+typedef struct {
+    int idx;
+    char port[FILE_PATH_SIZE];
+    const char *cmd;
+    bool *aborted;
+    char *out;
+    int res;
+    uint64_t elapsed;
+} fanout_job_t;
+
+static void *fanout_worker(void *arg) {
+    fanout_job_t *job = (fanout_job_t *)arg;
+
+    // CommandReceived wants a writable copy, CmdFanout checked the length
+    char line[512] = {0};
+    strcpy(line, job->cmd);
+
+    lf_workspace_t *ws = CreateLFWorkspace();
+    if (ws == NULL) {
+        job->res = PM3_EMALLOC;
+        return NULL;
+    }
+
+    // talk to our device, demodulate on our own graph and keep the output for later
+    SetThreadDevice(job->idx);
+    SetLFWorkspace(ws);
+    PrintAndLogCapture(job->out, FANOUT_CAPTURE_SIZE);
+    kbd_share_enter(job->aborted);
+
+    uint64_t t1 = msclock();
+    job->res = CommandReceived(line);
+    job->elapsed = msclock() - t1;
+
+    kbd_share_enter(NULL);
+    PrintAndLogCapture(NULL, 0);
+    SetLFWorkspace(NULL);
+    SetThreadDevice(-1);
+    FreeLFWorkspace(ws);
+    return NULL;
+}
+
+static int CmdFanout(const char *Cmd) {
+
+    while (*Cmd == ' ')
+        Cmd++;
+
+    if (*Cmd == 0x00 || ((tolower(*Cmd) == 'h') && (Cmd[1] == 0x00 || Cmd[1] == ' ')))
+        return usage_hw_fanout();
+
+    if (fanout_running) {
+        PrintAndLogEx(WARNING, "fanout can't be nested");
+        return PM3_EINVARG;
+    }
+
+    if (strlen(Cmd) >= 512) {
+        PrintAndLogEx(WARNING, "Command too long");
+        return PM3_EOVFLOW;
+    }
+
+    if (fanout_listed(Cmd, fanout_refused, true)) {
+        PrintAndLogEx(WARNING, "Commands changing the devices or their connection can't run in hw fanout");
+        return PM3_EINVARG;
+    }
+
+    // the others use client state which is not per device, run them in turn
+    bool concurrent = fanout_listed(Cmd, fanout_concurrent, false);
+
+    fanout_job_t jobs[MAX_DEVICES];
+    pthread_t threads[MAX_DEVICES];
+    bool started[MAX_DEVICES] = {false};
+    bool aborted = false;
+    int count = 0;
+
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        pm3_device_info_t info;
+        if (GetDeviceInfo(i, &info) == false || info.present == false)
+            continue;
+
+        fanout_job_t *job = &jobs[count];
+        memset(job, 0, sizeof(fanout_job_t));
+        job->idx = i;
+        memcpy(job->port, info.port, sizeof(job->port));
+        job->cmd = Cmd;
+        job->aborted = &aborted;
+        job->res = PM3_EMALLOC;
+        job->out = calloc(FANOUT_CAPTURE_SIZE, sizeof(char));
+        count++;
+    }
+
+    if (count == 0) {
+        PrintAndLogEx(WARNING, "No device connected");
+        return PM3_ENOTTY;
+    }
+
+    PrintAndLogEx(INFO, "Running on " _YELLOW_("%d") " device%s%s", count, (count > 1) ? "s" : "", (concurrent || count == 1) ? "" : ", one after the other");
+
+    fanout_running = true;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, FANOUT_STACK_SIZE);
+
+    for (int i = 0; i < count && concurrent; i++) {
+        if (jobs[i].out == NULL)
+            continue;
+        started[i] = (pthread_create(&threads[i], &attr, fanout_worker, &jobs[i]) == 0);
+    }
+    pthread_attr_destroy(&attr);
+
+    // not reentrant, or no thread to spare, run those in turn
+    for (int i = 0; i < count; i++) {
+        if (jobs[i].out && started[i] == false)
+            fanout_worker(&jobs[i]);
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+
+    fanout_running = false;
+
+    for (int i = 0; i < count; i++) {
+        PrintAndLogEx(NORMAL, "");
+        PrintAndLogEx(INFO, "--- device " _YELLOW_("%d") " | %s", jobs[i].idx, jobs[i].port);
+        if (jobs[i].out == NULL)
+            continue;
+
+        char *line = jobs[i].out;
+        char *nl;
+        while ((nl = strchr(line, '\n')) != NULL) {
+            *nl = '\0';
+            PrintAndLogEx(NORMAL, "%s", line);
+            line = nl + 1;
+        }
+        if (*line)
+            PrintAndLogEx(NORMAL, "%s", line);
+        free(jobs[i].out);
+    }
+
+    int ret = PM3_SUCCESS;
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "   # | result | time (ms)");
+    PrintAndLogEx(NORMAL, "-----+--------+----------");
+    for (int i = 0; i < count; i++) {
+        PrintAndLogEx(NORMAL, "   %d | %s | %" PRIu64,
+                      jobs[i].idx,
+                      (jobs[i].res == PM3_SUCCESS) ? _GREEN_("  ok  ") : _RED_(" fail "),
+                      jobs[i].elapsed
+                     );
+        if (ret == PM3_SUCCESS)
+            ret = jobs[i].res;
+    }
+    PrintAndLogEx(NORMAL, "");
+    return ret;
+}
+
+static json_t *stats_dir_json(const comms_stats_t *stats, const comms_dir_stats_t *dir) {
+    json_t *o = json_object();
+    json_object_set_new(o, "frames", json_integer(dir->frames));
+    json_object_set_new(o, "bytes", json_integer(dir->bytes));
+    json_object_set_new(o, "bytes_per_s", json_integer(comms_stats_rate(stats, dir)));
+    json_object_set_new(o, "peak_bytes_per_s", json_integer(comms_stats_peak(stats, dir)));
+    return o;
+}
+
+static json_t *stats_json(const comms_stats_t *stats) {
+    json_t *root = json_object();
+    json_object_set_new(root, "Created", json_string("proxmark3"));
+    json_object_set_new(root, "FileType", json_string("commsstats"));
+    json_object_set_new(root, "elapsed_us", json_integer(stats->now_us - stats->start_us));
+    json_object_set_new(root, "tx", stats_dir_json(stats, &stats->tx));
+    json_object_set_new(root, "rx", stats_dir_json(stats, &stats->rx));
+
+    json_t *events = json_object();
+    for (int i = 0; i < COMMS_EVENT_COUNT; i++)
+        json_object_set_new(events, comms_stats_event_name(i), json_integer(stats->events[i]));
+    json_object_set_new(root, "events", events);
+
+    json_t *queues = json_object();
+    for (int i = 0; i < COMMS_DEPTH_COUNT; i++) {
+        json_t *q = json_object();
+        json_object_set_new(q, "now", json_integer(stats->depth_now[i]));
+        json_object_set_new(q, "max", json_integer(stats->depth_max[i]));
+        json_object_set_new(queues, comms_stats_depth_name(i), q);
+    }
+    json_object_set_new(root, "queues", queues);
+
+    // upper bounds of the histogram buckets, the last one is open
+    json_t *limits = json_array();
+    for (int b = 0; b < COMMS_STATS_BUCKETS - 1; b++)
+        json_array_append_new(limits, json_integer(COMMS_STATS_BUCKET0_US << b));
+    json_object_set_new(root, "bucket_limits_us", limits);
+
+    json_t *cmds = json_array();
+    for (int i = 0; i < stats->cmd_count; i++) {
+        const comms_cmd_stats_t *c = &stats->cmds[i];
+        char id[7];
+        snprintf(id, sizeof(id), "0x%04x", c->cmd);
+        json_t *o = json_object();
+        json_object_set_new(o, "cmd", json_string(id));
+        json_object_set_new(o, "sent", json_integer(c->sent));
+        json_object_set_new(o, "replies", json_integer(c->replies));
+        if (c->replies) {
+            json_object_set_new(o, "min_us", json_integer(c->min_us));
+            json_object_set_new(o, "avg_us", json_integer(c->sum_us / c->replies));
+            json_object_set_new(o, "p50_us", json_integer(comms_stats_percentile(c, 50)));
+            json_object_set_new(o, "p99_us", json_integer(comms_stats_percentile(c, 99)));
+            json_object_set_new(o, "max_us", json_integer(c->max_us));
+        }
+        json_t *hist = json_array();
+        for (int b = 0; b < COMMS_STATS_BUCKETS; b++)
+            json_array_append_new(hist, json_integer(c->hist[b]));
+        json_object_set_new(o, "histogram", hist);
+        json_array_append_new(cmds, o);
+    }
+    json_object_set_new(root, "commands", cmds);
+    json_object_set_new(root, "untracked_commands", json_integer(stats->untracked));
+    return root;
+}
+
+static void stats_print(const comms_stats_t *stats) {
+    uint64_t elapsed = stats->now_us - stats->start_us;
+
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(INFO, "link statistics over " _YELLOW_("%" PRIu64 ".%03" PRIu64) "s", elapsed / 1000000, (elapsed / 1000) % 1000);
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "      |     frames |        bytes |      B/s |  peak B/s");
+    PrintAndLogEx(NORMAL, "------+------------+--------------+----------+----------");
+    PrintAndLogEx(NORMAL, "   tx | %10u | %12" PRIu64 " | %8" PRIu64 " | %9" PRIu64,
+                  stats->tx.frames, stats->tx.bytes, comms_stats_rate(stats, &stats->tx), comms_stats_peak(stats, &stats->tx));
+    PrintAndLogEx(NORMAL, "   rx | %10u | %12" PRIu64 " | %8" PRIu64 " | %9" PRIu64,
+                  stats->rx.frames, stats->rx.bytes, comms_stats_rate(stats, &stats->rx), comms_stats_peak(stats, &stats->rx));
+
+    PrintAndLogEx(NORMAL, "");
+    for (int i = 0; i < COMMS_EVENT_COUNT; i++) {
+        if (stats->events[i] && i != COMMS_WTX)
+            PrintAndLogEx(NORMAL, "   %-18s " _RED_("%u"), comms_stats_event_name(i), stats->events[i]);
+        else
+            PrintAndLogEx(NORMAL, "   %-18s %u", comms_stats_event_name(i), stats->events[i]);
+    }
+
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "   queue            |  now |  max");
+    PrintAndLogEx(NORMAL, "   -----------------+------+-----");
+    for (int i = 0; i < COMMS_DEPTH_COUNT; i++)
+        PrintAndLogEx(NORMAL, "   %-16s | %4u | %4u", comms_stats_depth_name(i), stats->depth_now[i], stats->depth_max[i]);
+
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "   cmd   |   sent | replies | min ms |  avg ms |  p50 ms |  p99 ms |  max ms");
+    PrintAndLogEx(NORMAL, "  -------+--------+---------+--------+---------+---------+---------+---------");
+    for (int i = 0; i < stats->cmd_count; i++) {
+        const comms_cmd_stats_t *c = &stats->cmds[i];
+        if (c->replies == 0) {
+            PrintAndLogEx(NORMAL, "   %04x  | %6u | %7u |", c->cmd, c->sent, c->replies);
+            continue;
+        }
+        uint32_t avg = c->sum_us / c->replies;
+        PrintAndLogEx(NORMAL, "   %04x  | %6u | %7u | %6.2f | %7.2f | %7.2f | %7.2f | %7.2f",
+                      c->cmd, c->sent, c->replies,
+                      c->min_us / 1000.0, avg / 1000.0,
+                      comms_stats_percentile(c, 50) / 1000.0,
+                      comms_stats_percentile(c, 99) / 1000.0,
+                      c->max_us / 1000.0
+                     );
+    }
+    if (stats->untracked)
+        PrintAndLogEx(NORMAL, "   %u commands with other ids not tracked", stats->untracked);
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(INFO, "round trips are measured from sending until the reply, percentiles are histogram bucket bounds");
+}
+
+static int CmdStats(const char *Cmd) {
+    char filename[FILE_PATH_SIZE] = {0};
+    bool reset = false, json = false;
+    bool errors = false;
+    uint8_t cmdp = 0;
+
+    while (param_getchar(Cmd, cmdp) != 0x00 && !errors) {
+        switch (tolower(param_getchar(Cmd, cmdp))) {
+            case 'h':
+                return usage_hw_stats();
+            case 'r':
+                reset = true;
+                cmdp++;
+                break;
+            case 'j':
+                json = true;
+                cmdp++;
+                break;
+            case 'f':
+                if (param_getstr(Cmd, cmdp + 1, filename, sizeof(filename)) == 0)
+                    errors = true;
+                cmdp += 2;
+                break;
+            default:
+                PrintAndLogEx(WARNING, "Unknown parameter '%c'", param_getchar(Cmd, cmdp));
+                errors = true;
+                break;
+        }
+    }
+    if (errors)
+        return usage_hw_stats();
+
+    comms_stats_t *stats = calloc(1, sizeof(comms_stats_t));
+    if (stats == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+    GetCommsStats(stats);
+
+    int res = PM3_SUCCESS;
+    if (json || filename[0]) {
+        json_t *root = stats_json(stats);
+        if (json) {
+            json_dumpf(root, stdout, JSON_INDENT(2));
+            printf("\n");
+            fflush(stdout);
+        }
+        if (filename[0]) {
+            if (json_dump_file(root, filename, JSON_INDENT(2))) {
+                PrintAndLogEx(WARNING, "couldn't write '%s'", filename);
+                res = PM3_EFILE;
+            } else {
+                PrintAndLogEx(SUCCESS, "saved link statistics to " _YELLOW_("%s"), filename);
+            }
+        }
+        json_decref(root);
+    }
+    if (json == false)
+        stats_print(stats);
+
+    free(stats);
+
+    if (reset) {
+        ResetCommsStats();
+        PrintAndLogEx(INFO, "statistics reset");
+    }
+    return res;
+}
+
 static command_t CommandTable[] = {
     {"help",          CmdHelp,        AlwaysAvailable, "This help"},
+    {"attach",        CmdAttach,      AlwaysAvailable, "connect one more Proxmark3 and select it"},
     {"dbg",           CmdDbg,         IfPm3Present,    "Set Proxmark3 debug level"},
     {"connect",       CmdConnect,     AlwaysAvailable, "connect Proxmark3 to serial port"},
+    {"detach",        CmdDetach,      AlwaysAvailable, "disconnect a Proxmark3"},
     {"detectreader",  CmdDetectReader, IfPm3Present,    "['l'|'h'] -- Detect external reader field (option 'l' or 'h' to limit to LF or HF)"},
+    {"devices",       CmdDevices,     AlwaysAvailable, "List connected Proxmark3 devices"},
+    {"fanout",        CmdFanout,      AlwaysAvailable, "<command> -- Run a command on every connected Proxmark3"},
     {"fpgaoff",       CmdFPGAOff,     IfPm3Present,    "Set FPGA off"},
     {"lcd",           CmdLCD,         IfPm3Lcd,        "<HEX command> <count> -- Send command/data to LCD"},
     {"lcdreset",      CmdLCDReset,    IfPm3Lcd,        "Hardware reset LCD"},
     {"ping",          CmdPing,        IfPm3Present,    "Test if the Proxmark3 is responsive"},
     {"readmem",       CmdReadmem,     IfPm3Present,    "[address] -- Read memory at decimal address from flash"},
     {"reset",         CmdReset,       IfPm3Present,    "Reset the Proxmark3"},
+    {"select",        CmdSelect,      AlwaysAvailable, "<index> -- Select the Proxmark3 commands are sent to"},
     {"setlfdivisor",  CmdSetDivisor,  IfPm3Present,    "<19 - 255> -- Drive LF antenna at 12MHz/(divisor+1)"},
     {"setmux",        CmdSetMux,      IfPm3Present,    "Set the ADC mux to a specific value"},
     {"standalone",    CmdStandalone,  IfPm3Present,    "Jump to the standalone mode"},
+    {"stats",         CmdStats,       AlwaysAvailable, "Show latency, throughput and error statistics of the link to the Proxmark3"},
     {"status",        CmdStatus,      IfPm3Present,    "Show runtime status information about the connected Proxmark3"},
     {"tune",          CmdTune,        IfPm3Present,    "Measure antenna tuning"},
     {"version",       CmdVersion,     IfPm3Present,    "Show version information about the connected Proxmark3"},
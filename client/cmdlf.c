@@ -7,6 +7,8 @@
 //-----------------------------------------------------------------------------
 // Low frequency commands
 //-----------------------------------------------------------------------------
+// this define is needed for scandir/alphasort to work
+#define _GNU_SOURCE
 #include "cmdlf.h"
 
 #include <stdio.h>
@@ -14,6 +16,13 @@
 #include <string.h>
 #include <limits.h>
 #include <ctype.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include <dirent.h>
+#include <jansson.h>
 
 #include "cmdparser.h"    // command_t
 #include "comms.h"
@@ -47,6 +56,9 @@
 #include "cmdlfsecurakey.h" // for securakey menu
 #include "cmdlfpac.h"       // for pac menu
 #include "cmdlfkeri.h"      // for keri menu
+#include "util.h"           // num_CPUs
+#include "util_posix.h"     // msclock, msleep
+#include "scandir.h"        // for `lf classify`
 
 bool g_lf_threshold_set = false;
 
@@ -192,10 +204,27 @@ static int usage_lf_find(void) {
 }
 
 
+static int usage_lf_classify(void) {
+    PrintAndLogEx(NORMAL, "Run the `lf search` decoders over every .pm3 capture in a directory (and its sub directories)");
+    PrintAndLogEx(NORMAL, "and report the detected protocol and ID per file. Captures are spread over worker threads.");
+    PrintAndLogEx(NORMAL, "Confidence is " _YELLOW_("high") " when exactly one decoder accepts the capture, " _YELLOW_("low") " when several do.");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Usage:  lf classify [h] d <dir> [f <report>] [t <workers>]");
+    PrintAndLogEx(NORMAL, "Options:");
+    PrintAndLogEx(NORMAL, "       h             This help");
+    PrintAndLogEx(NORMAL, "       d <dir>       directory with .pm3 captures");
+    PrintAndLogEx(NORMAL, "       f <report>    write report, CSV if the name ends in .csv, JSON otherwise");
+    PrintAndLogEx(NORMAL, "       t <workers>   number of worker threads, default number of CPUs, at most 64");
+    PrintAndLogEx(NORMAL, "Examples:");
+    PrintAndLogEx(NORMAL, "      lf classify d traces");
+    PrintAndLogEx(NORMAL, "      lf classify d /data/captures f report.csv t 8");
+    return PM3_SUCCESS;
+}
+
 /* send a LF command before reading */
 int CmdLFCommandRead(const char *Cmd) {
 
-    if (!session.pm3_present) return PM3_ENOTTY;
+    if (!IsPm3Present()) return PM3_ENOTTY;
 
     bool errors = false;
     uint16_t datalen = 0;
@@ -268,8 +297,12 @@ int CmdFlexdemod(const char *Cmd) {
 #endif
     int i, j, start, bit, sum;
 
-    int data[GraphTraceLen];
-    memcpy(data, GraphBuffer, GraphTraceLen);
+    int *data = calloc(GraphTraceLen, sizeof(int));
+    if (data == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+    memcpy(data, GraphBuffer, GraphTraceLen * sizeof(int));
 
     size_t size = GraphTraceLen;
 
@@ -289,6 +322,7 @@ int CmdFlexdemod(const char *Cmd) {
 
     if (start == size - LONG_WAIT) {
         PrintAndLogEx(WARNING, "nothing to wait for");
+        free(data);
         return PM3_ENODATA;
     }
 
@@ -317,9 +351,13 @@ int CmdFlexdemod(const char *Cmd) {
         if (sum < 0 && bits[bit] != 0) PrintAndLogEx(WARNING, "oops2 at %d", bit);
 
     }
+    free(data);
 
     // iceman,  use demod buffer?  blue line?
     // HACK writing back to graphbuffer.
+    if (GraphReserve(32 * 64) != PM3_SUCCESS)
+        return PM3_EMALLOC;
+
     GraphTraceLen = 32 * 64;
     i = 0;
     for (bit = 0; bit < 64; bit++) {
@@ -337,7 +375,7 @@ int CmdFlexdemod(const char *Cmd) {
 
 int CmdLFSetConfig(const char *Cmd) {
 
-    if (!session.pm3_present) return PM3_ENOTTY;
+    if (!IsPm3Present()) return PM3_ENOTTY;
 
     uint8_t divisor =  0;//Frequency divisor
     uint8_t bps = 0; // Bits per sample
@@ -405,7 +443,7 @@ int CmdLFSetConfig(const char *Cmd) {
 }
 
 int lf_read(bool silent, uint32_t samples) {
-    if (!session.pm3_present) return PM3_ENOTTY;
+    if (!IsPm3Present()) return PM3_ENOTTY;
 
     struct p {
         uint8_t silent;
@@ -438,7 +476,7 @@ int lf_read(bool silent, uint32_t samples) {
 
 int CmdLFRead(const char *Cmd) {
 
-    if (!session.pm3_present) return PM3_ENOTTY;
+    if (!IsPm3Present()) return PM3_ENOTTY;
 
     bool errors = false;
     bool silent = false;
@@ -471,7 +509,7 @@ int CmdLFRead(const char *Cmd) {
 
 int CmdLFSniff(const char *Cmd) {
 
-    if (!session.pm3_present) return PM3_ENOTTY;
+    if (!IsPm3Present()) return PM3_ENOTTY;
 
     uint8_t cmdp = tolower(param_getchar(Cmd, 0));
     if (cmdp == 'h') return usage_lf_sniff();
@@ -497,7 +535,7 @@ static void ChkBitstream() {
 // converts GraphBuffer to bitstream (based on zero crossings) if needed.
 int CmdLFSim(const char *Cmd) {
 
-    if (!session.pm3_present) return PM3_ENOTTY;
+    if (!IsPm3Present()) return PM3_ENOTTY;
 
     // sanity check
     if (GraphTraceLen < 20) {
@@ -527,7 +565,7 @@ int CmdLFSim(const char *Cmd) {
     payload_up.flag = 0x1;
 
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
 
     //can send only 512 bits at a time (1 byte sent per bit...)
     for (uint16_t i = 0; i < GraphTraceLen; i += PM3_CMD_DATA_SIZE - 3) {
@@ -548,7 +586,7 @@ int CmdLFSim(const char *Cmd) {
     }
 
     // Disable fast mode before last command
-    conn.block_after_ACK = false;
+    GetConn()->block_after_ACK = false;
     printf("\n");
 
     PrintAndLogEx(INFO, "Simulating");
@@ -966,6 +1004,9 @@ int CmdVchDemod(const char *Cmd) {
 
     // clone
     if (strcmp(Cmd, "clone") == 0) {
+        if (GraphReserve(strlen(bits) * 16) != PM3_SUCCESS)
+            return PM3_EMALLOC;
+
         GraphTraceLen = 0;
         char *s;
         for (s = bits; *s; s++) {
@@ -985,8 +1026,9 @@ static bool CheckChipType(bool getDeviceData) {
 
     if (!getDeviceData) return retval;
 
-    save_restoreGB(GRAPH_SAVE);
-    save_restoreDB(GRAPH_SAVE);
+    // the chip reads below fill the graph, keep the user's one
+    lf_workspace_t *ws = PushLFWorkspace();
+    if (ws == NULL) return retval;
 
     //check for em4x05/em4x69 chips first
     uint32_t word = 0;
@@ -1006,11 +1048,42 @@ static bool CheckChipType(bool getDeviceData) {
     }
 
 out:
-    save_restoreGB(GRAPH_RESTORE);
-    save_restoreDB(GRAPH_RESTORE);
+    PopLFWorkspace(ws, LF_KEEP_NOTHING);
     return retval;
 }
 
+// known tag decoders, in the order `lf search` tries them
+typedef struct {
+    const char *name;
+    int (*demod)(void);
+} lf_decoder_t;
+
+static const lf_decoder_t lf_decoders[] = {
+    {"HID Prox ID",               demodHID},
+    {"AWID ID",                   demodAWID},
+    {"Paradox ID",                demodParadox},
+    {"EM410x ID",                 demodEM410x},
+    {"FDX-B ID",                  demodFDX},
+    {"Guardall G-Prox II ID",     demodGuard},
+    {"Idteck ID",                 demodIdteck},
+    {"Indala ID",                 demodIndala},
+    {"IO Prox ID",                demodIOProx},
+    {"Jablotron ID",              demodJablotron},
+    {"NEDAP ID",                  demodNedap},
+    {"NexWatch ID",               demodNexWatch},
+    {"Noralsy ID",                demodNoralsy},
+    {"KERI ID",                   demodKeri},
+    {"PAC/Stanley ID",            demodPac},
+    {"Presco ID",                 demodPresco},
+    {"Pyramid ID",                demodPyramid},
+    {"Securakey ID",              demodSecurakey},
+    {"Viking ID",                 demodViking},
+    {"Visa2000 ID",               demodVisa2k},
+    {"Texas Instrument ID",       demodTI},
+//    {"Fermax ID",                 demodFermax},
+//    {"Flex ID",                   demodFlex},
+};
+
 //by marshmellow
 int CmdLFfind(const char *Cmd) {
     int ans = 0;
@@ -1022,7 +1095,7 @@ int CmdLFfind(const char *Cmd) {
 
     if (cmdp == 'u') testRaw = 'u';
 
-    bool isOnline = (session.pm3_present && (cmdp != '1'));
+    bool isOnline = (IsPm3Present() && (cmdp != '1'));
 
     if (isOnline)
         lf_read(true, 30000);
@@ -1042,7 +1115,7 @@ int CmdLFfind(const char *Cmd) {
     if (isOnline) {
         // only run if graphbuffer is just noise as it should be for hitag
         // The improved noise detection will find Cotag.
-        if (getSignalProperties()->isnoise) {
+        if (getSignalProperties_ctx(LF_DEMOD_CTX)->isnoise) {
 
             if (IfPm3Hitag()) {
                 if (readHitagUid()) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Hitag") "found!"); return PM3_SUCCESS;}
@@ -1056,31 +1129,12 @@ int CmdLFfind(const char *Cmd) {
 
     if (EM4x50Read("", false) == PM3_SUCCESS)  { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("EM4x50 ID") "found!"); return PM3_SUCCESS;}
 
-    if (demodHID() == PM3_SUCCESS)             { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("HID Prox ID") "found!"); goto out;}
-    if (demodAWID() == PM3_SUCCESS)            { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("AWID ID") "found!"); goto out;}
-    if (demodParadox() == PM3_SUCCESS)         { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Paradox ID") "found!"); goto out;}
-
-    if (demodEM410x() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("EM410x ID") "found!"); goto out;}
-    if (demodFDX() == PM3_SUCCESS)             { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("FDX-B ID") "found!"); goto out;}
-    if (demodGuard() == PM3_SUCCESS)           { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Guardall G-Prox II ID") "found!"); goto out; }
-    if (demodIdteck() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Idteck ID") "found!"); goto out;}
-    if (demodIndala() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Indala ID") "found!");  goto out;}
-    if (demodIOProx() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("IO Prox ID") "found!"); goto out;}
-    if (demodJablotron() == PM3_SUCCESS)       { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Jablotron ID") "found!"); goto out;}
-    if (demodNedap() == PM3_SUCCESS)           { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("NEDAP ID") "found!"); goto out;}
-    if (demodNexWatch() == PM3_SUCCESS)        { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("NexWatch ID") "found!"); goto out;}
-    if (demodNoralsy() == PM3_SUCCESS)         { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Noralsy ID") "found!"); goto out;}
-    if (demodKeri() == PM3_SUCCESS)            { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("KERI ID") "found!"); goto out;}
-    if (demodPac() == PM3_SUCCESS)             { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("PAC/Stanley ID") "found!"); goto out;}
-
-    if (demodPresco() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Presco ID") "found!"); goto out;}
-    if (demodPyramid() == PM3_SUCCESS)         { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Pyramid ID") "found!"); goto out;}
-    if (demodSecurakey() == PM3_SUCCESS)       { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Securakey ID") "found!"); goto out;}
-    if (demodViking() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Viking ID") "found!"); goto out;}
-    if (demodVisa2k() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Visa2000 ID") "found!"); goto out;}
-    if (demodTI() == PM3_SUCCESS)              { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Texas Instrument ID") "found!"); goto out;}
-    //if (demodFermax() == PM3_SUCCESS)          { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Fermax ID") "found!"); goto out;}
-    //if (demodFlex() == PM3_SUCCESS)            { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Flex ID") "found!"); goto out;}
+    for (size_t i = 0; i < ARRAYLEN(lf_decoders); i++) {
+        if (lf_decoders[i].demod() == PM3_SUCCESS) {
+            PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("%s") "found!", lf_decoders[i].name);
+            goto out;
+        }
+    }
 
     PrintAndLogEx(FAILED, _RED_("No known 125/134 kHz tags found!"));
 
@@ -1129,6 +1183,396 @@ out:
     return PM3_SUCCESS;
 }
 
+// ---------------------------------------------------------------------------
+// lf classify, offline batch run of the lf search decoders
+//
+// Every worker thread runs the decoders on its own LF workspace, so the captures never
+// touch the user's graph. Workers pull file indexes from a shared counter and fill
+// their slot of the result table.
+// ---------------------------------------------------------------------------
+#define LF_CLASSIFY_CAPTURE_SIZE  (64 * 1024)
+#define LF_CLASSIFY_MAX_WORKERS   64
+
+typedef struct {
+    char protocol[40];
+    char id[200];
+    char also[200];
+    uint32_t samples;
+    uint8_t matches;
+    bool loaded;
+    bool isnoise;
+} lf_classify_result_t;
+
+typedef struct {
+    char **files;
+    size_t count;
+    lf_classify_result_t *results;
+    uint32_t next;
+    uint32_t done;
+    uint32_t running;
+} lf_classify_state_t;
+
+// the decoder's own summary line: first line with a ':' in it, else the first non empty one
+static void lf_classify_extract_id(const char *out, char *id, size_t idlen) {
+    const char *first = NULL, *pick = NULL;
+    size_t firstlen = 0, picklen = 0;
+
+    for (const char *line = out; *line; ) {
+        const char *eol = strchr(line, '\n');
+        size_t len = (eol) ? (size_t)(eol - line) : strlen(line);
+
+        // skip "[+] " style prefixes and surrounding blanks
+        const char *p = line;
+        const char *end = line + len;
+        if (*p == '[') {
+            const char *q = memchr(p, ']', len);
+            if (q && q - p <= 4)
+                p = q + 1;
+        }
+        while (p < end && isspace((unsigned char)*p)) p++;
+        while (end > p && isspace((unsigned char)end[-1])) end--;
+
+        if (end > p) {
+            if (first == NULL) {
+                first = p;
+                firstlen = end - p;
+            }
+            if (memchr(p, ':', end - p)) {
+                pick = p;
+                picklen = end - p;
+                break;
+            }
+        }
+        if (eol == NULL)
+            break;
+        line = eol + 1;
+    }
+
+    if (pick == NULL) {
+        pick = first;
+        picklen = firstlen;
+    }
+
+    id[0] = '\0';
+    if (pick) {
+        if (picklen > idlen - 1)
+            picklen = idlen - 1;
+        memcpy(id, pick, picklen);
+        id[picklen] = '\0';
+    }
+}
+
+static void *lf_classify_worker(void *arg) {
+    lf_classify_state_t *state = arg;
+    char **files = state->files;
+
+    lf_workspace_t *ws = CreateLFWorkspace();
+    char *out = calloc(LF_CLASSIFY_CAPTURE_SIZE, sizeof(char));
+    if (ws == NULL || out == NULL) {
+        FreeLFWorkspace(ws);
+        free(out);
+        __atomic_fetch_sub(&state->running, 1, __ATOMIC_SEQ_CST);
+        return NULL;
+    }
+    SetLFWorkspace(ws);
+
+    int *samples = NULL;
+    size_t samples_cap = 0;
+
+    for (;;) {
+        uint32_t idx = __atomic_fetch_add(&state->next, 1, __ATOMIC_SEQ_CST);
+        if (idx >= state->count)
+            break;
+
+        lf_classify_result_t *r = &state->results[idx];
+
+        PrintAndLogCapture(out, LF_CLASSIFY_CAPTURE_SIZE);
+
+        bool loaded = (loadGraphFile(files[idx]) == PM3_SUCCESS && GraphTraceLen > 0);
+        if (loaded && GraphTraceLen > samples_cap) {
+            int *tmp = realloc(samples, GraphTraceLen * sizeof(int));
+            if (tmp == NULL) {
+                loaded = false;
+            } else {
+                samples = tmp;
+                samples_cap = GraphTraceLen;
+            }
+        }
+
+        if (loaded) {
+            size_t len = GraphTraceLen;
+            r->loaded = true;
+            r->samples = len;
+            memcpy(samples, GraphBuffer, len * sizeof(int));
+            signal_t sig = *getSignalProperties_ctx(LF_DEMOD_CTX);
+            r->isnoise = sig.isnoise;
+
+            // every decoder gets the freshly loaded capture, some of them modify it
+            for (int d = -1; d < (int)ARRAYLEN(lf_decoders); d++) {
+                memcpy(GraphBuffer, samples, len * sizeof(int));
+                GraphTraceLen = len;
+                *getSignalProperties_ctx(LF_DEMOD_CTX) = sig;
+                DemodBufferLen = 0;
+
+                PrintAndLogCapture(out, LF_CLASSIFY_CAPTURE_SIZE);
+
+                const char *name = (d < 0) ? "EM4x50 ID" : lf_decoders[d].name;
+                int res = (d < 0) ? EM4x50Read("", false) : lf_decoders[d].demod();
+                if (res != PM3_SUCCESS)
+                    continue;
+
+                r->matches++;
+                if (r->matches == 1) {
+                    snprintf(r->protocol, sizeof(r->protocol), "%s", name);
+                    lf_classify_extract_id(out, r->id, sizeof(r->id));
+                } else {
+                    size_t l = strlen(r->also);
+                    snprintf(r->also + l, sizeof(r->also) - l, "%s%s", (l) ? ";" : "", name);
+                }
+            }
+        }
+
+        PrintAndLogCapture(NULL, 0);
+        __atomic_fetch_add(&state->done, 1, __ATOMIC_SEQ_CST);
+    }
+
+    SetLFWorkspace(NULL);
+    FreeLFWorkspace(ws);
+    free(samples);
+    free(out);
+    __atomic_fetch_sub(&state->running, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+static int lf_classify_collect(const char *path, char ***files, size_t *count, size_t *alloc) {
+    struct dirent **namelist;
+    int n = scandir(path, &namelist, NULL, alphasort);
+    if (n < 0)
+        return PM3_EFILE;
+
+    for (int i = 0; i < n; i++) {
+        const char *name = namelist[i]->d_name;
+        if (name[0] == '.') {
+            free(namelist[i]);
+            continue;
+        }
+
+        char *full = calloc(strlen(path) + strlen(name) + 2, sizeof(char));
+        if (full == NULL) {
+            free(namelist[i]);
+            continue;
+        }
+        sprintf(full, "%s%s%s", path, (path[strlen(path) - 1] == '/') ? "" : "/", name);
+
+        struct stat st;
+        if (stat(full, &st) == 0 && S_ISDIR(st.st_mode)) {
+            lf_classify_collect(full, files, count, alloc);
+            free(full);
+        } else if (str_endswith(name, ".pm3")) {
+            if (*count == *alloc) {
+                *alloc = (*alloc) ? *alloc * 2 : 256;
+                char **tmp = realloc(*files, *alloc * sizeof(char *));
+                if (tmp == NULL) {
+                    free(full);
+                    free(namelist[i]);
+                    continue;
+                }
+                *files = tmp;
+            }
+            (*files)[(*count)++] = full;
+        } else {
+            free(full);
+        }
+        free(namelist[i]);
+    }
+    free(namelist);
+    return PM3_SUCCESS;
+}
+
+static const char *lf_classify_confidence(const lf_classify_result_t *r) {
+    if (r->matches == 0) return "";
+    return (r->matches == 1) ? "high" : "low";
+}
+
+static void lf_classify_csv_field(FILE *f, const char *s, bool last) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"')
+            fputc('"', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+    fputc((last) ? '\n' : ',', f);
+}
+
+static int lf_classify_report(const char *fn, char **files, size_t count, const lf_classify_result_t *results) {
+
+    if (str_endswith(fn, ".csv")) {
+        FILE *f = fopen(fn, "w");
+        if (f == NULL) {
+            PrintAndLogEx(WARNING, "couldn't open '%s'", fn);
+            return PM3_EFILE;
+        }
+        fprintf(f, "file,samples,noise,protocol,id,confidence,also\n");
+        for (size_t i = 0; i < count; i++) {
+            const lf_classify_result_t *r = &results[i];
+            lf_classify_csv_field(f, files[i], false);
+            fprintf(f, "%u,%u,", r->samples, r->isnoise);
+            lf_classify_csv_field(f, r->protocol, false);
+            lf_classify_csv_field(f, r->id, false);
+            lf_classify_csv_field(f, lf_classify_confidence(r), false);
+            lf_classify_csv_field(f, r->also, true);
+        }
+        fclose(f);
+    } else {
+        json_t *root = json_object();
+        json_object_set_new(root, "Created", json_string("proxmark3"));
+        json_object_set_new(root, "FileType", json_string("lfclassify"));
+        json_t *arr = json_array();
+        for (size_t i = 0; i < count; i++) {
+            const lf_classify_result_t *r = &results[i];
+            json_t *o = json_object();
+            json_object_set_new(o, "file", json_string(files[i]));
+            json_object_set_new(o, "loaded", json_boolean(r->loaded));
+            json_object_set_new(o, "samples", json_integer(r->samples));
+            json_object_set_new(o, "noise", json_boolean(r->isnoise));
+            json_object_set_new(o, "protocol", json_string(r->protocol));
+            json_object_set_new(o, "id", json_string(r->id));
+            json_object_set_new(o, "confidence", json_string(lf_classify_confidence(r)));
+            json_object_set_new(o, "also", json_string(r->also));
+            json_array_append_new(arr, o);
+        }
+        json_object_set_new(root, "captures", arr);
+        int res = json_dump_file(root, fn, JSON_INDENT(2));
+        json_decref(root);
+        if (res) {
+            PrintAndLogEx(WARNING, "couldn't write '%s'", fn);
+            return PM3_EFILE;
+        }
+    }
+    PrintAndLogEx(SUCCESS, "saved %zu results to " _YELLOW_("%s"), count, fn);
+    return PM3_SUCCESS;
+}
+
+static int CmdLFClassify(const char *Cmd) {
+    char dir[FILE_PATH_SIZE] = {0};
+    char report[FILE_PATH_SIZE] = {0};
+    int workers = num_CPUs();
+    bool errors = false;
+    uint8_t cmdp = 0;
+
+    while (param_getchar(Cmd, cmdp) != 0x00 && !errors) {
+        switch (tolower(param_getchar(Cmd, cmdp))) {
+            case 'h':
+                return usage_lf_classify();
+            case 'd':
+                if (param_getstr(Cmd, cmdp + 1, dir, sizeof(dir)) == 0)
+                    errors = true;
+                cmdp += 2;
+                break;
+            case 'f':
+                if (param_getstr(Cmd, cmdp + 1, report, sizeof(report)) == 0)
+                    errors = true;
+                cmdp += 2;
+                break;
+            case 't':
+                workers = param_get32ex(Cmd, cmdp + 1, workers, 10);
+                cmdp += 2;
+                break;
+            default:
+                PrintAndLogEx(WARNING, "Unknown parameter '%c'", param_getchar(Cmd, cmdp));
+                errors = true;
+                break;
+        }
+    }
+    if (errors || dir[0] == '\0') return usage_lf_classify();
+    if (workers < 1) workers = 1;
+    if (workers > LF_CLASSIFY_MAX_WORKERS) workers = LF_CLASSIFY_MAX_WORKERS;
+
+    char **files = NULL;
+    size_t count = 0, alloc = 0;
+    if (lf_classify_collect(dir, &files, &count, &alloc) != PM3_SUCCESS) {
+        PrintAndLogEx(WARNING, "couldn't read directory '%s'", dir);
+        return PM3_EFILE;
+    }
+    if (count == 0) {
+        PrintAndLogEx(WARNING, "no .pm3 files found in '%s'", dir);
+        free(files);
+        return PM3_ESOFT;
+    }
+    if ((size_t)workers > count) workers = count;
+
+    PrintAndLogEx(INFO, "classifying " _YELLOW_("%zu") " captures", count);
+    uint64_t t1 = msclock();
+
+    lf_classify_state_t state = { files, count, NULL, 0, 0, 0 };
+    state.results = calloc(count, sizeof(lf_classify_result_t));
+    if (state.results == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        for (size_t i = 0; i < count; i++) free(files[i]);
+        free(files);
+        return PM3_EMALLOC;
+    }
+    lf_classify_result_t *results = state.results;
+
+    pthread_t threads[LF_CLASSIFY_MAX_WORKERS];
+    int started = 0;
+    for (int i = 0; i < workers; i++) {
+        __atomic_fetch_add(&state.running, 1, __ATOMIC_SEQ_CST);
+        if (pthread_create(&threads[started], NULL, lf_classify_worker, &state) != 0) {
+            __atomic_fetch_sub(&state.running, 1, __ATOMIC_SEQ_CST);
+            break;
+        }
+        started++;
+    }
+
+    if (started == 0) {
+        // no thread to spare, the worker brings its own workspace anyway
+        __atomic_fetch_add(&state.running, 1, __ATOMIC_SEQ_CST);
+        lf_classify_worker(&state);
+    } else {
+        uint64_t next_report = 1000;
+        while (__atomic_load_n(&state.running, __ATOMIC_SEQ_CST) > 0) {
+            msleep(100);
+            uint64_t elapsed = msclock() - t1;
+            if (elapsed >= next_report) {
+                next_report += 1000;
+                PrintAndLogEx(INPLACE, "%u / %zu captures   ", __atomic_load_n(&state.done, __ATOMIC_SEQ_CST), count);
+            }
+        }
+        for (int i = 0; i < started; i++)
+            pthread_join(threads[i], NULL);
+        PrintAndLogEx(NORMAL, "");
+    }
+
+    // summary
+    uint32_t found = 0, ambiguous = 0, noise = 0, failed = 0;
+    for (size_t i = 0; i < count; i++) {
+        const lf_classify_result_t *r = &results[i];
+        if (r->loaded == false) failed++;
+        if (r->isnoise) noise++;
+        if (r->matches) found++;
+        if (r->matches > 1) ambiguous++;
+
+        if (report[0] == '\0') {
+            PrintAndLogEx(NORMAL, "%-40s %-22s %-4s %s", files[i], (r->matches) ? r->protocol : (r->loaded) ? "-" : "load failed", lf_classify_confidence(r), r->id);
+        }
+    }
+
+    PrintAndLogEx(SUCCESS, "%zu captures in %" PRIu64 " ms, %d worker(s)", count, msclock() - t1, (started) ? started : 1);
+    PrintAndLogEx(SUCCESS, "identified " _GREEN_("%u") "  ambiguous " _YELLOW_("%u") "  noise %u  unreadable %u", found, ambiguous, noise, failed);
+
+    int res = PM3_SUCCESS;
+    if (report[0])
+        res = lf_classify_report(report, files, count, results);
+
+    free(results);
+    for (size_t i = 0; i < count; i++)
+        free(files[i]);
+    free(files);
+    return res;
+}
+
 static command_t CommandTable[] = {
     {"help",        CmdHelp,            AlwaysAvailable, "This help"},
     {"awid",        CmdLFAWID,          AlwaysAvailable, "{ AWID RFIDs...              }"},
@@ -1156,6 +1600,7 @@ static command_t CommandTable[] = {
     {"viking",      CmdLFViking,        AlwaysAvailable, "{ Viking RFIDs...            }"},
     {"visa2000",    CmdLFVisa2k,        AlwaysAvailable, "{ Visa2000 RFIDs...          }"},
     {"config",      CmdLFSetConfig,     IfPm3Lf,         "Set config for LF sampling, bit/sample, decimation, frequency"},
+    {"classify",    CmdLFClassify,      AlwaysAvailable, "d <dir> [f <report>] -- Batch classify a directory of .pm3 captures, JSON/CSV report"},
     {"cmdread",     CmdLFCommandRead,   IfPm3Lf,         "<off period> <'0' period> <'1' period> <command> ['h' 134] \n\t\t-- Modulate LF reader field to send command before read (all periods in microseconds)"},
     {"flexdemod",   CmdFlexdemod,       AlwaysAvailable, "Demodulate samples for FlexPass"},
     {"read",        CmdLFRead,          IfPm3Lf,         "['s' silent] Read 125/134 kHz LF ID-only tag. Do 'lf read h' for help"},
@@ -204,7 +204,7 @@ static int CmdAWIDDemod(const char *Cmd) {
     }
     //get binary from fsk wave
     int waveIdx = 0;
-    int idx = detectAWID(bits, &size, &waveIdx);
+    int idx = detectAWID_ctx(LF_DEMOD_CTX, bits, &size, &waveIdx);
     if (idx <= 0) {
 
         if (idx == -1)
@@ -417,11 +417,11 @@ static int CmdAWIDClone(const char *Cmd) {
     PacketResponseNG resp;
 
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
     for (uint8_t i = 0; i < 4; i++) {
         if (i == 3) {
             // Disable fast mode on last packet
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
         }
         clearCommandBuffer();
 
@@ -514,7 +514,7 @@ static int CmdAWIDBrute(const char *Cmd) {
     // main loop
     for (;;) {
 
-        if (!session.pm3_present) {
+        if (!IsPm3Present()) {
             PrintAndLogEx(WARNING, "Device offline\n");
             return PM3_ENODATA;
         }
@@ -436,7 +436,9 @@ static int CmdEM410xDemod(const char *Cmd) {
     if (AskEm410xDemod(Cmd, &hi, &lo, true) != PM3_SUCCESS)
         return PM3_ESOFT;
 
-    g_em410xid = lo;
+    // the replay ID is the one the user has in the graph, not one from a batch worker
+    if (IsLFWorkspaceShown())
+        g_em410xid = lo;
     return PM3_SUCCESS;
 }
 
@@ -813,9 +815,9 @@ int EM4x50Read(const char *Cmd, bool verbose) {
 
     uint8_t bits[MAX_GRAPH_TRACE_LEN] = {0};
     size_t size = getFromGraphBuf(bits);
-    computeSignalProperties(bits, size);
+    computeSignalProperties_ctx(LF_DEMOD_CTX, bits, size);
 
-    signal_t *sp = getSignalProperties();
+    signal_t *sp = getSignalProperties_ctx(LF_DEMOD_CTX);
     high = sp->high;
     low = sp->low;
 
@@ -906,8 +908,9 @@ int EM4x50Read(const char *Cmd, bool verbose) {
 
     start = skip;
     snprintf(tmp2, sizeof(tmp2), "%d %d 1000 %d", clk, invert, clk * 47);
-    // save GraphBuffer - to restore it later
-    save_restoreGB(GRAPH_SAVE);
+    // trim and demod a copy of the graph, only the demod buffer is kept
+    lf_workspace_t *ws = PushLFWorkspace();
+    if (ws == NULL) return PM3_EMALLOC;
     // get rid of leading crap
     snprintf(tmp, sizeof(tmp), "%i", skip);
     CmdLtrim(tmp);
@@ -936,7 +939,7 @@ int EM4x50Read(const char *Cmd, bool verbose) {
         i += 2;
 
         if (ASKDemod(tmp2, false, false, 1) != PM3_SUCCESS) {
-            save_restoreGB(GRAPH_RESTORE);
+            PopLFWorkspace(ws, LF_KEEP_DEMOD);
             return PM3_ESOFT;
         }
         //set DemodBufferLen to just one block
@@ -974,8 +977,7 @@ int EM4x50Read(const char *Cmd, bool verbose) {
         }
     }
 
-    //restore GraphBuffer
-    save_restoreGB(GRAPH_RESTORE);
+    PopLFWorkspace(ws, LF_KEEP_DEMOD);
     return AllPTest ? PM3_SUCCESS : PM3_ESOFT;
 }
 
@@ -1010,9 +1012,9 @@ static bool downloadSamplesEM() {
 
     setGraphBuf(got, sizeof(got));
     // set signal properties low/high/mean/amplitude and is_noise detection
-    computeSignalProperties(got, sizeof(got));
+    computeSignalProperties_ctx(LF_DEMOD_CTX, got, sizeof(got));
     RepaintGraphWindow();
-    if (getSignalProperties()->isnoise) {
+    if (getSignalProperties_ctx(LF_DEMOD_CTX)->isnoise) {
         PrintAndLogEx(DEBUG, "No tag found - signal looks like noise");
         return false;
     }
@@ -299,11 +299,11 @@ static int CmdFdxClone(const char *Cmd) {
     PacketResponseNG resp;
 
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
     for (int i = 4; i >= 0; --i) {
         if (i == 0) {
             // Disable fast mode on last packet
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
         }
         clearCommandBuffer();
 
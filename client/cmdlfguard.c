@@ -186,11 +186,11 @@ static int CmdGuardClone(const char *Cmd) {
     PacketResponseNG resp;
 
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
     for (uint8_t i = 0; i < 4; i++) {
         if (i == 3) {
             // Disable fast mode on last packet
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
         }
         clearCommandBuffer();
 
@@ -147,7 +147,7 @@ static int CmdHIDDemod(const char *Cmd) {
     //raw fsk demod no manchester decoding no start bit finding just get binary from wave
     uint32_t hi2 = 0, hi = 0, lo = 0;
 
-    uint8_t bits[GraphTraceLen];
+    uint8_t bits[MAX_GRAPH_TRACE_LEN];
     size_t size = getFromGraphBuf(bits);
     if (size == 0) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - HID not enough samples");
@@ -155,7 +155,7 @@ static int CmdHIDDemod(const char *Cmd) {
     }
     //get binary from fsk wave
     int waveIdx = 0;
-    int idx = HIDdemodFSK(bits, &size, &hi2, &hi, &lo, &waveIdx);
+    int idx = HIDdemodFSK_ctx(LF_DEMOD_CTX, bits, &size, &hi2, &hi, &lo, &waveIdx);
     if (idx < 0) {
 
         if (idx == -1)
@@ -591,7 +591,7 @@ static int CmdHIDBrute(const char *Cmd) {
     // main loop
     for (;;) {
 
-        if (!session.pm3_present) {
+        if (!IsPm3Present()) {
             PrintAndLogEx(WARNING, "Device offline\n");
             return PM3_ENODATA;
         }
@@ -16,6 +16,7 @@
 #include "commonutil.h"
 #include "hitag.h"
 #include "fileutils.h"  // savefile
+#include "hitag2/hitag2_crack.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -106,6 +107,24 @@ static int usage_hitag_writer(void) {
     PrintAndLogEx(NORMAL, "      27  <password> <page> <byte0...byte3>  Write page, password mode. Default: 4D494B52 (\"MIKR\")");
     return 0;
 }
+static int usage_hitag_crack(void) {
+    PrintAndLogEx(NORMAL, "Recover a Hitag2 key from reader authentications (nR aR pairs), e.g. collected with " _YELLOW_("`lf hitag sniff`"));
+    PrintAndLogEx(NORMAL, "Two pairs identify the key. The search runs offline on all cores.");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Usage:   lf hitag crack [h] u <uid> [n <nR aR>]... [f <filename>] [p <key prefix>]");
+    PrintAndLogEx(NORMAL, "Options:");
+    PrintAndLogEx(NORMAL, "       h              This help");
+    PrintAndLogEx(NORMAL, "       u <uid>        tag UID, 4 hex bytes");
+    PrintAndLogEx(NORMAL, "       n <nR aR>      reader nonce and answer, 8 hex bytes. Repeat for more pairs");
+    PrintAndLogEx(NORMAL, "       f <filename>   load pairs from a challenge file as used by " _YELLOW_("`lf hitag cc`"));
+    PrintAndLogEx(NORMAL, "       p <hex>        known first key bytes (1 - %u), shrinks the search", HITAG2_CRACK_MAX_PREFIX);
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Examples:");
+    PrintAndLogEx(NORMAL, "         lf hitag crack u 49435769 n 656E457228DC8031 n 12345678B0C4A17B");
+    PrintAndLogEx(NORMAL, "         lf hitag crack u 49435769 n 656E457228DC8031 n 12345678B0C4A17B p 4F4E4D");
+    PrintAndLogEx(NORMAL, "         lf hitag crack u 49435769 f lf-hitag-challenges");
+    return 0;
+}
 static int usage_hitag_checkchallenges(void) {
     PrintAndLogEx(NORMAL, "Check challenges, load a file with save hitag crypto challenges and test them all.");
     PrintAndLogEx(NORMAL, "The file should be 8 * 60 bytes long,  the file extension defaults to " _YELLOW_("`.cc`"));
@@ -694,6 +713,112 @@ static int CmdLFHitagDump(const char *Cmd) {
 }
 */
 
+static int CmdLFHitagCrack(const char *Cmd) {
+
+    uint8_t uid[4] = {0};
+    uint8_t prefix[HITAG2_CRACK_MAX_PREFIX] = {0};
+    int prefixlen = 0;
+    char filename[FILE_PATH_SIZE] = {0};
+    bool has_uid = false;
+    bool errors = false;
+    uint8_t count = 0;
+    uint8_t cmdp = 0;
+
+    uint8_t *nrar = calloc(HITAG2_CRACK_MAX_TRACES * 8, sizeof(uint8_t));
+    if (nrar == NULL)
+        return PM3_EMALLOC;
+
+    while (param_getchar(Cmd, cmdp) != 0x00 && !errors) {
+        switch (tolower(param_getchar(Cmd, cmdp))) {
+            case 'h':
+                free(nrar);
+                return usage_hitag_crack();
+            case 'u':
+                if (param_gethex(Cmd, cmdp + 1, uid, 8)) {
+                    PrintAndLogEx(WARNING, "uid must be 4 hex bytes");
+                    errors = true;
+                    break;
+                }
+                has_uid = true;
+                cmdp += 2;
+                break;
+            case 'n':
+                if (count == HITAG2_CRACK_MAX_TRACES) {
+                    PrintAndLogEx(WARNING, "too many pairs, max %u", HITAG2_CRACK_MAX_TRACES);
+                    errors = true;
+                    break;
+                }
+                if (param_gethex(Cmd, cmdp + 1, nrar + count * 8, 16)) {
+                    PrintAndLogEx(WARNING, "nR aR must be 8 hex bytes");
+                    errors = true;
+                    break;
+                }
+                count++;
+                cmdp += 2;
+                break;
+            case 'f': {
+                size_t datalen = 0;
+                param_getstr(Cmd, cmdp + 1, filename, sizeof(filename));
+                if (loadFile(filename, ".cc", nrar + count * 8, (HITAG2_CRACK_MAX_TRACES - count) * 8, &datalen) != PM3_SUCCESS) {
+                    errors = true;
+                    break;
+                }
+                // a challenge file is padded with unused zero pairs
+                for (size_t i = 0; i + 8 <= datalen; i += 8) {
+                    uint8_t *pair = nrar + count * 8;
+                    bool used = false;
+                    for (uint8_t j = 0; j < 8; j++)
+                        used |= (pair[j] != 0);
+                    if (used == false)
+                        break;
+                    count++;
+                }
+                cmdp += 2;
+                break;
+            }
+            case 'p':
+                if (param_getlength(Cmd, cmdp + 1) > HITAG2_CRACK_MAX_PREFIX * 2
+                        || param_gethex_ex(Cmd, cmdp + 1, prefix, &prefixlen) || prefixlen == 0) {
+                    PrintAndLogEx(WARNING, "key prefix must be 1 - %u hex bytes", HITAG2_CRACK_MAX_PREFIX);
+                    errors = true;
+                    break;
+                }
+                prefixlen /= 2;
+                cmdp += 2;
+                break;
+            default:
+                PrintAndLogEx(WARNING, "Unknown parameter '%c'", param_getchar(Cmd, cmdp));
+                errors = true;
+                break;
+        }
+    }
+
+    //Validations
+    if (errors || has_uid == false || count == 0) {
+        free(nrar);
+        return usage_hitag_crack();
+    }
+
+    uint8_t key[6] = {0};
+    int res = hitag2_crack(uid, nrar, count, prefix, prefixlen, key);
+    free(nrar);
+
+    switch (res) {
+        case PM3_SUCCESS:
+            PrintAndLogEx(SUCCESS, "found valid key [ " _GREEN_("%s") "]", sprint_hex_inrow(key, sizeof(key)));
+            break;
+        case PM3_EOPABORTED:
+            PrintAndLogEx(WARNING, "aborted via keyboard");
+            break;
+        case PM3_ESOFT:
+            PrintAndLogEx(FAILED, "no key matches all pairs");
+            break;
+        default:
+            break;
+    }
+    return res;
+}
+
 static command_t CommandTable[] = {
     {"help",     CmdHelp,                   AlwaysAvailable, "This help" },
     {"list",     CmdLFHitagList,            IfPm3Hitag,      "List Hitag trace history" },
@@ -703,6 +828,7 @@ static command_t CommandTable[] = {
     {"sniff",    CmdLFHitagSniff,           IfPm3Hitag,      "Eavesdrop Hitag communication" },
     {"writer",   CmdLFHitagWriter,          IfPm3Hitag,      "Act like a Hitag Writer" },
     {"cc",       CmdLFHitagCheckChallenges, IfPm3Hitag,      "Test all challenges" },
+    {"crack",    CmdLFHitagCrack,           AlwaysAvailable, "Recover a Hitag2 key from nR aR pairs" },
     { NULL, NULL, 0, NULL }
 };
 
@@ -361,6 +361,9 @@ static int CmdIndalaDemodAlt(const char *Cmd) {
     // Remodulating for tag cloning
     // HACK: 2015-01-04 this will have an impact on our new way of seening lf commands (demod)
     // since this changes graphbuffer data.
+    if (GraphReserve(32 * uidlen) != PM3_SUCCESS)
+        return PM3_EMALLOC;
+
     GraphTraceLen = 32 * uidlen;
     i = 0;
     int phase;
@@ -100,7 +100,7 @@ static int CmdIOProxDemod(const char *Cmd) {
     }
     //get binary from fsk wave
     int waveIdx = 0;
-    idx = detectIOProx(bits, &size, &waveIdx);
+    idx = detectIOProx_ctx(LF_DEMOD_CTX, bits, &size, &waveIdx);
     if (idx < 0) {
         if (g_debugMode) {
             if (idx == -1) {
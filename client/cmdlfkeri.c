@@ -162,11 +162,11 @@ static int CmdKeriClone(const char *Cmd) {
     PacketResponseNG resp;
 
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
     for (uint8_t i = 0; i < 3; i++) {
         if (i == 2) {
             // Disable fast mode on last packet
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
         }
         clearCommandBuffer();
 
@@ -472,11 +472,11 @@ int CmdLFNedapClone(const char *Cmd) {
     PacketResponseNG resp;
 
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
     for (uint8_t i = 0; i < max; i++) {
         if (i == max - 1) {
             // Disable fast mode on last packet
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
         }
         clearCommandBuffer();
         t55xx_write_block_t ng;
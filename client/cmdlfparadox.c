@@ -181,10 +181,10 @@ int detectParadox(uint8_t *dest, size_t *size, uint32_t *hi2, uint32_t *hi, uint
     //make sure buffer has data
     if (*size < 96 * 50) return -1;
 
-    if (getSignalProperties()->isnoise) return -2;
+    if (getSignalProperties_ctx(LF_DEMOD_CTX)->isnoise) return -2;
 
     // FSK demodulator
-    *size = fskdemod(dest, *size, 50, 1, 10, 8, waveStartIdx); // paradox fsk2a
+    *size = fskdemod_ctx(LF_DEMOD_CTX, dest, *size, 50, 1, 10, 8, waveStartIdx); // paradox fsk2a
 
     //did we get a good demod?
     if (*size < 96) return -3;
@@ -249,11 +249,11 @@ static int CmdPyramidClone(const char *Cmd) {
     PacketResponseNG resp;
 
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
     for (uint8_t i = 0; i < 5; i++) {
         if (i == 4) {
             // Disable fast mode on last packet
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
         }
         clearCommandBuffer();
         t55xx_write_block_t ng;
@@ -376,10 +376,10 @@ int detectPyramid(uint8_t *dest, size_t *size, int *waveStartIdx) {
     if (*size < 128 * 50) return -1;
 
     //test samples are not just noise
-    if (getSignalProperties()->isnoise) return -2;
+    if (getSignalProperties_ctx(LF_DEMOD_CTX)->isnoise) return -2;
 
     // FSK demodulator RF/50 FSK 10,8
-    *size = fskdemod(dest, *size, 50, 1, 10, 8, waveStartIdx);  // pyramid fsk2
+    *size = fskdemod_ctx(LF_DEMOD_CTX, dest, *size, 50, 1, 10, 8, waveStartIdx);  // pyramid fsk2
 
     //did we get a good demod?
     if (*size < 128) return -3;
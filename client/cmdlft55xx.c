@@ -497,6 +497,7 @@ bool DecodeT55xxBlock(void) {
     int ans = 0;
     bool ST = config.ST;
     uint8_t bitRate[8] = {8, 16, 32, 40, 50, 64, 100, 128};
+    lf_workspace_t *ws;
     DemodBufferLen = 0x00;
 
     switch (config.modulation) {
@@ -520,23 +521,25 @@ bool DecodeT55xxBlock(void) {
             break;
         case DEMOD_PSK1:
             // skip first 160 samples to allow antenna to settle in (psk gets inverted occasionally otherwise)
-            save_restoreGB(GRAPH_SAVE);
+            ws = PushLFWorkspace();
+            if (ws == NULL) return false;
             CmdLtrim("150");
             snprintf(cmdStr, sizeof(buf), "%d %d 6", bitRate[config.bitrate], config.inverted);
             ans = PSKDemod(cmdStr, false);
             //undo trim samples
-            save_restoreGB(GRAPH_RESTORE);
+            PopLFWorkspace(ws, LF_KEEP_DEMOD);
             break;
         case DEMOD_PSK2: //inverted won't affect this
         case DEMOD_PSK3: //not fully implemented
             // skip first 160 samples to allow antenna to settle in (psk gets inverted occasionally otherwise)
-            save_restoreGB(GRAPH_SAVE);
+            ws = PushLFWorkspace();
+            if (ws == NULL) return false;
             CmdLtrim("150");
             snprintf(cmdStr, sizeof(buf), "%d 0 6", bitRate[config.bitrate]);
             ans = PSKDemod(cmdStr, false);
             psk1TOpsk2(DemodBuffer, DemodBufferLen);
             //undo trim samples
-            save_restoreGB(GRAPH_RESTORE);
+            PopLFWorkspace(ws, LF_KEEP_DEMOD);
             break;
         case DEMOD_NRZ:
             snprintf(cmdStr, sizeof(buf), "%d %d 1", bitRate[config.bitrate], config.inverted);
@@ -562,7 +565,7 @@ static bool DecodeT5555TraceBlock(void) {
 
 // sanity check. Don't use proxmark if it is offline and you didn't specify useGraphbuf
 static int SanityOfflineCheck(bool useGraphBuffer) {
-    if (!useGraphBuffer && !session.pm3_present) {
+    if (!useGraphBuffer && !IsPm3Present()) {
         PrintAndLogEx(WARNING, "Your proxmark3 device is offline. Specify [1] to use graphbuffer data instead");
         return PM3_ENODATA;
     }
@@ -780,7 +783,8 @@ bool tryDetectModulation(void) {
         clk = GetPskClock("", false);
         if (clk > 0) {
             // allow undo
-            save_restoreGB(GRAPH_SAVE);
+            lf_workspace_t *ws = PushLFWorkspace();
+            if (ws == NULL) return false;
             // skip first 160 samples to allow antenna to settle in (psk gets inverted occasionally otherwise)
             CmdLtrim("160");
             if ((PSKDemod("0 0 6", false) == PM3_SUCCESS) && test(DEMOD_PSK1, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5)) {
@@ -825,7 +829,7 @@ bool tryDetectModulation(void) {
                 }
             } // inverse waves does not affect this demod
             //undo trim samples
-            save_restoreGB(GRAPH_RESTORE);
+            PopLFWorkspace(ws, LF_KEEP_DEMOD);
         }
     }
     if (hits == 1) {
@@ -1719,7 +1723,7 @@ bool AquireData(uint8_t page, uint8_t block, bool pwdmode, uint32_t password, ui
 
     getSamples(12000, true);
 
-    return !getSignalProperties()->isnoise;
+    return !getSignalProperties_ctx(LF_DEMOD_CTX)->isnoise;
 }
 
 char *GetPskCfStr(uint32_t id, bool q5) {
@@ -2126,7 +2130,7 @@ static int CmdT55xxChkPwds(const char *Cmd) {
     }
 
     if (use_pwd_file) {
-        uint16_t keycount = 0;
+        uint32_t keycount = 0;
 
         int res = loadFileDICTIONARY_safe(filename, (void**) &keyBlock, 4, &keycount);
         if (res != PM3_SUCCESS || keycount == 0 || keyBlock == NULL) {
@@ -2139,9 +2143,9 @@ static int CmdT55xxChkPwds(const char *Cmd) {
 
         // loop
         uint64_t curr_password = 0x00;
-        for (uint16_t c = 0; c < keycount; ++c) {
+        for (uint32_t c = 0; c < keycount; ++c) {
 
-            if (!session.pm3_present) {
+            if (!IsPm3Present()) {
                 PrintAndLogEx(WARNING, "Device offline\n");
                 free(keyBlock);
                 return PM3_ENODATA;
@@ -22,6 +22,34 @@
 
 static int CmdHelp(const char *Cmd);
 
+// split a +1/-1 tone into runs of equal sign, edges[] holds run boundaries
+static int tone_runs(const int *tone, int len, int *edges, int *signs) {
+    int runs = 0;
+    for (int j = 0; j < len; j++) {
+        if (j == 0 || tone[j] != tone[j - 1]) {
+            edges[runs] = j;
+            signs[runs] = tone[j];
+            runs++;
+        }
+    }
+    edges[runs] = len;
+    return runs;
+}
+
+static void prefix_sum(int64_t *prefix, const int *src, size_t len) {
+    prefix[0] = 0;
+    for (size_t i = 0; i < len; i++)
+        prefix[i + 1] = prefix[i] + src[i];
+}
+
+// sum(tone[j] * samples[pos + j]) using the prefix sum of samples
+static int correlate_tone(const int64_t *prefix, size_t pos, const int *edges, const int *signs, int runs) {
+    int64_t sum = 0;
+    for (int r = 0; r < runs; r++)
+        sum += signs[r] * (prefix[pos + edges[r + 1]] - prefix[pos + edges[r]]);
+    return (int)sum;
+}
+
 static int CmdTIDemod(const char *Cmd) {
     (void)Cmd; // Cmd is not used so far
     /* MATLAB as follows:
@@ -79,46 +107,65 @@ static int CmdTIDemod(const char *Cmd) {
         1, 1, 1, 1, 1, 1, 1, 1
     };
 
-    save_restoreGB(GRAPH_SAVE);
-
     int lowLen = ARRAYLEN(LowTone);
     int highLen = ARRAYLEN(HighTone);
     int convLen = (highLen > lowLen) ? highLen : lowLen;
+
+    // the sync search below looks this far into the buffer, after the
+    // correlation shortened it by convLen + 16 samples
+    size_t syncLen = 6000 + 17 * lowLen + 6 * highLen;
+    if (GraphTraceLen < syncLen + convLen + 16) {
+        PrintAndLogEx(DEBUG, "too few samples for a TI tag, %zu < %zu", GraphTraceLen, syncLen + convLen + 16);
+        return PM3_ESOFT;
+    }
+
+    // filter a copy of the graph, the user gets to see it only if a tag was found
+    lf_workspace_t *ws = PushLFWorkspace();
+    if (ws == NULL)
+        return PM3_EMALLOC;
+
     uint16_t crc;
     int i, j, TagType;
-    int lowSum = 0, highSum = 0;;
-    int lowTot = 0, highTot = 0;
     int retval = PM3_ESOFT;
 
+    // the tones are square waves, so each correlation is a signed sum over a few runs
+    // of samples. With a prefix sum of the buffer that is O(runs) per sample instead
+    // of O(tone length), same integer results as the direct convolution.
+    int lowEdges[ARRAYLEN(LowTone) + 1], lowSigns[ARRAYLEN(LowTone)];
+    int highEdges[ARRAYLEN(HighTone) + 1], highSigns[ARRAYLEN(HighTone)];
+    int lowRuns = tone_runs(LowTone, lowLen, lowEdges, lowSigns);
+    int highRuns = tone_runs(HighTone, highLen, highEdges, highSigns);
+
+    int64_t *prefix = calloc(GraphTraceLen + 1, sizeof(int64_t));
+    if (prefix == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        goto out;
+    }
+
+    prefix_sum(prefix, GraphBuffer, GraphTraceLen);
+
     for (i = 0; i < GraphTraceLen - convLen; i++) {
-        lowSum = 0;
-        highSum = 0;;
+        int lowSum = correlate_tone(prefix, i, lowEdges, lowSigns, lowRuns);
+        int highSum = correlate_tone(prefix, i, highEdges, highSigns, highRuns);
 
-        for (j = 0; j < lowLen; j++) {
-            lowSum += LowTone[j] * GraphBuffer[i + j];
-        }
-        for (j = 0; j < highLen; j++) {
-            highSum += HighTone[j] * GraphBuffer[i + j];
-        }
         lowSum = abs((100 * lowSum) / lowLen);
         highSum = abs((100 * highSum) / highLen);
-        lowSum = (lowSum < 0) ? -lowSum : lowSum;
-        highSum = (highSum < 0) ? -highSum : highSum;
 
         GraphBuffer[i] = (highSum << 16) | lowSum;
     }
 
+    // 16 and 15 are f_s divided by f_l and f_h, rounded
+    int lowTot = 0, highTot = 0;
+    for (j = 0; j < 16; j++)
+        lowTot += (GraphBuffer[j] & 0xffff);
+    for (j = 0; j < 15; j++)
+        highTot += (GraphBuffer[j] >> 16);
+
     for (i = 0; i < GraphTraceLen - convLen - 16; i++) {
-        lowTot = 0;
-        highTot = 0;
-        // 16 and 15 are f_s divided by f_l and f_h, rounded
-        for (j = 0; j < 16; j++) {
-            lowTot += (GraphBuffer[i + j] & 0xffff);
-        }
-        for (j = 0; j < 15; j++) {
-            highTot += (GraphBuffer[i + j] >> 16);
-        }
-        GraphBuffer[i] = lowTot - highTot;
+        int v = lowTot - highTot;
+        lowTot += (GraphBuffer[i + 16] & 0xffff) - (GraphBuffer[i] & 0xffff);
+        highTot += (GraphBuffer[i + 15] >> 16) - (GraphBuffer[i] >> 16);
+        GraphBuffer[i] = v;
     }
 
     GraphTraceLen -= (convLen + 16);
@@ -138,22 +185,20 @@ static int CmdTIDemod(const char *Cmd) {
     // Okay, so now we have unsliced soft decisions;
     // find bit-sync, and then get some bits.
     // look for 17 low bits followed by 6 highs (common pattern for ro and rw tags)
+    prefix_sum(prefix, GraphBuffer, syncLen);
+
     int max = 0, maxPos = 0;
     for (i = 0; i < 6000; i++) {
-        int dec = 0;
-        // searching 17 consecutive lows
-        for (j = 0; j < 17 * lowLen; j++) {
-            dec -= GraphBuffer[i + j];
-        }
-        // searching 7 consecutive highs
-        for (; j < 17 * lowLen + 6 * highLen; j++) {
-            dec += GraphBuffer[i + j];
-        }
+        // searching 17 consecutive lows, then 7 consecutive highs
+        int64_t lows = prefix[i + 17 * lowLen] - prefix[i];
+        int64_t highs = prefix[i + syncLen - 6000] - prefix[i + 17 * lowLen];
+        int dec = (int)(highs - lows);
         if (dec > max) {
             max = dec;
             maxPos = i;
         }
     }
+    free(prefix);
 
     // place a marker in the buffer to visually aid location
     // of the start of sync
@@ -179,6 +224,10 @@ static int CmdTIDemod(const char *Cmd) {
 
     for (i = 0; i < ARRAYLEN(bits) - 1; i++) {
         int high = 0, low = 0;
+        if (maxPos + highLen > GraphTraceLen) {
+            PrintAndLogEx(DEBUG, "capture ends before the last data bit");
+            goto out;
+        }
         for (j = 0; j < lowLen; j++) {
             low -= GraphBuffer[maxPos + j];
         }
@@ -267,9 +316,8 @@ static int CmdTIDemod(const char *Cmd) {
     }
 
 out:
-    if (retval != PM3_SUCCESS)
-        save_restoreGB(GRAPH_RESTORE);
-
+    PopLFWorkspace(ws, (retval == PM3_SUCCESS) ? LF_KEEP_GRAPH : LF_KEEP_NOTHING);
+    RepaintGraphWindow();
     return retval;
 }
 
@@ -97,15 +97,12 @@ static uint8_t visa_parity(uint32_t id) {
 static int CmdVisa2kDemod(const char *Cmd) {
     (void)Cmd; // Cmd is not used so far
 
-    save_restoreGB(GRAPH_SAVE);
-
     //CmdAskEdgeDetect("");
 
     //ASK / Manchester
     bool st = true;
     if (ASKDemod_ext("64 0 0", false, false, 1, &st) != PM3_SUCCESS) {
         PrintAndLogEx(DEBUG, "DEBUG: Error - Visa2k: ASK/Manchester Demod failed");
-        save_restoreGB(GRAPH_RESTORE);
         return PM3_ESOFT;
     }
     size_t size = DemodBufferLen;
@@ -120,7 +117,6 @@ static int CmdVisa2kDemod(const char *Cmd) {
         else
             PrintAndLogEx(DEBUG, "DEBUG: Error - Visa2k: ans: %d", ans);
 
-        save_restoreGB(GRAPH_RESTORE);
         return PM3_ESOFT;
     }
     setDemodBuff(DemodBuffer, 96, ans);
@@ -138,7 +134,6 @@ static int CmdVisa2kDemod(const char *Cmd) {
     // test checksums
     if (chk != calc) {
         PrintAndLogEx(DEBUG, "DEBUG: error: Visa2000 checksum failed %x - %x\n", chk, calc);
-        save_restoreGB(GRAPH_RESTORE);
         return PM3_ESOFT;
     }
     // parity
@@ -146,7 +141,6 @@ static int CmdVisa2kDemod(const char *Cmd) {
     uint8_t chk_par = (raw3 & 0xFF0) >> 4;
     if (calc_par != chk_par) {
         PrintAndLogEx(DEBUG, "DEBUG: error: Visa2000 parity failed %x - %x\n", chk_par, calc_par);
-        save_restoreGB(GRAPH_RESTORE);
         return PM3_ESOFT;
     }
     PrintAndLogEx(SUCCESS, "Visa2000 Tag Found: Card ID %u,  Raw: %08X%08X%08X", raw2,  raw1, raw2, raw3);
@@ -183,11 +177,11 @@ static int CmdVisa2kClone(const char *Cmd) {
     PacketResponseNG resp;
 
     // fast push mode
-    conn.block_after_ACK = true;
+    GetConn()->block_after_ACK = true;
     for (uint8_t i = 0; i < 4; i++) {
         if (i == 3) {
             // Disable fast mode on last packet
-            conn.block_after_ACK = false;
+            GetConn()->block_after_ACK = false;
         }
         clearCommandBuffer();
         t55xx_write_block_t ng;
@@ -23,53 +23,53 @@ bool AlwaysAvailable(void) {
 bool IfPm3Present(void) {
     if (session.help_dump_mode)
         return false;
-    return session.pm3_present;
+    return IsPm3Present();
 }
 
 bool IfPm3Flash(void) {
     if (!IfPm3Present())
         return false;
-    if (!pm3_capabilities.compiled_with_flash)
+    if (!GetCapabilities()->compiled_with_flash)
         return false;
-    return pm3_capabilities.hw_available_flash;
+    return GetCapabilities()->hw_available_flash;
 }
 
 bool IfPm3Smartcard(void) {
     if (!IfPm3Present())
         return false;
-    if (!pm3_capabilities.compiled_with_smartcard)
+    if (!GetCapabilities()->compiled_with_smartcard)
         return false;
-    return pm3_capabilities.hw_available_smartcard;
+    return GetCapabilities()->hw_available_smartcard;
 }
 
 bool IfPm3FpcUsart(void) {
     if (!IfPm3Present())
         return false;
-    return pm3_capabilities.compiled_with_fpc_usart;
+    return GetCapabilities()->compiled_with_fpc_usart;
 }
 
 bool IfPm3FpcUsartHost(void) {
     if (!IfPm3Present())
         return false;
-    return pm3_capabilities.compiled_with_fpc_usart_host;
+    return GetCapabilities()->compiled_with_fpc_usart_host;
 }
 
 bool IfPm3FpcUsartHostFromUsb(void) {
     // true if FPC USART Host support and if talking from USB-CDC interface
     if (!IfPm3Present())
         return false;
-    if (!pm3_capabilities.compiled_with_fpc_usart_host)
+    if (!GetCapabilities()->compiled_with_fpc_usart_host)
         return false;
-    return !conn.send_via_fpc_usart;
+    return !GetConn()->send_via_fpc_usart;
 }
 
 bool IfPm3FpcUsartDevFromUsb(void) {
     // true if FPC USART developer support and if talking from USB-CDC interface
     if (!IfPm3Present())
         return false;
-    if (!pm3_capabilities.compiled_with_fpc_usart_dev)
+    if (!GetCapabilities()->compiled_with_fpc_usart_dev)
         return false;
-    return !conn.send_via_fpc_usart;
+    return !GetConn()->send_via_fpc_usart;
 }
 
 bool IfPm3FpcUsartFromUsb(void) {
@@ -80,73 +80,73 @@ bool IfPm3FpcUsartFromUsb(void) {
 bool IfPm3Lf(void) {
     if (!IfPm3Present())
         return false;
-    return pm3_capabilities.compiled_with_lf;
+    return GetCapabilities()->compiled_with_lf;
 }
 
 bool IfPm3Hitag(void) {
     if (!IfPm3Present())
         return false;
-    return pm3_capabilities.compiled_with_hitag;
+    return GetCapabilities()->compiled_with_hitag;
 }
 
 bool IfPm3Hfsniff(void) {
     if (!IfPm3Present())
         return false;
-    return pm3_capabilities.compiled_with_hfsniff;
+    return GetCapabilities()->compiled_with_hfsniff;
 }
 
 bool IfPm3Iso14443a(void) {
     if (!IfPm3Present())
         return false;
-    return pm3_capabilities.compiled_with_iso14443a;
+    return GetCapabilities()->compiled_with_iso14443a;
 }
 
 bool IfPm3Iso14443b(void) {
     if (!IfPm3Present())
         return false;
-    return pm3_capabilities.compiled_with_iso14443b;
+    return GetCapabilities()->compiled_with_iso14443b;
 }
 
 bool IfPm3Iso14443(void) {
     if (!IfPm3Present())
         return false;
-    return pm3_capabilities.compiled_with_iso14443a || pm3_capabilities.compiled_with_iso14443b;
+    return GetCapabilities()->compiled_with_iso14443a || GetCapabilities()->compiled_with_iso14443b;
 }
 
 bool IfPm3Iso15693(void) {
     if (!IfPm3Present())
         return false;
-    return pm3_capabilities.compiled_with_iso15693;
+    return GetCapabilities()->compiled_with_iso15693;
 }
 
 bool IfPm3Felica(void) {
     if (!IfPm3Present())
         return false;
-    return pm3_capabilities.compiled_with_felica;
+    return GetCapabilities()->compiled_with_felica;
 }
 
 bool IfPm3Legicrf(void) {
     if (!IfPm3Present())
         return false;
-    return pm3_capabilities.compiled_with_legicrf;
+    return GetCapabilities()->compiled_with_legicrf;
 }
 
 bool IfPm3Iclass(void) {
     if (!IfPm3Present())
         return false;
-    return pm3_capabilities.compiled_with_iclass;
+    return GetCapabilities()->compiled_with_iclass;
 }
 
 bool IfPm3NfcBarcode(void) {
     if (!IfPm3Present())
         return false;
-    return pm3_capabilities.compiled_with_nfcbarcode;
+    return GetCapabilities()->compiled_with_nfcbarcode;
 }
 
 bool IfPm3Lcd(void) {
     if (!IfPm3Present())
         return false;
-    return pm3_capabilities.compiled_with_lcd;
+    return GetCapabilities()->compiled_with_lcd;
 }
 
 
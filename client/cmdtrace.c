@@ -10,6 +10,12 @@
 #include "cmdtrace.h"
 
 #include <ctype.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include "cmdparser.h"    // command_t
 #include "protocols.h"
@@ -23,6 +29,22 @@ static int CmdHelp(const char *Cmd);
 // trace pointer
 static uint8_t *trace;
 long traceLen = 0;
+// length of the file mapping when trace points into a loaded file, 0 for heap memory
+static size_t trace_mapped = 0;
+// offset of every record in trace, built once per load / download
+static uint32_t *trace_index = NULL;
+static uint32_t trace_records = 0;
+
+// record header: 32 bits timestamp, 16 bits duration, 16 bits data length | response flag
+#define TRACE_HDR_LEN   (sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint16_t))
+
+typedef struct {
+    uint32_t start;     // relative to the first record, like the Start column
+    uint32_t end;
+    int8_t src;         // -1 any, 0 reader, 1 tag
+    uint8_t cmd[8];     // frame must start with these bytes
+    uint8_t cmdlen;
+} trace_filter_t;
 
 static int usage_trace_list() {
     PrintAndLogEx(NORMAL, "List protocol data in trace buffer.");
@@ -32,6 +54,11 @@ static int usage_trace_list() {
     PrintAndLogEx(NORMAL, "    x      - show hexdump to convert to pcap(ng) or to import into Wireshark using encapsulation type \"ISO 14443\"");
     PrintAndLogEx(NORMAL, "             syntax to use: `text2pcap -t \"%%S.\" -l 264 -n <input-text-file> <output-pcapng-file>`");
     PrintAndLogEx(NORMAL, "    <0|1>  - use data from Tracebuffer, if not set, try reading data from tag.");
+    PrintAndLogEx(NORMAL, "    s <n>  - start listing at record n");
+    PrintAndLogEx(NORMAL, "    n <n>  - list at most n records (page size)");
+    PrintAndLogEx(NORMAL, "    t <start> <end> - only records whose start time is in this range");
+    PrintAndLogEx(NORMAL, "    d <r|t> - only reader (r) or tag (t) records");
+    PrintAndLogEx(NORMAL, "    m <hex> - only records starting with these bytes, e.g. 60 for mifare auth A");
     PrintAndLogEx(NORMAL, "Supported <protocol> values:");
     PrintAndLogEx(NORMAL, "    raw      - just show raw data without annotations");
     PrintAndLogEx(NORMAL, "    14a      - interpret data as iso14443a communications");
@@ -50,6 +77,11 @@ static int usage_trace_list() {
     PrintAndLogEx(NORMAL, "Examples:");
     PrintAndLogEx(NORMAL, "        trace list 14a f");
     PrintAndLogEx(NORMAL, "        trace list iclass");
+    PrintAndLogEx(NORMAL, "        trace list 14a 1 s 2000 n 100     - records 2000..2099 of a loaded trace");
+    PrintAndLogEx(NORMAL, "        trace list mf 1 d r m 60           - reader frames starting with 0x60");
+    PrintAndLogEx(NORMAL, "        trace list 14a 1 t 100000 200000");
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, "Note: mf decryption follows the auth in the listed records, start before it.");
     return 0;
 }
 static int usage_trace_load() {
@@ -67,16 +99,107 @@ static int usage_trace_save() {
     return 0;
 }
 
-static bool is_last_record(uint16_t tracepos, uint8_t *trace, uint16_t traceLen) {
+static bool is_last_record(uint32_t tracepos, uint8_t *trace, uint32_t traceLen) {
     return (tracepos + sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint16_t) >= traceLen);
 }
 
-static bool next_record_is_response(uint16_t tracepos, uint8_t *trace) {
+static bool next_record_is_response(uint32_t tracepos, uint8_t *trace) {
     uint16_t next_records_datalen = *((uint16_t *)(trace + tracepos + sizeof(uint32_t) + sizeof(uint16_t)));
     return ((next_records_datalen & 0x8000) == 0x8000);
 }
 
-static bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, uint16_t *tracepos, uint16_t traceLen,
+static void trace_free(void) {
+#ifndef _WIN32
+    if (trace_mapped) {
+        munmap(trace, trace_mapped);
+        trace = NULL;
+    }
+#endif
+    free(trace);
+    trace = NULL;
+    trace_mapped = 0;
+    traceLen = 0;
+    free(trace_index);
+    trace_index = NULL;
+    trace_records = 0;
+}
+
+// offset of the record after the one at tracepos, traceLen if it is truncated
+static uint32_t trace_next_record(uint32_t tracepos) {
+    if (tracepos + TRACE_HDR_LEN > (uint32_t)traceLen)
+        return traceLen;
+
+    uint16_t data_len = *((uint16_t *)(trace + tracepos + sizeof(uint32_t) + sizeof(uint16_t))) & 0x7FFF;
+    uint16_t parity_len = (data_len - 1) / 8 + 1;
+    uint32_t next = tracepos + TRACE_HDR_LEN + data_len + parity_len;
+    return (next > (uint32_t)traceLen) ? traceLen : next;
+}
+
+// walk the trace once and remember where every record starts
+static int trace_build_index(void) {
+    free(trace_index);
+    trace_index = NULL;
+    trace_records = 0;
+
+    uint32_t cap = 0;
+    uint32_t tracepos = 0;
+    while (tracepos + TRACE_HDR_LEN <= (uint32_t)traceLen) {
+        if (trace_records == cap) {
+            cap = (cap) ? cap * 2 : 1024;
+            uint32_t *tmp = realloc(trace_index, cap * sizeof(uint32_t));
+            if (tmp == NULL) {
+                PrintAndLogEx(FAILED, "Cannot allocate memory for trace index");
+                free(trace_index);
+                trace_index = NULL;
+                trace_records = 0;
+                return PM3_EMALLOC;
+            }
+            trace_index = tmp;
+        }
+        trace_index[trace_records++] = tracepos;
+        tracepos = trace_next_record(tracepos);
+    }
+    return PM3_SUCCESS;
+}
+
+// index of the record containing tracepos
+static uint32_t trace_record_at(uint32_t tracepos) {
+    uint32_t lo = 0, hi = trace_records;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (trace_index[mid] <= tracepos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (lo) ? lo - 1 : 0;
+}
+
+static bool trace_filter_match(uint32_t tracepos, uint32_t first_timestamp, const trace_filter_t *f) {
+    // a trailing partial record never matches
+    if (tracepos + TRACE_HDR_LEN > (uint32_t)traceLen)
+        return false;
+
+    uint32_t timestamp = *((uint32_t *)(trace + tracepos)) - first_timestamp;
+    if (timestamp < f->start || timestamp > f->end)
+        return false;
+
+    uint16_t data_len = *((uint16_t *)(trace + tracepos + sizeof(uint32_t) + sizeof(uint16_t)));
+    bool isResponse = (data_len & 0x8000);
+    data_len &= 0x7FFF;
+    if (f->src >= 0 && isResponse != (f->src == 1))
+        return false;
+
+    if (f->cmdlen) {
+        if (data_len < f->cmdlen || tracepos + TRACE_HDR_LEN + f->cmdlen > (uint32_t)traceLen)
+            return false;
+        if (memcmp(trace + tracepos + TRACE_HDR_LEN, f->cmd, f->cmdlen) != 0)
+            return false;
+    }
+    return true;
+}
+
+static bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, uint32_t *tracepos, uint32_t traceLen,
                                       uint8_t *trace, uint8_t *frame, uint8_t *topaz_reader_command, uint16_t *data_len) {
 
 #define MAX_TOPAZ_READER_CMD_LEN 16
@@ -114,7 +237,7 @@ static bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, ui
     return true;
 }
 
-static uint16_t printHexLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, uint8_t protocol) {
+static uint32_t printHexLine(uint32_t tracepos, uint32_t traceLen, uint8_t *trace, uint8_t protocol) {
     // sanity check
     if (tracepos + sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint16_t) > traceLen) return traceLen;
 
@@ -197,7 +320,7 @@ static uint16_t printHexLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trac
     return tracepos;
 }
 
-static uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, uint8_t protocol, bool showWaitCycles, bool markCRCBytes) {
+static uint32_t printTraceLine(uint32_t tracepos, uint32_t traceLen, uint8_t *trace, uint8_t protocol, bool showWaitCycles, bool markCRCBytes) {
     // sanity check
     if (tracepos + sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint16_t) > traceLen) return traceLen;
 
@@ -409,12 +532,12 @@ static uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *tr
     return tracepos;
 }
 
-static void printFelica(uint16_t traceLen, uint8_t *trace) {
+static void printFelica(uint32_t traceLen, uint8_t *trace) {
 
     PrintAndLogEx(NORMAL, "ISO18092 / FeliCa - Timings are not as accurate");
     PrintAndLogEx(NORMAL, "    Gap | Src | Data                            | CRC      | Annotation        |");
     PrintAndLogEx(NORMAL, "--------|-----|---------------------------------|----------|-------------------|");
-    uint16_t tracepos = 0;
+    uint32_t tracepos = 0;
 
     while (tracepos < traceLen) {
 
@@ -611,13 +734,51 @@ static int SanityOfflineCheck( bool useTraceBuffer ){
 
 static int CmdTraceLoad(const char *Cmd) {
 
-    FILE *f = NULL;
     char filename[FILE_PATH_SIZE];
     char cmdp = tolower(param_getchar(Cmd, 0));
     if (strlen(Cmd) < 1 || cmdp == 'h') return usage_trace_load();
 
     param_getstr(Cmd, 0, filename, sizeof(filename));
 
+#ifndef _WIN32
+    // map the file instead of copying it, long sniff sessions can be large.
+    // MAP_PRIVATE since listing some protocols touches the frame bytes.
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        PrintAndLogEx(FAILED, "Could not open file " _YELLOW_("%s"), filename);
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        PrintAndLogEx(FAILED, "error, when getting filesize");
+        close(fd);
+        return 3;
+    }
+    if (st.st_size < 4) {
+        PrintAndLogEx(FAILED, "error, file is too small");
+        close(fd);
+        return 4;
+    }
+    if ((uint64_t)st.st_size > UINT32_MAX) {
+        PrintAndLogEx(FAILED, "error, file is too large");
+        close(fd);
+        return 4;
+    }
+
+    uint8_t *p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        PrintAndLogEx(FAILED, "Cannot map trace file");
+        return 2;
+    }
+
+    trace_free();
+    trace = p;
+    trace_mapped = st.st_size;
+    traceLen = st.st_size;
+#else
+    FILE *f = NULL;
     if ((f = fopen(filename, "rb")) == NULL) {
         PrintAndLogEx(FAILED, "Could not open file " _YELLOW_("%s"), filename);
         return 0;
@@ -639,8 +800,7 @@ static int CmdTraceLoad(const char *Cmd) {
         return 4;
     }
 
-    if (trace)
-        free(trace);
+    trace_free();
 
     trace = calloc(fsize, sizeof(uint8_t));
     if (!trace) {
@@ -652,7 +812,10 @@ static int CmdTraceLoad(const char *Cmd) {
     size_t bytes_read = fread(trace, 1, fsize, f);
     traceLen = bytes_read;
     fclose(f);
-    PrintAndLogEx(SUCCESS, "Recorded Activity (TraceLen = %d bytes) loaded from file %s", traceLen, filename);
+#endif
+
+    trace_build_index();
+    PrintAndLogEx(SUCCESS, "Recorded Activity (TraceLen = %ld bytes, %u records) loaded from file %s", traceLen, trace_records, filename);
     return 0;
 }
 
@@ -702,6 +865,10 @@ int CmdTraceList(const char *Cmd) {
     bool errors = false;
     uint8_t protocol = 0;
     char type[10] = {0};
+    uint32_t start_record = 0;
+    uint32_t max_records = UINT32_MAX;
+    trace_filter_t filter = { 0, UINT32_MAX, -1, {0}, 0 };
+    bool filtering = false;
 
     //int tlen = param_getstr(Cmd,0,type);
     //char param1 = param_getchar(Cmd, 1);
@@ -736,6 +903,47 @@ int CmdTraceList(const char *Cmd) {
                     isOnline = false;
                     cmdp++;
                     break;
+                case 's':
+                    start_record = param_get32ex(Cmd, cmdp + 1, 0, 10);
+                    cmdp += 2;
+                    break;
+                case 'n':
+                    max_records = param_get32ex(Cmd, cmdp + 1, 0, 10);
+                    if (max_records == 0)
+                        errors = true;
+                    cmdp += 2;
+                    break;
+                case 't':
+                    filter.start = param_get32ex(Cmd, cmdp + 1, 0, 10);
+                    filter.end = param_get32ex(Cmd, cmdp + 2, UINT32_MAX, 10);
+                    if (filter.end < filter.start)
+                        errors = true;
+                    filtering = true;
+                    cmdp += 3;
+                    break;
+                case 'd': {
+                    char src = tolower(param_getchar(Cmd, cmdp + 1));
+                    if (src == 'r')
+                        filter.src = 0;
+                    else if (src == 't')
+                        filter.src = 1;
+                    else
+                        errors = true;
+                    filtering = true;
+                    cmdp += 2;
+                    break;
+                }
+                case 'm': {
+                    int hexlen = param_getlength(Cmd, cmdp + 1);
+                    if (hexlen == 0 || hexlen > (int)sizeof(filter.cmd) * 2 || param_gethex_ex(Cmd, cmdp + 1, filter.cmd, &hexlen)) {
+                        PrintAndLogEx(WARNING, "command filter must be 1-%zu hex bytes", sizeof(filter.cmd));
+                        errors = true;
+                    }
+                    filter.cmdlen = hexlen / 2;
+                    filtering = true;
+                    cmdp += 2;
+                    break;
+                }
                 default:
                     PrintAndLogEx(WARNING, "Unknown parameter '%c'", param_getchar(Cmd, cmdp));
                     errors = true;
@@ -771,7 +979,11 @@ int CmdTraceList(const char *Cmd) {
     //Validations
     if (errors) return usage_trace_list();
 
-    uint16_t tracepos = 0;
+    uint32_t tracepos = 0;
+
+    // a mapped trace file can't be resized, download into heap memory
+    if (isOnline && trace_mapped)
+        trace_free();
 
     // reserv some space.
     if (!trace)
@@ -790,25 +1002,53 @@ int CmdTraceList(const char *Cmd) {
             uint8_t *p = realloc(trace, traceLen);
             if (p == NULL) {
                 PrintAndLogEx(FAILED, "Cannot allocate memory for trace");
-                free(trace);
+                trace_free();
                 return 2;
             }
             trace = p;
             if (!GetFromDevice(BIG_BUF, trace, traceLen, 0, NULL, 0, NULL, 2500, false)) {
                 PrintAndLogEx(WARNING, "command execution time out");
-                free(trace);
+                trace_free();
                 return 3;
             }
         }
+        trace_build_index();
+    } else if (trace_index == NULL) {
+        trace_build_index();
+    }
+
+    if (start_record && start_record >= trace_records) {
+        PrintAndLogEx(WARNING, "start record %u is past the end, trace has %u records", start_record, trace_records);
+        return 0;
     }
+    if (start_record)
+        tracepos = trace_index[start_record];
 
     PrintAndLogEx(SUCCESS, "Recorded Activity (TraceLen = %d bytes)", traceLen);
     PrintAndLogEx(INFO, "");
     if (protocol == FELICA) {
         printFelica(traceLen, trace);
     } else if (showHex) {
+        uint32_t first_timestamp = *((uint32_t *)(trace));
+        uint32_t shown = 0;
         while (tracepos < traceLen) {
+            if (filtering && !trace_filter_match(tracepos, first_timestamp, &filter)) {
+                tracepos = trace_next_record(tracepos);
+                continue;
+            }
+
+            if (shown == max_records) {
+                uint32_t next = trace_record_at(tracepos);
+                PrintAndLogEx(NORMAL, "");
+                PrintAndLogEx(INFO, "listed %u records, continue with " _YELLOW_("s %u") " (%u records in trace)", shown, next, trace_records);
+                break;
+            }
+
             tracepos = printHexLine(tracepos, traceLen, trace, protocol);
+            shown++;
+
+            if (kbd_enter_pressed())
+                break;
         }
     } else {
         PrintAndLogEx(NORMAL, "Start = Start of Start Bit, End = End of last modulation. Src = Source of Transfer");
@@ -837,8 +1077,23 @@ int CmdTraceList(const char *Cmd) {
         PrintAndLogEx(NORMAL, "------------+------------+-----+-------------------------------------------------------------------------+-----+--------------------");
 
         ClearAuthData();
+        uint32_t first_timestamp = *((uint32_t *)(trace));
+        uint32_t shown = 0;
         while (tracepos < traceLen) {
+            if (filtering && !trace_filter_match(tracepos, first_timestamp, &filter)) {
+                tracepos = trace_next_record(tracepos);
+                continue;
+            }
+
+            if (shown == max_records) {
+                uint32_t next = trace_record_at(tracepos);
+                PrintAndLogEx(NORMAL, "");
+                PrintAndLogEx(INFO, "listed %u records, continue with " _YELLOW_("s %u") " (%u records in trace)", shown, next, trace_records);
+                break;
+            }
+
             tracepos = printTraceLine(tracepos, traceLen, trace, protocol, showWaitCycles, markCRCBytes);
+            shown++;
 
             if (kbd_enter_pressed())
                 break;
@@ -18,49 +18,168 @@
 #include "uart.h"
 #include "ui.h"
 #include "crc16.h"
-#include "util_posix.h" // msclock
+#include "util_posix.h" // msclock, msdeadline
 #include "util_darwin.h" // en/dis-ableNapp();
 
 //#define COMMS_DEBUG
 //#define COMMS_DEBUG_RAW
 
-// Serial port that we are communicating with the PM3 on.
-static serial_port sp = NULL;
-
-communication_arg_t conn;
-capabilities_t pm3_capabilities;
-
-static pthread_t communication_thread;
-static bool comm_thread_dead = false;
+// Transmit queue slot.
+// Commands are queued by SendCommand* / SubmitCommand* and drained by the
+// communication thread, so a caller only blocks when the queue is full.
+typedef struct {
+    union {
+        PacketCommandOLD old;
+        PacketCommandNGRaw ng;
+    } frame;
+    size_t ngLen;        // 0 if it holds an OLD frame
+} tx_slot_t;
+
+// Requests submitted through SubmitCommand* which are waiting to be reaped.
+// Only touched by the thread issuing commands.
+typedef struct {
+    uint32_t id;
+    uint16_t reply_cmd;
+} pending_request_t;
+
+// Waiter slot states, replies for the command a handler is currently waiting for are handed
+// over by the communication thread without going through rxBuffer.
+enum {
+    WAITER_IDLE,
+    WAITER_CLAIMED,  // being set up by its owner
+    WAITER_ARMED,
+    WAITER_FILLING,
+    WAITER_READY,
+    WAITER_KEPT      // reply which arrived after the owner got one from rxBuffer, for its next wait
+};
+
+// One waiter slot per thread waiting on a device, so threads waiting for different
+// commands don't take each other's replies. Further waiters poll rxBuffer.
+#define RX_WAITERS 4
+
+typedef struct {
+    int state;
+    pthread_t owner;
+    uint16_t cmd;
+    uint32_t wtx;    // Waiting Time eXtensions received while armed, in ms
+    PacketResponseNG packet;
+} rx_waiter_t;
+
+// Everything belonging to one connection to a Proxmark3.
+// Command handlers talk to the device set for their thread, by default the selected one.
+typedef struct {
+    bool used;
+
+    // Serial port that we are communicating with the PM3 on.
+    serial_port sp;
+    pthread_t communication_thread;
+    bool comm_thread_dead;
+
+    communication_arg_t conn;
+    capabilities_t capabilities;
+    bool present;
+
+    tx_slot_t txQueue[TX_QUEUE_SIZE];
+    // Points to the next free slot to write to
+    int tx_head;
+    // Points to the oldest slot not sent yet
+    int tx_tail;
+    pthread_mutex_t txBufferMutex;
+    pthread_cond_t txBufferSig;
+
+    pending_request_t pendingRequests[TX_QUEUE_SIZE];
+    int pending_head;
+    int pending_tail;
+    uint32_t request_seq;
+
+    // Used by PacketResponseReceived as a ring buffer for messages that are yet to be
+    // processed by a command handler (WaitForResponse{,Timeout})
+    // One producer, the communication thread. Consumers (getReply, takeReply, clearCommandBuffer)
+    // may be several threads and take turns with rxTakeMutex, the producer doesn't take it.
+    // head and tail are free running counters, reply n lives in rxBuffer[n % CMD_BUFFER_SIZE].
+    // head is only written by the producer. tail is moved by the consumer holding rxTakeMutex and by
+    // the producer when it drops the oldest reply of a full ring, so both move it with a CAS.
+    // With rx_backpressure set the producer sleeps on rxSpaceSig under rxSigMutex instead of dropping.
+    // Replies a handler is waiting for skip the ring, see rx_waiters.
+    struct {
+        PacketResponseNG packet;
+        uint32_t taken;  // == counter of the reply if takeReply took it out of order, consumer only
+    } rxBuffer[CMD_BUFFER_SIZE];
+    // Counter of the next reply to write
+    uint32_t cmd_head;
+    // Counter of the oldest unread reply
+    uint32_t cmd_tail;
+
+    pthread_mutex_t rxTakeMutex;
+
+    rx_waiter_t rx_waiters[RX_WAITERS];
+
+    // to wake up the consumer as soon as a reply arrives
+    pthread_mutex_t rxSigMutex;
+    pthread_cond_t rxSig;
+
+    // While a download is running, the communication thread waits for room in rxBuffer
+    // instead of dropping chunks the consumer didn't get to yet.
+    bool rx_backpressure;
+    pthread_cond_t rxSpaceSig;
+
+    // Start time for WaitForResponseTimeout & dl_it, so we can reset timeout when we get packets
+    // as sending lot of these packets can slow down things wuite a lot on slow links (e.g. hw status or lf read at 9600)
+    uint64_t timeout_start_time;
+    uint64_t last_packet_time;
+
+    // link statistics, see `hw stats`
+    pthread_mutex_t statsMutex;
+    comms_stats_t stats;
+} pm3_device_t;
+
+// Device 0 always exists, the others are added with AddDevice
+static pm3_device_t devices[MAX_DEVICES] = {
+    [0] = {
+        .used = true,
+        .txBufferMutex = PTHREAD_MUTEX_INITIALIZER,
+        .txBufferSig = PTHREAD_COND_INITIALIZER,
+        .rxTakeMutex = PTHREAD_MUTEX_INITIALIZER,
+        .rxSigMutex = PTHREAD_MUTEX_INITIALIZER,
+        .rxSig = PTHREAD_COND_INITIALIZER,
+        .rxSpaceSig = PTHREAD_COND_INITIALIZER,
+        .statsMutex = PTHREAD_MUTEX_INITIALIZER,
+    }
+};
+static int selected_device = 0;
+// device the calling thread talks to, -1 follows selected_device
+static __thread int thread_device = -1;
 
-// Transmit buffer.
-static PacketCommandOLD txBuffer;
-static PacketCommandNGRaw txBufferNG;
-size_t txBufferNGLen;
-static bool txBuffer_pending = false;
-static pthread_mutex_t txBufferMutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t txBufferSig = PTHREAD_COND_INITIALIZER;
+#define RX_SLOT(d, n) (&(d)->rxBuffer[(n) % CMD_BUFFER_SIZE])
 
-// Used by PacketResponseReceived as a ring buffer for messages that are yet to be
-// processed by a command handler (WaitForResponse{,Timeout})
-static PacketResponseNG rxBuffer[CMD_BUFFER_SIZE];
+#define TX_QUEUE_EMPTY(d) ((d)->tx_head == (d)->tx_tail)
+#define TX_QUEUE_FULL(d)  ((((d)->tx_head + 1) % TX_QUEUE_SIZE) == (d)->tx_tail)
 
-// Points to the next empty position to write to
-static int cmd_head = 0;
+// max time a waiter sleeps before checking its timeout again
+#define RX_WAIT_SLICE_MS 100
 
-// Points to the position of the last unread command
-static int cmd_tail = 0;
+#define RX_BACKPRESSURE_MS 1000
 
-// to lock rxBuffer operations from different threads
-static pthread_mutex_t rxBufferMutex = PTHREAD_MUTEX_INITIALIZER;
+static pm3_device_t *current_device(void) {
+    if (thread_device >= 0)
+        return &devices[thread_device];
+    return &devices[__atomic_load_n(&selected_device, __ATOMIC_ACQUIRE)];
+}
 
-// Global start time for WaitForResponseTimeout & dl_it, so we can reset timeout when we get packets
-// as sending lot of these packets can slow down things wuite a lot on slow links (e.g. hw status or lf read at 9600)
-static uint64_t timeout_start_time;
+static bool takeKept(pm3_device_t *dev, uint16_t cmd, PacketResponseNG *response);
+static bool dl_it(DeviceMemType_t memtype, uint32_t bytes, uint32_t start_index, uint8_t *data, uint32_t datalen, dl_sink_t *sink, PacketResponseNG *response, size_t ms_timeout, bool show_warning);
 
-static uint64_t last_packet_time;
+static void stats_event(pm3_device_t *dev, comms_event_t ev) {
+    pthread_mutex_lock(&dev->statsMutex);
+    comms_stats_event(&dev->stats, ev);
+    pthread_mutex_unlock(&dev->statsMutex);
+}
 
-static bool dl_it(uint8_t *dest, uint32_t bytes, uint32_t start_index, PacketResponseNG *response, size_t ms_timeout, bool show_warning, uint32_t rec_cmd);
+static void stats_depth(pm3_device_t *dev, comms_depth_t which, uint32_t depth) {
+    pthread_mutex_lock(&dev->statsMutex);
+    comms_stats_depth(&dev->stats, which, depth);
+    pthread_mutex_unlock(&dev->statsMutex);
+}
 
 // Simple alias to track usages linked to the Bootloader, these commands must not be migrated.
 // - commands sent to enter bootloader mode as we might have to talk to old firmwares
@@ -70,6 +189,7 @@ void SendCommandBL(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, vo
 }
 
 void SendCommandOLD(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *data, size_t len) {
+    pm3_device_t *dev = current_device();
     PacketCommandOLD c = {CMD_UNKNOWN, {0, 0, 0}, {{0}}};
     c.cmd = cmd;
     c.arg[0] = arg0;
@@ -87,91 +207,103 @@ void SendCommandOLD(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, v
     print_hex_break((uint8_t *)&c.d, sizeof(c.d), 32);
 #endif
 
-    if (!session.pm3_present) {
+    if (!dev->present) {
         PrintAndLogEx(WARNING, "Sending bytes to Proxmark3 failed." _YELLOW_("offline"));
         return;
     }
 
-    pthread_mutex_lock(&txBufferMutex);
+    pthread_mutex_lock(&dev->txBufferMutex);
     /**
     This causes hangups at times, when the pm3 unit is unresponsive or disconnected. The main console thread is alive,
     but comm thread just spins here. Not good.../holiman
     **/
-    while (txBuffer_pending) {
-        // wait for communication thread to complete sending a previous commmand
-        pthread_cond_wait(&txBufferSig, &txBufferMutex);
+    if (TX_QUEUE_FULL(dev))
+        stats_event(dev, COMMS_TX_STALL);
+
+    while (TX_QUEUE_FULL(dev)) {
+        // wait for communication thread to free a slot in the queue
+        pthread_cond_wait(&dev->txBufferSig, &dev->txBufferMutex);
     }
 
-    txBuffer = c;
-    txBuffer_pending = true;
+    dev->txQueue[dev->tx_head].frame.old = c;
+    dev->txQueue[dev->tx_head].ngLen = 0;
+    dev->tx_head = (dev->tx_head + 1) % TX_QUEUE_SIZE;
+    stats_depth(dev, COMMS_DEPTH_TX_QUEUE, (dev->tx_head - dev->tx_tail + TX_QUEUE_SIZE) % TX_QUEUE_SIZE);
 
     // tell communication thread that a new command can be send
-    pthread_cond_signal(&txBufferSig);
+    pthread_cond_broadcast(&dev->txBufferSig);
 
-    pthread_mutex_unlock(&txBufferMutex);
+    pthread_mutex_unlock(&dev->txBufferMutex);
 
 //__atomic_test_and_set(&txcmd_pending, __ATOMIC_SEQ_CST);
 }
 
-static void SendCommandNG_internal(uint16_t cmd, uint8_t *data, size_t len, bool ng) {
+static int SendCommandNG_internal(uint16_t cmd, uint8_t *data, size_t len, bool ng) {
+    pm3_device_t *dev = current_device();
 #ifdef COMMS_DEBUG
     PrintAndLogEx(NORMAL, "Sending %s", ng ? "NG" : "MIX");
 #endif
 
-    if (!session.pm3_present) {
+    if (!dev->present) {
         PrintAndLogEx(NORMAL, "Sending bytes to proxmark failed - offline");
-        return;
+        return PM3_ENOTTY;
     }
     if (len > PM3_CMD_DATA_SIZE) {
         PrintAndLogEx(WARNING, "Sending %d bytes of payload is too much, abort", len);
-        return;
+        return PM3_EOVFLOW;
     }
 
-    PacketCommandNGPostamble *tx_post = (PacketCommandNGPostamble *)((uint8_t *)&txBufferNG + sizeof(PacketCommandNGPreamble) + len);
-
-    pthread_mutex_lock(&txBufferMutex);
+    pthread_mutex_lock(&dev->txBufferMutex);
     /**
     This causes hangups at times, when the pm3 unit is unresponsive or disconnected. The main console thread is alive,
     but comm thread just spins here. Not good.../holiman
     **/
-    while (txBuffer_pending) {
-        // wait for communication thread to complete sending a previous commmand
-        pthread_cond_wait(&txBufferSig, &txBufferMutex);
+    if (TX_QUEUE_FULL(dev))
+        stats_event(dev, COMMS_TX_STALL);
+
+    while (TX_QUEUE_FULL(dev)) {
+        // wait for communication thread to free a slot in the queue
+        pthread_cond_wait(&dev->txBufferSig, &dev->txBufferMutex);
     }
 
-    txBufferNG.pre.magic = COMMANDNG_PREAMBLE_MAGIC;
-    txBufferNG.pre.ng = ng;
-    txBufferNG.pre.length = len;
-    txBufferNG.pre.cmd = cmd;
+    PacketCommandNGRaw *txBufferNG = &dev->txQueue[dev->tx_head].frame.ng;
+    PacketCommandNGPostamble *tx_post = (PacketCommandNGPostamble *)((uint8_t *)txBufferNG + sizeof(PacketCommandNGPreamble) + len);
+
+    txBufferNG->pre.magic = COMMANDNG_PREAMBLE_MAGIC;
+    txBufferNG->pre.ng = ng;
+    txBufferNG->pre.length = len;
+    txBufferNG->pre.cmd = cmd;
     if (len > 0 && data)
-        memcpy(&txBufferNG.data, data, len);
+        memcpy(&txBufferNG->data, data, len);
 
-    if ((conn.send_via_fpc_usart && conn.send_with_crc_on_fpc) || ((!conn.send_via_fpc_usart) && conn.send_with_crc_on_usb)) {
+    if ((dev->conn.send_via_fpc_usart && dev->conn.send_with_crc_on_fpc) || ((!dev->conn.send_via_fpc_usart) && dev->conn.send_with_crc_on_usb)) {
         uint8_t first, second;
-        compute_crc(CRC_14443_A, (uint8_t *)&txBufferNG, sizeof(PacketCommandNGPreamble) + len, &first, &second);
+        compute_crc(CRC_14443_A, (uint8_t *)txBufferNG, sizeof(PacketCommandNGPreamble) + len, &first, &second);
         tx_post->crc = (first << 8) + second;
     } else {
         tx_post->crc = COMMANDNG_POSTAMBLE_MAGIC;
     }
 
-    txBufferNGLen = sizeof(PacketCommandNGPreamble) + len + sizeof(PacketCommandNGPostamble);
+    dev->txQueue[dev->tx_head].ngLen = sizeof(PacketCommandNGPreamble) + len + sizeof(PacketCommandNGPostamble);
 
 #ifdef COMMS_DEBUG_RAW
-    print_hex_break((uint8_t *)&txBufferNG.pre, sizeof(PacketCommandNGPreamble), 32);
+    print_hex_break((uint8_t *)&txBufferNG->pre, sizeof(PacketCommandNGPreamble), 32);
     if (ng) {
-        print_hex_break((uint8_t *)&txBufferNG.data, len, 32);
+        print_hex_break((uint8_t *)&txBufferNG->data, len, 32);
     } else {
-        print_hex_break((uint8_t *)&txBufferNG.data, 3 * sizeof(uint64_t), 32);
-        print_hex_break((uint8_t *)&txBufferNG.data + 3 * sizeof(uint64_t), len - 3 * sizeof(uint64_t), 32);
+        print_hex_break((uint8_t *)&txBufferNG->data, 3 * sizeof(uint64_t), 32);
+        print_hex_break((uint8_t *)&txBufferNG->data + 3 * sizeof(uint64_t), len - 3 * sizeof(uint64_t), 32);
     }
     print_hex_break((uint8_t *)tx_post, sizeof(PacketCommandNGPostamble), 32);
 #endif
-    txBuffer_pending = true;
+    dev->tx_head = (dev->tx_head + 1) % TX_QUEUE_SIZE;
+    stats_depth(dev, COMMS_DEPTH_TX_QUEUE, (dev->tx_head - dev->tx_tail + TX_QUEUE_SIZE) % TX_QUEUE_SIZE);
 
     // tell communication thread that a new command can be send
-    pthread_cond_signal(&txBufferSig);
+    pthread_cond_broadcast(&dev->txBufferSig);
 
-    pthread_mutex_unlock(&txBufferMutex);
+    pthread_mutex_unlock(&dev->txBufferMutex);
+    return PM3_SUCCESS;
 
 //__atomic_test_and_set(&txcmd_pending, __ATOMIC_SEQ_CST);
 }
@@ -193,6 +325,100 @@ void SendCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, v
     SendCommandNG_internal(cmd, cmddata, len + sizeof(arg), false);
 }
 
+static int submit_request(uint16_t reply_cmd, uint32_t *request_id) {
+    pm3_device_t *dev = current_device();
+    dev->pendingRequests[dev->pending_head].id = ++dev->request_seq;
+    dev->pendingRequests[dev->pending_head].reply_cmd = reply_cmd;
+    dev->pending_head = (dev->pending_head + 1) % TX_QUEUE_SIZE;
+    stats_depth(dev, COMMS_DEPTH_PENDING, (dev->pending_head - dev->pending_tail + TX_QUEUE_SIZE) % TX_QUEUE_SIZE);
+    if (request_id)
+        *request_id = dev->request_seq;
+    return PM3_SUCCESS;
+}
+
+/**
+ * @brief Queues a NG command without waiting for its reply.
+ *  Replies are collected in submission order with ReapResponseTimeout, which lets a caller
+ *  keep several commands in flight and hide the link round-trip time.
+ *  Only for commands whose device handler doesn't poll data_available(): sniff, sim and
+ *  similar loops quit as soon as the next queued command arrives.
+ * @param cmd command to send
+ * @param data payload
+ * @param len payload length
+ * @param reply_cmd command id of the reply which completes this request
+ * @param request_id optional, receives the id of the queued request
+ * @return PM3_SUCCESS, PM3_EOVFLOW if too many requests are in flight
+ */
+int SubmitCommandNG(uint16_t cmd, uint8_t *data, size_t len, uint16_t reply_cmd, uint32_t *request_id) {
+    if (GetPendingRequests() >= TX_QUEUE_SIZE - 1)
+        return PM3_EOVFLOW;
+
+    int res = SendCommandNG_internal(cmd, data, len, true);
+    if (res != PM3_SUCCESS)
+        return res;
+
+    return submit_request(reply_cmd, request_id);
+}
+
+int SubmitCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *data, size_t len, uint16_t reply_cmd, uint32_t *request_id) {
+    if (GetPendingRequests() >= TX_QUEUE_SIZE - 1)
+        return PM3_EOVFLOW;
+
+    if (len > PM3_CMD_DATA_SIZE_MIX) {
+        PrintAndLogEx(WARNING, "Sending %d bytes of payload is too much for MIX frames, abort", len);
+        return PM3_EOVFLOW;
+    }
+
+    uint64_t arg[3] = {arg0, arg1, arg2};
+    uint8_t cmddata[PM3_CMD_DATA_SIZE];
+    memcpy(cmddata, arg, sizeof(arg));
+    if (len && data)
+        memcpy(cmddata + sizeof(arg), data, len);
+
+    int res = SendCommandNG_internal(cmd, cmddata, len + sizeof(arg), false);
+    if (res != PM3_SUCCESS)
+        return res;
+
+    return submit_request(reply_cmd, request_id);
+}
+
+/**
+ * @brief Waits for the reply to the oldest submitted request.
+ *  The device handles commands one after another, so replies come back in submission order.
+ * @param request_id optional, receives the id of the completed request
+ * @param response struct to copy received reply into
+ * @param ms_timeout timeout in milliseconds
+ * @return true if a request was completed. On timeout the request stays pending.
+ */
+bool ReapResponseTimeout(uint32_t *request_id, PacketResponseNG *response, size_t ms_timeout) {
+    pm3_device_t *dev = current_device();
+    if (dev->pending_head == dev->pending_tail)
+        return false;
+
+    pending_request_t *req = &dev->pendingRequests[dev->pending_tail];
+    if (WaitForResponseTimeoutW(req->reply_cmd, response, ms_timeout, false) == false)
+        return false;
+
+    if (request_id)
+        *request_id = req->id;
+
+    dev->pending_tail = (dev->pending_tail + 1) % TX_QUEUE_SIZE;
+    return true;
+}
+
+// Number of submitted requests which are not reaped yet
+uint32_t GetPendingRequests(void) {
+    pm3_device_t *dev = current_device();
+    return (dev->pending_head - dev->pending_tail + TX_QUEUE_SIZE) % TX_QUEUE_SIZE;
+}
+
+// Forget about all submitted requests, e.g. after an early exit. Replies still in flight
+// are discarded by the next clearCommandBuffer.
+void CancelPendingRequests(void) {
+    pm3_device_t *dev = current_device();
+    dev->pending_tail = dev->pending_head;
+}
+
 
 /**
  * @brief This method should be called when sending a new command to the pm3. In case any old
@@ -201,65 +427,311 @@ void SendCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, v
  *  operation. Right now we'll just have to live with this.
  */
 void clearCommandBuffer() {
+    pm3_device_t *dev = current_device();
     //This is a very simple operation
-    pthread_mutex_lock(&rxBufferMutex);
-    cmd_tail = cmd_head;
-    pthread_mutex_unlock(&rxBufferMutex);
+    pthread_mutex_lock(&dev->rxTakeMutex);
+    uint32_t head = __atomic_load_n(&dev->cmd_head, __ATOMIC_ACQUIRE);
+    uint32_t tail = __atomic_load_n(&dev->cmd_tail, __ATOMIC_ACQUIRE);
+    // the producer may drop the oldest reply at the same time
+    while ((int32_t)(head - tail) > 0 && __atomic_compare_exchange_n(&dev->cmd_tail, &tail, head, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) == false) {};
+    pthread_mutex_unlock(&dev->rxTakeMutex);
+
+    // drop a reply left over in our waiter slot
+    PacketResponseNG dummy;
+    while (takeKept(dev, CMD_UNKNOWN, &dummy)) {};
+}
+
+static void notifyReply(pm3_device_t *dev) {
+    pthread_mutex_lock(&dev->rxSigMutex);
+    pthread_cond_broadcast(&dev->rxSig);
+    pthread_mutex_unlock(&dev->rxSigMutex);
+}
+
+static bool replyAvailable(pm3_device_t *dev) {
+    if (__atomic_load_n(&dev->cmd_head, __ATOMIC_ACQUIRE) != __atomic_load_n(&dev->cmd_tail, __ATOMIC_ACQUIRE))
+        return true;
+    for (int i = 0; i < RX_WAITERS; i++) {
+        if (__atomic_load_n(&dev->rx_waiters[i].state, __ATOMIC_ACQUIRE) == WAITER_READY)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Sleeps until a reply is available or ms milliseconds elapsed
+ */
+static void waitReply(pm3_device_t *dev, uint32_t ms) {
+    struct timespec ts;
+    msdeadline(&ts, ms);
+
+    pthread_mutex_lock(&dev->rxSigMutex);
+    if (!replyAvailable(dev))
+        pthread_cond_timedwait(&dev->rxSig, &dev->rxSigMutex, &ts);
+    pthread_mutex_unlock(&dev->rxSigMutex);
+}
+
+/**
+ * @brief hands a reply over to a handler waiting for it.
+ *  Waiting Time eXtensions go to every armed waiter.
+ * @return true if a waiter took it
+ */
+static bool deliverReply(pm3_device_t *dev, PacketResponseNG *packet) {
+    bool is_wtx = (packet->cmd == CMD_WTX && packet->length == sizeof(uint16_t));
+    bool taken = false;
+
+    for (int i = 0; i < RX_WAITERS; i++) {
+        rx_waiter_t *w = &dev->rx_waiters[i];
+        if (__atomic_load_n(&w->state, __ATOMIC_ACQUIRE) != WAITER_ARMED)
+            continue;
+
+        if (is_wtx) {
+            __atomic_add_fetch(&w->wtx, packet->data.asDwords[0] & 0xFFFF, __ATOMIC_SEQ_CST);
+            taken = true;
+            continue;
+        }
+
+        if (packet->cmd != __atomic_load_n(&w->cmd, __ATOMIC_ACQUIRE))
+            continue;
+
+        int state = WAITER_ARMED;
+        if (__atomic_compare_exchange_n(&w->state, &state, WAITER_FILLING, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) == false)
+            continue;
+
+        memcpy(&w->packet, packet, sizeof(PacketResponseNG));
+        __atomic_store_n(&w->state, WAITER_READY, __ATOMIC_RELEASE);
+        return true;
+    }
+    return taken;
 }
+
+/**
+ * @brief Frees the waiter slot holding a reply kept for the calling thread
+ * @param cmd the reply is copied to response if it is for cmd, CMD_UNKNOWN only drops it
+ * @return true if a kept reply for cmd was copied, or dropped with CMD_UNKNOWN
+ */
+static bool takeKept(pm3_device_t *dev, uint16_t cmd, PacketResponseNG *response) {
+    for (int i = 0; i < RX_WAITERS; i++) {
+        rx_waiter_t *w = &dev->rx_waiters[i];
+        if (__atomic_load_n(&w->state, __ATOMIC_ACQUIRE) != WAITER_KEPT)
+            continue;
+
+        int state = WAITER_KEPT;
+        if (__atomic_compare_exchange_n(&w->state, &state, WAITER_CLAIMED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) == false)
+            continue;
+
+        // kept for another thread
+        if (pthread_equal(w->owner, pthread_self()) == false) {
+            __atomic_store_n(&w->state, WAITER_KEPT, __ATOMIC_RELEASE);
+            continue;
+        }
+
+        bool match = (w->packet.cmd == cmd || cmd == CMD_UNKNOWN);
+        if (match)
+            memcpy(response, &w->packet, sizeof(PacketResponseNG));
+        __atomic_store_n(&w->state, WAITER_IDLE, __ATOMIC_RELEASE);
+        return match;
+    }
+    return false;
+}
+
+/**
+ * @brief Claims a waiter slot for the calling thread and arms it for cmd.
+ *  A reply kept from this thread's previous wait is returned right away if it is for cmd.
+ * @return the armed slot, NULL if the reply was kept already or all slots are busy
+ */
+static rx_waiter_t *armWaiter(pm3_device_t *dev, uint16_t cmd, PacketResponseNG *response, bool *kept) {
+    pthread_t self = pthread_self();
+
+    // a reply left over from a previous wait
+    *kept = takeKept(dev, cmd, response);
+    if (*kept)
+        return NULL;
+
+    // a free slot, else one which holds a reply kept for another thread
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < RX_WAITERS; i++) {
+            rx_waiter_t *w = &dev->rx_waiters[i];
+            int state = (pass == 0) ? WAITER_IDLE : WAITER_KEPT;
+            if (__atomic_compare_exchange_n(&w->state, &state, WAITER_CLAIMED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) == false)
+                continue;
+
+            w->owner = self;
+            __atomic_store_n(&w->cmd, cmd, __ATOMIC_RELEASE);
+            __atomic_store_n(&w->wtx, 0, __ATOMIC_RELEASE);
+            __atomic_store_n(&w->state, WAITER_ARMED, __ATOMIC_RELEASE);
+            return w;
+        }
+    }
+    return NULL;
+}
+
+// Empties the reply ring, only while no communication thread is running
+static void resetReplies(pm3_device_t *dev) {
+    dev->cmd_head = dev->cmd_tail = 0;
+    for (uint32_t i = 0; i < CMD_BUFFER_SIZE; i++)
+        dev->rxBuffer[i].taken = i + 1;
+}
+
 /**
  * @brief storeCommand stores a USB command in a circular buffer
+ *  If nobody consumes the replies and the buffer is full, the oldest reply is dropped.
  * @param UC
  */
-static void storeReply(PacketResponseNG *packet) {
-    pthread_mutex_lock(&rxBufferMutex);
-    if ((cmd_head + 1) % CMD_BUFFER_SIZE == cmd_tail) {
-        //If these two are equal, we're about to overwrite in the
-        // circular buffer.
-        PrintAndLogEx(FAILED, "WARNING: Command buffer about to overwrite command! This needs to be fixed!");
-        fflush(stdout);
+static void storeReply(pm3_device_t *dev, PacketResponseNG *packet) {
+    uint32_t head = __atomic_load_n(&dev->cmd_head, __ATOMIC_RELAXED);
+    if (head - __atomic_load_n(&dev->cmd_tail, __ATOMIC_ACQUIRE) >= CMD_BUFFER_SIZE && __atomic_load_n(&dev->rx_backpressure, __ATOMIC_ACQUIRE)) {
+        struct timespec ts;
+        msdeadline(&ts, RX_BACKPRESSURE_MS);
+        pthread_mutex_lock(&dev->rxSigMutex);
+        while (head - __atomic_load_n(&dev->cmd_tail, __ATOMIC_ACQUIRE) >= CMD_BUFFER_SIZE && __atomic_load_n(&dev->rx_backpressure, __ATOMIC_ACQUIRE)) {
+            if (pthread_cond_timedwait(&dev->rxSpaceSig, &dev->rxSigMutex, &ts) != 0)
+                break;
+        }
+        pthread_mutex_unlock(&dev->rxSigMutex);
     }
+
+    uint32_t tail = __atomic_load_n(&dev->cmd_tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= CMD_BUFFER_SIZE) {
+        // Nobody consumes these replies, make room by dropping the oldest one.
+        // The CAS fails if the consumer took it meanwhile.
+        uint16_t old_cmd = RX_SLOT(dev, tail)->packet.cmd;
+        if (__atomic_compare_exchange_n(&dev->cmd_tail, &tail, tail + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            PrintAndLogEx(DEBUG, "Command buffer full, dropping oldest reply 0x%04x", old_cmd);
+            stats_event(dev, COMMS_DROPPED_REPLY);
+        }
+    }
+
     //Store the command at the 'head' location
-    PacketResponseNG *destination = &rxBuffer[cmd_head];
-    memcpy(destination, packet, sizeof(PacketResponseNG));
+    memcpy(&RX_SLOT(dev, head)->packet, packet, sizeof(PacketResponseNG));
+
+    //increment head
+    __atomic_store_n(&dev->cmd_head, head + 1, __ATOMIC_RELEASE);
+    stats_depth(dev, COMMS_DEPTH_RX_BUFFER, head + 1 - __atomic_load_n(&dev->cmd_tail, __ATOMIC_ACQUIRE));
+}
 
-    //increment head and wrap
-    cmd_head = (cmd_head + 1) % CMD_BUFFER_SIZE;
-    pthread_mutex_unlock(&rxBufferMutex);
+static void signalSpace(pm3_device_t *dev) {
+    if (__atomic_load_n(&dev->rx_backpressure, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&dev->rxSigMutex);
+        pthread_cond_signal(&dev->rxSpaceSig);
+        pthread_mutex_unlock(&dev->rxSigMutex);
+    }
 }
+
 /**
  * @brief getCommand gets a command from an internal circular buffer.
+ *  Replies already taken by takeReply are skipped.
  * @param response location to write command
  * @return 1 if response was returned, 0 if nothing has been received
  */
-static int getReply(PacketResponseNG *packet) {
-    pthread_mutex_lock(&rxBufferMutex);
+static int getReply(pm3_device_t *dev, PacketResponseNG *packet) {
+    int ret = 0;
+    pthread_mutex_lock(&dev->rxTakeMutex);
+    uint32_t tail = __atomic_load_n(&dev->cmd_tail, __ATOMIC_ACQUIRE);
     //If head == tail, there's nothing to read, or if we just got initialized
-    if (cmd_head == cmd_tail)  {
-        pthread_mutex_unlock(&rxBufferMutex);
-        return 0;
+    while (__atomic_load_n(&dev->cmd_head, __ATOMIC_ACQUIRE) != tail) {
+
+        bool taken = (RX_SLOT(dev, tail)->taken == tail);
+
+        //Pick out the next unread command
+        if (taken == false)
+            memcpy(packet, &RX_SLOT(dev, tail)->packet, sizeof(PacketResponseNG));
+
+        // A failed CAS means the producer dropped this reply while we copied it, tail is reloaded
+        if (__atomic_compare_exchange_n(&dev->cmd_tail, &tail, tail + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) == false)
+            continue;
+
+        signalSpace(dev);
+        if (taken == false) {
+            ret = 1;
+            break;
+        }
+
+        tail++;
+    }
+    pthread_mutex_unlock(&dev->rxTakeMutex);
+    return ret;
+}
+
+// moves tail past the replies takeReply took out of order, with rxTakeMutex held
+static void skipTaken(pm3_device_t *dev) {
+    uint32_t tail = __atomic_load_n(&dev->cmd_tail, __ATOMIC_ACQUIRE);
+    while (__atomic_load_n(&dev->cmd_head, __ATOMIC_ACQUIRE) != tail && RX_SLOT(dev, tail)->taken == tail) {
+        if (__atomic_compare_exchange_n(&dev->cmd_tail, &tail, tail + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            tail++;
+            signalSpace(dev);
+        }
     }
+}
 
-    //Pick out the next unread command
-    memcpy(packet, &rxBuffer[cmd_tail], sizeof(PacketResponseNG));
+/**
+ * @brief takes the oldest reply for cmd out of the circular buffer, unrelated replies stay queued.
+ *  Waiting Time eXtension requests met on the way are consumed and added to wtx.
+ *  Taken replies are only marked, getReply skips them and tail moves past them once they are the oldest.
+ * @return 1 if response was returned
+ */
+static int takeReply(pm3_device_t *dev, uint16_t cmd, PacketResponseNG *packet, uint32_t *wtx) {
+    pthread_mutex_lock(&dev->rxTakeMutex);
+    uint32_t head = __atomic_load_n(&dev->cmd_head, __ATOMIC_ACQUIRE);
+    int ret = 0;
+
+    for (uint32_t i = __atomic_load_n(&dev->cmd_tail, __ATOMIC_ACQUIRE); i != head; i++) {
+        if (RX_SLOT(dev, i)->taken == i)
+            continue;
+
+        PacketResponseNG *p = &RX_SLOT(dev, i)->packet;
+        bool is_wtx = (p->cmd == CMD_WTX && p->length == sizeof(uint16_t));
+        if (p->cmd != cmd && !is_wtx)
+            continue;
+
+        uint32_t w = 0;
+        if (is_wtx)
+            w = p->data.asDwords[0] & 0xFFFF;
+        else
+            memcpy(packet, p, sizeof(PacketResponseNG));
+
+        // the producer only overwrites a reply after dropping it, make sure this one is still queued
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint32_t tail = __atomic_load_n(&dev->cmd_tail, __ATOMIC_ACQUIRE);
+        if ((int32_t)(i - tail) < 0) {
+            i = tail - 1;
+            continue;
+        }
+        RX_SLOT(dev, i)->taken = i;
 
-    //Increment tail - this is a circular buffer, so modulo buffer size
-    cmd_tail = (cmd_tail + 1) % CMD_BUFFER_SIZE;
+        if (is_wtx) {
+            *wtx += w;
+            continue;
+        }
+        ret = 1;
+        break;
+    }
+    skipTaken(dev);
+    pthread_mutex_unlock(&dev->rxTakeMutex);
+    return ret;
+}
 
-    pthread_mutex_unlock(&rxBufferMutex);
-    return 1;
+// Accounts a valid frame of len bytes on the wire, and the round trip it completes
+static void stats_received(pm3_device_t *dev, PacketResponseNG *packet, size_t len) {
+    pthread_mutex_lock(&dev->statsMutex);
+    comms_stats_received(&dev->stats, len);
+    if (packet->cmd == CMD_WTX && packet->length == sizeof(uint16_t))
+        comms_stats_event(&dev->stats, COMMS_WTX);
+    else if (packet->cmd != CMD_DEBUG_PRINT_STRING && packet->cmd != CMD_DEBUG_PRINT_INTEGERS)
+        comms_stats_reply(&dev->stats, packet->cmd);
+    pthread_mutex_unlock(&dev->statsMutex);
 }
 
 //-----------------------------------------------------------------------------
 // Entry point into our code: called whenever we received a packet over USB
 // that we weren't necessarily expecting, for example a debug print.
 //-----------------------------------------------------------------------------
-static void PacketResponseReceived(PacketResponseNG *packet) {
+static void PacketResponseReceived(pm3_device_t *dev, PacketResponseNG *packet) {
 
     // we got a packet, reset WaitForResponseTimeout timeout
-    uint64_t prev_clk = __atomic_load_n(&last_packet_time, __ATOMIC_SEQ_CST);
+    uint64_t prev_clk = __atomic_load_n(&dev->last_packet_time, __ATOMIC_SEQ_CST);
     uint64_t clk = msclock();
-    __atomic_store_n(&timeout_start_time,  clk, __ATOMIC_SEQ_CST);
-    __atomic_store_n(&last_packet_time, clk, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&dev->timeout_start_time,  clk, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&dev->last_packet_time, clk, __ATOMIC_SEQ_CST);
     (void) prev_clk;
 //    PrintAndLogEx(NORMAL, "[%07"PRIu64"] RECV %s magic %08x length %04x status %04x crc %04x cmd %04x",
 //                clk - prev_clk, packet->ng ? "NG" : "OLD", packet->magic, packet->length, packet->status, packet->crc, packet->cmd);
@@ -309,7 +781,9 @@ static void PacketResponseReceived(PacketResponseNG *packet) {
         // CMD_DOWNLOAD_BIGBUF packages which is not dealt with. I wonder if simply ignoring them will
         // work. lets try it.
         default: {
-            storeReply(packet);
+            if (!deliverReply(dev, packet))
+                storeReply(dev, packet);
+            notifyReply(dev);
             break;
         }
     }
@@ -326,7 +800,7 @@ __attribute__((force_align_arg_pointer))
 #endif
 #endif
 *uart_communication(void *targ) {
-    communication_arg_t *connection = (communication_arg_t *)targ;
+    pm3_device_t *dev = (pm3_device_t *)targ;
     uint32_t rxlen;
     bool commfailed = false;
     PacketResponseNG rx;
@@ -336,8 +810,11 @@ __attribute__((force_align_arg_pointer))
     disableAppNap("Proxmark3 polling UART");
 #endif
 
-    // is this connection->run a cross thread call?
-    while (connection->run) {
+    // for anything below which asks for the current device
+    thread_device = dev - devices;
+
+    // is this run a cross thread call?
+    while (__atomic_load_n(&dev->conn.run, __ATOMIC_SEQ_CST)) {
         rxlen = 0;
         bool ACK_received = false;
         bool error = false;
@@ -346,14 +823,14 @@ __attribute__((force_align_arg_pointer))
         // Signal to main thread that communications seems off.
         // main thread will kill and restart this thread.
         if (commfailed) {
-            if (conn.last_command != CMD_HARDWARE_RESET) {
+            if (dev->conn.last_command != CMD_HARDWARE_RESET) {
                 PrintAndLogEx(WARNING, "Communicating with Proxmark3 device " _RED_("failed"));
             }
-            __atomic_test_and_set(&comm_thread_dead, __ATOMIC_SEQ_CST);
+            __atomic_test_and_set(&dev->comm_thread_dead, __ATOMIC_SEQ_CST);
             break;
         }
 
-        res = uart_receive(sp, (uint8_t *)&rx_raw.pre, sizeof(PacketResponseNGPreamble), &rxlen);
+        res = uart_receive(dev->sp, (uint8_t *)&rx_raw.pre, sizeof(PacketResponseNGPreamble), &rxlen);
         if ((res == PM3_SUCCESS) && (rxlen == sizeof(PacketResponseNGPreamble))) {
             rx.magic = rx_raw.pre.magic;
             uint16_t length = rx_raw.pre.length;
@@ -363,26 +840,29 @@ __attribute__((force_align_arg_pointer))
             if (rx.magic == RESPONSENG_PREAMBLE_MAGIC) { // New style NG reply
                 if (length > PM3_CMD_DATA_SIZE) {
                     PrintAndLogEx(WARNING, "Received packet frame with incompatible length: 0x%04x", length);
+                    stats_event(dev, COMMS_FRAME_ERROR);
                     error = true;
                 }
                 if ((!error) && (length > 0)) { // Get the variable length payload
 
-                    res = uart_receive(sp, (uint8_t *)&rx_raw.data, length, &rxlen);
+                    res = uart_receive(dev->sp, (uint8_t *)&rx_raw.data, length, &rxlen);
                     if ((res != PM3_SUCCESS) || (rxlen != length)) {
                         PrintAndLogEx(WARNING, "Received packet frame with variable part too short? %d/%d", rxlen, length);
+                        stats_event(dev, COMMS_FRAME_ERROR);
                         error = true;
                     } else {
 
                         if (rx.ng) {      // Received a valid NG frame
                             memcpy(&rx.data, &rx_raw.data, length);
                             rx.length = length;
-                            if ((rx.cmd == conn.last_command) && (rx.status == PM3_SUCCESS)) {
+                            if ((rx.cmd == dev->conn.last_command) && (rx.status == PM3_SUCCESS)) {
                                 ACK_received = true;
                             }
                         } else {
                             uint64_t arg[3];
                             if (length < sizeof(arg)) {
                                 PrintAndLogEx(WARNING, "Received MIX packet frame with incompatible length: 0x%04x", length);
+                                stats_event(dev, COMMS_FRAME_ERROR);
                                 error = true;
                             }
                             if (!error) { // Received a valid MIX frame
@@ -400,9 +880,10 @@ __attribute__((force_align_arg_pointer))
                     }
                 }
                 if (!error) {                        // Get the postamble
-                    res = uart_receive(sp, (uint8_t *)&rx_raw.foopost, sizeof(PacketResponseNGPostamble), &rxlen);
+                    res = uart_receive(dev->sp, (uint8_t *)&rx_raw.foopost, sizeof(PacketResponseNGPostamble), &rxlen);
                     if ((res != PM3_SUCCESS) || (rxlen != sizeof(PacketResponseNGPostamble))) {
                         PrintAndLogEx(WARNING, "Received packet frame without postamble");
+                        stats_event(dev, COMMS_FRAME_ERROR);
                         error = true;
                     }
                 }
@@ -413,6 +894,7 @@ __attribute__((force_align_arg_pointer))
                         compute_crc(CRC_14443_A, (uint8_t *)&rx_raw, sizeof(PacketResponseNGPreamble) + length, &first, &second);
                         if ((first << 8) + second != rx.crc) {
                             PrintAndLogEx(WARNING, "Received packet frame with invalid CRC %02X%02X <> %04X", first, second, rx.crc);
+                            stats_event(dev, COMMS_CRC_ERROR);
                             error = true;
                         }
                     }
@@ -426,15 +908,17 @@ __attribute__((force_align_arg_pointer))
                     print_hex_break((uint8_t *)&rx_raw.data, rx_raw.pre.length, 32);
                     print_hex_break((uint8_t *)&rx_raw.foopost, sizeof(PacketResponseNGPostamble), 32);
 #endif
-                    PacketResponseReceived(&rx);
+                    stats_received(dev, &rx, sizeof(PacketResponseNGPreamble) + length + sizeof(PacketResponseNGPostamble));
+                    PacketResponseReceived(dev, &rx);
                 }
             } else {                               // Old style reply
                 PacketResponseOLD rx_old;
                 memcpy(&rx_old, &rx_raw.pre, sizeof(PacketResponseNGPreamble));
 
-                res = uart_receive(sp, ((uint8_t *)&rx_old) + sizeof(PacketResponseNGPreamble), sizeof(PacketResponseOLD) - sizeof(PacketResponseNGPreamble), &rxlen);
+                res = uart_receive(dev->sp, ((uint8_t *)&rx_old) + sizeof(PacketResponseNGPreamble), sizeof(PacketResponseOLD) - sizeof(PacketResponseNGPreamble), &rxlen);
                 if ((res != PM3_SUCCESS) || (rxlen != sizeof(PacketResponseOLD) - sizeof(PacketResponseNGPreamble))) {
                     PrintAndLogEx(WARNING, "Received packet OLD frame with payload too short? %d/%d", rxlen, sizeof(PacketResponseOLD) - sizeof(PacketResponseNGPreamble));
+                    stats_event(dev, COMMS_FRAME_ERROR);
                     error = true;
                 }
                 if (!error) {
@@ -456,7 +940,8 @@ __attribute__((force_align_arg_pointer))
                     rx.oldarg[2] = rx_old.arg[2];
                     rx.length = PM3_CMD_DATA_SIZE;
                     memcpy(&rx.data, &rx_old.d, rx.length);
-                    PacketResponseReceived(&rx);
+                    stats_received(dev, &rx, sizeof(PacketResponseOLD));
+                    PacketResponseReceived(dev, &rx);
                     if (rx.cmd == CMD_ACK) {
                         ACK_received = true;
                     }
@@ -465,6 +950,7 @@ __attribute__((force_align_arg_pointer))
         } else {
             if (rxlen > 0) {
                 PrintAndLogEx(WARNING, "Received packet frame preamble too short: %d/%d", rxlen, sizeof(PacketResponseNGPreamble));
+                stats_event(dev, COMMS_FRAME_ERROR);
                 error = true;
             }
             if (res == PM3_ENOTTY) {
@@ -474,52 +960,65 @@ __attribute__((force_align_arg_pointer))
 
         // TODO if error, shall we resync ?
 
-        pthread_mutex_lock(&txBufferMutex);
+        pthread_mutex_lock(&dev->txBufferMutex);
 
-        if (connection->block_after_ACK) {
+        if (dev->conn.block_after_ACK) {
             // if we just received an ACK, wait here until a new command is to be transmitted
             // This is only working on OLD frames, and only used by flasher and flashmem
             if (ACK_received) {
 #ifdef COMMS_DEBUG
                 PrintAndLogEx(NORMAL, "Received ACK, fast TX mode: ignoring other RX till TX");
 #endif
-                while (!txBuffer_pending) {
-                    pthread_cond_wait(&txBufferSig, &txBufferMutex);
+                while (TX_QUEUE_EMPTY(dev)) {
+                    pthread_cond_wait(&dev->txBufferSig, &dev->txBufferMutex);
                 }
             }
         }
 
-        if (txBuffer_pending) {
+        // send everything queued so far, commands are pipelined towards the device
+        while (!TX_QUEUE_EMPTY(dev)) {
 
-            if (txBufferNGLen) { // NG packet
-                res = uart_send(sp, (uint8_t *) &txBufferNG, txBufferNGLen);
+            tx_slot_t *slot = &dev->txQueue[dev->tx_tail];
+            pthread_mutex_lock(&dev->statsMutex);
+            if (slot->ngLen)
+                comms_stats_sent(&dev->stats, slot->frame.ng.pre.cmd, slot->frame.ng.pre.ng == false, slot->ngLen);
+            else
+                comms_stats_sent(&dev->stats, slot->frame.old.cmd, true, sizeof(PacketCommandOLD));
+            pthread_mutex_unlock(&dev->statsMutex);
+
+            if (slot->ngLen) { // NG packet
+                res = uart_send(dev->sp, (uint8_t *) &slot->frame.ng, slot->ngLen);
                 if (res == PM3_EIO) {
                     commfailed = true;
                 }
-                conn.last_command = txBufferNG.pre.cmd;
-                txBufferNGLen = 0;
+                dev->conn.last_command = slot->frame.ng.pre.cmd;
             } else {
-                res = uart_send(sp, (uint8_t *) &txBuffer, sizeof(PacketCommandOLD));
+                res = uart_send(dev->sp, (uint8_t *) &slot->frame.old, sizeof(PacketCommandOLD));
                 if (res == PM3_EIO) {
                     commfailed = true;
                 }
-                conn.last_command = txBuffer.cmd;
+                dev->conn.last_command = slot->frame.old.cmd;
             }
+            if (res != PM3_SUCCESS)
+                stats_event(dev, COMMS_SEND_ERROR);
 
-            txBuffer_pending = false;
+            dev->tx_tail = (dev->tx_tail + 1) % TX_QUEUE_SIZE;
 
             // main thread doesn't know send failed...
 
-            // tell main thread that txBuffer is empty
-            pthread_cond_signal(&txBufferSig);
+            // tell main thread that a slot in dev->txQueue is free
+            pthread_cond_broadcast(&dev->txBufferSig);
+
+            if (commfailed)
+                break;
         }
 
-        pthread_mutex_unlock(&txBufferMutex);
+        pthread_mutex_unlock(&dev->txBufferMutex);
     }
 
     // when thread dies, we close the serial port.
-    uart_close(sp);
-    sp = NULL;
+    uart_close(dev->sp);
+    dev->sp = NULL;
 
 #if defined(__MACH__) && defined(__APPLE__)
     enableAppNap();
@@ -530,55 +1029,69 @@ __attribute__((force_align_arg_pointer))
 }
 
 bool IsCommunicationThreadDead(void) {
-    bool ret = __atomic_load_n(&comm_thread_dead, __ATOMIC_SEQ_CST);
+    pm3_device_t *dev = current_device();
+    bool ret = __atomic_load_n(&dev->comm_thread_dead, __ATOMIC_SEQ_CST);
     return ret;
 }
 
 bool OpenProxmark(void *port, bool wait_for_port, int timeout, bool flash_mode, uint32_t speed) {
+    pm3_device_t *dev = current_device();
 
     char *portname = (char *)port;
     if (!wait_for_port) {
         PrintAndLogEx(INFO, "Using UART port " _YELLOW_("%s"), portname);
-        sp = uart_open(portname, speed);
+        dev->sp = uart_open(portname, speed);
     } else {
         PrintAndLogEx(SUCCESS, "Waiting for Proxmark3 to appear on " _YELLOW_("%s"), portname);
         fflush(stdout);
         int openCount = 0;
         do {
-            sp = uart_open(portname, speed);
+            dev->sp = uart_open(portname, speed);
             msleep(500);
             printf(".");
             fflush(stdout);
-        } while (++openCount < timeout && (sp == INVALID_SERIAL_PORT || sp == CLAIMED_SERIAL_PORT));
+        } while (++openCount < timeout && (dev->sp == INVALID_SERIAL_PORT || dev->sp == CLAIMED_SERIAL_PORT));
     }
 
     // check result of uart opening
-    if (sp == INVALID_SERIAL_PORT) {
+    if (dev->sp == INVALID_SERIAL_PORT) {
         PrintAndLogEx(WARNING, "\n" _RED_("ERROR:") "invalid serial port " _YELLOW_("%s"), portname);
-        sp = NULL;
+        dev->sp = NULL;
         return false;
-    } else if (sp == CLAIMED_SERIAL_PORT) {
+    } else if (dev->sp == CLAIMED_SERIAL_PORT) {
         PrintAndLogEx(WARNING, "\n" _RED_("ERROR:") "serial port " _YELLOW_("%s") " is claimed by another process", portname);
-        sp = NULL;
+        dev->sp = NULL;
         return false;
     } else {
         // start the communication thread
-        if (portname != (char *)conn.serial_port_name) {
+        if (portname != (char *)dev->conn.serial_port_name) {
             uint16_t len = MIN(strlen(portname), FILE_PATH_SIZE - 1);
-            memset(conn.serial_port_name, 0, FILE_PATH_SIZE);
-            memcpy(conn.serial_port_name, portname, len);
+            memset(dev->conn.serial_port_name, 0, FILE_PATH_SIZE);
+            memcpy(dev->conn.serial_port_name, portname, len);
         }
-        conn.run = true;
-        conn.block_after_ACK = flash_mode;
+        dev->conn.run = true;
+        dev->conn.block_after_ACK = flash_mode;
         // Flags to tell where to add CRC on sent replies
-        conn.send_with_crc_on_usb = false;
-        conn.send_with_crc_on_fpc = true;
+        dev->conn.send_with_crc_on_usb = false;
+        dev->conn.send_with_crc_on_fpc = true;
         // "Session" flag, to tell via which interface next msgs should be sent: USB or FPC USART
-        conn.send_via_fpc_usart = false;
-
-        pthread_create(&communication_thread, NULL, &uart_communication, &conn);
-        __atomic_clear(&comm_thread_dead, __ATOMIC_SEQ_CST);
-        session.pm3_present = true;
+        dev->conn.send_via_fpc_usart = false;
+
+        // drop whatever was queued for a previous connection
+        pthread_mutex_lock(&dev->txBufferMutex);
+        dev->tx_head = dev->tx_tail = 0;
+        pthread_mutex_unlock(&dev->txBufferMutex);
+        CancelPendingRequests();
+        resetReplies(dev);
+        for (int i = 0; i < RX_WAITERS; i++)
+            dev->rx_waiters[i].state = WAITER_IDLE;
+        pthread_mutex_lock(&dev->statsMutex);
+        comms_stats_reset(&dev->stats);
+        pthread_mutex_unlock(&dev->statsMutex);
+
+        pthread_create(&dev->communication_thread, NULL, &uart_communication, dev);
+        __atomic_clear(&dev->comm_thread_dead, __ATOMIC_SEQ_CST);
+        dev->present = true;
 
         fflush(stdout);
 
@@ -588,6 +1101,7 @@ bool OpenProxmark(void *port, bool wait_for_port, int timeout, bool flash_mode,
 
 // check if we can communicate with Pm3
 int TestProxmark(void) {
+    pm3_device_t *dev = current_device();
 
     PacketResponseNG resp;
     uint16_t len = 32;
@@ -595,7 +1109,7 @@ int TestProxmark(void) {
     for (uint16_t i = 0; i < len; i++)
         data[i] = i & 0xFF;
 
-    __atomic_store_n(&last_packet_time,  msclock(), __ATOMIC_SEQ_CST);
+    __atomic_store_n(&dev->last_packet_time,  msclock(), __ATOMIC_SEQ_CST);
     clearCommandBuffer();
     SendCommandNG(CMD_PING, data, len);
 
@@ -623,24 +1137,24 @@ int TestProxmark(void) {
         return PM3_ETIMEOUT;
     }
 
-    if ((resp.length != sizeof(pm3_capabilities)) || (resp.data.asBytes[0] != CAPABILITIES_VERSION)) {
+    if ((resp.length != sizeof(capabilities_t)) || (resp.data.asBytes[0] != CAPABILITIES_VERSION)) {
         PrintAndLogEx(ERR, _RED_("Capabilities structure version sent by Proxmark3 is not the same as the one used by the client!"));
         PrintAndLogEx(ERR, _RED_("Please flash the Proxmark with the same version as the client."));
         return PM3_EDEVNOTSUPP;
     }
 
-    memcpy(&pm3_capabilities, resp.data.asBytes, MIN(sizeof(capabilities_t), resp.length));
-    conn.send_via_fpc_usart = pm3_capabilities.via_fpc;
-    conn.uart_speed = pm3_capabilities.baudrate;
+    memcpy(&dev->capabilities, resp.data.asBytes, MIN(sizeof(capabilities_t), resp.length));
+    dev->conn.send_via_fpc_usart = dev->capabilities.via_fpc;
+    dev->conn.uart_speed = dev->capabilities.baudrate;
 
     PrintAndLogEx(INFO, "Communicating with PM3 over %s%s",
-                  conn.send_via_fpc_usart ? _YELLOW_("FPC UART") : _YELLOW_("USB-CDC"),
-                  memcmp(conn.serial_port_name, "tcp:", 4) == 0 ? "over " _YELLOW_("TCP") : "");
+                  dev->conn.send_via_fpc_usart ? _YELLOW_("FPC UART") : _YELLOW_("USB-CDC"),
+                  memcmp(dev->conn.serial_port_name, "tcp:", 4) == 0 ? "over " _YELLOW_("TCP") : "");
 
-    if (conn.send_via_fpc_usart) {
-        PrintAndLogEx(INFO, "PM3 UART serial baudrate: " _YELLOW_("%u") "\n", conn.uart_speed);
+    if (dev->conn.send_via_fpc_usart) {
+        PrintAndLogEx(INFO, "PM3 UART serial baudrate: " _YELLOW_("%u") "\n", dev->conn.uart_speed);
     } else {
-        int res = uart_reconfigure_timeouts(UART_USB_CLIENT_RX_TIMEOUT_MS);
+        int res = uart_reconfigure_timeouts(dev->sp, UART_USB_CLIENT_RX_TIMEOUT_MS);
         if (res != PM3_SUCCESS) {
             return res;
         }
@@ -648,26 +1162,175 @@ int TestProxmark(void) {
     return PM3_SUCCESS;
 }
 
-void CloseProxmark(void) {
-    conn.run = false;
+static void close_device(pm3_device_t *dev) {
+    __atomic_store_n(&dev->conn.run, false, __ATOMIC_SEQ_CST);
 
 #ifdef __BIONIC__
-    if (communication_thread != 0) {
-        pthread_join(communication_thread, NULL);
+    if (dev->communication_thread != 0) {
+        pthread_join(dev->communication_thread, NULL);
     }
 #else
-    pthread_join(communication_thread, NULL);
+    pthread_join(dev->communication_thread, NULL);
 #endif
 
-    if (sp) {
-        uart_close(sp);
+    if (dev->sp) {
+        uart_close(dev->sp);
     }
 
     // Clean up our state
-    sp = NULL;
-    memset(&communication_thread, 0, sizeof(pthread_t));
+    dev->sp = NULL;
+    memset(&dev->communication_thread, 0, sizeof(pthread_t));
+
+    dev->present = false;
+}
+
+void CloseProxmark(void) {
+    close_device(current_device());
+}
 
-    session.pm3_present = false;
+/**
+ * @brief Adds a device slot, to be selected and opened with OpenProxmark.
+ * @return index of the new device, or -1 if all MAX_DEVICES slots are taken
+ */
+int AddDevice(void) {
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        pm3_device_t *dev = &devices[i];
+        if (dev->used)
+            continue;
+
+        memset(dev, 0, sizeof(pm3_device_t));
+        pthread_mutex_init(&dev->txBufferMutex, NULL);
+        pthread_cond_init(&dev->txBufferSig, NULL);
+        pthread_mutex_init(&dev->rxSigMutex, NULL);
+        pthread_cond_init(&dev->rxSig, NULL);
+        pthread_cond_init(&dev->rxSpaceSig, NULL);
+        pthread_mutex_init(&dev->statsMutex, NULL);
+        pthread_mutex_init(&dev->rxTakeMutex, NULL);
+        dev->used = true;
+        return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Closes a device and frees its slot. If it is the selected device,
+ *  another one is selected first, the last device is only closed.
+ */
+int RemoveDevice(int idx) {
+    if (idx < 0 || idx >= MAX_DEVICES || devices[idx].used == false)
+        return PM3_EINVARG;
+
+    pm3_device_t *dev = &devices[idx];
+
+    if (idx == GetSelectedDevice()) {
+        int other = -1;
+        for (int i = 0; i < MAX_DEVICES; i++) {
+            if (i != idx && devices[i].used) {
+                other = i;
+                break;
+            }
+        }
+        if (other == -1) {
+            if (dev->present)
+                close_device(dev);
+            return PM3_SUCCESS;
+        }
+        SelectDevice(other);
+    }
+
+    if (dev->present)
+        close_device(dev);
+
+    pthread_mutex_destroy(&dev->txBufferMutex);
+    pthread_cond_destroy(&dev->txBufferSig);
+    pthread_mutex_destroy(&dev->rxSigMutex);
+    pthread_cond_destroy(&dev->rxSig);
+    pthread_cond_destroy(&dev->rxSpaceSig);
+    pthread_mutex_destroy(&dev->statsMutex);
+    pthread_mutex_destroy(&dev->rxTakeMutex);
+    dev->used = false;
+    return PM3_SUCCESS;
+}
+
+/**
+ * @brief Makes idx the device commands are sent to, for threads which didn't set their own.
+ *  The other devices keep their connection open.
+ */
+int SelectDevice(int idx) {
+    if (idx < 0 || idx >= MAX_DEVICES || devices[idx].used == false)
+        return PM3_EINVARG;
+
+    __atomic_store_n(&selected_device, idx, __ATOMIC_RELEASE);
+    return PM3_SUCCESS;
+}
+
+int GetSelectedDevice(void) {
+    return __atomic_load_n(&selected_device, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Makes idx the device the calling thread talks to, -1 goes back to the selected one.
+ *  Used to run commands on several devices at once, one thread per device.
+ */
+int SetThreadDevice(int idx) {
+    if (idx < -1 || idx >= MAX_DEVICES || (idx >= 0 && devices[idx].used == false))
+        return PM3_EINVARG;
+
+    thread_device = idx;
+    return PM3_SUCCESS;
+}
+
+communication_arg_t *GetConn(void) {
+    return &current_device()->conn;
+}
+
+capabilities_t *GetCapabilities(void) {
+    return &current_device()->capabilities;
+}
+
+bool IsPm3Present(void) {
+    return current_device()->present;
+}
+
+bool GetDeviceInfo(int idx, pm3_device_info_t *info) {
+    if (idx < 0 || idx >= MAX_DEVICES || devices[idx].used == false || info == NULL)
+        return false;
+
+    pm3_device_t *dev = &devices[idx];
+    communication_arg_t *c = &dev->conn;
+
+    memset(info, 0, sizeof(pm3_device_info_t));
+    memcpy(info->port, c->serial_port_name, sizeof(info->port) - 1);
+    info->selected = (idx == GetSelectedDevice());
+    info->present = dev->present;
+    info->dead = __atomic_load_n(&dev->comm_thread_dead, __ATOMIC_SEQ_CST);
+    info->via_fpc = c->send_via_fpc_usart;
+    info->uart_speed = c->uart_speed;
+    return true;
+}
+
+/**
+ * @brief Copies the link statistics of the selected device, with the current queue depths
+ */
+void GetCommsStats(comms_stats_t *stats) {
+    pm3_device_t *dev = current_device();
+
+    pthread_mutex_lock(&dev->statsMutex);
+    memcpy(stats, &dev->stats, sizeof(comms_stats_t));
+    pthread_mutex_unlock(&dev->statsMutex);
+
+    stats->now_us = usclock();
+    stats->depth_now[COMMS_DEPTH_TX_QUEUE] = (__atomic_load_n(&dev->tx_head, __ATOMIC_ACQUIRE) - __atomic_load_n(&dev->tx_tail, __ATOMIC_ACQUIRE) + TX_QUEUE_SIZE) % TX_QUEUE_SIZE;
+    stats->depth_now[COMMS_DEPTH_RX_BUFFER] = __atomic_load_n(&dev->cmd_head, __ATOMIC_ACQUIRE) - __atomic_load_n(&dev->cmd_tail, __ATOMIC_ACQUIRE);
+    stats->depth_now[COMMS_DEPTH_PENDING] = GetPendingRequests();
+}
+
+void ResetCommsStats(void) {
+    pm3_device_t *dev = current_device();
+
+    pthread_mutex_lock(&dev->statsMutex);
+    comms_stats_reset(&dev->stats);
+    pthread_mutex_unlock(&dev->statsMutex);
 }
 
 // Gives a rough estimate of the communication delay based on channel & baudrate
@@ -680,8 +1343,9 @@ void CloseProxmark(void) {
 //           ~ = 12000000 / USART_BAUD_RATE
 // Let's take 2x (maybe we need more for BT link?)
 static size_t communication_delay(void) {
-    if (conn.send_via_fpc_usart)  // needed also for Windows USB USART??
-        return 2 * (12000000 / conn.uart_speed);
+    pm3_device_t *dev = current_device();
+    if (dev->conn.send_via_fpc_usart)  // needed also for Windows USB USART??
+        return 2 * (12000000 / dev->conn.uart_speed);
     return 0;
 }
 
@@ -696,6 +1360,7 @@ static size_t communication_delay(void) {
  * @return true if command was returned, otherwise false
  */
 bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms_timeout, bool show_warning) {
+    pm3_device_t *dev = current_device();
 
     PacketResponseNG resp;
 
@@ -706,35 +1371,91 @@ bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms
     if (ms_timeout != (size_t) - 1)
         ms_timeout += communication_delay();
 
-    __atomic_store_n(&timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
+    __atomic_store_n(&dev->timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
+
+    // let the communication thread hand the reply over directly
+    rx_waiter_t *waiter = NULL;
+    if (cmd != CMD_UNKNOWN) {
+        bool kept;
+        waiter = armWaiter(dev, cmd, response, &kept);
+        if (kept)
+            return true;
+    }
+
+    bool found = false;
 
     // Wait until the command is received
     while (true) {
 
-        while (getReply(response)) {
-            if (cmd == CMD_UNKNOWN || response->cmd == cmd) {
-                return true;
-            }
-            if (response->cmd == CMD_WTX && response->length == sizeof(uint16_t)) {
-                uint16_t wtx = response->data.asDwords[0] & 0xFFFF;
+        if (cmd != CMD_UNKNOWN) {
+            uint32_t wtx = 0;
+            // replies stored before we armed the waiter slot
+            if (takeReply(dev, cmd, response, &wtx))
+                found = true;
+
+            if (waiter)
+                wtx += __atomic_exchange_n(&waiter->wtx, 0, __ATOMIC_SEQ_CST);
+            if (wtx) {
                 PrintAndLogEx(DEBUG, "Got Waiting Time eXtension request %i ms", wtx);
                 if (ms_timeout != (size_t) - 1)
                     ms_timeout += wtx;
             }
+
+            if (found)
+                break;
+
+            if (waiter && __atomic_load_n(&waiter->state, __ATOMIC_ACQUIRE) == WAITER_READY) {
+                memcpy(response, &waiter->packet, sizeof(PacketResponseNG));
+                __atomic_store_n(&waiter->state, WAITER_IDLE, __ATOMIC_RELEASE);
+                return true;
+            }
+        } else {
+            if (getReply(dev, response)) {
+                if (response->cmd == CMD_WTX && response->length == sizeof(uint16_t)) {
+                    uint16_t wtx = response->data.asDwords[0] & 0xFFFF;
+                    PrintAndLogEx(DEBUG, "Got Waiting Time eXtension request %i ms", wtx);
+                    if (ms_timeout != (size_t) - 1)
+                        ms_timeout += wtx;
+                }
+                return true;
+            }
         }
 
-        uint64_t tmp_clk = __atomic_load_n(&timeout_start_time, __ATOMIC_SEQ_CST);
-        if ((ms_timeout != (size_t) -1) && (msclock() - tmp_clk > ms_timeout))
+        uint64_t tmp_clk = __atomic_load_n(&dev->timeout_start_time, __ATOMIC_SEQ_CST);
+        uint64_t elapsed = msclock() - tmp_clk;
+        if ((ms_timeout != (size_t) -1) && (elapsed > ms_timeout))
             break;
 
-        if (msclock() - tmp_clk > 3000 && show_warning) {
+        if (elapsed > 3000 && show_warning) {
             // 3 seconds elapsed (but this doesn't mean the timeout was exceeded)
 //            PrintAndLogEx(INFO, "Waiting for a response from the Proxmark3...");
             PrintAndLogEx(INFO, "You can cancel this operation by pressing the pm3 button");
             show_warning = false;
         }
+
+        uint32_t slice = RX_WAIT_SLICE_MS;
+        if ((ms_timeout != (size_t) -1) && (ms_timeout - elapsed < slice))
+            slice = ms_timeout - elapsed + 1;
+        waitReply(dev, slice);
     }
-    return false;
+
+    if (waiter) {
+        int state = WAITER_ARMED;
+        if (__atomic_compare_exchange_n(&waiter->state, &state, WAITER_IDLE, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) == false) {
+            while (__atomic_load_n(&waiter->state, __ATOMIC_ACQUIRE) == WAITER_FILLING) {};
+            if (found == false) {
+                // reply arrived while timing out, take it
+                memcpy(response, &waiter->packet, sizeof(PacketResponseNG));
+                __atomic_store_n(&waiter->state, WAITER_IDLE, __ATOMIC_RELEASE);
+                return true;
+            }
+            // we got one from rxBuffer meanwhile, this one is for our next wait
+            __atomic_store_n(&waiter->state, WAITER_KEPT, __ATOMIC_RELEASE);
+        }
+    }
+    if (found == false && cmd != CMD_UNKNOWN)
+        stats_event(dev, COMMS_TIMEOUT);
+    return found;
 }
 
 bool WaitForResponseTimeout(uint32_t cmd, PacketResponseNG *response, size_t ms_timeout) {
@@ -745,6 +1466,11 @@ bool WaitForResponse(uint32_t cmd, PacketResponseNG *response) {
     return WaitForResponseTimeoutW(cmd, response, -1, true);
 }
 
+static int dl_mem_write(void *ctx, uint32_t offset, const uint8_t *data, uint32_t len) {
+    memcpy((uint8_t *)ctx + offset, data, len);
+    return PM3_SUCCESS;
+}
+
 /**
 * Data transfer from Proxmark to client. This method times out after
 * ms_timeout milliseconds.
@@ -763,45 +1489,120 @@ bool WaitForResponse(uint32_t cmd, PacketResponseNG *response) {
 bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint32_t start_index, uint8_t *data, uint32_t datalen, PacketResponseNG *response, size_t ms_timeout, bool show_warning) {
 
     if (dest == NULL) return false;
+
+    dl_sink_t sink = {dl_mem_write, NULL, dest};
+    return GetFromDeviceStream(memtype, bytes, start_index, data, datalen, &sink, response, ms_timeout, show_warning);
+}
+
+/**
+* Streamed data transfer from Proxmark to client. Each chunk is handed to the sink as soon as it
+* arrives, so large downloads don't need to be assembled in memory first.
+* If the transfer times out, it is resumed from the first missing byte, up to DL_MAX_RESUME times.
+* @brief GetFromDeviceStream
+* @param memtype Type of memory to download from proxmark
+* @param bytes number of bytes to be transferred
+* @param start_index offset into Proxmark3 memory
+* @param data used by SPIFFS to provide filename
+* @param datalen used by SPIFFS to provide filename length
+* @param sink where to write the chunks, offsets are relative to start_index
+* @param response struct to copy last command (CMD_ACK) into
+* @param ms_timeout timeout in milliseconds
+* @param show_warning display message after 2 seconds
+* @return true if command was returned, otherwise false
+*/
+bool GetFromDeviceStream(DeviceMemType_t memtype, uint32_t bytes, uint32_t start_index, uint8_t *data, uint32_t datalen, dl_sink_t *sink, PacketResponseNG *response, size_t ms_timeout, bool show_warning) {
+    if (sink == NULL || sink->write == NULL) return false;
     if (bytes == 0) return true;
 
     PacketResponseNG resp;
     if (response == NULL)
         response = &resp;
 
+    SetRxBackpressure(true);
+    bool res = dl_it(memtype, bytes, start_index, data, datalen, sink, response, ms_timeout, show_warning);
+    SetRxBackpressure(false);
+    return res;
+}
+
+// While enabled, the communication thread of the current device waits up to RX_BACKPRESSURE_MS
+// for room in the reply buffer instead of dropping the oldest reply.
+// For commands whose replies are a stream the caller consumes as fast as it can.
+void SetRxBackpressure(bool enable) {
+    pm3_device_t *dev = current_device();
+    if (enable) {
+        __atomic_store_n(&dev->rx_backpressure, true, __ATOMIC_RELEASE);
+        return;
+    }
+    // release the communication thread if it is still waiting for room
+    pthread_mutex_lock(&dev->rxSigMutex);
+    __atomic_store_n(&dev->rx_backpressure, false, __ATOMIC_RELEASE);
+    pthread_cond_signal(&dev->rxSpaceSig);
+    pthread_mutex_unlock(&dev->rxSigMutex);
+}
+
+// Progress callback printing a percentage in place, at most every 250ms
+void dl_print_progress(void *ctx, uint32_t done, uint32_t total) {
+    (void) ctx;
+    static __thread uint64_t last = 0;
+    uint64_t now = msclock();
+    if (done != total && now - last < 250)
+        return;
+
+    last = now;
+    PrintAndLogEx(INPLACE, "downloaded %u / %u bytes (%u%%)", done, total, (uint32_t)((100 * (uint64_t)done) / total));
+    if (done == total)
+        PrintAndLogEx(NORMAL, "");
+}
+
+// Sends the download command for memtype, returns the command of the data packets to expect or 0
+static uint16_t dl_request(DeviceMemType_t memtype, uint32_t start_index, uint32_t bytes, uint8_t *data, uint32_t datalen) {
+
     // clear
     clearCommandBuffer();
 
     switch (memtype) {
         case BIG_BUF: {
             SendCommandMIX(CMD_DOWNLOAD_BIGBUF, start_index, bytes, 0, NULL, 0);
-            return dl_it(dest, bytes, start_index, response, ms_timeout, show_warning, CMD_DOWNLOADED_BIGBUF);
+            return CMD_DOWNLOADED_BIGBUF;
         }
         case BIG_BUF_EML: {
             SendCommandMIX(CMD_DOWNLOAD_EML_BIGBUF, start_index, bytes, 0, NULL, 0);
-            return dl_it(dest, bytes, start_index, response, ms_timeout, show_warning, CMD_DOWNLOADED_EML_BIGBUF);
+            return CMD_DOWNLOADED_EML_BIGBUF;
         }
         case SPIFFS: {
             SendCommandMIX(CMD_SPIFFS_DOWNLOAD, start_index, bytes, 0, data, datalen);
-            return dl_it(dest, bytes, start_index, response, ms_timeout, show_warning, CMD_SPIFFS_DOWNLOADED);
+            return CMD_SPIFFS_DOWNLOADED;
         }
         case FLASH_MEM: {
             SendCommandMIX(CMD_FLASHMEM_DOWNLOAD, start_index, bytes, 0, NULL, 0);
-            return dl_it(dest, bytes, start_index, response, ms_timeout, show_warning, CMD_FLASHMEM_DOWNLOADED);
+            return CMD_FLASHMEM_DOWNLOADED;
         }
         case SIM_MEM: {
             //SendCommandMIX(CMD_DOWNLOAD_SIM_MEM, start_index, bytes, 0, NULL, 0);
-            //return dl_it(dest, bytes, start_index, response, ms_timeout, show_warning, CMD_DOWNLOADED_SIMMEM);
-            return false;
+            //return CMD_DOWNLOADED_SIMMEM;
+            return 0;
         }
     }
-    return false;
+    return 0;
 }
 
-static bool dl_it(uint8_t *dest, uint32_t bytes, uint32_t start_index, PacketResponseNG *response, size_t ms_timeout, bool show_warning, uint32_t rec_cmd) {
+static bool dl_it(DeviceMemType_t memtype, uint32_t bytes, uint32_t start_index, uint8_t *data, uint32_t datalen, dl_sink_t *sink, PacketResponseNG *response, size_t ms_timeout, bool show_warning) {
+    pm3_device_t *dev = current_device();
+
+    // SPIFFS downloads always restart at the beginning of the file
+    bool resumable = (memtype != SPIFFS);
 
+    // offset of the current request within the whole transfer
+    uint32_t base = 0;
+    // bytes received in sequence so far
     uint32_t bytes_completed = 0;
-    __atomic_store_n(&timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
+    uint8_t resumed = 0;
+
+    uint16_t rec_cmd = dl_request(memtype, start_index, bytes, data, datalen);
+    if (rec_cmd == 0)
+        return false;
+
+    __atomic_store_n(&dev->timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
 
     // Add delay depending on the communication channel & speed
     if (ms_timeout != (size_t) -1)
@@ -809,7 +1610,7 @@ static bool dl_it(uint8_t *dest, uint32_t bytes, uint32_t start_index, PacketRes
 
     while (true) {
 
-        if (getReply(response)) {
+        if (getReply(dev, response)) {
 
             // sample_buf is a array pointer, located in data.c
             // arg0 = offset in transfer. Startindex of this chunk
@@ -817,8 +1618,8 @@ static bool dl_it(uint8_t *dest, uint32_t bytes, uint32_t start_index, PacketRes
             // arg2 = bigbuff tracelength (?)
             if (response->cmd == rec_cmd) {
 
-                uint32_t offset = response->oldarg[0];
-                uint32_t copy_bytes = MIN(bytes - bytes_completed, response->oldarg[1]);
+                uint32_t offset = base + response->oldarg[0];
+                uint32_t copy_bytes = MIN(bytes - MIN(offset, bytes), response->oldarg[1]);
                 //uint32_t tracelen = response->oldarg[2];
 
                 // extended bounds check1.  upper limit is PM3_CMD_DATA_SIZE
@@ -831,10 +1632,40 @@ static bool dl_it(uint8_t *dest, uint32_t bytes, uint32_t start_index, PacketRes
                     break;
                 }
 
-                memcpy(dest + offset, response->data.asBytes, copy_bytes);
-                bytes_completed += copy_bytes;
+                // already got that part before resuming, or a chunk was lost before this one
+                if (offset + copy_bytes <= bytes_completed || (resumable && offset > bytes_completed))
+                    continue;
+
+                if (sink->write(sink->ctx, offset, response->data.asBytes, copy_bytes) != PM3_SUCCESS) {
+                    PrintAndLogEx(FAILED, "ERROR: failed to store downloaded data at offset %u", offset);
+                    break;
+                }
+
+                if (offset <= bytes_completed)
+                    bytes_completed = offset + copy_bytes;
+
+                if (sink->progress)
+                    sink->progress(sink->ctx, bytes_completed, bytes);
+
+                continue;
             } else if (response->cmd == CMD_ACK) {
-                return true;
+                if (bytes_completed == bytes)
+                    return true;
+
+                // device is done, but some chunks got lost on the way
+                if (resumed < DL_MAX_RESUME) {
+                    resumed++;
+                    stats_event(dev, COMMS_DL_RESUME);
+                    base = resumable ? bytes_completed : 0;
+                    PrintAndLogEx(WARNING, "Incomplete at offset %u / %u, resuming download (%u/%u)", bytes_completed, bytes, resumed, DL_MAX_RESUME);
+                    dl_request(memtype, start_index + base, bytes - base, data, datalen);
+                    __atomic_store_n(&dev->timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
+                    continue;
+                }
+
+                // a holed download must not pass as complete
+                PrintAndLogEx(FAILED, "ERROR: download incomplete, got %u of %u bytes", bytes_completed, bytes);
+                return false;
             } else if (response->cmd == CMD_WTX && response->length == sizeof(uint16_t)) {
                 uint16_t wtx = response->data.asDwords[0] & 0xFFFF;
                 PrintAndLogEx(DEBUG, "Got Waiting Time eXtension request %i ms", wtx);
@@ -843,8 +1674,23 @@ static bool dl_it(uint8_t *dest, uint32_t bytes, uint32_t start_index, PacketRes
             }
         }
 
-        uint64_t tmp_clk = __atomic_load_n(&timeout_start_time, __ATOMIC_SEQ_CST);
+        uint64_t tmp_clk = __atomic_load_n(&dev->timeout_start_time, __ATOMIC_SEQ_CST);
         if (msclock() - tmp_clk > ms_timeout) {
+
+            if (resumed < DL_MAX_RESUME && bytes_completed < bytes) {
+                resumed++;
+                stats_event(dev, COMMS_DL_RESUME);
+                base = resumable ? bytes_completed : 0;
+                PrintAndLogEx(WARNING, "Timed out at offset %u / %u, resuming download (%u/%u)", bytes_completed, bytes, resumed, DL_MAX_RESUME);
+                if (resumable)
+                    dl_request(memtype, start_index + base, bytes - base, data, datalen);
+                else
+                    dl_request(memtype, start_index, bytes, data, datalen);
+
+                __atomic_store_n(&dev->timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
+                continue;
+            }
+
             PrintAndLogEx(FAILED, "Timed out while trying to download data from device");
             break;
         }
@@ -855,6 +1701,8 @@ static bool dl_it(uint8_t *dest, uint32_t bytes, uint32_t start_index, PacketRes
             PrintAndLogEx(NORMAL, "You can cancel this operation by pressing the pm3 button");
             show_warning = false;
         }
+
+        waitReply(dev, RX_WAIT_SLICE_MS);
     }
     return false;
 }
@@ -15,6 +15,7 @@
 #include "common.h"
 #include "pm3_cmd.h"    // Packet structs
 #include "util.h"       // FILE_PATH_SIZE
+#include "comms_stats.h"
 
 #ifndef DropField
 #define DropField() { \
@@ -30,9 +31,14 @@
     }
 #endif
 
-//For storing command that are received from the device
+//For storing command that are received from the device, must be a power of two
 #ifndef CMD_BUFFER_SIZE
-#define CMD_BUFFER_SIZE 100
+#define CMD_BUFFER_SIZE 128
+#endif
+
+// Number of commands which can be queued towards the device
+#ifndef TX_QUEUE_SIZE
+#define TX_QUEUE_SIZE 32
 #endif
 
 typedef enum {
@@ -43,6 +49,18 @@ typedef enum {
     SPIFFS
 } DeviceMemType_t;
 
+// Destination of a streamed download (GetFromDeviceStream)
+typedef struct {
+    // called for each chunk, offset is relative to the download start. Return PM3_SUCCESS to go on
+    int (*write)(void *ctx, uint32_t offset, const uint8_t *data, uint32_t len);
+    // optional, called after each chunk
+    void (*progress)(void *ctx, uint32_t done, uint32_t total);
+    void *ctx;
+} dl_sink_t;
+
+// How many times a timed out download is resumed
+#define DL_MAX_RESUME 3
+
 typedef struct {
     bool run; // If TRUE, continue running the uart_communication thread
     bool block_after_ACK; // if true, block after receiving an ACK package
@@ -57,7 +75,24 @@ typedef struct {
     uint8_t serial_port_name[FILE_PATH_SIZE];
 } communication_arg_t;
 
-extern communication_arg_t conn;
+// Settings of the device the calling thread talks to, see SetThreadDevice
+communication_arg_t *GetConn(void);
+capabilities_t *GetCapabilities(void);
+bool IsPm3Present(void);
+
+// Number of Proxmark3 devices a client can be connected to at the same time
+#ifndef MAX_DEVICES
+#define MAX_DEVICES 8
+#endif
+
+typedef struct {
+    char port[FILE_PATH_SIZE];
+    bool selected;
+    bool present;
+    bool dead;       // communication thread stopped
+    bool via_fpc;
+    uint32_t uart_speed;
+} pm3_device_info_t;
 
 void *uart_receiver(void *targ);
 void SendCommandBL(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *data, size_t len);
@@ -66,18 +101,40 @@ void SendCommandNG(uint16_t cmd, uint8_t *data, size_t len);
 void SendCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *data, size_t len);
 void clearCommandBuffer(void);
 
+// Pipelined commands, replies are reaped in submission order
+int SubmitCommandNG(uint16_t cmd, uint8_t *data, size_t len, uint16_t reply_cmd, uint32_t *request_id);
+int SubmitCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, void *data, size_t len, uint16_t reply_cmd, uint32_t *request_id);
+bool ReapResponseTimeout(uint32_t *request_id, PacketResponseNG *response, size_t ms_timeout);
+uint32_t GetPendingRequests(void);
+void CancelPendingRequests(void);
+
 #define FLASHMODE_SPEED 460800
 bool IsCommunicationThreadDead(void);
 bool OpenProxmark(void *port, bool wait_for_port, int timeout, bool flash_mode, uint32_t speed);
 int TestProxmark(void);
 void CloseProxmark(void);
 
+// Several devices, commands go to the selected one unless the thread set its own
+int AddDevice(void);
+int RemoveDevice(int idx);
+int SelectDevice(int idx);
+int GetSelectedDevice(void);
+int SetThreadDevice(int idx);
+bool GetDeviceInfo(int idx, pm3_device_info_t *info);
+
+// Link statistics of the selected device
+void GetCommsStats(comms_stats_t *stats);
+void ResetCommsStats(void);
+
 bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms_timeout, bool show_warning);
 bool WaitForResponseTimeout(uint32_t cmd, PacketResponseNG *response, size_t ms_timeout);
 bool WaitForResponse(uint32_t cmd, PacketResponseNG *response);
 
 //bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint32_t start_index, PacketResponseNG *response, size_t ms_timeout, bool show_warning);
 bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint32_t start_index, uint8_t *data, uint32_t datalen, PacketResponseNG *response, size_t ms_timeout, bool show_warning);
+bool GetFromDeviceStream(DeviceMemType_t memtype, uint32_t bytes, uint32_t start_index, uint8_t *data, uint32_t datalen, dl_sink_t *sink, PacketResponseNG *response, size_t ms_timeout, bool show_warning);
+void dl_print_progress(void *ctx, uint32_t done, uint32_t total);
+void SetRxBackpressure(bool enable);
 
 #endif
 
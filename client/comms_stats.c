@@ -0,0 +1,196 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Link statistics: per command round-trip latencies, throughput, errors
+//
+// Filled by comms.c, which serializes the calls. A round trip lasts from
+// handing a command to uart_send until the first reply with the same command
+// id arrives, or CMD_ACK for commands without such a reply.
+//-----------------------------------------------------------------------------
+
+#include "comms_stats.h"
+
+#include <string.h>
+
+#include "pm3_cmd.h"        // CMD_ACK
+#include "util_posix.h"     // usclock
+
+static const char *event_names[COMMS_EVENT_COUNT] = {
+    [COMMS_CRC_ERROR] = "crc_errors",
+    [COMMS_FRAME_ERROR] = "frame_errors",
+    [COMMS_SEND_ERROR] = "send_errors",
+    [COMMS_DROPPED_REPLY] = "dropped_replies",
+    [COMMS_TIMEOUT] = "timeouts",
+    [COMMS_DL_RESUME] = "download_resumes",
+    [COMMS_WTX] = "wtx",
+    [COMMS_TX_STALL] = "tx_queue_stalls",
+};
+
+static const char *depth_names[COMMS_DEPTH_COUNT] = {
+    [COMMS_DEPTH_TX_QUEUE] = "tx_queue",
+    [COMMS_DEPTH_RX_BUFFER] = "rx_buffer",
+    [COMMS_DEPTH_PENDING] = "pending_requests",
+};
+
+void comms_stats_reset(comms_stats_t *stats) {
+    memset(stats, 0, sizeof(comms_stats_t));
+    stats->start_us = usclock();
+}
+
+static comms_cmd_stats_t *find_cmd(comms_stats_t *stats, uint16_t cmd, bool add) {
+    for (uint16_t i = 0; i < stats->cmd_count; i++) {
+        if (stats->cmds[i].cmd == cmd)
+            return &stats->cmds[i];
+    }
+    if (add == false || stats->cmd_count == COMMS_STATS_MAX_CMDS)
+        return NULL;
+
+    comms_cmd_stats_t *c = &stats->cmds[stats->cmd_count++];
+    c->cmd = cmd;
+    c->min_us = UINT32_MAX;
+    return c;
+}
+
+static void dir_add(comms_dir_stats_t *dir, size_t len, uint64_t now) {
+    dir->bytes += len;
+    dir->frames++;
+
+    if (now - dir->window_start_us >= COMMS_STATS_WINDOW_US) {
+        if (dir->window_start_us) {
+            uint64_t bps = dir->window_bytes * 1000000 / (now - dir->window_start_us);
+            if (bps > dir->peak_bps)
+                dir->peak_bps = bps;
+        }
+        dir->window_start_us = now;
+        dir->window_bytes = 0;
+    }
+    dir->window_bytes += len;
+}
+
+void comms_stats_sent(comms_stats_t *stats, uint16_t cmd, bool acked, size_t len) {
+    uint64_t now = usclock();
+    dir_add(&stats->tx, len, now);
+
+    comms_cmd_stats_t *c = find_cmd(stats, cmd, true);
+    if (c == NULL) {
+        stats->untracked++;
+        return;
+    }
+    c->sent++;
+
+    // forget the oldest one, it is not going to be answered anymore
+    if (stats->inflight_count == COMMS_STATS_INFLIGHT) {
+        stats->inflight_head = (stats->inflight_head + 1) % COMMS_STATS_INFLIGHT;
+        stats->inflight_count--;
+    }
+    uint8_t i = (stats->inflight_head + stats->inflight_count) % COMMS_STATS_INFLIGHT;
+    stats->inflight[i].cmd = cmd;
+    stats->inflight[i].acked = acked;
+    stats->inflight[i].sent_us = now;
+    stats->inflight_count++;
+}
+
+void comms_stats_received(comms_stats_t *stats, size_t len) {
+    dir_add(&stats->rx, len, usclock());
+}
+
+void comms_stats_reply(comms_stats_t *stats, uint16_t cmd) {
+    uint8_t n;
+    for (n = 0; n < stats->inflight_count; n++) {
+        if (stats->inflight[(stats->inflight_head + n) % COMMS_STATS_INFLIGHT].cmd == cmd)
+            break;
+    }
+    // CMD_ACK answers the oldest OLD / MIX command, but some NG commands use it too
+    if (n == stats->inflight_count && cmd == CMD_ACK) {
+        for (n = 0; n < stats->inflight_count; n++) {
+            if (stats->inflight[(stats->inflight_head + n) % COMMS_STATS_INFLIGHT].acked)
+                break;
+        }
+        if (n == stats->inflight_count && n)
+            n = 0;
+    }
+    if (n == stats->inflight_count)
+        return;
+
+    uint8_t i = (stats->inflight_head + n) % COMMS_STATS_INFLIGHT;
+    uint64_t rtt = usclock() - stats->inflight[i].sent_us;
+    if (rtt > UINT32_MAX)
+        rtt = UINT32_MAX;
+
+    // the device handles commands in order, older ones got no reply we know of
+    stats->inflight_head = (i + 1) % COMMS_STATS_INFLIGHT;
+    stats->inflight_count -= n + 1;
+
+    comms_cmd_stats_t *c = find_cmd(stats, stats->inflight[i].cmd, false);
+    if (c == NULL)
+        return;
+
+    c->replies++;
+    c->sum_us += rtt;
+    if (rtt < c->min_us)
+        c->min_us = rtt;
+    if (rtt > c->max_us)
+        c->max_us = rtt;
+
+    uint8_t b = 0;
+    while (b < COMMS_STATS_BUCKETS - 1 && rtt >= ((uint64_t)COMMS_STATS_BUCKET0_US << b))
+        b++;
+    c->hist[b]++;
+}
+
+void comms_stats_event(comms_stats_t *stats, comms_event_t ev) {
+    if (ev < COMMS_EVENT_COUNT)
+        stats->events[ev]++;
+}
+
+void comms_stats_depth(comms_stats_t *stats, comms_depth_t which, uint32_t depth) {
+    if (which < COMMS_DEPTH_COUNT && depth > stats->depth_max[which])
+        stats->depth_max[which] = depth;
+}
+
+const char *comms_stats_event_name(comms_event_t ev) {
+    return (ev < COMMS_EVENT_COUNT) ? event_names[ev] : "";
+}
+
+const char *comms_stats_depth_name(comms_depth_t which) {
+    return (which < COMMS_DEPTH_COUNT) ? depth_names[which] : "";
+}
+
+uint64_t comms_stats_rate(const comms_stats_t *stats, const comms_dir_stats_t *dir) {
+    uint64_t elapsed = stats->now_us - stats->start_us;
+    if (elapsed == 0)
+        return 0;
+    return dir->bytes * 1000000 / elapsed;
+}
+
+uint64_t comms_stats_peak(const comms_stats_t *stats, const comms_dir_stats_t *dir) {
+    uint64_t peak = dir->peak_bps;
+    // the window still open counts as a full one at least
+    if (dir->window_start_us) {
+        uint64_t span = stats->now_us - dir->window_start_us;
+        if (span < COMMS_STATS_WINDOW_US)
+            span = COMMS_STATS_WINDOW_US;
+        uint64_t bps = dir->window_bytes * 1000000 / span;
+        if (bps > peak)
+            peak = bps;
+    }
+    return peak;
+}
+
+uint32_t comms_stats_percentile(const comms_cmd_stats_t *c, uint8_t pct) {
+    if (c->replies == 0)
+        return 0;
+
+    uint64_t want = ((uint64_t)c->replies * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (uint8_t b = 0; b < COMMS_STATS_BUCKETS - 1; b++) {
+        seen += c->hist[b];
+        if (seen >= want) {
+            uint32_t limit = COMMS_STATS_BUCKET0_US << b;
+            return (limit < c->max_us) ? limit : c->max_us;
+        }
+    }
+    return c->max_us;
+}
@@ -0,0 +1,103 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Link statistics: per command round-trip latencies, throughput, errors
+//-----------------------------------------------------------------------------
+
+#ifndef COMMS_STATS_H__
+#define COMMS_STATS_H__
+
+#include "common.h"
+
+// distinct command ids tracked, further ones are only counted in `untracked`
+#define COMMS_STATS_MAX_CMDS    128
+// commands sent and not answered yet, the oldest is forgotten when full
+#define COMMS_STATS_INFLIGHT    32
+// latency histogram, bucket b holds round trips below (COMMS_STATS_BUCKET0_US << b),
+// the last one everything above
+#define COMMS_STATS_BUCKETS     16
+#define COMMS_STATS_BUCKET0_US  128
+// throughput peaks are measured over windows of this length
+#define COMMS_STATS_WINDOW_US   1000000
+
+typedef enum {
+    COMMS_CRC_ERROR,        // frame dropped, CRC mismatch
+    COMMS_FRAME_ERROR,      // frame dropped, bad length, short read or missing postamble
+    COMMS_SEND_ERROR,       // uart_send failed
+    COMMS_DROPPED_REPLY,    // reply dropped, rx buffer full
+    COMMS_TIMEOUT,          // WaitForResponseTimeout gave up
+    COMMS_DL_RESUME,        // download resumed after a loss or timeout
+    COMMS_WTX,              // Waiting Time eXtension received
+    COMMS_TX_STALL,         // caller blocked on a full tx queue
+    COMMS_EVENT_COUNT
+} comms_event_t;
+
+typedef enum {
+    COMMS_DEPTH_TX_QUEUE,   // commands queued for the communication thread
+    COMMS_DEPTH_RX_BUFFER,  // replies waiting in the rx buffer
+    COMMS_DEPTH_PENDING,    // SubmitCommand* requests not reaped yet
+    COMMS_DEPTH_COUNT
+} comms_depth_t;
+
+typedef struct {
+    uint16_t cmd;
+    uint32_t sent;
+    uint32_t replies;       // round trips measured
+    uint64_t sum_us;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t hist[COMMS_STATS_BUCKETS];
+} comms_cmd_stats_t;
+
+typedef struct {
+    uint64_t bytes;
+    uint32_t frames;
+    uint64_t window_start_us;
+    uint64_t window_bytes;
+    uint64_t peak_bps;
+} comms_dir_stats_t;
+
+typedef struct {
+    uint64_t start_us;      // last reset
+    uint64_t now_us;        // time of the snapshot
+    comms_dir_stats_t tx;
+    comms_dir_stats_t rx;
+    uint32_t events[COMMS_EVENT_COUNT];
+    uint32_t depth_max[COMMS_DEPTH_COUNT];
+    uint32_t depth_now[COMMS_DEPTH_COUNT];  // only filled in snapshots
+    uint32_t untracked;     // commands sent once the table was full
+    uint16_t cmd_count;
+    comms_cmd_stats_t cmds[COMMS_STATS_MAX_CMDS];
+
+    struct {
+        uint16_t cmd;
+        bool acked;         // OLD or MIX frame, the device may answer with CMD_ACK
+        uint64_t sent_us;
+    } inflight[COMMS_STATS_INFLIGHT];
+    uint8_t inflight_head;
+    uint8_t inflight_count;
+} comms_stats_t;
+
+void comms_stats_reset(comms_stats_t *stats);
+
+// a frame of len bytes was sent / received on the link
+void comms_stats_sent(comms_stats_t *stats, uint16_t cmd, bool acked, size_t len);
+void comms_stats_received(comms_stats_t *stats, size_t len);
+// the reply which completes the oldest matching command sent, measures its round trip
+void comms_stats_reply(comms_stats_t *stats, uint16_t cmd);
+
+void comms_stats_event(comms_stats_t *stats, comms_event_t ev);
+void comms_stats_depth(comms_stats_t *stats, comms_depth_t which, uint32_t depth);
+
+const char *comms_stats_event_name(comms_event_t ev);
+const char *comms_stats_depth_name(comms_depth_t which);
+
+// average bytes/s since the last reset, and the highest over one window
+uint64_t comms_stats_rate(const comms_stats_t *stats, const comms_dir_stats_t *dir);
+uint64_t comms_stats_peak(const comms_stats_t *stats, const comms_dir_stats_t *dir);
+// latency below which pct percent of the round trips of c are, from the histogram
+uint32_t comms_stats_percentile(const comms_cmd_stats_t *c, uint8_t pct);
+
+#endif
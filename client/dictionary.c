@@ -0,0 +1,245 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Compiled key dictionaries: deduplicated keys with hit counts, mmap'd on load
+//-----------------------------------------------------------------------------
+#include "dictionary.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "commonutil.h"     // bytes_to_num
+
+typedef struct {
+    uint64_t key;
+    uint32_t pos;
+} dictionary_entry_t;
+
+static int cmp_entry(const void *a, const void *b) {
+    const dictionary_entry_t *x = a, *y = b;
+    if (x->key != y->key)
+        return (x->key > y->key) ? 1 : -1;
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+// entries sorted by key, equal keys by position
+static dictionary_entry_t *sorted_entries(const uint8_t *keys, uint32_t keycnt, uint8_t keylen) {
+    dictionary_entry_t *e = calloc(keycnt ? keycnt : 1, sizeof(dictionary_entry_t));
+    if (e == NULL)
+        return NULL;
+
+    for (uint32_t i = 0; i < keycnt; i++) {
+        e[i].key = bytes_to_num((uint8_t *)keys + (size_t)i * keylen, keylen);
+        e[i].pos = i;
+    }
+    qsort(e, keycnt, sizeof(dictionary_entry_t), cmp_entry);
+    return e;
+}
+
+int dictionary_open(const char *path, dictionary_t *dict) {
+
+    memset(dict, 0, sizeof(dictionary_t));
+
+    size_t size = 0;
+    uint8_t *p = NULL;
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return PM3_EFILE;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(dictionary_header_t) || (uint64_t)st.st_size > UINT32_MAX) {
+        close(fd);
+        return PM3_EFILE;
+    }
+    size = st.st_size;
+    p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return PM3_EFILE;
+#else
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return PM3_EFILE;
+
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (fsize < (long)sizeof(dictionary_header_t)) {
+        fclose(f);
+        return PM3_EFILE;
+    }
+    size = fsize;
+    p = calloc(size, sizeof(uint8_t));
+    if (p == NULL) {
+        fclose(f);
+        return PM3_EMALLOC;
+    }
+    if (fread(p, 1, size, f) != size) {
+        fclose(f);
+        free(p);
+        return PM3_EFILE;
+    }
+    fclose(f);
+#endif
+
+    dict->map = p;
+    dict->map_size = size;
+
+    const dictionary_header_t *h = (const dictionary_header_t *)p;
+    uint64_t keys_size = (uint64_t)h->keycount * h->keylen;
+    uint64_t table_size = (uint64_t)h->keycount * sizeof(uint32_t);
+    if (h->magic != DICTIONARY_MAGIC
+            || h->version != DICTIONARY_VERSION
+            || h->keylen == 0 || h->keylen > DICTIONARY_MAX_KEYLEN
+            || h->keys_offset < sizeof(dictionary_header_t)
+            || h->keys_offset + keys_size > size
+            || h->hits_offset % sizeof(uint32_t) || h->hits_offset + table_size > size
+            || h->index_offset % sizeof(uint32_t) || h->index_offset + table_size > size) {
+        dictionary_close(dict);
+        return PM3_EFILE;
+    }
+
+    dict->keylen = h->keylen;
+    dict->keycount = h->keycount;
+    dict->sources = h->sources;
+    dict->keys = p + h->keys_offset;
+    dict->hits = (const uint32_t *)(p + h->hits_offset);
+    dict->index = (const uint32_t *)(p + h->index_offset);
+    return PM3_SUCCESS;
+}
+
+int dictionary_verify(const dictionary_t *dict) {
+    uint64_t prev = 0;
+    for (uint32_t i = 0; i < dict->keycount; i++) {
+        if (dict->index[i] >= dict->keycount)
+            return PM3_EFILE;
+
+        uint64_t key = bytes_to_num((uint8_t *)dict->keys + (size_t)dict->index[i] * dict->keylen, dict->keylen);
+        if (i && key <= prev)
+            return PM3_EFILE;
+        prev = key;
+    }
+    return PM3_SUCCESS;
+}
+
+void dictionary_close(dictionary_t *dict) {
+    if (dict->map) {
+#ifndef _WIN32
+        munmap(dict->map, dict->map_size);
+#else
+        free(dict->map);
+#endif
+    }
+    memset(dict, 0, sizeof(dictionary_t));
+}
+
+int32_t dictionary_find(const dictionary_t *dict, const uint8_t *key) {
+    uint32_t lo = 0, hi = dict->keycount;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t pos = dict->index[mid];
+        // a damaged index finds nothing, but never reads outside the keys
+        if (pos >= dict->keycount)
+            return -1;
+        int cmp = memcmp(dict->keys + (size_t)pos * dict->keylen, key, dict->keylen);
+        if (cmp == 0)
+            return pos;
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return -1;
+}
+
+uint32_t dictionary_dedupe(uint8_t *keys, uint32_t keycnt, uint8_t keylen) {
+
+    if (keycnt < 2 || keylen == 0 || keylen > DICTIONARY_MAX_KEYLEN)
+        return keycnt;
+
+    dictionary_entry_t *e = sorted_entries(keys, keycnt, keylen);
+    uint8_t *dup = calloc(keycnt, sizeof(uint8_t));
+    if (e == NULL || dup == NULL) {
+        free(e);
+        free(dup);
+        return keycnt;
+    }
+
+    for (uint32_t i = 1; i < keycnt; i++) {
+        if (e[i].key == e[i - 1].key)
+            dup[e[i].pos] = 1;
+    }
+    free(e);
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < keycnt; i++) {
+        if (dup[i])
+            continue;
+        if (n != i)
+            memcpy(keys + (size_t)n * keylen, keys + (size_t)i * keylen, keylen);
+        n++;
+    }
+    free(dup);
+    return n;
+}
+
+int dictionary_save(const char *path, const uint8_t *keys, const uint32_t *hits, uint32_t keycnt, uint8_t keylen, uint32_t sources) {
+
+    if (keylen == 0 || keylen > DICTIONARY_MAX_KEYLEN)
+        return PM3_EINVARG;
+
+    dictionary_entry_t *e = sorted_entries(keys, keycnt, keylen);
+    uint32_t *index = calloc(keycnt ? keycnt : 1, sizeof(uint32_t));
+    if (e == NULL || index == NULL) {
+        free(e);
+        free(index);
+        return PM3_EMALLOC;
+    }
+    for (uint32_t i = 0; i < keycnt; i++) {
+        if (i && e[i].key == e[i - 1].key) {
+            free(e);
+            free(index);
+            return PM3_EINVARG;
+        }
+        index[i] = e[i].pos;
+    }
+    free(e);
+
+    size_t keys_size = (size_t)keycnt * keylen;
+    dictionary_header_t h = {
+        .magic = DICTIONARY_MAGIC,
+        .version = DICTIONARY_VERSION,
+        .keylen = keylen,
+        .keycount = keycnt,
+        .keys_offset = sizeof(dictionary_header_t),
+        .sources = sources,
+    };
+    h.hits_offset = (h.keys_offset + keys_size + 3) & ~3UL;
+    h.index_offset = h.hits_offset + keycnt * sizeof(uint32_t);
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        free(index);
+        return PM3_EFILE;
+    }
+
+    static const uint8_t pad[4] = {0};
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    ok &= fwrite(keys, 1, keys_size, f) == keys_size;
+    ok &= fwrite(pad, 1, h.hits_offset - h.keys_offset - keys_size, f) == h.hits_offset - h.keys_offset - keys_size;
+    ok &= fwrite(hits, sizeof(uint32_t), keycnt, f) == keycnt;
+    ok &= fwrite(index, sizeof(uint32_t), keycnt, f) == keycnt;
+    ok &= fclose(f) == 0;
+    free(index);
+    return ok ? PM3_SUCCESS : PM3_EFILE;
+}
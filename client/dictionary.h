@@ -0,0 +1,65 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Compiled key dictionaries: deduplicated keys with hit counts, mmap'd on load
+//-----------------------------------------------------------------------------
+
+#ifndef DICTIONARY_H__
+#define DICTIONARY_H__
+
+#include "common.h"
+#include "pm3_cmd.h"
+
+#define DICTIONARY_SUFFIX       ".bdic"
+#define DICTIONARY_MAGIC        0x43494450  // "PDIC"
+#define DICTIONARY_VERSION      1
+#define DICTIONARY_MAX_KEYLEN   8
+
+// File layout, native byte order, a foreign one fails the magic check:
+//   header
+//   keys    keycount * keylen bytes, in the order they should be tried
+//   hits    keycount * uint32_t, hit count of the key at the same position
+//   index   keycount * uint32_t, key positions in ascending key order
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t keylen;
+    uint8_t reserved;
+    uint32_t keycount;
+    uint32_t keys_offset;
+    uint32_t hits_offset;
+    uint32_t index_offset;
+    uint32_t sources;           // number of dictionaries merged into this one
+    uint32_t reserved2;
+} PACKED dictionary_header_t;
+
+typedef struct {
+    uint8_t keylen;
+    uint32_t keycount;
+    uint32_t sources;
+    const uint8_t *keys;
+    const uint32_t *hits;
+    const uint32_t *index;
+    void *map;
+    size_t map_size;
+} dictionary_t;
+
+// maps a compiled dictionary read-only. Only the header is checked, the index is
+// trusted as dictionary_save wrote it, dictionary_find stays in bounds regardless.
+int dictionary_open(const char *path, dictionary_t *dict);
+// full O(n) check that the index is a strictly ascending permutation of the keys
+int dictionary_verify(const dictionary_t *dict);
+void dictionary_close(dictionary_t *dict);
+
+// position of key in try order, -1 if not present. Binary search over the index.
+int32_t dictionary_find(const dictionary_t *dict, const uint8_t *key);
+
+// removes repeated keys in place, the first occurrence stays. Returns the new count.
+uint32_t dictionary_dedupe(uint8_t *keys, uint32_t keycnt, uint8_t keylen);
+
+// writes keys in the given try order, with their hit counts
+int dictionary_save(const char *path, const uint8_t *keys, const uint32_t *hits, uint32_t keycnt, uint8_t keylen, uint32_t sources);
+
+#endif
@@ -0,0 +1,129 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Radix-2 FFT and FFT based correlation for sample buffers
+//-----------------------------------------------------------------------------
+#include "fft.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static size_t next_pow2(size_t n) {
+    size_t p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+int fft_transform(fft_complex_t *data, size_t n, bool inverse) {
+
+    if (n < 2 || (n & (n - 1)))
+        return PM3_EINVARG;
+
+    // bit reversal permutation
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            fft_complex_t t = data[i];
+            data[i] = data[j];
+            data[j] = t;
+        }
+    }
+
+    // twiddles computed once for the largest stage, smaller stages stride through them.
+    // Taking each one from cos/sin directly keeps the rounding error flat over large n.
+    fft_complex_t *w = calloc(n / 2, sizeof(fft_complex_t));
+    if (w == NULL)
+        return PM3_EMALLOC;
+
+    double sign = inverse ? 1.0 : -1.0;
+    for (size_t k = 0; k < n / 2; k++) {
+        double a = 2.0 * M_PI * (double)k / (double)n;
+        w[k].re = cos(a);
+        w[k].im = sign * sin(a);
+    }
+
+    for (size_t len = 2; len <= n; len <<= 1) {
+        size_t half = len >> 1;
+        size_t step = n / len;
+        for (size_t i = 0; i < n; i += len) {
+            for (size_t k = 0; k < half; k++) {
+                fft_complex_t *a = &data[i + k];
+                fft_complex_t *b = &data[i + k + half];
+                const fft_complex_t *tw = &w[k * step];
+                double re = b->re * tw->re - b->im * tw->im;
+                double im = b->re * tw->im + b->im * tw->re;
+                b->re = a->re - re;
+                b->im = a->im - im;
+                a->re += re;
+                a->im += im;
+            }
+        }
+    }
+
+    free(w);
+    return PM3_SUCCESS;
+}
+
+// Wiener-Khinchin: the autocorrelation is the inverse transform of the power spectrum.
+// Zero padding to at least 2*len turns the circular correlation into a linear one,
+// which is O(n log n) instead of O(n * lags) for the direct sum.
+// The samples are integers, so their lag products sum to integers. Those are rounded,
+// which drops the transform's rounding error, and the mean is taken out afterwards
+// with running sums. The result matches the direct sum instead of landing just below it.
+int fft_autocovariance(const int *in, size_t len, double mean, double *out, size_t lags) {
+
+    if (len == 0 || lags > len)
+        return PM3_EINVARG;
+    if (lags == 0)
+        return PM3_SUCCESS;
+
+    size_t n = next_pow2(len * 2);
+    fft_complex_t *buf = calloc(n, sizeof(fft_complex_t));
+    if (buf == NULL)
+        return PM3_EMALLOC;
+
+    int64_t total = 0;
+    for (size_t i = 0; i < len; i++) {
+        buf[i].re = in[i];
+        total += in[i];
+    }
+
+    int res = fft_transform(buf, n, false);
+    if (res != PM3_SUCCESS) {
+        free(buf);
+        return res;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        buf[i].re = buf[i].re * buf[i].re + buf[i].im * buf[i].im;
+        buf[i].im = 0.0;
+    }
+
+    res = fft_transform(buf, n, true);
+    if (res != PM3_SUCCESS) {
+        free(buf);
+        return res;
+    }
+
+    // head = sum in[0 .. len-k-1], tail = sum in[k .. len-1]
+    int64_t head = total, tail = total;
+    for (size_t k = 0; k < lags; k++) {
+        int64_t products = llround(buf[k].re / (double)n);
+        out[k] = products - mean * (double)(head + tail) + (double)(len - k) * mean * mean;
+        head -= in[len - 1 - k];
+        tail -= in[k];
+    }
+
+    free(buf);
+    return PM3_SUCCESS;
+}
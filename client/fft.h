@@ -0,0 +1,27 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Radix-2 FFT and FFT based correlation for sample buffers
+//-----------------------------------------------------------------------------
+
+#ifndef FFT_H__
+#define FFT_H__
+
+#include "common.h"
+#include "pm3_cmd.h"
+
+typedef struct {
+    double re;
+    double im;
+} fft_complex_t;
+
+// in-place radix-2 transform, n must be a power of two.
+// inverse == true computes the unscaled inverse transform.
+int fft_transform(fft_complex_t *data, size_t n, bool inverse);
+
+// out[k] = sum_{j=0}^{len-k-1} (in[j] - mean) * (in[j+k] - mean), for k < lags
+int fft_autocovariance(const int *in, size_t len, double mean, double *out, size_t lags);
+
+#endif
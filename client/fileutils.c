@@ -46,12 +46,15 @@
 #include "commonutil.h"
 #include "proxmark3.h"
 #include "util.h"
+#include "dictionary.h"
 #ifdef _WIN32
 #include "scandir.h"
 #endif
 
 #define PATH_MAX_LENGTH 100
 
+static int searchFinalFile(char **foundpath, const char *pm3dir, const char *searchname);
+
 /**
  * @brief checks if a file exists
  * @param filename
@@ -169,6 +172,81 @@ out:
     return retval;
 }
 
+int openFileStream(fileStream_t *fs, const char *preferredName, const char *suffix, DumpFileType_t ftype, size_t blocksize) {
+
+    memset(fs, 0, sizeof(fileStream_t));
+    if (ftype != BIN && ftype != EML) return PM3_EINVARG;
+    if (ftype == EML && blocksize == 0) return PM3_EINVARG;
+
+    fs->fileName = newfilenamemcopy(preferredName, suffix);
+    if (fs->fileName == NULL) return PM3_EMALLOC;
+
+    // binary mode for EML too, so a row always takes blocksize * 2 + 1 bytes and chunks can be placed with fseek
+    fs->f = fopen(fs->fileName, "wb+");
+    if (!fs->f) {
+        PrintAndLogEx(WARNING, "file not found or locked. '" _YELLOW_("%s")"'", fs->fileName);
+        free(fs->fileName);
+        fs->fileName = NULL;
+        return PM3_EFILE;
+    }
+    fs->ftype = ftype;
+    fs->blocksize = blocksize;
+    return PM3_SUCCESS;
+}
+
+int writeFileStream(void *ctx, uint32_t offset, const uint8_t *data, uint32_t len) {
+
+    for (fileStream_t *fs = ctx; fs != NULL; fs = fs->next) {
+
+        if (fs->f == NULL) return PM3_EFILE;
+
+        if (fs->ftype == BIN) {
+            if (offset != fs->pos && fseek(fs->f, offset, SEEK_SET) != 0)
+                return PM3_EFILE;
+            if (fwrite(data, 1, len, fs->f) != len)
+                return PM3_EFILE;
+            fs->pos = offset + len;
+            fs->size = MAX(fs->size, fs->pos);
+            continue;
+        }
+
+        // EML rows have a fixed width, byte n starts at n * 2 plus the newlines before its row
+        if (offset != fs->pos) {
+            long at = (long)offset * 2 + offset / fs->blocksize;
+            if (fseek(fs->f, at, SEEK_SET) != 0)
+                return PM3_EFILE;
+            fs->pos = offset;
+        }
+        for (uint32_t i = 0; i < len; i++) {
+            // no extra line in the end
+            if (fs->pos && (fs->pos % fs->blocksize) == 0)
+                fprintf(fs->f, "\n");
+            fprintf(fs->f, "%02X", data[i]);
+            fs->pos++;
+        }
+        fs->size = MAX(fs->size, fs->pos);
+    }
+    return PM3_SUCCESS;
+}
+
+int closeFileStream(fileStream_t *fs) {
+
+    if (fs->f == NULL) return PM3_EFILE;
+
+    fflush(fs->f);
+    fclose(fs->f);
+    fs->f = NULL;
+
+    if (fs->ftype == BIN)
+        PrintAndLogEx(SUCCESS, "saved %u bytes to binary file " _YELLOW_("%s"), fs->size, fs->fileName);
+    else
+        PrintAndLogEx(SUCCESS, "saved %u blocks to text file " _YELLOW_("%s"), fs->size / fs->blocksize, fs->fileName);
+
+    free(fs->fileName);
+    fs->fileName = NULL;
+    return PM3_SUCCESS;
+}
+
 int saveFileJSON(const char *preferredName, JSONFileType ftype, uint8_t *data, size_t datalen) {
 
     if (data == NULL) return 1;
@@ -582,44 +660,54 @@ out:
     return retval;
 }
 
-int loadFileDICTIONARY(const char *preferredName, void *data, size_t *datalen, uint8_t keylen, uint16_t *keycnt) {
+static int loadDictionaryCompiled(const char *path, uint8_t keylen, dictionary_keys_t *dk) {
 
-    if (data == NULL) return PM3_ESOFT;
-    char *path;
-    if (searchFile(&path, DICTIONARIES_SUBDIR, preferredName, ".dic") != PM3_SUCCESS)
+    int res = dictionary_open(path, &dk->dict);
+    if (res != PM3_SUCCESS) {
+        PrintAndLogEx(WARNING, "file not a valid compiled dictionary. '" _YELLOW_("%s")"'", path);
+        return res;
+    }
+    if (dk->dict.keylen != keylen) {
+        PrintAndLogEx(WARNING, "compiled dictionary holds %u byte keys, expected %u. '" _YELLOW_("%s")"'", dk->dict.keylen, keylen, path);
+        dictionary_close(&dk->dict);
         return PM3_EFILE;
-
-    // t5577 == 4bytes
-    // mifare == 6 bytes
-    // iclass == 8 bytes
-    // default to 6 bytes.
-    if (keylen != 4 && keylen != 6 && keylen != 8) {
-        keylen = 6;
     }
 
-    // double up since its chars
-    keylen <<= 1;
-
-    char line[255];
+    dk->keys = dk->dict.keys;
+    dk->keycnt = dk->dict.keycount;
+    PrintAndLogEx(SUCCESS, "loaded " _GREEN_("%2u") "keys from compiled dictionary file " _YELLOW_("%s"), dk->keycnt, path);
+    return PM3_SUCCESS;
+}
 
-    size_t counter = 0;
-    int retval = PM3_SUCCESS;
+static int loadDictionaryText(const char *path, uint8_t keylen, dictionary_keys_t *dk) {
 
     FILE *f = fopen(path, "r");
     if (!f) {
         PrintAndLogEx(WARNING, "file not found or locked. '" _YELLOW_("%s")"'", path);
-        retval = PM3_EFILE;
-        goto out;
+        return PM3_EFILE;
+    }
+
+    // grown by doubling, large merged dictionaries have hundreds of thousands of keys
+    size_t mem_keys = 256;
+    uint8_t *data = calloc(mem_keys, keylen);
+    if (data == NULL) {
+        fclose(f);
+        return PM3_EMALLOC;
     }
 
+    // double up since its chars
+    uint8_t hexlen = keylen << 1;
+    uint32_t counter = 0;
+    char line[255];
+
     // read file
     while (fgets(line, sizeof(line), f)) {
 
         // add null terminator
-        line[keylen] = 0;
+        line[hexlen] = 0;
 
         // smaller keys than expected is skipped
-        if (strlen(line) < keylen)
+        if (strlen(line) < hexlen)
             continue;
 
         // The line start with # is comment, skip
@@ -627,34 +715,45 @@ int loadFileDICTIONARY(const char *preferredName, void *data, size_t *datalen, u
             continue;
 
         if (!isxdigit(line[0])) {
-            PrintAndLogEx(FAILED, "file content error. '%s' must include " _BLUE_("%2d") "HEX symbols", line, keylen);
+            PrintAndLogEx(FAILED, "file content error. '%s' must include " _BLUE_("%2d") "HEX symbols", line, hexlen);
             continue;
         }
 
-        uint64_t key = strtoull(line, NULL, 16);
+        if (counter == mem_keys) {
+            uint8_t *tmp = realloc(data, mem_keys * 2 * keylen);
+            if (tmp == NULL) {
+                free(data);
+                fclose(f);
+                return PM3_EMALLOC;
+            }
+            data = tmp;
+            mem_keys *= 2;
+        }
 
-        num_to_bytes(key, keylen >> 1, data + counter);
-        (*keycnt)++;
+        uint64_t key = strtoull(line, NULL, 16);
+        num_to_bytes(key, keylen, data + (size_t)counter * keylen);
+        counter++;
         memset(line, 0, sizeof(line));
-        counter += (keylen >> 1);
     }
     fclose(f);
-    PrintAndLogEx(SUCCESS, "loaded " _GREEN_("%2d") "keys from dictionary file " _YELLOW_("%s"), *keycnt, path);
 
-    if (datalen)
-        *datalen = counter;
-out:
-    free(path);
-    return retval;
+    uint32_t unique = dictionary_dedupe(data, counter, keylen);
+    if (unique != counter)
+        PrintAndLogEx(INFO, "skipped " _YELLOW_("%u") " duplicate keys", counter - unique);
+
+    dk->data = data;
+    dk->keys = data;
+    dk->keycnt = unique;
+    PrintAndLogEx(SUCCESS, "loaded " _GREEN_("%2u") "keys from dictionary file " _YELLOW_("%s"), dk->keycnt, path);
+    return PM3_SUCCESS;
 }
 
-int loadFileDICTIONARY_safe(const char *preferredName, void **pdata, uint8_t keylen, uint16_t *keycnt) {
+// Shared by all dictionary loaders.
+// A name ending in DICTIONARY_SUFFIX loads that compiled dictionary. Otherwise the text
+// dictionary is used, unless a compiled one of the same name sits next to it and is not older.
+int openFileDICTIONARY(const char *preferredName, uint8_t keylen, dictionary_keys_t *dk) {
 
-    int retval = PM3_SUCCESS;
-	
-    char *path;
-    if (searchFile(&path, DICTIONARIES_SUBDIR, preferredName, ".dic") != PM3_SUCCESS)
-        return PM3_EFILE;
+    memset(dk, 0, sizeof(dictionary_keys_t));
 
     // t5577 == 4bytes
     // mifare == 6 bytes
@@ -664,73 +763,127 @@ int loadFileDICTIONARY_safe(const char *preferredName, void **pdata, uint8_t key
         keylen = 6;
     }
 
-    size_t mem_size;
-	size_t block_size = 10 * keylen;
-
-    // double up since its chars
-    keylen <<= 1;
+    char *path = NULL;
+    int res;
+    if (str_endswith(preferredName, DICTIONARY_SUFFIX)) {
+        if (searchFile(&path, DICTIONARIES_SUBDIR, preferredName, DICTIONARY_SUFFIX) != PM3_SUCCESS)
+            return PM3_EFILE;
+        res = loadDictionaryCompiled(path, keylen, dk);
+        free(path);
+        return res;
+    }
 
-    char line[255];
+    char *filename = filenamemcopy(preferredName, ".dic");
+    if (filename == NULL)
+        return PM3_EMALLOC;
 
-    // allocate some space for the dictionary
-    *pdata = calloc( block_size , sizeof(uint8_t));
-    if (*pdata == NULL)
-		return PM3_EFILE;
+    // compiled sibling: <name>.dic -> <name>.bdic
+    char *compiled = calloc(strlen(filename) + strlen(DICTIONARY_SUFFIX) + 1, sizeof(char));
+    if (compiled == NULL) {
+        free(filename);
+        return PM3_EMALLOC;
+    }
+    memcpy(compiled, filename, strlen(filename) - strlen(".dic"));
+    strcat(compiled, DICTIONARY_SUFFIX);
+
+    if (searchFinalFile(&path, DICTIONARIES_SUBDIR, filename) == PM3_SUCCESS) {
+        char *cpath = calloc(strlen(path) + strlen(DICTIONARY_SUFFIX) + 1, sizeof(char));
+        if (cpath != NULL) {
+            memcpy(cpath, path, strlen(path) - strlen(".dic"));
+            strcat(cpath, DICTIONARY_SUFFIX);
+
+            struct stat st_text, st_comp;
+            if (stat(path, &st_text) == 0 && stat(cpath, &st_comp) == 0 && st_comp.st_mtime >= st_text.st_mtime) {
+                res = loadDictionaryCompiled(cpath, keylen, dk);
+                if (res == PM3_SUCCESS) {
+                    free(cpath);
+                    free(path);
+                    free(compiled);
+                    free(filename);
+                    return res;
+                }
+            }
+            free(cpath);
+        }
+        res = loadDictionaryText(path, keylen, dk);
+    } else if (searchFinalFile(&path, DICTIONARIES_SUBDIR, compiled) == PM3_SUCCESS) {
+        res = loadDictionaryCompiled(path, keylen, dk);
+    } else {
+        PrintAndLogEx(FAILED, "Error - can't find %s", filename);
+        path = NULL;
+        res = PM3_EFILE;
+    }
+    free(path);
+    free(compiled);
+    free(filename);
+    return res;
+}
 
-	mem_size = block_size;
+void closeFileDICTIONARY(dictionary_keys_t *dk) {
+    if (dk->dict.map)
+        dictionary_close(&dk->dict);
+    free(dk->data);
+    memset(dk, 0, sizeof(dictionary_keys_t));
+}
 
-    FILE *f = fopen(path, "r");
-    if (!f) {
-        PrintAndLogEx(WARNING, "file not found or locked. '" _YELLOW_("%s")"'", path);
-        retval = PM3_EFILE;
-        goto out;    }
+int loadFileDICTIONARY(const char *preferredName, void *data, size_t maxdatalen, size_t *datalen, uint8_t keylen, uint16_t *keycnt) {
 
-    // read file
-    while (fgets(line, sizeof(line), f)) {
+    if (data == NULL) return PM3_ESOFT;
 
-        // check if we have enough space (if not allocate more)
-        if ( (*keycnt * (keylen >> 1) ) >= mem_size ) {
-			
-            mem_size += block_size;
-            *pdata = realloc(*pdata, mem_size);
+    if (keylen != 4 && keylen != 6 && keylen != 8) {
+        keylen = 6;
+    }
 
-            if (*pdata == NULL) {
-                return PM3_EFILE;
-            } else {
-                memset(*pdata + (mem_size - block_size), 0, block_size);
-            }
-        }
+    dictionary_keys_t dk;
+    int res = openFileDICTIONARY(preferredName, keylen, &dk);
+    if (res != PM3_SUCCESS)
+        return res;
 
-        // add null terminator
-        line[keylen] = 0;
+    uint32_t count = dk.keycnt;
+    if (count > UINT16_MAX) {
+        PrintAndLogEx(WARNING, "too many keys, only the first %u are used", UINT16_MAX);
+        count = UINT16_MAX;
+    }
+    if ((size_t)count * keylen > maxdatalen) {
+        PrintAndLogEx(FAILED, "dictionary too large, %u keys, room for %zu", count, maxdatalen / keylen);
+        closeFileDICTIONARY(&dk);
+        return PM3_EOVFLOW;
+    }
 
-        // smaller keys than expected is skipped
-        if (strlen(line) < keylen)
-            continue;
+    memcpy(data, dk.keys, (size_t)count * keylen);
+    closeFileDICTIONARY(&dk);
+    *keycnt = count;
+    if (datalen)
+        *datalen = (size_t)count * keylen;
+    return PM3_SUCCESS;
+}
 
-        // The line start with # is comment, skip
-        if (line[0] == '#')
-            continue;
+int loadFileDICTIONARY_safe(const char *preferredName, void **pdata, uint8_t keylen, uint32_t *keycnt) {
 
-        if (!isxdigit(line[0])) {
-            PrintAndLogEx(FAILED, "file content error. '%s' must include " _BLUE_("%2d") "HEX symbols", line, keylen);
-            continue;
-        }
+    *pdata = NULL;
+    *keycnt = 0;
 
-        uint64_t key = strtoull(line, NULL, 16);
+    dictionary_keys_t dk;
+    int res = openFileDICTIONARY(preferredName, keylen, &dk);
+    if (res != PM3_SUCCESS)
+        return res;
 
-        num_to_bytes(key, keylen >> 1, *pdata + (*keycnt * (keylen >> 1)) );
-        
-        (*keycnt)++;
-		
-        memset(line, 0, sizeof(line));
+    // the caller owns and may change the keys, a mapping can't be handed over
+    if (dk.data == NULL) {
+        uint8_t keysize = dk.dict.keylen;
+        dk.data = calloc(dk.keycnt ? dk.keycnt : 1, keysize);
+        if (dk.data == NULL) {
+            closeFileDICTIONARY(&dk);
+            return PM3_EMALLOC;
+        }
+        memcpy(dk.data, dk.keys, (size_t)dk.keycnt * keysize);
     }
-    fclose(f);
-    PrintAndLogEx(SUCCESS, "loaded " _GREEN_("%2d") "keys from dictionary file " _YELLOW_("%s"), *keycnt, path);
 
-out:
-    free(path);
-    return retval;
+    *pdata = dk.data;
+    *keycnt = dk.keycnt;
+    dk.data = NULL;
+    closeFileDICTIONARY(&dk);
+    return PM3_SUCCESS;
 }
 
 int convertOldMfuDump(uint8_t **dump, size_t *dumplen) {
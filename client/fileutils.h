@@ -49,6 +49,7 @@
 #include "mifare/mifare4.h"
 #include "mifare/mifarehost.h"
 #include "cmdhfmfu.h"
+#include "dictionary.h"
 
 typedef enum {
     jsfRaw,
@@ -97,6 +98,54 @@ int saveFile(const char *preferredName, const char *suffix, const void *data, si
 */
 int saveFileEML(const char *preferredName, uint8_t *data, size_t datalen, size_t blocksize);
 
+/**
+ * @brief A file written chunk by chunk while data arrives, e.g. from GetFromDeviceStream.
+ * Streams can be chained with next, writeFileStream then writes to all of them.
+ */
+typedef struct fileStream_s {
+    FILE *f;
+    char *fileName;
+    DumpFileType_t ftype;   // BIN or EML
+    size_t blocksize;       // EML: length of one row
+    uint32_t pos;
+    uint32_t size;
+    struct fileStream_s *next;
+} fileStream_t;
+
+/**
+ * @brief Utility function to open a file for streamed writing. This method takes a preferred name, but if that
+ * file already exists, it tries with another name until it finds something suitable.
+ *
+ * @param fs the stream to initialise
+ * @param preferredName
+ * @param suffix the file suffix. Including the ".".
+ * @param ftype BIN or EML
+ * @param blocksize EML: the length of one row
+ * @return PM3_SUCCESS or an error code
+ */
+int openFileStream(fileStream_t *fs, const char *preferredName, const char *suffix, DumpFileType_t ftype, size_t blocksize);
+
+/**
+ * @brief Writes a chunk to a chain of file streams at its offset. Chunks may come in any order,
+ * gaps are filled once the missing chunks arrive.
+ * Matches the dl_sink_t write callback.
+ *
+ * @param ctx the first fileStream_t of the chain
+ * @param offset position of the chunk
+ * @param data the chunk
+ * @param len length of the chunk
+ * @return PM3_SUCCESS or PM3_EFILE
+ */
+int writeFileStream(void *ctx, uint32_t offset, const uint8_t *data, uint32_t len);
+
+/**
+ * @brief Flushes and closes a file stream
+ *
+ * @param fs the stream
+ * @return PM3_SUCCESS or PM3_EFILE
+ */
+int closeFileStream(fileStream_t *fs);
+
 /** STUB
  * @brief Utility function to save JSON data to a file. This method takes a preferred name, but if that
  * file already exists, it tries with another name until it finds something suitable.
@@ -159,6 +208,8 @@ int loadFileJSON(const char *preferredName, void *data, size_t maxdatalen, size_
 /**
  * @brief  Utility function to load data from a DICTIONARY textfile. This method takes a preferred name.
  * E.g. mfc_default_keys.dic
+ * A compiled dictionary (DICTIONARY_SUFFIX) is used instead when named explicitly,
+ * or when it sits next to the textfile and is not older. Repeated keys are dropped.
  *
  * @param preferredName
  * @param data The data array to store the loaded bytes from file
@@ -167,18 +218,39 @@ int loadFileJSON(const char *preferredName, void *data, size_t maxdatalen, size_
  * @param keylen  the number of bytes a key per row is
  * @return 0 for ok, 1 for failz
 */
-int loadFileDICTIONARY(const char *preferredName, void *data, size_t *datalen, uint8_t keylen, uint16_t *keycnt);
+int loadFileDICTIONARY(const char *preferredName, void *data, size_t maxdatalen, size_t *datalen, uint8_t keylen, uint16_t *keycnt);
 
 /**
  * @brief  Utility function to load data safely from a DICTIONARY textfile. This method takes a preferred name.
  * E.g. mfc_default_keys.dic
+ * Same file selection and deduplication as loadFileDICTIONARY.
  *
  * @param preferredName
  * @param pdata A pointer to a pointer  (for reverencing the loaded dictionary)
  * @param keylen  the number of bytes a key per row is
  * @return 0 for ok, 1 for failz
 */
-int loadFileDICTIONARY_safe(const char *preferredName, void **pdata, uint8_t keylen, uint16_t *keycnt);
+int loadFileDICTIONARY_safe(const char *preferredName, void **pdata, uint8_t keylen, uint32_t *keycnt);
+
+// keys of a dictionary file, a compiled one is used straight from its read-only mapping
+typedef struct {
+    const uint8_t *keys;
+    uint32_t keycnt;
+    dictionary_t dict;      // mapping of a compiled dictionary
+    uint8_t *data;          // keys read from a textfile
+} dictionary_keys_t;
+
+/**
+ * @brief  Utility function to open a DICTIONARY file without copying a compiled one.
+ * Same file selection and deduplication as loadFileDICTIONARY.
+ *
+ * @param preferredName
+ * @param keylen  the number of bytes a key per row is
+ * @param dk  the keys, valid until closeFileDICTIONARY
+ * @return PM3_SUCCESS or an error code
+*/
+int openFileDICTIONARY(const char *preferredName, uint8_t keylen, dictionary_keys_t *dk);
+void closeFileDICTIONARY(dictionary_keys_t *dk);
 
 /**
  * @brief  Utility function to check and convert old mfu dump format to new
@@ -9,22 +9,167 @@
 //-----------------------------------------------------------------------------
 #include "graph.h"
 
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "ui.h"
 #include "util.h"    //param_get32ex
 #include "lfdemod.h"
 #include "cmddata.h" //for g_debugmode
+#include "pm3_cmd.h" // PM3_*
 
-int GraphBuffer[MAX_GRAPH_TRACE_LEN];
-size_t GraphTraceLen;
-int s_Buff[MAX_GRAPH_TRACE_LEN];
+// one device trace worth of samples, grown by doubling
+#define GRAPH_INITIAL_LEN 40000
 
-/* write a manchester bit to the graph
-TODO,  verfy that this doesn't overflow buffer  (iceman)
-*/
+// until the first GraphReserve() the buffers point to a zeroed placeholder,
+// so readers of an empty graph never see NULL.
+static int GraphEmpty[1];
+
+static lf_workspace_t lf_default_workspace = {
+    .graph = GraphEmpty,
+    .s_buff = GraphEmpty,
+    .demod_ctx = { { 255, -255, 0, 0, true } },
+};
+__thread lf_workspace_t *g_lf_workspace = &lf_default_workspace;
+
+// held by the graph window while it draws the default workspace
+static pthread_mutex_t graph_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void GraphLock(void) {
+    pthread_mutex_lock(&graph_lock);
+}
+
+void GraphUnlock(void) {
+    pthread_mutex_unlock(&graph_lock);
+}
+
+lf_workspace_t *CreateLFWorkspace(void) {
+    lf_workspace_t *ws = calloc(1, sizeof(lf_workspace_t));
+    if (ws == NULL)
+        return NULL;
+    ws->graph = GraphEmpty;
+    ws->s_buff = GraphEmpty;
+    lfdemod_ctx_init(&ws->demod_ctx);
+    return ws;
+}
+
+void FreeLFWorkspace(lf_workspace_t *ws) {
+    if (ws == NULL || ws == &lf_default_workspace)
+        return;
+    if (ws->graph_cap) {
+        free(ws->graph);
+        free(ws->s_buff);
+    }
+    freeDemodCache(ws);
+    free(ws);
+}
+
+void SetLFWorkspace(lf_workspace_t *ws) {
+    g_lf_workspace = (ws) ? ws : &lf_default_workspace;
+}
+
+bool IsLFWorkspaceShown(void) {
+    return g_lf_workspace == &lf_default_workspace;
+}
+
+lf_workspace_t *PushLFWorkspace(void) {
+    lf_workspace_t *cur = g_lf_workspace;
+    lf_workspace_t *ws = CreateLFWorkspace();
+    if (ws == NULL)
+        return NULL;
+
+    g_lf_workspace = ws;
+    if (GraphReserve(cur->graph_len) != PM3_SUCCESS) {
+        g_lf_workspace = cur;
+        FreeLFWorkspace(ws);
+        return NULL;
+    }
+    memcpy(ws->graph, cur->graph, cur->graph_len * sizeof(int));
+    ws->graph_len = cur->graph_len;
+    memcpy(ws->demod, cur->demod, cur->demod_len);
+    ws->demod_len = cur->demod_len;
+    ws->demod_start_idx = cur->demod_start_idx;
+    ws->demod_clock = cur->demod_clock;
+    ws->demod_ctx = cur->demod_ctx;
+    ws->prev = cur;
+    return ws;
+}
+
+void PopLFWorkspace(lf_workspace_t *ws, uint8_t keep) {
+    if (ws == NULL)
+        return;
+
+    lf_workspace_t *cur = ws->prev;
+    g_lf_workspace = cur;
+
+    if ((keep & LF_KEEP_GRAPH) && GraphReserve(ws->graph_len) == PM3_SUCCESS) {
+        memcpy(cur->graph, ws->graph, ws->graph_len * sizeof(int));
+        cur->graph_len = ws->graph_len;
+        cur->demod_ctx = ws->demod_ctx;
+    }
+    if (keep & LF_KEEP_DEMOD) {
+        memcpy(cur->demod, ws->demod, ws->demod_len);
+        cur->demod_len = ws->demod_len;
+        cur->demod_start_idx = ws->demod_start_idx;
+        cur->demod_clock = ws->demod_clock;
+    }
+    FreeLFWorkspace(ws);
+}
+
+// make room for at least len samples in GraphBuffer and s_Buff.
+// The first GraphTraceLen samples are kept, new space is zeroed. Old GraphBuffer pointers are invalid afterwards.
+int GraphReserve(size_t len) {
+    if (len <= g_lf_workspace->graph_cap)
+        return PM3_SUCCESS;
+
+    if (len > MAX_GRAPH_STORE_LEN) {
+        PrintAndLogEx(WARNING, "graph can't hold more than %d samples", MAX_GRAPH_STORE_LEN);
+        return PM3_EOVFLOW;
+    }
+
+    size_t cap = (g_lf_workspace->graph_cap) ? g_lf_workspace->graph_cap : GRAPH_INITIAL_LEN;
+    while (cap < len)
+        cap *= 2;
+    if (cap > MAX_GRAPH_STORE_LEN)
+        cap = MAX_GRAPH_STORE_LEN;
+
+    int *gb = calloc(cap, sizeof(int));
+    int *sb = calloc(cap, sizeof(int));
+    if (gb == NULL || sb == NULL) {
+        free(gb);
+        free(sb);
+        PrintAndLogEx(WARNING, "failed to allocate memory for %zu samples", cap);
+        return PM3_EMALLOC;
+    }
+
+    // the graph window may be drawing the old buffers
+    bool shown = IsLFWorkspaceShown();
+    if (shown)
+        GraphLock();
+
+    size_t used = MIN(GraphTraceLen, g_lf_workspace->graph_cap);
+    memcpy(gb, GraphBuffer, used * sizeof(int));
+    memcpy(sb, s_Buff, used * sizeof(int));
+    if (g_lf_workspace->graph_cap) {
+        free(GraphBuffer);
+        free(s_Buff);
+    }
+    GraphBuffer = gb;
+    s_Buff = sb;
+    g_lf_workspace->graph_cap = cap;
+
+    if (shown)
+        GraphUnlock();
+    return PM3_SUCCESS;
+}
+
+/* write a manchester bit to the graph */
 void AppendGraph(bool redraw, uint16_t clock, int bit) {
-    uint8_t half = clock / 2;
-    uint8_t i;
+    if (GraphReserve(GraphTraceLen + clock) != PM3_SUCCESS)
+        return;
+
+    uint16_t half = clock / 2;
+    uint16_t i;
     //set first half the clock bit (all 1's or 0's for a 0 or 1 bit)
     for (i = 0; i < half; ++i)
         GraphBuffer[GraphTraceLen++] = bit;
@@ -46,33 +191,16 @@ size_t ClearGraph(bool redraw) {
         RepaintGraphWindow();
     return gtl;
 }
-// option '1' to save GraphBuffer any other to restore
-void save_restoreGB(uint8_t saveOpt) {
-    static int SavedGB[MAX_GRAPH_TRACE_LEN];
-    static size_t SavedGBlen = 0;
-    static bool GB_Saved = false;
-    static int SavedGridOffsetAdj = 0;
-
-    if (saveOpt == GRAPH_SAVE) { //save
-        memcpy(SavedGB, GraphBuffer, sizeof(GraphBuffer));
-        SavedGBlen = GraphTraceLen;
-        GB_Saved = true;
-        SavedGridOffsetAdj = GridOffset;
-    } else if (GB_Saved) { //restore
-        memcpy(GraphBuffer, SavedGB, sizeof(GraphBuffer));
-        GraphTraceLen = SavedGBlen;
-        GridOffset = SavedGridOffsetAdj;
-        RepaintGraphWindow();
-    }
-}
-
 void setGraphBuf(uint8_t *buff, size_t size) {
     if (buff == NULL) return;
 
     ClearGraph(false);
 
-    if (size > MAX_GRAPH_TRACE_LEN)
-        size = MAX_GRAPH_TRACE_LEN;
+    if (size > MAX_GRAPH_STORE_LEN)
+        size = MAX_GRAPH_STORE_LEN;
+
+    if (GraphReserve(size) != PM3_SUCCESS)
+        return;
 
     for (size_t i = 0; i < size; ++i)
         GraphBuffer[i] = buff[i] - 128;
@@ -81,10 +209,16 @@ void setGraphBuf(uint8_t *buff, size_t size) {
     RepaintGraphWindow();
 }
 
+// buff must hold MAX_GRAPH_TRACE_LEN samples, longer graphs are cut to that window
 size_t getFromGraphBuf(uint8_t *buff) {
+    return getFromGraphBufEx(buff, MAX_GRAPH_TRACE_LEN);
+}
+
+size_t getFromGraphBufEx(uint8_t *buff, size_t maxlen) {
     if (buff == NULL) return 0;
+    size_t len = MIN(GraphTraceLen, maxlen);
     size_t i;
-    for (i = 0; i < GraphTraceLen; ++i) {
+    for (i = 0; i < len; ++i) {
         //trim
         if (GraphBuffer[i] > 127) GraphBuffer[i] = 127;
         if (GraphBuffer[i] < -127) GraphBuffer[i] = -127;
@@ -122,18 +256,18 @@ void convertGraphFromBitstreamEx(int hi, int low) {
         else
             GraphBuffer[i] = 0;
     }
-    uint8_t bits[GraphTraceLen];
+    uint8_t bits[MAX_GRAPH_TRACE_LEN];
     memset(bits, 0, sizeof(bits));
     size_t size = getFromGraphBuf(bits);
 
     // set signal properties low/high/mean/amplitude and is_noise detection
-    computeSignalProperties(bits, size);
+    computeSignalProperties_ctx(LF_DEMOD_CTX, bits, size);
     RepaintGraphWindow();
 }
 
 // Get or auto-detect ask clock rate
 int GetAskClock(const char *str, bool printAns) {
-    if (getSignalProperties()->isnoise)
+    if (getSignalProperties_ctx(LF_DEMOD_CTX)->isnoise)
         return false;
 
     int clock1 = param_get32ex(str, 0, 0, 10);
@@ -149,10 +283,10 @@ int GetAskClock(const char *str, bool printAns) {
     }
 
     size_t ststart = 0, stend = 0;
-    bool st = DetectST(bits, &size, &clock1, &ststart, &stend);
+    bool st = DetectST_ctx(LF_DEMOD_CTX, bits, &size, &clock1, &ststart, &stend);
     int idx = stend;
     if (st == false) {
-        idx = DetectASKClock(bits, size, &clock1, 20);
+        idx = DetectASKClock_ctx(LF_DEMOD_CTX, bits, size, &clock1, 20);
     }
 
     if (clock1 > 0) {
@@ -166,7 +300,7 @@ int GetAskClock(const char *str, bool printAns) {
 }
 
 uint8_t GetPskCarrier(const char *str, bool printAns) {
-    if (getSignalProperties()->isnoise)
+    if (getSignalProperties_ctx(LF_DEMOD_CTX)->isnoise)
         return false;
 
     uint8_t carrier = 0;
@@ -188,7 +322,7 @@ uint8_t GetPskCarrier(const char *str, bool printAns) {
 
 int GetPskClock(const char *str, bool printAns) {
 
-    if (getSignalProperties()->isnoise)
+    if (getSignalProperties_ctx(LF_DEMOD_CTX)->isnoise)
         return -1;
 
     int clock1 = param_get32ex(str, 0, 0, 10);
@@ -204,7 +338,7 @@ int GetPskClock(const char *str, bool printAns) {
     }
     size_t firstPhaseShiftLoc = 0;
     uint8_t curPhase = 0, fc = 0;
-    clock1 = DetectPSKClock(grph, size, 0, &firstPhaseShiftLoc, &curPhase, &fc);
+    clock1 = DetectPSKClock_ctx(LF_DEMOD_CTX, grph, size, 0, &firstPhaseShiftLoc, &curPhase, &fc);
     setClockGrid(clock1, firstPhaseShiftLoc);
     // Only print this message if we're not looping something
     if (printAns)
@@ -215,7 +349,7 @@ int GetPskClock(const char *str, bool printAns) {
 
 int GetNrzClock(const char *str, bool printAns) {
 
-    if (getSignalProperties()->isnoise)
+    if (getSignalProperties_ctx(LF_DEMOD_CTX)->isnoise)
         return -1;
 
     int clock1 = param_get32ex(str, 0, 0, 10);
@@ -230,7 +364,7 @@ int GetNrzClock(const char *str, bool printAns) {
         return -1;
     }
     size_t clkStartIdx = 0;
-    clock1 = DetectNRZClock(grph, size, 0, &clkStartIdx);
+    clock1 = DetectNRZClock_ctx(LF_DEMOD_CTX, grph, size, 0, &clkStartIdx);
     setClockGrid(clock1, clkStartIdx);
     // Only print this message if we're not looping something
     if (printAns)
@@ -265,7 +399,7 @@ int GetFskClock(const char *str, bool printAns) {
 }
 bool fskClocks(uint8_t *fc1, uint8_t *fc2, uint8_t *rf1, int *firstClockEdge) {
 
-    if (getSignalProperties()->isnoise)
+    if (getSignalProperties_ctx(LF_DEMOD_CTX)->isnoise)
         return false;
 
     uint8_t bits[MAX_GRAPH_TRACE_LEN] = {0};
@@ -12,13 +12,19 @@
 #define GRAPH_H__
 
 #include "common.h"
+#include "lfdemod.h"    // lfdemod_ctx_t
 
+int GraphReserve(size_t len);
+// GraphReserve swaps the buffers of the default workspace under this lock,
+// code reading them on another thread (the graph window) holds it meanwhile
+void GraphLock(void);
+void GraphUnlock(void);
 void AppendGraph(bool redraw, uint16_t clock, int bit);
 size_t ClearGraph(bool redraw);
 bool HasGraphData(void);
 void setGraphBuf(uint8_t *buff, size_t size);
-void save_restoreGB(uint8_t saveOpt);
 size_t getFromGraphBuf(uint8_t *buff);
+size_t getFromGraphBufEx(uint8_t *buff, size_t maxlen);
 void convertGraphFromBitstream(void);
 void convertGraphFromBitstreamEx(int hi, int low);
 bool isGraphBitstream(void);
@@ -31,14 +37,60 @@ int GetFskClock(const char *str, bool printAns);
 bool fskClocks(uint8_t *fc1, uint8_t *fc2, uint8_t *rf1, int *firstClockEdge);
 
 // Max graph trace len: 40000 (bigbuf) * 8 (at 1 bit per sample)
+// this is the window the demodulators see, see getFromGraphBuf
 #ifndef MAX_GRAPH_TRACE_LEN
 #define MAX_GRAPH_TRACE_LEN (40000 * 8 )
 #endif
-#define GRAPH_SAVE 1
-#define GRAPH_RESTORE 0
+// GraphBuffer grows on demand up to this many samples (long captures loaded from file)
+#ifndef MAX_GRAPH_STORE_LEN
+#define MAX_GRAPH_STORE_LEN (MAX_GRAPH_TRACE_LEN * 32)
+#endif
+#ifndef MAX_DEMOD_BUF_LEN
+#define MAX_DEMOD_BUF_LEN (1024*128)
+#endif
+
+// Everything the LF demodulators work on. The commands and the graph window use the
+// default workspace, a thread can switch to a private one and run the same demods
+// without touching what the user sees.
+typedef struct lf_workspace_s {
+    int *graph;
+    int *s_buff;
+    size_t graph_len;
+    size_t graph_cap;
+    uint8_t demod[MAX_DEMOD_BUF_LEN];
+    size_t demod_len;
+    size_t demod_start_idx;
+    int demod_clock;
+    lfdemod_ctx_t demod_ctx;
+    void *demod_cache;      // owned by cmddata.c
+    struct lf_workspace_s *prev;    // workspace to return to, see PushLFWorkspace
+} lf_workspace_t;
+
+extern __thread lf_workspace_t *g_lf_workspace;
+
+lf_workspace_t *CreateLFWorkspace(void);
+void FreeLFWorkspace(lf_workspace_t *ws);
+// switch the calling thread to ws, NULL for the default one
+void SetLFWorkspace(lf_workspace_t *ws);
+// true when the calling thread works on what the graph window shows
+bool IsLFWorkspaceShown(void);
+
+// Switch to a private copy of the current workspace, e.g. to trim or filter the graph
+// for one demod attempt. PopLFWorkspace switches back and frees it, copying over the
+// parts named in keep.
+#define LF_KEEP_NOTHING 0x00
+#define LF_KEEP_DEMOD   0x01    // demod buffer, clock and start index
+#define LF_KEEP_GRAPH   0x02
+lf_workspace_t *PushLFWorkspace(void);
+void PopLFWorkspace(lf_workspace_t *ws, uint8_t keep);
 
-extern int GraphBuffer[MAX_GRAPH_TRACE_LEN];
-extern size_t GraphTraceLen;
-extern int s_Buff[MAX_GRAPH_TRACE_LEN];
+#define GraphBuffer     (g_lf_workspace->graph)
+#define GraphTraceLen   (g_lf_workspace->graph_len)
+#define s_Buff          (g_lf_workspace->s_buff)
+#define DemodBuffer     (g_lf_workspace->demod)
+#define DemodBufferLen  (g_lf_workspace->demod_len)
+#define g_DemodStartIdx (g_lf_workspace->demod_start_idx)
+#define g_DemodClock    (g_lf_workspace->demod_clock)
+#define LF_DEMOD_CTX    (&g_lf_workspace->demod_ctx)
 
 #endif
@@ -88,9 +88,46 @@ typedef union {
 
 // filter function (f20)
 // sourced from ``Wirelessly Pickpocketing a Mifare Classic Card'' by Flavio Garcia, Peter van Rossum, Roel Verdult and Ronny Wichers Schreur
-#define f20a(a,b,c,d) (((a|b)^(a&d))^(c&((a^b)|d)))
-#define f20b(a,b,c,d) (((a&b)|c)^((a^b)&(c|d)))
-#define f20c(a,b,c,d,e) ((a|((b|e)&(d^e)))^((a^(b&d))&((c^d)|(b&e))))
+#define f20a_expr(a,b,c,d) (((a|b)^(a&d))^(c&((a^b)|d)))
+#define f20b_expr(a,b,c,d) (((a&b)|c)^((a^b)&(c|d)))
+#define f20c_expr(a,b,c,d,e) ((a|((b|e)&(d^e)))^((a^(b&d))&((c^d)|(b&e))))
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+// vpternlogd computes any boolean function of 3 inputs in one instruction, the immediate being its truth table.
+// The filter subfunctions have 4 and 5 inputs, they are split into 3 input functions for each value of the
+// last input(s), which are then selected by it: 3 vpternlogd for f20a/f20b and 7 for f20c instead of 6 to 11 and/or/xor.
+#define TERNLOG_IMM(f) ((f(0xf0, 0xcc, 0xaa)) & 0xff)
+#define TERNLOG(f, a, b, c) ((bitslice_value_t)_mm512_ternarylogic_epi32((__m512i)(a), (__m512i)(b), (__m512i)(c), TERNLOG_IMM(f)))
+#define MUX_EXPR(s, x, y) (((s) & (x)) | (~(s) & (y)))
+
+#define F20A_D0(a,b,c) f20a_expr(a,b,c,0x00)
+#define F20A_D1(a,b,c) f20a_expr(a,b,c,0xff)
+#define F20B_D0(a,b,c) f20b_expr(a,b,c,0x00)
+#define F20B_D1(a,b,c) f20b_expr(a,b,c,0xff)
+#define F20C_D0E0(a,b,c) f20c_expr(a,b,c,0x00,0x00)
+#define F20C_D1E0(a,b,c) f20c_expr(a,b,c,0xff,0x00)
+#define F20C_D0E1(a,b,c) f20c_expr(a,b,c,0x00,0xff)
+#define F20C_D1E1(a,b,c) f20c_expr(a,b,c,0xff,0xff)
+
+static inline bitslice_value_t f20a(bitslice_value_t a, bitslice_value_t b, bitslice_value_t c, bitslice_value_t d) {
+    return TERNLOG(MUX_EXPR, d, TERNLOG(F20A_D1, a, b, c), TERNLOG(F20A_D0, a, b, c));
+}
+
+static inline bitslice_value_t f20b(bitslice_value_t a, bitslice_value_t b, bitslice_value_t c, bitslice_value_t d) {
+    return TERNLOG(MUX_EXPR, d, TERNLOG(F20B_D1, a, b, c), TERNLOG(F20B_D0, a, b, c));
+}
+
+static inline bitslice_value_t f20c(bitslice_value_t a, bitslice_value_t b, bitslice_value_t c, bitslice_value_t d, bitslice_value_t e) {
+    bitslice_value_t e0 = TERNLOG(MUX_EXPR, d, TERNLOG(F20C_D1E0, a, b, c), TERNLOG(F20C_D0E0, a, b, c));
+    bitslice_value_t e1 = TERNLOG(MUX_EXPR, d, TERNLOG(F20C_D1E1, a, b, c), TERNLOG(F20C_D0E1, a, b, c));
+    return TERNLOG(MUX_EXPR, e, e1, e0);
+}
+#else
+#define f20a f20a_expr
+#define f20b f20b_expr
+#define f20c f20c_expr
+#endif
 
 // bit indexing
 #define get_bit(n, word) (((word) >> (n)) & 1)
@@ -59,6 +59,7 @@ THE SOFTWARE.
 #include "common.h"
 #include "proxmark3.h"
 #include "cmdhfmfhard.h"
+#include "pm3_cmd.h"   // PM3_SUCCESS
 #include "hardnested_bf_core.h"
 #include "ui.h"
 #include "util.h"
@@ -66,10 +67,14 @@ THE SOFTWARE.
 #include "crapto1/crapto1.h"
 #include "parity.h"
 
-#define NUM_BRUTE_FORCE_THREADS         (num_CPUs())
+#define NUM_BRUTE_FORCE_THREADS         (bf_num_threads ? bf_num_threads : num_CPUs())
 #define DEFAULT_BRUTE_FORCE_RATE        (120000000.0) // if benchmark doesn't succeed
 #define TEST_BENCH_SIZE                 (6000)        // number of odd and even states for brute force benchmark
 #define TEST_BENCH_FILENAME             "hardnested/bf_bench_data.bin"
+#define BENCHMARK_RUNS                  3             // best of, for each SIMD core and thread count
+#define BENCHMARK_BUCKETS_PER_THREAD    4             // long enough runs for a stable figure
+#define BF_CHUNKS_PER_THREAD            16            // the work is split into about this many chunks per thread
+#define BF_MIN_CHUNK_ODD_STATES         256           // each chunk bitslices its even states again, keep that overhead small
 //#define WRITE_BENCH_FILE
 
 // debugging options
@@ -81,12 +86,18 @@ typedef enum {
     ODD_STATE = 1
 } odd_even_t;
 
+static uint32_t bf_num_threads = 0;  // 0 = one thread per CPU
+static uint32_t bf_bench_buckets = 1; // benchmark buckets per thread
 static uint32_t nonces_to_bruteforce = 0;
 static uint32_t bf_test_nonce[256];
 static uint8_t bf_test_nonce_2nd_byte[256];
 static uint8_t bf_test_nonce_par[256];
-static uint32_t bucket_count = 0;
-static statelist_t *buckets[128];
+// Work queue. Each chunk is a slice of the odd states of one bucket with all of its even states.
+// Chunks are sorted by decreasing work and idle threads take the next one, so no thread is
+// left with a long tail of big buckets while the others wait.
+static statelist_t *chunks = NULL;
+static uint32_t chunk_count = 0;
+static uint32_t next_chunk = 0;
 static uint32_t keys_found = 0;
 static uint64_t num_keys_tested;
 static uint64_t found_bs_key = 0;
@@ -156,42 +167,105 @@ crack_states_thread(void *x) {
     } *thread_arg;
 
     thread_arg = (struct arg *)x;
-    const int thread_id = thread_arg->thread_ID;
-    uint32_t current_bucket = thread_id;
-    while (current_bucket < bucket_count) {
-        statelist_t *bucket = buckets[current_bucket];
-        if (bucket) {
 #if defined (DEBUG_BRUTE_FORCE)
-            printf("Thread %u starts working on bucket %u\n", thread_id, current_bucket);
+    const int thread_id = thread_arg->thread_ID;
 #endif
-            const uint64_t key = crack_states_bitsliced(thread_arg->cuid, thread_arg->best_first_bytes, bucket, &keys_found, &num_keys_tested, nonces_to_bruteforce, bf_test_nonce_2nd_byte, thread_arg->nonces);
-            if (key != -1) {
-                __atomic_fetch_add(&keys_found, 1, __ATOMIC_SEQ_CST);
-                __atomic_fetch_add(&found_bs_key, key, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&keys_found, __ATOMIC_SEQ_CST) == 0) {
+        uint32_t current_chunk = __atomic_fetch_add(&next_chunk, 1, __ATOMIC_SEQ_CST);
+        if (current_chunk >= chunk_count)
+            break;
 
+        statelist_t *bucket = &chunks[current_chunk];
+#if defined (DEBUG_BRUTE_FORCE)
+        printf("Thread %u starts working on chunk %u\n", thread_id, current_chunk);
+#endif
+        const uint64_t key = crack_states_bitsliced(thread_arg->cuid, thread_arg->best_first_bytes, bucket, &keys_found, &num_keys_tested, nonces_to_bruteforce, bf_test_nonce_2nd_byte, thread_arg->nonces);
+        if (key != -1) {
+            __atomic_fetch_add(&keys_found, 1, __ATOMIC_SEQ_CST);
+            __atomic_fetch_add(&found_bs_key, key, __ATOMIC_SEQ_CST);
+
+            char progress_text[80];
+            char keystr[19];
+            sprintf(keystr, "%012" PRIx64 "  ", key);
+            sprintf(progress_text, "Brute force phase completed. Key found: " _YELLOW_("%s"), keystr);
+            hardnested_print_progress(thread_arg->num_acquired_nonces, progress_text, 0.0, 0);
+            break;
+        } else if (keys_found) {
+            break;
+        } else {
+            if (!thread_arg->silent) {
                 char progress_text[80];
-                char keystr[19];
-                sprintf(keystr, "%012" PRIx64 "  ", key);
-                sprintf(progress_text, "Brute force phase completed. Key found: " _YELLOW_("%s"), keystr);
-                hardnested_print_progress(thread_arg->num_acquired_nonces, progress_text, 0.0, 0);
-                break;
-            } else if (keys_found) {
-                break;
-            } else {
-                if (!thread_arg->silent) {
-                    char progress_text[80];
-                    sprintf(progress_text, "Brute force phase: %6.02f%%\t", 100.0 * (float)num_keys_tested / (float)(thread_arg->maximum_states));
-                    float remaining_bruteforce = thread_arg->nonces[thread_arg->best_first_bytes[0]].expected_num_brute_force - (float)num_keys_tested / 2;
-                    hardnested_print_progress(thread_arg->num_acquired_nonces, progress_text, remaining_bruteforce, 5000);
-                }
+                sprintf(progress_text, "Brute force phase: %6.02f%%\t", 100.0 * (float)num_keys_tested / (float)(thread_arg->maximum_states));
+                float remaining_bruteforce = thread_arg->nonces[thread_arg->best_first_bytes[0]].expected_num_brute_force - (float)num_keys_tested / 2;
+                hardnested_print_progress(thread_arg->num_acquired_nonces, progress_text, remaining_bruteforce, 5000);
             }
         }
-        current_bucket += NUM_BRUTE_FORCE_THREADS;
     }
     return NULL;
 }
 
 
+static int compare_chunks(const void *a, const void *b) {
+    const statelist_t *ca = (const statelist_t *)a;
+    const statelist_t *cb = (const statelist_t *)b;
+    uint64_t work_a = (uint64_t)ca->len[ODD_STATE] * ca->len[EVEN_STATE];
+    uint64_t work_b = (uint64_t)cb->len[ODD_STATE] * cb->len[EVEN_STATE];
+    if (work_a > work_b) return -1;
+    if (work_a < work_b) return 1;
+    return 0;
+}
+
+// Splits the candidate buckets into chunks of roughly the same work, largest first
+static bool build_chunks(statelist_t *candidates, uint32_t num_threads) {
+
+    uint64_t total_work = 0;
+    for (statelist_t *p = candidates; p != NULL; p = p->next) {
+        if (p->states[ODD_STATE] != NULL && p->states[EVEN_STATE] != NULL)
+            total_work += (uint64_t)p->len[ODD_STATE] * p->len[EVEN_STATE];
+    }
+
+    uint64_t chunk_work = total_work / ((uint64_t)num_threads * BF_CHUNKS_PER_THREAD) + 1;
+
+    // count first, then fill
+    for (uint8_t pass = 0; pass < 2; pass++) {
+        chunk_count = 0;
+        for (statelist_t *p = candidates; p != NULL; p = p->next) {
+            if (p->states[ODD_STATE] == NULL || p->states[EVEN_STATE] == NULL || p->len[ODD_STATE] == 0 || p->len[EVEN_STATE] == 0)
+                continue;
+
+            uint64_t odd_per_chunk = chunk_work / p->len[EVEN_STATE];
+            if (odd_per_chunk < BF_MIN_CHUNK_ODD_STATES)
+                odd_per_chunk = BF_MIN_CHUNK_ODD_STATES;
+
+            for (uint32_t odd_start = 0; odd_start < p->len[ODD_STATE]; odd_start += odd_per_chunk) {
+                if (pass == 1) {
+                    statelist_t *c = &chunks[chunk_count];
+                    c->states[EVEN_STATE] = p->states[EVEN_STATE];
+                    c->len[EVEN_STATE] = p->len[EVEN_STATE];
+                    c->states[ODD_STATE] = p->states[ODD_STATE] + odd_start;
+                    c->len[ODD_STATE] = MIN(odd_per_chunk, p->len[ODD_STATE] - odd_start);
+                    c->next = NULL;
+                }
+                chunk_count++;
+            }
+        }
+
+        if (pass == 0) {
+            chunks = calloc(chunk_count + 1, sizeof(statelist_t));
+            if (chunks == NULL) {
+                PrintAndLogEx(ERR, "Out of memory error in brute_force");
+                chunk_count = 0;
+                return false;
+            }
+        }
+    }
+
+    qsort(chunks, chunk_count, sizeof(statelist_t), compare_chunks);
+    next_chunk = 0;
+    return true;
+}
+
+
 void prepare_bf_test_nonces(noncelist_t *nonces, uint8_t best_first_byte) {
     // we do bitsliced brute forcing with best_first_bytes[0] only.
     // Extract the corresponding 2nd bytes
@@ -300,15 +374,6 @@ bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint
 
     bitslice_test_nonces(nonces_to_bruteforce, bf_test_nonce, bf_test_nonce_par);
 
-    // count number of states to go
-    bucket_count = 0;
-    for (statelist_t *p = candidates; p != NULL; p = p->next) {
-        if (p->states[ODD_STATE] != NULL && p->states[EVEN_STATE] != NULL) {
-            buckets[bucket_count] = p;
-            bucket_count++;
-        }
-    }
-
     uint64_t start_time = msclock();
 
 #if defined(__linux__) ||  defined(__APPLE__)
@@ -316,6 +381,9 @@ bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint
         return false;
 #endif
 
+    if (build_chunks(candidates, NUM_BRUTE_FORCE_THREADS) == false)
+        return false;
+
     pthread_t threads[NUM_BRUTE_FORCE_THREADS];
     struct args {
         bool silent;
@@ -343,6 +411,10 @@ bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint
 
     uint64_t elapsed_time = msclock() - start_time;
 
+    free(chunks);
+    chunks = NULL;
+    chunk_count = 0;
+
     if (bf_rate != NULL)
         *bf_rate = (float)num_keys_tested / ((float)elapsed_time / 1000.0);
 
@@ -425,30 +497,33 @@ static bool read_bench_data(statelist_t *test_candidates) {
 
 
 float brute_force_benchmark() {
-    statelist_t test_candidates[NUM_BRUTE_FORCE_THREADS];
+    const uint32_t num_buckets = NUM_BRUTE_FORCE_THREADS * bf_bench_buckets;
+    statelist_t test_candidates[num_buckets];
 
     test_candidates[0].states[ODD_STATE] = malloc((TEST_BENCH_SIZE + 1) * sizeof(uint32_t));
     test_candidates[0].states[EVEN_STATE] = malloc((TEST_BENCH_SIZE + 1) * sizeof(uint32_t));
-    for (uint8_t i = 0; i < NUM_BRUTE_FORCE_THREADS - 1; i++) {
+    for (uint32_t i = 0; i < num_buckets - 1; i++) {
         test_candidates[i].next = test_candidates + i + 1;
         test_candidates[i + 1].states[ODD_STATE] = test_candidates[0].states[ODD_STATE];
         test_candidates[i + 1].states[EVEN_STATE] = test_candidates[0].states[EVEN_STATE];
     }
-    test_candidates[NUM_BRUTE_FORCE_THREADS - 1].next = NULL;
+    test_candidates[num_buckets - 1].next = NULL;
 
     if (!read_bench_data(test_candidates)) {
         PrintAndLogEx(NORMAL, "Couldn't read benchmark data. Assuming brute force rate of %1.0f states per second", DEFAULT_BRUTE_FORCE_RATE);
+        free(test_candidates[0].states[ODD_STATE]);
+        free(test_candidates[0].states[EVEN_STATE]);
         return DEFAULT_BRUTE_FORCE_RATE;
     }
 
-    for (uint8_t i = 0; i < NUM_BRUTE_FORCE_THREADS; i++) {
+    for (uint32_t i = 0; i < num_buckets; i++) {
         test_candidates[i].len[ODD_STATE] = TEST_BENCH_SIZE;
         test_candidates[i].len[EVEN_STATE] = TEST_BENCH_SIZE;
         test_candidates[i].states[ODD_STATE][TEST_BENCH_SIZE] = -1;
         test_candidates[i].states[EVEN_STATE][TEST_BENCH_SIZE] = -1;
     }
 
-    uint64_t maximum_states = TEST_BENCH_SIZE * TEST_BENCH_SIZE * (uint64_t)NUM_BRUTE_FORCE_THREADS;
+    uint64_t maximum_states = TEST_BENCH_SIZE * TEST_BENCH_SIZE * (uint64_t)num_buckets;
 
     float bf_rate;
     uint64_t found_key = 0;
@@ -461,3 +536,67 @@ float brute_force_benchmark() {
 }
 
 
+static float brute_force_benchmark_best(uint32_t num_threads) {
+    bf_num_threads = num_threads;
+    bf_bench_buckets = BENCHMARK_BUCKETS_PER_THREAD;
+    float best = 0.0;
+    for (uint8_t i = 0; i < BENCHMARK_RUNS; i++) {
+        float rate = brute_force_benchmark();
+        if (rate > best)
+            best = rate;
+    }
+    bf_num_threads = 0;
+    bf_bench_buckets = 1;
+    return best;
+}
+
+// Runs the brute force benchmark with each SIMD core this CPU supports, on one and on all CPUs
+int brute_force_benchmark_all(void) {
+
+    static const struct {
+        SIMDExecInstr instr;
+        const char *name;
+    } cores[] = {
+        {SIMD_AVX512, "AVX512F"},
+        {SIMD_AVX2,   "AVX2"},
+        {SIMD_AVX,    "AVX"},
+        {SIMD_SSE2,   "SSE2"},
+        {SIMD_MMX,    "MMX"},
+        {SIMD_NONE,   "no SIMD"},
+    };
+
+    char bench_file_path[strlen(get_my_executable_directory()) + strlen(TEST_BENCH_FILENAME) + 1];
+    strcpy(bench_file_path, get_my_executable_directory());
+    strcat(bench_file_path, TEST_BENCH_FILENAME);
+
+    FILE *benchfile = fopen(bench_file_path, "rb");
+    if (benchfile == NULL) {
+        PrintAndLogEx(ERR, "Couldn't read benchmark data " _YELLOW_("%s"), bench_file_path);
+        return PM3_EFILE;
+    }
+    fclose(benchfile);
+
+    SetSIMDInstr(SIMD_AUTO);
+    SIMDExecInstr best = GetSIMDInstrAuto();
+    int cpus = num_CPUs();
+
+    PrintAndLogEx(INFO, "Brute force benchmark, %u x %u x %u states per thread, best of %u runs", BENCHMARK_BUCKETS_PER_THREAD, TEST_BENCH_SIZE, TEST_BENCH_SIZE, BENCHMARK_RUNS);
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(NORMAL, " SIMD core | keys/s 1 thread | keys/s %3d threads | keys/s per core", cpus);
+    PrintAndLogEx(NORMAL, "-----------+-----------------+--------------------+----------------");
+
+    for (uint8_t i = 0; i < sizeof(cores) / sizeof(cores[0]); i++) {
+        // faster cores than the CPU supports would crash
+        if (cores[i].instr < best)
+            continue;
+
+        SetSIMDInstr(cores[i].instr);
+        float single = brute_force_benchmark_best(1);
+        float all = (cpus > 1) ? brute_force_benchmark_best(cpus) : single;
+        PrintAndLogEx(NORMAL, " %-9s | %15.0f | %18.0f | %14.0f", cores[i].name, single, all, all / cpus);
+    }
+    PrintAndLogEx(NORMAL, "");
+
+    SetSIMDInstr(SIMD_AUTO);
+    return PM3_SUCCESS;
+}
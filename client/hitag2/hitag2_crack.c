@@ -0,0 +1,226 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Hitag2 key recovery from authentication challenges (nR / aR pairs)
+//
+// A reader authenticates with nR in clear and aR, the inverted first 32 bits
+// of keystream. Every pair rules out all but 2^-32 of the keys, two pairs
+// leave the right one. The key space is searched bitsliced on all cores.
+//-----------------------------------------------------------------------------
+
+#include "hitag2_crack.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "hitag2_crack_core.h"
+#include "hitag2_crypto.h"
+#include "commonutil.h"     // reflect8
+#include "pm3_cmd.h"        // PM3_*
+#include "util.h"           // num_CPUs, kbd_enter_pressed
+#include "util_posix.h"     // msclock, msleep
+#include "ui.h"
+
+typedef struct {
+    hitag2_crack_job_t *job;
+    pthread_mutex_t lock;
+    uint32_t next;          // next unit to search
+    uint32_t first;
+    uint32_t step;
+    uint32_t units;
+    uint32_t done;
+    uint64_t tested;
+    bool found;
+    uint64_t key;
+} hitag2_crack_state_t;
+
+// bytes as sent on air to a cipher value, the firmware does the same with REV32 / REV64
+static uint64_t bytes_to_cipher(const uint8_t *b, uint8_t len) {
+    uint64_t v = 0;
+    for (uint8_t i = 0; i < len; i++)
+        v |= (uint64_t)reflect8(b[i]) << (8 * i);
+    return v;
+}
+
+static void cipher_to_bytes(uint64_t v, uint8_t *b, uint8_t len) {
+    for (uint8_t i = 0; i < len; i++)
+        b[i] = reflect8((v >> (8 * i)) & 0xFF);
+}
+
+bool hitag2_crack_verify(const hitag2_crack_job_t *job, uint64_t key) {
+    for (uint8_t t = 0; t < job->count; t++) {
+        uint64_t cs = _hitag2_init(key, job->uid, job->nr[t]);
+        uint32_t ks = 0;
+        for (uint8_t n = 0; n < 32; n++)
+            ks |= (uint32_t)_hitag2_round(&cs) << n;
+        if (ks != job->ks[t])
+            return false;
+    }
+    return true;
+}
+
+// searches the next unit, false when there is none left
+static bool hitag2_crack_next(hitag2_crack_state_t *st) {
+    pthread_mutex_lock(&st->lock);
+    if (*st->job->stop || st->next >= st->units) {
+        pthread_mutex_unlock(&st->lock);
+        return false;
+    }
+    uint32_t unit = st->first + st->next * st->step;
+    st->next++;
+    pthread_mutex_unlock(&st->lock);
+
+    uint64_t key = 0, tested = 0;
+    bool found = hitag2_crack_unit(st->job, unit, &key, &tested);
+
+    pthread_mutex_lock(&st->lock);
+    st->tested += tested;
+    st->done++;
+    if (found && st->found == false) {
+        st->found = true;
+        st->key = key;
+        *st->job->stop = true;
+    }
+    pthread_mutex_unlock(&st->lock);
+    return true;
+}
+
+static void *
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+hitag2_crack_thread(void *arg) {
+    while (hitag2_crack_next(arg));
+    return NULL;
+}
+
+int hitag2_crack(const uint8_t *uid, const uint8_t *nrar, uint8_t count, const uint8_t *prefix, uint8_t prefixlen, uint8_t *key) {
+
+    if (count == 0 || count > HITAG2_CRACK_MAX_TRACES || prefixlen > HITAG2_CRACK_MAX_PREFIX)
+        return PM3_EINVARG;
+
+    volatile bool stop = false;
+    hitag2_crack_job_t *job = calloc(1, sizeof(hitag2_crack_job_t));
+    if (job == NULL)
+        return PM3_EMALLOC;
+
+    job->uid = bytes_to_cipher(uid, 4);
+    job->count = count;
+    for (uint8_t t = 0; t < count; t++) {
+        job->nr[t] = bytes_to_cipher(nrar + t * 8, 4);
+        // aR is the inverted keystream, first bit in the msb of each byte
+        uint32_t ks = 0;
+        for (uint8_t n = 0; n < 32; n++)
+            ks |= (uint32_t)(((~nrar[t * 8 + 4 + n / 8]) >> (7 - (n % 8))) & 1) << n;
+        job->ks[t] = ks;
+    }
+    job->fixed = prefixlen * 8;
+    job->prefix = bytes_to_cipher(prefix, prefixlen);
+    job->stop = &stop;
+
+    hitag2_crack_state_t st = {
+        .job = job,
+        .next = 0,
+        .first = 0,
+        .step = 1,
+        .units = 0x10000,
+    };
+    // key bits 0..15 select the unit, a known first key byte fixes half of them
+    if (prefixlen >= 2) {
+        st.first = job->prefix & 0xFFFF;
+        st.units = 1;
+    } else if (prefixlen == 1) {
+        st.first = job->prefix & 0xFF;
+        st.step = 0x100;
+        st.units = 0x100;
+    }
+    pthread_mutex_init(&st.lock, NULL);
+
+    int num_threads = num_CPUs();
+    if (num_threads < 1)
+        num_threads = 1;
+    if ((uint32_t)num_threads > st.units)
+        num_threads = st.units;
+
+    uint64_t keyspace = 1ULL << (48 - job->fixed);
+    PrintAndLogEx(INFO, "searching " _YELLOW_("2^%u") " keys with %u pair%s on %d thread%s, %u keys per vector",
+                  48 - job->fixed, count, (count > 1) ? "s" : "", num_threads, (num_threads > 1) ? "s" : "", hitag2_crack_bitslices());
+    if (count == 1)
+        PrintAndLogEx(WARNING, "one pair is consistent with about 2^16 keys, the first one found is reported");
+    PrintAndLogEx(INFO, "press " _YELLOW_("'enter'") " to cancel");
+
+    pthread_t *threads = calloc(num_threads, sizeof(pthread_t));
+    bool *started = calloc(num_threads, sizeof(bool));
+    if (threads == NULL || started == NULL) {
+        free(threads);
+        free(started);
+        pthread_mutex_destroy(&st.lock);
+        free(job);
+        return PM3_EMALLOC;
+    }
+    // threads which don't start leave their units to the others
+    int running = 0;
+    for (int i = 0; i < num_threads; i++) {
+        started[i] = (pthread_create(&threads[i], NULL, hitag2_crack_thread, &st) == 0);
+        if (started[i])
+            running++;
+    }
+    if (running < num_threads)
+        PrintAndLogEx(WARNING, "only %d of %d threads started", running, num_threads);
+
+    uint64_t start = msclock();
+    uint64_t last = start;
+    bool aborted = false;
+    for (;;) {
+        pthread_mutex_lock(&st.lock);
+        bool finished = st.found || st.done >= st.units;
+        uint64_t tested = st.tested;
+        pthread_mutex_unlock(&st.lock);
+        if (finished)
+            break;
+
+        if (kbd_enter_pressed()) {
+            aborted = true;
+            stop = true;
+            break;
+        }
+
+        uint64_t now = msclock();
+        if (now - last >= 10000 && tested) {
+            last = now;
+            double rate = (double)tested / ((now - start) / 1000.0);
+            PrintAndLogEx(INPLACE, "%5.2f%%  %.1f Mkeys/s  %.0f s left", 100.0 * tested / keyspace, rate / 1e6, (keyspace - tested) / rate);
+        }
+        // without any thread the units are searched here, one per round
+        if (running == 0)
+            hitag2_crack_next(&st);
+        else
+            msleep(100);
+    }
+
+    for (int i = 0; i < num_threads; i++)
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    free(threads);
+    free(started);
+    pthread_mutex_destroy(&st.lock);
+
+    uint64_t elapsed = msclock() - start;
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(INFO, "tested %" PRIu64 " keys in %" PRIu64 ".%03" PRIu64 " s", st.tested, elapsed / 1000, elapsed % 1000);
+
+    free(job);
+    if (aborted)
+        return PM3_EOPABORTED;
+    if (st.found == false)
+        return PM3_ESOFT;
+
+    cipher_to_bytes(st.key, key, 6);
+    return PM3_SUCCESS;
+}
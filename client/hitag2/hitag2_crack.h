@@ -0,0 +1,35 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Hitag2 key recovery from authentication challenges (nR / aR pairs)
+//-----------------------------------------------------------------------------
+
+#ifndef HITAG2_CRACK_H__
+#define HITAG2_CRACK_H__
+
+#include "common.h"
+
+#define HITAG2_CRACK_MAX_TRACES     60      // same as a `lf hitag cc` challenge file
+#define HITAG2_CRACK_MAX_PREFIX     4       // known key bytes
+
+// All values in cipher bit order, as used by _hitag2_init()
+typedef struct {
+    uint32_t uid;
+    uint8_t count;
+    uint32_t nr[HITAG2_CRACK_MAX_TRACES];
+    uint32_t ks[HITAG2_CRACK_MAX_TRACES];   // keystream after init, first bit in bit 0
+    uint8_t fixed;                          // key bits 0..fixed-1 are known
+    uint64_t prefix;
+    volatile bool *stop;
+} hitag2_crack_job_t;
+
+// uid 4 bytes, nrar count * 8 bytes (nR, aR as sent by the reader), prefix 0..HITAG2_CRACK_MAX_PREFIX known key bytes.
+// On success the 6 byte key is stored in key, in the byte order `lf hitag reader` takes it.
+int hitag2_crack(const uint8_t *uid, const uint8_t *nrar, uint8_t count, const uint8_t *prefix, uint8_t prefixlen, uint8_t *key);
+
+// the first `count` pairs are consistent with key
+bool hitag2_crack_verify(const hitag2_crack_job_t *job, uint64_t key);
+
+#endif
@@ -0,0 +1,294 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Hitag2 bitsliced key search
+//
+// The cipher state starts as key bits 0..15 and the uid, key bit 16+i is
+// shifted in with nR bit i during init round i. Keys are enumerated as a tree
+// over the init rounds, so a state is only computed once for all keys sharing
+// the bits shifted in so far. The last init rounds and the keystream are
+// computed bitsliced, one key per bit of a SIMD vector.
+//
+// This file is compiled once for each instruction set, like the hardnested
+// brute forcer, and the best one is picked at runtime.
+//-----------------------------------------------------------------------------
+
+#include "hitag2_crack_core.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hitag2_crypto.h"
+#include "hardnested/hardnested_bf_core.h"   // SIMDExecInstr, GetSIMDInstrAuto
+
+#if defined(__AVX512F__)
+#define MAX_BITSLICES 512
+#define LANE_BITS 9
+#elif defined(__AVX2__)
+#define MAX_BITSLICES 256
+#define LANE_BITS 8
+#elif defined(__AVX__)
+#define MAX_BITSLICES 128
+#define LANE_BITS 7
+#elif defined(__SSE2__)
+#define MAX_BITSLICES 128
+#define LANE_BITS 7
+#else // MMX or SSE or NOSIMD
+#define MAX_BITSLICES 64
+#define LANE_BITS 6
+#endif
+
+#define VECTOR_SIZE (MAX_BITSLICES/8)
+typedef uint32_t __attribute__((aligned(VECTOR_SIZE))) __attribute__((vector_size(VECTOR_SIZE))) bitslice_value_t;
+typedef union {
+    bitslice_value_t value;
+    uint64_t bytes64[MAX_BITSLICES / 64];
+} bitslice_t;
+
+// init rounds done per key tree node, the rest is bitsliced
+#define SCALAR_ROUNDS   (32 - LANE_BITS)
+
+// filter functions f4a (0x2C79), f4b (0x6671) and f5c (0x7907287B) as boolean expressions
+#define f_a_bs(a,b,c,d)       (~(((a|b)&c)^(a|d)^b))
+#define f_b_bs(a,b,c,d)       (~(((d|c)&(a^b))^(d|a|b)))
+#define f_c_bs(a,b,c,d,e)     (~((((((c^e)|d)&a)^b)&(c^b))^(((d^e)|a)&((d^b)|c))))
+
+#define i4(x,a,b,c,d)    ((uint32_t)((((x)>>(a))&1)+(((x)>>(b))&1)*2+(((x)>>(c))&1)*4+(((x)>>(d))&1)*8))
+
+static const uint32_t ht2_f4a = 0x2C79;
+static const uint32_t ht2_f4b = 0x6671;
+static const uint32_t ht2_f5c = 0x7907287B;
+
+// this needs to be compiled several times for each instruction set.
+// For each instruction set, define a dedicated function name:
+#if defined (__AVX512F__)
+#define HITAG2_CRACK_UNIT hitag2_crack_unit_AVX512
+#elif defined (__AVX2__)
+#define HITAG2_CRACK_UNIT hitag2_crack_unit_AVX2
+#elif defined (__AVX__)
+#define HITAG2_CRACK_UNIT hitag2_crack_unit_AVX
+#elif defined (__SSE2__)
+#define HITAG2_CRACK_UNIT hitag2_crack_unit_SSE2
+#elif defined (__MMX__)
+#define HITAG2_CRACK_UNIT hitag2_crack_unit_MMX
+#else
+#define HITAG2_CRACK_UNIT hitag2_crack_unit_NOSIMD
+#endif
+
+// typedefs and declaration of functions:
+typedef bool hitag2_crack_unit_t(const hitag2_crack_job_t *, uint32_t, uint64_t *, uint64_t *);
+hitag2_crack_unit_t hitag2_crack_unit_AVX512;
+hitag2_crack_unit_t hitag2_crack_unit_AVX2;
+hitag2_crack_unit_t hitag2_crack_unit_AVX;
+hitag2_crack_unit_t hitag2_crack_unit_SSE2;
+hitag2_crack_unit_t hitag2_crack_unit_MMX;
+hitag2_crack_unit_t hitag2_crack_unit_NOSIMD;
+hitag2_crack_unit_t hitag2_crack_unit_dispatch;
+
+static inline bool bitslice_is_zero(const bitslice_t *v) {
+    uint64_t r = 0;
+    for (uint8_t i = 0; i < MAX_BITSLICES / 64; i++)
+        r |= v->bytes64[i];
+    return r == 0;
+}
+
+// f20 of the state in planes x[0..47]
+static inline bitslice_value_t f20_bs(const bitslice_t *x) {
+    bitslice_value_t a = f_a_bs(x[1].value, x[2].value, x[4].value, x[5].value);
+    bitslice_value_t b = f_b_bs(x[7].value, x[11].value, x[13].value, x[14].value);
+    bitslice_value_t c = f_b_bs(x[16].value, x[20].value, x[22].value, x[25].value);
+    bitslice_value_t d = f_b_bs(x[27].value, x[28].value, x[30].value, x[32].value);
+    bitslice_value_t e = f_a_bs(x[33].value, x[42].value, x[43].value, x[45].value);
+    return f_c_bs(a, b, c, d, e);
+}
+
+// one init round on a scalar state
+static inline uint64_t init_round(uint64_t x, uint32_t bit) {
+    x >>= 1;
+    return x | ((uint64_t)(_f20(x) ^ (bit & 1)) << 47);
+}
+
+bool HITAG2_CRACK_UNIT(const hitag2_crack_job_t *job, uint32_t unit, uint64_t *key, uint64_t *tested) {
+
+    const uint32_t nr = job->nr[0];
+    const uint32_t ks = job->ks[0];
+
+    bitslice_value_t zero = {0};
+    bitslice_value_t ones = ~zero;
+
+    // lane l tries key bits 16 + SCALAR_ROUNDS + k = bit k of l
+    bitslice_t lanes[LANE_BITS];
+    static const uint64_t lane_pattern[6] = {
+        0xAAAAAAAAAAAAAAAAULL, 0xCCCCCCCCCCCCCCCCULL, 0xF0F0F0F0F0F0F0F0ULL,
+        0xFF00FF00FF00FF00ULL, 0xFFFF0000FFFF0000ULL, 0xFFFFFFFF00000000ULL
+    };
+    for (uint8_t k = 0; k < LANE_BITS; k++) {
+        for (uint8_t w = 0; w < MAX_BITSLICES / 64; w++) {
+            if (k < 6)
+                lanes[k].bytes64[w] = lane_pattern[k];
+            else
+                lanes[k].bytes64[w] = ((w >> (k - 6)) & 1) ? ~0ULL : 0;
+        }
+    }
+
+    // key bits fixed by the prefix, init rounds 0..fixed_rounds-1
+    uint8_t fixed_rounds = (job->fixed > 16) ? job->fixed - 16 : 0;
+    uint64_t kfixed = (job->prefix & ((1ULL << job->fixed) - 1)) | (unit & 0xFFFF);
+
+    uint64_t states[SCALAR_ROUNDS + 1];
+    states[0] = ((uint64_t)(unit & 0xFFFF) << 32) | job->uid;
+    for (uint8_t r = 0; r < fixed_rounds; r++)
+        states[r + 1] = init_round(states[r], (nr >> r) ^ (uint32_t)(kfixed >> (16 + r)));
+
+    const uint8_t free_rounds = SCALAR_ROUNDS - fixed_rounds;
+    const uint64_t leaves = 1ULL << free_rounds;
+
+    // planes: state bit j after `off` rounds is p[off + j]
+    bitslice_t p[48 + LANE_BITS + 32];
+
+    for (uint64_t leaf = 0; leaf < leaves; leaf++) {
+
+        if ((leaf & 0xFFF) == 0 && *job->stop)
+            break;
+
+        // only the rounds whose key bit changed are recomputed
+        uint8_t from = leaf ? SCALAR_ROUNDS - 1 - __builtin_ctzll(leaf) : fixed_rounds;
+        for (uint8_t r = from; r < SCALAR_ROUNDS; r++) {
+            uint32_t bit = (uint32_t)(leaf >> (SCALAR_ROUNDS - 1 - r));
+            states[r + 1] = init_round(states[r], (nr >> r) ^ bit);
+        }
+
+        uint64_t x = states[SCALAR_ROUNDS];
+        for (uint8_t j = 0; j < 48; j++)
+            p[j].value = ((x >> j) & 1) ? ones : zero;
+
+        // bitsliced init rounds. The lane bits enter at bit 47 and don't reach the taps
+        // of the first four f4 functions yet, those are still computed on the scalar state.
+        uint8_t off = 0;
+        for (uint8_t k = 0; k < LANE_BITS; k++) {
+            x >>= 1;
+            uint32_t idx = ((ht2_f4a >> i4(x, 1, 2, 4, 5)) & 1)
+                           | ((ht2_f4b >> i4(x, 7, 11, 13, 14)) & 1) << 1
+                           | ((ht2_f4b >> i4(x, 16, 20, 22, 25)) & 1) << 2
+                           | ((ht2_f4b >> i4(x, 27, 28, 30, 32)) & 1) << 3;
+            uint32_t m0 = (ht2_f5c >> idx) & 1;
+            uint32_t m1 = (ht2_f5c >> (idx + 16)) & 1;
+
+            const bitslice_t *s = p + off + 1;
+            bitslice_value_t e = f_a_bs(s[33].value, s[42].value, s[43].value, s[45].value);
+            bitslice_value_t f;
+            if (m0 == m1)
+                f = m0 ? ones : zero;
+            else
+                f = m1 ? e : ~e;
+
+            if ((nr >> (SCALAR_ROUNDS + k)) & 1)
+                f = ~f;
+            p[off + 48].value = f ^ lanes[k].value;
+            off++;
+        }
+
+        // keystream, stop as soon as every lane is wrong
+        bitslice_t alive;
+        alive.value = ones;
+        uint8_t n;
+        for (n = 0; n < 32; n++) {
+            const bitslice_t *s = p + off;
+            p[off + 48].value = s[0].value ^ s[2].value ^ s[3].value ^ s[6].value
+                                ^ s[7].value ^ s[8].value ^ s[16].value ^ s[22].value
+                                ^ s[23].value ^ s[26].value ^ s[30].value ^ s[41].value
+                                ^ s[42].value ^ s[43].value ^ s[46].value ^ s[47].value;
+            off++;
+
+            bitslice_value_t out = f20_bs(p + off);
+            alive.value &= ((ks >> n) & 1) ? out : ~out;
+            if (bitslice_is_zero(&alive))
+                break;
+        }
+        if (n < 32)
+            continue;
+
+        // candidates for the first pair, check them against all
+        uint64_t kbase = kfixed;
+        for (uint8_t r = fixed_rounds; r < SCALAR_ROUNDS; r++)
+            kbase |= ((leaf >> (SCALAR_ROUNDS - 1 - r)) & 1ULL) << (16 + r);
+
+        for (uint16_t w = 0; w < MAX_BITSLICES / 64; w++) {
+            uint64_t bits = alive.bytes64[w];
+            while (bits) {
+                uint64_t l = w * 64 + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                uint64_t k = kbase | (l << (16 + SCALAR_ROUNDS));
+                if (hitag2_crack_verify(job, k)) {
+                    *key = k;
+                    *tested += (leaf + 1) * MAX_BITSLICES;
+                    return true;
+                }
+            }
+        }
+    }
+
+    *tested += leaves * MAX_BITSLICES;
+    return false;
+}
+
+#ifndef __MMX__
+
+// pointers to functions:
+static hitag2_crack_unit_t *hitag2_crack_unit_function_p = &hitag2_crack_unit_dispatch;
+
+// determine the available instruction set at runtime and call the correct function
+bool hitag2_crack_unit_dispatch(const hitag2_crack_job_t *job, uint32_t unit, uint64_t *key, uint64_t *tested) {
+    switch (GetSIMDInstrAuto()) {
+#if defined (__i386__) || defined (__x86_64__)
+#if !defined(__APPLE__) || (defined(__APPLE__) && (__clang_major__ > 8 || __clang_major__ == 8 && __clang_minor__ >= 1))
+#if (__GNUC__ >= 5) && (__GNUC__ > 5 || __GNUC_MINOR__ > 2)
+        case SIMD_AVX512:
+            hitag2_crack_unit_function_p = &hitag2_crack_unit_AVX512;
+            break;
+#endif
+        case SIMD_AVX2:
+            hitag2_crack_unit_function_p = &hitag2_crack_unit_AVX2;
+            break;
+        case SIMD_AVX:
+            hitag2_crack_unit_function_p = &hitag2_crack_unit_AVX;
+            break;
+        case SIMD_SSE2:
+            hitag2_crack_unit_function_p = &hitag2_crack_unit_SSE2;
+            break;
+        case SIMD_MMX:
+            hitag2_crack_unit_function_p = &hitag2_crack_unit_MMX;
+            break;
+#endif
+#endif
+        default:
+            hitag2_crack_unit_function_p = &hitag2_crack_unit_NOSIMD;
+            break;
+    }
+
+    // call the most optimized function for this CPU
+    return (*hitag2_crack_unit_function_p)(job, unit, key, tested);
+}
+
+// Entries to dispatched function calls
+bool hitag2_crack_unit(const hitag2_crack_job_t *job, uint32_t unit, uint64_t *key, uint64_t *tested) {
+    return (*hitag2_crack_unit_function_p)(job, unit, key, tested);
+}
+
+uint16_t hitag2_crack_bitslices(void) {
+    switch (GetSIMDInstrAuto()) {
+        case SIMD_AVX512:
+            return 512;
+        case SIMD_AVX2:
+            return 256;
+        case SIMD_AVX:
+        case SIMD_SSE2:
+            return 128;
+        default:
+            return 64;
+    }
+}
+
+#endif
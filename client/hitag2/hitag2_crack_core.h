@@ -0,0 +1,21 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Hitag2 bitsliced key search, one build per SIMD instruction set
+//-----------------------------------------------------------------------------
+
+#ifndef HITAG2_CRACK_CORE_H__
+#define HITAG2_CRACK_CORE_H__
+
+#include "hitag2_crack.h"
+
+// Searches all keys with bits 0..15 == unit (and the known prefix), 2^32 keys without prefix.
+// Returns true and the key in cipher bit order when all pairs match. tested is increased by the keys tried.
+bool hitag2_crack_unit(const hitag2_crack_job_t *job, uint32_t unit, uint64_t *key, uint64_t *tested);
+
+// keys tested in parallel by the selected instruction set
+uint16_t hitag2_crack_bitslices(void);
+
+#endif
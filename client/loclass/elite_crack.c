@@ -47,6 +47,9 @@
 #include "fileutils.h"
 #include "mbedtls/des.h"
 #include "util_posix.h"
+#include "util.h"               // num_CPUs
+#include "optimized_cipher.h"
+#include <pthread.h>
 
 /**
  * @brief Permutes a key from standard NIST format to Iclass specific format
@@ -291,13 +294,65 @@ static int _readFromDump(uint8_t dump[], dumpdata *item, uint8_t i) {
  * @param keytable where to write found values.
  * @return
  */
+#define LOCLASS_BRUTE_CHUNK     0x1000  // candidates per work item
+
+typedef struct {
+    const dumpdata *item;
+    uint8_t key_sel[8];         // key bytes selected by hash1, known ones filled in
+    int8_t brute_byte[8];       // per key_sel position: which byte of the brute value goes there, -1 = known
+    uint32_t endmask;
+    uint32_t next_chunk;
+    uint32_t found_value;       // smallest matching brute value, UINT32_MAX while none
+    uint64_t tested;
+    uint32_t threads_done;
+} loclass_brute_t;
+
+static void
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+*bruteforce_worker(void *arg) {
+    loclass_brute_t *b = arg;
+    uint8_t key_sel[8], key_sel_p[8], div_key[8], calculated_MAC[4];
+    memcpy(key_sel, b->key_sel, sizeof(key_sel));
+
+    for (;;) {
+        uint32_t start = __atomic_fetch_add(&b->next_chunk, 1, __ATOMIC_SEQ_CST) * LOCLASS_BRUTE_CHUNK;
+        // stop past the end, or past a match found by another thread (smaller values are still searched,
+        // so the result is the same as a serial search would give)
+        if (start >= b->endmask || start > __atomic_load_n(&b->found_value, __ATOMIC_SEQ_CST))
+            break;
+
+        uint32_t stop = MIN(start + LOCLASS_BRUTE_CHUNK, b->endmask);
+        for (uint32_t brute = start; brute < stop; brute++) {
+            for (int i = 0; i < 8; i++) {
+                if (b->brute_byte[i] >= 0)
+                    key_sel[i] = brute >> (b->brute_byte[i] * 8);
+            }
+            //Permute from iclass format to standard format
+            permutekey_rev(key_sel, key_sel_p);
+            //Diversify
+            diversifyKey((uint8_t *)b->item->csn, key_sel_p, div_key);
+            //Calc mac
+            opt_doReaderMAC((uint8_t *)b->item->cc_nr, div_key, calculated_MAC);
+
+            if (memcmp(calculated_MAC, b->item->mac, 4) == 0) {
+                uint32_t current = __atomic_load_n(&b->found_value, __ATOMIC_SEQ_CST);
+                while (brute < current && !__atomic_compare_exchange_n(&b->found_value, &current, brute, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+                break;
+            }
+        }
+        __atomic_fetch_add(&b->tested, stop - start, __ATOMIC_SEQ_CST);
+    }
+    __atomic_fetch_add(&b->threads_done, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
 int bruteforceItem(dumpdata item, uint16_t keytable[]) {
     int errors = 0;
     int found = false;
-    uint8_t key_sel_p[8] = {0};
-    uint8_t div_key[8] = {0};
-    uint8_t key_sel[8] = {0};
-    uint8_t calculated_MAC[4] = {0};
 
     //Get the key index (hash1)
     uint8_t key_index[8] = {0};
@@ -340,8 +395,6 @@ int bruteforceItem(dumpdata item, uint16_t keytable[]) {
     /*
      *A uint32 has room for 4 bytes, we'll only need 24 of those bits to bruteforce up to three bytes,
      */
-    //uint32_t brute = startvalue;
-    uint32_t brute = 0;
     /*
        Determine where to stop the bruteforce. A 1-byte attack stops after 256 tries,
        (when brute reaches 0x100). And so on...
@@ -355,48 +408,68 @@ int bruteforceItem(dumpdata item, uint16_t keytable[]) {
     for (i = 0 ; i < numbytes_to_recover && numbytes_to_recover > 1; i++)
         PrintAndLogEx(INFO, "Bruteforcing byte %d", bytes_to_recover[i]);
 
-    while (!found && !(brute & endmask)) {
-
-        //Update the keytable with the brute-values
-        for (i = 0; i < numbytes_to_recover; i++) {
-            keytable[bytes_to_recover[i]] &= 0xFF00;
-            keytable[bytes_to_recover[i]] |= (brute >> (i * 8) & 0xFF);
+    // Piece together the key: known bytes from the keytable, the others from the brute value
+    loclass_brute_t brute = {
+        .item = &item,
+        .endmask = endmask,
+        .next_chunk = 0,
+        .found_value = UINT32_MAX,
+        .tested = 0,
+        .threads_done = 0,
+    };
+    for (i = 0; i < 8; i++) {
+        brute.key_sel[i] = keytable[key_index[i]] & 0xFF;
+        brute.brute_byte[i] = -1;
+        for (int j = 0; j < numbytes_to_recover; j++) {
+            if (key_index[i] == bytes_to_recover[j])
+                brute.brute_byte[i] = j;
         }
+    }
 
-        // Piece together the key
-        key_sel[0] = keytable[key_index[0]] & 0xFF;
-        key_sel[1] = keytable[key_index[1]] & 0xFF;
-        key_sel[2] = keytable[key_index[2]] & 0xFF;
-        key_sel[3] = keytable[key_index[3]] & 0xFF;
-        key_sel[4] = keytable[key_index[4]] & 0xFF;
-        key_sel[5] = keytable[key_index[5]] & 0xFF;
-        key_sel[6] = keytable[key_index[6]] & 0xFF;
-        key_sel[7] = keytable[key_index[7]] & 0xFF;
-
-        //Permute from iclass format to standard format
-        permutekey_rev(key_sel, key_sel_p);
-        //Diversify
-        diversifyKey(item.csn, key_sel_p, div_key);
-        //Calc mac
-        doMAC(item.cc_nr, div_key, calculated_MAC);
-
-        // success
-        if (memcmp(calculated_MAC, item.mac, 4) == 0) {
-            printf("\r\n");
-            for (i = 0 ; i < numbytes_to_recover; i++) {
-                PrintAndLogEx(INFO, "%d: 0x%02x", bytes_to_recover[i], 0xFF & keytable[bytes_to_recover[i]]);
+    // single byte attacks are done in no time, keep them in this thread
+    uint32_t num_threads = (numbytes_to_recover > 1) ? num_CPUs() : 0;
+    pthread_t threads[num_threads + 1];
+    uint32_t started = 0;
+    for (i = 0; i < num_threads; i++) {
+        if (pthread_create(&threads[started], NULL, bruteforce_worker, &brute) == 0)
+            started++;
+    }
+    if (started == 0) {
+        bruteforce_worker(&brute);
+    } else {
+        // progress and ETA
+        uint64_t t1 = msclock();
+        uint64_t next_report = 1000;
+        while (__atomic_load_n(&brute.threads_done, __ATOMIC_SEQ_CST) < started) {
+            msleep(100);
+            uint64_t tested = __atomic_load_n(&brute.tested, __ATOMIC_SEQ_CST);
+            uint64_t elapsed = msclock() - t1;
+            if (tested && elapsed >= next_report) {
+                next_report += 1000;
+                uint64_t eta = elapsed * (endmask - MIN(tested, endmask)) / tested / 1000;
+                PrintAndLogEx(INPLACE, "%3u%%  %" PRIu64 " keys/s  %d thread(s)  ETA %" PRIu64 "s   "
+                              , (uint32_t)(100 * tested / endmask)
+                              , tested * 1000 / elapsed
+                              , started
+                              , eta
+                             );
             }
-            found = true;
-            break;
         }
+        for (i = 0; i < started; i++)
+            pthread_join(threads[i], NULL);
+    }
 
-        brute++;
-        if ((brute & 0xFFFF) == 0) {
-            printf("%3d,", (brute >> 16) & 0xFF);
-            if (((brute >> 16) % 0x10) == 0)
-                printf("\n");
-            fflush(stdout);
+    // success
+    if (brute.found_value != UINT32_MAX) {
+        for (i = 0; i < numbytes_to_recover; i++) {
+            keytable[bytes_to_recover[i]] &= 0xFF00;
+            keytable[bytes_to_recover[i]] |= (brute.found_value >> (i * 8) & 0xFF);
+        }
+        printf("\r\n");
+        for (i = 0 ; i < numbytes_to_recover; i++) {
+            PrintAndLogEx(INFO, "%d: 0x%02x", bytes_to_recover[i], 0xFF & keytable[bytes_to_recover[i]]);
         }
+        found = true;
     }
 
     if (!found) {
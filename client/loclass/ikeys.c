@@ -352,13 +352,14 @@ void hash0(uint64_t c, uint8_t k[8]) {
  * @param div_key
  */
 void diversifyKey(uint8_t csn[8], uint8_t key[8], uint8_t div_key[8]) {
-    // Prepare the DES key
-    mbedtls_des_setkey_enc(&ctx_enc, key);
+    // Prepare the DES key. Local context, the loclass bruteforce calls this from several threads
+    mbedtls_des_context ctx;
+    mbedtls_des_setkey_enc(&ctx, key);
 
     uint8_t crypted_csn[8] = {0};
 
     // Calculate DES(CSN, KEY)
-    mbedtls_des_crypt_ecb(&ctx_enc, csn, crypted_csn);
+    mbedtls_des_crypt_ecb(&ctx, csn, crypted_csn);
 
     //Calculate HASH0(DES))
     uint64_t crypt_csn = x_bytes_to_num(crypted_csn, 8);
@@ -0,0 +1,223 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// MIFARE Classic key hit statistics per card type (ATQA / SAK)
+//-----------------------------------------------------------------------------
+
+#include "keystats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "ui.h"             // searchHomeFilePath
+#include "commonutil.h"     // num_to_bytes
+#include "dictionary.h"
+
+typedef struct {
+    uint32_t hits;
+    uint32_t pos;
+} keystats_rank_t;
+
+// most hits first, ties keep their position
+static int cmp_rank(const void *a, const void *b) {
+    const keystats_rank_t *x = a, *y = b;
+    if (x->hits != y->hits)
+        return (x->hits < y->hits) ? 1 : -1;
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+static int keystats_path(char **path, const uint8_t *atqa, uint8_t sak, bool create) {
+    char name[sizeof(MF_KEYSTATS_FILE DICTIONARY_SUFFIX)];
+    snprintf(name, sizeof(name), MF_KEYSTATS_FILE DICTIONARY_SUFFIX, atqa[1], atqa[0], sak);
+    return searchHomeFilePath(path, name, create);
+}
+
+uint32_t mf_keystats_order(const uint8_t *atqa, uint8_t sak, uint8_t *keys, uint32_t keycnt) {
+
+    char *path = NULL;
+    if (keycnt < 2 || keystats_path(&path, atqa, sak, false) != PM3_SUCCESS)
+        return 0;
+
+    dictionary_t stats;
+    int res = dictionary_open(path, &stats);
+    free(path);
+    if (res != PM3_SUCCESS)
+        return 0;
+    if (stats.keylen != 6) {
+        dictionary_close(&stats);
+        return 0;
+    }
+
+    keystats_rank_t *rank = calloc(keycnt, sizeof(keystats_rank_t));
+    uint8_t *rest = calloc(keycnt, 6);
+    if (rank == NULL || rest == NULL) {
+        free(rank);
+        free(rest);
+        dictionary_close(&stats);
+        return 0;
+    }
+
+    uint32_t known = 0, unknown = 0;
+    for (uint32_t i = 0; i < keycnt; i++) {
+        int32_t pos = dictionary_find(&stats, keys + (size_t)i * 6);
+        if (pos >= 0 && stats.hits[pos]) {
+            rank[known].hits = stats.hits[pos];
+            rank[known].pos = i;
+            known++;
+        } else {
+            memcpy(rest + (size_t)unknown * 6, keys + (size_t)i * 6, 6);
+            unknown++;
+        }
+    }
+    dictionary_close(&stats);
+
+    if (known) {
+        qsort(rank, known, sizeof(keystats_rank_t), cmp_rank);
+        // gather the known keys before overwriting, positions refer to the old order
+        uint8_t *front = calloc(known, 6);
+        if (front == NULL) {
+            free(rank);
+            free(rest);
+            return 0;
+        }
+        for (uint32_t i = 0; i < known; i++)
+            memcpy(front + (size_t)i * 6, keys + (size_t)rank[i].pos * 6, 6);
+
+        memcpy(keys, front, (size_t)known * 6);
+        memcpy(keys + (size_t)known * 6, rest, (size_t)unknown * 6);
+        free(front);
+    }
+    free(rank);
+    free(rest);
+    return known;
+}
+
+// hw fanout may update the same file from several devices, read-modify-write one at a time
+static pthread_mutex_t keystats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int keystats_update(const uint8_t *atqa, uint8_t sak, const sector_t *e_sector, uint8_t sectorsCnt) {
+
+    // distinct keys found in this run
+    uint8_t *found = calloc(sectorsCnt * 2 + 1, 6);
+    if (found == NULL)
+        return PM3_EMALLOC;
+
+    uint32_t nfound = 0;
+    for (uint8_t i = 0; i < sectorsCnt; i++) {
+        for (uint8_t j = 0; j < 2; j++) {
+            if (e_sector[i].foundKey[j] == 0)
+                continue;
+            num_to_bytes(e_sector[i].Key[j], 6, found + nfound * 6);
+            nfound++;
+        }
+    }
+    nfound = dictionary_dedupe(found, nfound, 6);
+    if (nfound == 0) {
+        free(found);
+        return PM3_SUCCESS;
+    }
+
+    char *path = NULL;
+    int res = keystats_path(&path, atqa, sak, true);
+    if (res != PM3_SUCCESS) {
+        free(found);
+        return res;
+    }
+
+    dictionary_t stats;
+    bool has_stats = (dictionary_open(path, &stats) == PM3_SUCCESS);
+    if (has_stats && stats.keylen != 6) {
+        dictionary_close(&stats);
+        has_stats = false;
+    }
+    uint32_t count = has_stats ? stats.keycount : 0;
+
+    uint8_t *keys = calloc((size_t)count + nfound, 6);
+    uint32_t *hits = calloc((size_t)count + nfound, sizeof(uint32_t));
+    keystats_rank_t *rank = calloc((size_t)count + nfound, sizeof(keystats_rank_t));
+    if (keys == NULL || hits == NULL || rank == NULL) {
+        free(keys);
+        free(hits);
+        free(rank);
+        if (has_stats)
+            dictionary_close(&stats);
+        free(found);
+        free(path);
+        return PM3_EMALLOC;
+    }
+
+    if (has_stats) {
+        memcpy(keys, stats.keys, (size_t)count * 6);
+        memcpy(hits, stats.hits, (size_t)count * sizeof(uint32_t));
+    }
+    for (uint32_t i = 0; i < nfound; i++) {
+        int32_t pos = has_stats ? dictionary_find(&stats, found + i * 6) : -1;
+        if (pos >= 0) {
+            if (hits[pos] < UINT32_MAX)
+                hits[pos]++;
+        } else {
+            memcpy(keys + (size_t)count * 6, found + i * 6, 6);
+            hits[count++] = 1;
+        }
+    }
+    if (has_stats)
+        dictionary_close(&stats);
+    free(found);
+
+    // stored in try order
+    for (uint32_t i = 0; i < count; i++) {
+        rank[i].hits = hits[i];
+        rank[i].pos = i;
+    }
+    qsort(rank, count, sizeof(keystats_rank_t), cmp_rank);
+
+    uint8_t *okeys = calloc(count, 6);
+    uint32_t *ohits = calloc(count, sizeof(uint32_t));
+    if (okeys == NULL || ohits == NULL) {
+        res = PM3_EMALLOC;
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            memcpy(okeys + (size_t)i * 6, keys + (size_t)rank[i].pos * 6, 6);
+            ohits[i] = rank[i].hits;
+        }
+
+        // replace in one step, another client may have the old file mapped
+        char *tmp = calloc(strlen(path) + 5, sizeof(char));
+        if (tmp == NULL) {
+            res = PM3_EMALLOC;
+        } else {
+            sprintf(tmp, "%s.tmp", path);
+            res = dictionary_save(tmp, okeys, ohits, count, 6, 1);
+            if (res == PM3_SUCCESS) {
+#ifdef _WIN32
+                // rename() does not replace an existing file on windows
+                remove(path);
+#endif
+                if (rename(tmp, path) != 0)
+                    res = PM3_EFILE;
+            } else {
+                remove(tmp);
+            }
+            free(tmp);
+        }
+    }
+
+    free(okeys);
+    free(ohits);
+    free(keys);
+    free(hits);
+    free(rank);
+    free(path);
+    return res;
+}
+
+int mf_keystats_update(const uint8_t *atqa, uint8_t sak, const sector_t *e_sector, uint8_t sectorsCnt) {
+    pthread_mutex_lock(&keystats_lock);
+    int res = keystats_update(atqa, sak, e_sector, sectorsCnt);
+    pthread_mutex_unlock(&keystats_lock);
+    return res;
+}
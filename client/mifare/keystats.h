@@ -0,0 +1,26 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// MIFARE Classic key hit statistics per card type (ATQA / SAK)
+//-----------------------------------------------------------------------------
+
+#ifndef _KEYSTATS_H_
+#define _KEYSTATS_H_
+
+#include "common.h"
+#include "mifare/mifarehost.h"   // sector_t
+
+// one compiled dictionary per card type in the user directory,
+// hit counts are the number of checks the key was found in
+#define MF_KEYSTATS_FILE    "mfc_keystats_%02x%02x_%02x"
+
+// stable reorder, keys with hits for this card type go first, most hits first.
+// Returns the number of keys that moved to the front.
+uint32_t mf_keystats_order(const uint8_t *atqa, uint8_t sak, uint8_t *keys, uint32_t keycnt);
+
+// add one hit for every distinct key found in e_sector
+int mf_keystats_update(const uint8_t *atqa, uint8_t sak, const sector_t *e_sector, uint8_t sectorsCnt);
+
+#endif
@@ -12,6 +12,7 @@
 #include "mfkey.h"
 
 #include "crapto1/crapto1.h"
+#include "util.h"         // num_CPUs
 
 // MIFARE
 int compare_uint64(const void *a, const void *b) {
@@ -98,7 +99,7 @@ bool mfkey32(nonces_t data, uint64_t *outputkey) {
 
     uint32_t p640 = prng_successor(data.nonce, 64);
 
-    s = lfsr_recovery32(data.ar ^ p640, 0);
+    s = lfsr_recovery32_mt(data.ar ^ p640, 0, num_CPUs());
 
     for (t = s; t->odd | t->even; ++t) {
         lfsr_rollback_word(t, 0, 0);
@@ -130,7 +131,7 @@ bool mfkey32_moebius(nonces_t data, uint64_t *outputkey) {
     uint32_t p640 = prng_successor(data.nonce, 64);
     uint32_t p641 = prng_successor(data.nonce2, 64);
 
-    s = lfsr_recovery32(data.ar ^ p640, 0);
+    s = lfsr_recovery32_mt(data.ar ^ p640, 0, num_CPUs());
 
     for (t = s; t->odd | t->even; ++t) {
         lfsr_rollback_word(t, 0, 0);
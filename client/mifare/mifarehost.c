@@ -23,6 +23,8 @@
 #include "protocols.h"
 #include "mfkey.h"
 #include "util_posix.h"  // msclock
+#include "util.h"         // num_CPUs
+#include "radixsort.h"
 
 
 int mfDarkside(uint8_t blockno, uint8_t key_type, uint64_t *key) {
@@ -100,23 +102,17 @@ int mfDarkside(uint8_t blockno, uint8_t key_type, uint64_t *key) {
         PrintAndLogEx(SUCCESS, "found %u candidate key%s\n", keycount, (keycount > 1) ? "s." : ".");
 
         *key = UINT64_C(-1);
-        uint8_t keyBlock[PM3_CMD_DATA_SIZE];
-        uint32_t max_keys = KEYS_IN_BLOCK;
-        for (uint32_t i = 0; i < keycount; i += max_keys) {
-
-            uint32_t size = keycount - i > max_keys ? max_keys : keycount - i;
-            for (uint32_t j = 0; j < size; j++) {
-                if (par_list == 0) {
-                    num_to_bytes(last_keylist[i * max_keys + j], 6, keyBlock + (j * 6));
-                } else {
-                    num_to_bytes(keylist[i * max_keys + j], 6, keyBlock + (j * 6));
-                }
-            }
-
-            if (mfCheckKeys(blockno, key_type - 0x60, false, size, keyBlock, key) == PM3_SUCCESS) {
-                break;
-            }
+        uint8_t *keys = calloc(keycount, 6);
+        if (keys == NULL) {
+            free(last_keylist);
+            free(keylist);
+            return PM3_EMALLOC;
         }
+        for (uint32_t i = 0; i < keycount; i++)
+            num_to_bytes((par_list == 0) ? last_keylist[i] : keylist[i], 6, keys + (i * 6));
+
+        mfCheckKeysList(blockno, key_type - 0x60, false, keycount, keys, key);
+        free(keys);
 
         if (*key != UINT64_C(-1)) {
             break;
@@ -156,6 +152,79 @@ int mfCheckKeys(uint8_t blockNo, uint8_t keyType, bool clear_trace, uint8_t keyc
     return PM3_SUCCESS;
 }
 
+// Checks keycnt keys, KEYS_IN_BLOCK per CMD_HF_MIFARE_CHKKEYS.
+// MifareChkKeys doesn't poll data_available(), so up to KEYCHECK_PIPELINE_DEPTH blocks are
+// queued towards the device and the next block is already there when the previous one is done.
+// The depth grows with every block which found nothing, a key in the first block costs one round trip.
+// clear_trace only applies to the first block.
+int mfCheckKeysList(uint8_t blockNo, uint8_t keyType, bool clear_trace, uint32_t keycnt, uint8_t *keys, uint64_t *key) {
+    *key = -1;
+    if (keycnt == 0)
+        return PM3_ESOFT;
+
+    uint32_t blocks = (keycnt + KEYS_IN_BLOCK - 1) / KEYS_IN_BLOCK;
+    uint32_t submitted = 0, reaped = 0;
+    int res = PM3_ESOFT;
+
+    // the communication thread would stop reading after the first reply, with the
+    // following ones still in flight
+    bool block_after_ACK = GetConn()->block_after_ACK;
+    GetConn()->block_after_ACK = false;
+
+    clearCommandBuffer();
+    while (reaped < blocks) {
+
+        while (submitted < blocks && submitted - reaped < MIN(KEYCHECK_PIPELINE_DEPTH, reaped + 1)) {
+            uint32_t first = submitted * KEYS_IN_BLOCK;
+            uint8_t size = MIN(KEYS_IN_BLOCK, keycnt - first);
+
+            uint8_t data[PM3_CMD_DATA_SIZE] = {0};
+            data[0] = keyType;
+            data[1] = blockNo;
+            data[2] = clear_trace && submitted == 0;
+            data[3] = size;
+            memcpy(data + 4, keys + 6 * first, 6 * size);
+            if (SubmitCommandNG(CMD_HF_MIFARE_CHKKEYS, data, (4 + 6 * size), CMD_HF_MIFARE_CHKKEYS, NULL) != PM3_SUCCESS)
+                break;
+
+            submitted++;
+        }
+
+        PacketResponseNG resp;
+        if (!ReapResponseTimeout(NULL, &resp, 2500)) {
+            res = PM3_ETIMEOUT;
+            break;
+        }
+        reaped++;
+
+        if (resp.status != PM3_SUCCESS) {
+            res = resp.status;
+            break;
+        }
+
+        struct kr {
+            uint8_t key[6];
+            bool found;
+        } PACKED;
+        struct kr *keyresult = (struct kr *)&resp.data.asBytes;
+        if (keyresult->found) {
+            *key = bytes_to_num(keyresult->key, sizeof(keyresult->key));
+            res = PM3_SUCCESS;
+            break;
+        }
+    }
+
+    // let the blocks still in flight finish before returning
+    while (GetPendingRequests()) {
+        if (!ReapResponseTimeout(NULL, NULL, 2500))
+            break;
+    }
+    CancelPendingRequests();
+
+    GetConn()->block_after_ACK = block_after_ACK;
+    return res;
+}
+
 // Sends chunks of keys to device.
 // 0 == ok all keys found
 // 1 ==
@@ -239,7 +308,6 @@ int mfCheckKeys_fast(uint8_t sectorsCnt, uint8_t firstChunk, uint8_t lastChunk,
 // ref: https://github.com/J-Run/mf_key_brute
 int mfKeyBrute(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint64_t *resultkey) {
 
-    uint64_t key64;
     uint8_t found = false;
     uint8_t candidates[CANDIDATE_SIZE] = {0x00};
     uint8_t keyBlock[KEYBLOCK_SIZE] = {0x00};
@@ -257,33 +325,100 @@ int mfKeyBrute(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint64_t *resultk
         candidates[4 + j] = key[4];
         candidates[5 + j] = key[5];
     }
-    uint32_t counter, i;
-    for (i = 0, counter = 1; i < CANDIDATE_SIZE; i += KEYBLOCK_SIZE, ++counter) {
 
-        key64 = 0;
+    // Keep a few key blocks queued towards the device so the next block is
+    // already there when the previous one is done, instead of paying a full
+    // round-trip per block.
+    uint32_t chunks = (CANDIDATE_SIZE + KEYBLOCK_SIZE - 1) / KEYBLOCK_SIZE;
+    uint32_t submitted = 0, counter = 0;
+
+    clearCommandBuffer();
+    while (counter < chunks && !found) {
+
+        while (submitted < chunks && submitted - counter < KEYBRUTE_PIPELINE_DEPTH) {
+            uint32_t i = submitted * KEYBLOCK_SIZE;
+            uint8_t keycnt = MIN(KEYBLOCK_SIZE, CANDIDATE_SIZE - i) / 6;
+
+            // copy candidatekeys to test key block
+            memcpy(keyBlock, candidates + i, keycnt * 6);
+
+            uint8_t data[PM3_CMD_DATA_SIZE] = {0};
+            data[0] = keyType;
+            data[1] = blockNo;
+            data[2] = true;
+            data[3] = keycnt;
+            memcpy(data + 4, keyBlock, 6 * keycnt);
+            if (SubmitCommandNG(CMD_HF_MIFARE_CHKKEYS, data, (4 + 6 * keycnt), CMD_HF_MIFARE_CHKKEYS, NULL) != PM3_SUCCESS)
+                break;
 
-        // copy candidatekeys to test key block
-        memcpy(keyBlock, candidates + i, KEYBLOCK_SIZE);
+            submitted++;
+        }
 
         // check a block of generated candidate keys.
-        if (mfCheckKeys(blockNo, keyType, true, KEYS_IN_BLOCK, keyBlock, &key64) == PM3_SUCCESS) {
-            *resultkey = key64;
+        PacketResponseNG resp;
+        if (!ReapResponseTimeout(NULL, &resp, 2500)) {
+            PrintAndLogEx(WARNING, "command execution time out");
+            break;
+        }
+        counter++;
+
+        struct kr {
+            uint8_t key[6];
+            bool found;
+        } PACKED;
+        struct kr *keyresult = (struct kr *)&resp.data.asBytes;
+        if (resp.status == PM3_SUCCESS && keyresult->found) {
+            *resultkey = bytes_to_num(keyresult->key, sizeof(keyresult->key));
             found = true;
             break;
         }
 
         // progress
         if (counter % 20 == 0)
-            PrintAndLogEx(SUCCESS, "tried : %s.. \t %u keys", sprint_hex(candidates + i, 6),  counter * KEYS_IN_BLOCK);
+            PrintAndLogEx(SUCCESS, "tried : %s.. \t %u keys", sprint_hex(candidates + (counter - 1) * KEYBLOCK_SIZE, 6),  counter * KEYS_IN_BLOCK);
     }
+
+    // let the blocks still in flight finish before returning
+    while (GetPendingRequests()) {
+        if (!ReapResponseTimeout(NULL, NULL, 2500))
+            break;
+    }
+    CancelPendingRequests();
     return found;
 }
 
-// Compare 16 Bits out of cryptostate
-static int Compare16Bits(const void *a, const void *b) {
-    if ((*(uint64_t *)b & 0x00ff000000ff0000) == (*(uint64_t *)a & 0x00ff000000ff0000)) return 0;
-    if ((*(uint64_t *)b & 0x00ff000000ff0000) > (*(uint64_t *)a & 0x00ff000000ff0000)) return 1;
-    return -1;
+// The 16 Bits of the cryptostate that are already part of the key
+static inline uint32_t state16bits(uint64_t state) {
+    return ((state >> 40) & 0xff00) | ((state >> 16) & 0xff);
+}
+
+// counting sort on the 16 key bits, remembers where every bucket starts
+static bool sort16bits(StateList_t *statelist) {
+    uint32_t *buckets = calloc(NESTED_BUCKETS + 1, sizeof(uint32_t));
+    uint64_t *sorted = calloc(statelist->len + 1, sizeof(uint64_t));
+    if (buckets == NULL || sorted == NULL) {
+        free(buckets);
+        free(sorted);
+        return false;
+    }
+
+    uint64_t *list = statelist->head.keyhead;
+    for (uint32_t i = 0; i < statelist->len; i++)
+        buckets[state16bits(list[i]) + 1]++;
+    for (uint32_t i = 1; i <= NESTED_BUCKETS; i++)
+        buckets[i] += buckets[i - 1];
+
+    // buckets[b] ends up at the start of bucket b + 1, shift back afterwards
+    for (uint32_t i = 0; i < statelist->len; i++)
+        sorted[buckets[state16bits(list[i])]++] = list[i];
+    memmove(buckets + 1, buckets, NESTED_BUCKETS * sizeof(uint32_t));
+    buckets[0] = 0;
+
+    free(statelist->head.keyhead);
+    statelist->head.keyhead = sorted;
+    statelist->tail.keytail = sorted + statelist->len - 1;
+    statelist->buckets = buckets;
+    return true;
 }
 
 // wrapper function for multi-threaded lfsr_recovery32
@@ -296,26 +431,196 @@ __attribute__((force_align_arg_pointer))
 *nested_worker_thread(void *arg) {
     struct Crypto1State *p1;
     StateList_t *statelist = arg;
-    statelist->head.slhead = lfsr_recovery32(statelist->ks1, statelist->nt ^ statelist->uid);
+    // both nonces are recovered in parallel, each gets half of the cores
+    statelist->head.slhead = lfsr_recovery32_mt(statelist->ks1, statelist->nt ^ statelist->uid, num_CPUs() / 2);
+    statelist->buckets = NULL;
+    if (statelist->head.slhead == NULL)
+        return NULL;
 
     for (p1 = statelist->head.slhead; * (uint64_t *)p1 != 0; p1++) {};
 
     statelist->len = p1 - statelist->head.slhead;
-    statelist->tail.sltail = --p1;
-    qsort(statelist->head.slhead, statelist->len, sizeof(uint64_t), Compare16Bits);
-
+    if (sort16bits(statelist) == false) {
+        free(statelist->head.slhead);
+        statelist->head.slhead = NULL;
+    }
     return statelist->head.slhead;
 }
 
-int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *resultKey, bool calibrate) {
-    uint16_t i;
+typedef struct {
+    StateList_t *statelists;
+    uint32_t first;     // bucket range of this thread
+    uint32_t last;
+    uint32_t count;     // keys found in the range, stored from the start of the range in list 0
+    bool ok;
+} nested_join_t;
+
+// roll back the states of one bucket into buf, sorted
+static bool nested_rollback_bucket(const StateList_t *statelist, uint32_t bucket, uint64_t **buf, uint32_t *bufsize) {
+    uint32_t n = statelist->buckets[bucket + 1] - statelist->buckets[bucket];
+    if (n > *bufsize) {
+        uint64_t *tmp = realloc(*buf, n * sizeof(uint64_t));
+        if (tmp == NULL)
+            return false;
+        *buf = tmp;
+        *bufsize = n;
+    }
+
+    uint64_t *p = *buf;
+    memcpy(p, statelist->head.keyhead + statelist->buckets[bucket], n * sizeof(uint64_t));
+    for (uint32_t i = 0; i < n; i++)
+        lfsr_rollback_word((struct Crypto1State *)(p + i), statelist->nt ^ statelist->uid, 0);
+
+    // buckets are small, insertion sort unless one is unusually large
+    if (n > 64)
+        return radixSort(p, n) != NULL;
+
+    for (uint32_t i = 1; i < n; i++) {
+        uint64_t v = p[i];
+        uint32_t j = i;
+        for (; j > 0 && p[j - 1] > v; j--)
+            p[j] = p[j - 1];
+        p[j] = v;
+    }
+    return true;
+}
+
+// The key we are searching for must be in both lists. The first 16 Bits of the
+// cryptostate already contain part of the key, so only states from the same bucket
+// can roll back to the same key. Roll back and intersect bucket by bucket.
+static void *nested_join_thread(void *arg) {
+    nested_join_t *job = arg;
+    StateList_t *sl = job->statelists;
+    uint64_t *out = sl[0].head.keyhead + sl[0].buckets[job->first];
+    uint64_t *start = out;
+    uint64_t *buf[2] = {NULL, NULL};
+    uint32_t bufsize[2] = {0, 0};
+
+    job->ok = true;
+    for (uint32_t b = job->first; b < job->last; b++) {
+        if (sl[0].buckets[b] == sl[0].buckets[b + 1] || sl[1].buckets[b] == sl[1].buckets[b + 1])
+            continue;
+
+        // results never pass the start of the current bucket, it's copied out first
+        if (nested_rollback_bucket(&sl[0], b, &buf[0], &bufsize[0]) == false
+                || nested_rollback_bucket(&sl[1], b, &buf[1], &bufsize[1]) == false) {
+            job->ok = false;
+            break;
+        }
+
+        uint64_t *p1 = buf[0], *p1end = buf[0] + (sl[0].buckets[b + 1] - sl[0].buckets[b]);
+        uint64_t *p2 = buf[1], *p2end = buf[1] + (sl[1].buckets[b + 1] - sl[1].buckets[b]);
+        while (p1 < p1end && p2 < p2end) {
+            if (*p1 == *p2) {
+                *out++ = *p1++;
+                p2++;
+            } else if (*p1 < *p2) {
+                p1++;
+            } else {
+                p2++;
+            }
+        }
+    }
+
+    free(buf[0]);
+    free(buf[1]);
+    job->count = out - start;
+    return NULL;
+}
+
+// intersection of the rolled back statelists, result in statelists[0]
+static bool nested_intersect(StateList_t *statelists) {
+    int num_threads = num_CPUs();
+    if (num_threads < 1)
+        num_threads = 1;
+
+    pthread_t *thread_ids = calloc(num_threads, sizeof(pthread_t));
+    nested_join_t *jobs = calloc(num_threads, sizeof(nested_join_t));
+    if (thread_ids == NULL || jobs == NULL) {
+        free(thread_ids);
+        free(jobs);
+        return false;
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        jobs[i].statelists = statelists;
+        jobs[i].first = (uint32_t)((uint64_t)NESTED_BUCKETS * i / num_threads);
+        jobs[i].last = (uint32_t)((uint64_t)NESTED_BUCKETS * (i + 1) / num_threads);
+    }
+
+    // a range whose thread can't be started is done right here
+    int started = 0;
+    while (started < num_threads && pthread_create(thread_ids + started, NULL, nested_join_thread, jobs + started) == 0)
+        started++;
+    for (int i = started; i < num_threads; i++)
+        nested_join_thread(jobs + i);
+    for (int i = 0; i < started; i++)
+        pthread_join(thread_ids[i], NULL);
+
+    // move the results of every range next to each other
+    bool ok = true;
+    uint64_t *list = statelists[0].head.keyhead;
+    uint32_t len = 0;
+    for (int i = 0; i < num_threads; i++) {
+        ok &= jobs[i].ok;
+        memmove(list + len, list + statelists[0].buckets[jobs[i].first], jobs[i].count * sizeof(uint64_t));
+        len += jobs[i].count;
+    }
+    list[len] = UINT64_C(-1);
+    statelists[0].len = len;
+    statelists[0].tail.keytail = list + len - 1;
+
+    free(thread_ids);
+    free(jobs);
+    return ok;
+}
+
+// Candidates are rolled back to the key state. The right key gives the keystream of the
+// third nonce, move those to the front. Returns how many match.
+static uint32_t nested_filter(struct Crypto1State *keys, uint32_t keycnt, uint32_t uid, uint32_t nt, uint32_t ks1) {
+    uint32_t matches = 0;
+    for (uint32_t i = 0; i < keycnt; i++) {
+        struct Crypto1State s = keys[i];
+        if (crypto1_word(&s, nt ^ uid, 0) != ks1)
+            continue;
+
+        s = keys[i];
+        memmove(keys + matches + 1, keys + matches, (i - matches) * sizeof(struct Crypto1State));
+        keys[matches++] = s;
+    }
+    return matches;
+}
+
+// test candidates first..last-1 on the card, KEYS_IN_BLOCK per call
+static bool nested_check_keys(const StateList_t *statelist, uint32_t first, uint32_t last, uint64_t *key64) {
+    if (last <= first)
+        return false;
+
+    uint8_t *keys = calloc(last - first, 6);
+    if (keys == NULL)
+        return false;
+
+    for (uint32_t i = first; i < last; i++) {
+        uint64_t k;
+        crypto1_get_lfsr(statelist->head.slhead + i, &k);
+        num_to_bytes(k, 6, keys + (i - first) * 6);
+    }
+
+    bool found = (mfCheckKeysList(statelist->blockNo, statelist->keyType, false, last - first, keys, key64) == PM3_SUCCESS);
+    free(keys);
+    return found;
+}
+
+int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *resultKey, bool calibrate, bool filter) {
+    uint32_t i;
     uint32_t uid;
+    uint32_t nt3 = 0, ks3 = 0;
     PacketResponseNG resp;
     StateList_t statelists[2];
-    struct Crypto1State *p1, *p2, *p3, *p4;
 
+    uint32_t flags = (calibrate ? NESTED_CALIBRATE : 0) | (filter ? NESTED_EXTRA_NONCE : 0);
     clearCommandBuffer();
-    SendCommandOLD(CMD_HF_MIFARE_NESTED, blockNo + keyType * 0x100, trgBlockNo + trgKeyType * 0x100, calibrate, key, 6);
+    SendCommandOLD(CMD_HF_MIFARE_NESTED, blockNo + keyType * 0x100, trgBlockNo + trgKeyType * 0x100, flags, key, 6);
     if (!WaitForResponseTimeout(CMD_ACK, &resp, 1500)) return PM3_ETIMEOUT;
 
     // error during nested
@@ -330,61 +635,45 @@ int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo,
         memcpy(&statelists[i].nt, (void *)(resp.data.asBytes + 4 + i * 8 + 0), 4);
         memcpy(&statelists[i].ks1, (void *)(resp.data.asBytes + 4 + i * 8 + 4), 4);
     }
+    if (filter) {
+        memcpy(&nt3, resp.data.asBytes + 20, 4);
+        memcpy(&ks3, resp.data.asBytes + 24, 4);
+    }
 
     // calc keys
     pthread_t thread_id[2];
 
-    // create and run worker threads
+    // create and run worker threads, or run it here if no thread can be started
+    bool started[2] = {false, false};
     for (i = 0; i < 2; i++)
-        pthread_create(thread_id + i, NULL, nested_worker_thread, &statelists[i]);
+        started[i] = (pthread_create(thread_id + i, NULL, nested_worker_thread, &statelists[i]) == 0);
 
     // wait for threads to terminate:
-    for (i = 0; i < 2; i++)
-        pthread_join(thread_id[i], (void *)&statelists[i].head.slhead);
-
-    // the first 16 Bits of the cryptostate already contain part of our key.
-    // Create the intersection of the two lists based on these 16 Bits and
-    // roll back the cryptostate
-    p1 = p3 = statelists[0].head.slhead;
-    p2 = p4 = statelists[1].head.slhead;
-
-    while (p1 <= statelists[0].tail.sltail && p2 <= statelists[1].tail.sltail) {
-        if (Compare16Bits(p1, p2) == 0) {
-
-            struct Crypto1State savestate;
-            savestate = *p1;
-            while (Compare16Bits(p1, &savestate) == 0 && p1 <= statelists[0].tail.sltail) {
-                *p3 = *p1;
-                lfsr_rollback_word(p3, statelists[0].nt ^ statelists[0].uid, 0);
-                p3++;
-                p1++;
-            }
-            savestate = *p2;
-            while (Compare16Bits(p2, &savestate) == 0 && p2 <= statelists[1].tail.sltail) {
-                *p4 = *p2;
-                lfsr_rollback_word(p4, statelists[1].nt ^ statelists[1].uid, 0);
-                p4++;
-                p2++;
-            }
-        } else {
-            while (Compare16Bits(p1, p2) == -1) p1++;
-            while (Compare16Bits(p1, p2) == 1) p2++;
-        }
+    for (i = 0; i < 2; i++) {
+        if (started[i])
+            pthread_join(thread_id[i], (void *)&statelists[i].head.slhead);
+        else
+            statelists[i].head.slhead = nested_worker_thread(&statelists[i]);
     }
 
-    *(uint64_t *)p3 = -1;
-    *(uint64_t *)p4 = -1;
-    statelists[0].len = p3 - statelists[0].head.slhead;
-    statelists[1].len = p4 - statelists[1].head.slhead;
-    statelists[0].tail.sltail = --p3;
-    statelists[1].tail.sltail = --p4;
+    if (statelists[0].head.slhead == NULL || statelists[1].head.slhead == NULL) {
+        free(statelists[0].head.slhead);
+        free(statelists[1].head.slhead);
+        free(statelists[0].buckets);
+        free(statelists[1].buckets);
+        return PM3_EMALLOC;
+    }
 
     // the statelists now contain possible keys. The key we are searching for must be in the
     // intersection of both lists
-    qsort(statelists[0].head.keyhead, statelists[0].len, sizeof(uint64_t), compare_uint64);
-    qsort(statelists[1].head.keyhead, statelists[1].len, sizeof(uint64_t), compare_uint64);
-    // Create the intersection
-    statelists[0].len = intersection(statelists[0].head.keyhead, statelists[1].head.keyhead);
+    bool ok = nested_intersect(statelists);
+    free(statelists[0].buckets);
+    free(statelists[1].buckets);
+    if (ok == false) {
+        free(statelists[0].head.slhead);
+        free(statelists[1].head.slhead);
+        return PM3_EMALLOC;
+    }
 
     //statelists[0].tail.keytail = --p7;
     uint32_t keycnt = statelists[0].len;
@@ -393,31 +682,27 @@ int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo,
     memset(resultKey, 0, 6);
     uint64_t key64 = -1;
 
-    // The list may still contain several key candidates. Test each of them with mfCheckKeys
-    uint32_t max_keys = keycnt > KEYS_IN_BLOCK ? KEYS_IN_BLOCK : keycnt;
-    uint8_t keyBlock[PM3_CMD_DATA_SIZE] = {0x00};
-
-    for (i = 0; i < keycnt; i += max_keys) {
-
-        int size = keycnt - i > max_keys ? max_keys : keycnt - i;
-
-        for (int j = 0; j < size; j++) {
-            crypto1_get_lfsr(statelists[0].head.slhead + i, &key64);
-            num_to_bytes(key64, 6, keyBlock + i * 6);
-        }
+    // The list may still contain several key candidates. With the third nonce only the ones
+    // matching it go to the card first, the rest stays as fallback in case that nonce was mispredicted.
+    uint32_t first = keycnt;
+    if (filter) {
+        first = nested_filter(statelists[0].head.slhead, keycnt, uid, nt3, ks3);
+        PrintAndLogEx(DEBUG, "%u of %u key candidates match the third nonce", first, keycnt);
+    }
 
-        if (mfCheckKeys(statelists[0].blockNo, statelists[0].keyType, false, size, keyBlock, &key64) == PM3_SUCCESS) {
-            free(statelists[0].head.slhead);
-            free(statelists[1].head.slhead);
-            num_to_bytes(key64, 6, resultKey);
-
-            PrintAndLogEx(SUCCESS, "target block:%3u key type: %c  -- found valid key [%012" PRIx64 "]",
-                          (uint16_t)resp.oldarg[2] & 0xff,
-                          (resp.oldarg[2] >> 8) ? 'B' : 'A',
-                          key64
-                         );
-            return -5;
-        }
+    // Test each of them with mfCheckKeys
+    if (nested_check_keys(&statelists[0], 0, first, &key64)
+            || nested_check_keys(&statelists[0], first, keycnt, &key64)) {
+        free(statelists[0].head.slhead);
+        free(statelists[1].head.slhead);
+        num_to_bytes(key64, 6, resultKey);
+
+        PrintAndLogEx(SUCCESS, "target block:%3u key type: %c  -- found valid key [%012" PRIx64 "]",
+                      (uint16_t)resp.oldarg[2] & 0xff,
+                      (resp.oldarg[2] >> 8) ? 'B' : 'A',
+                      key64
+                     );
+        return -5;
     }
 
 out:
@@ -915,6 +1200,11 @@ int tryDecryptWord(uint32_t nt, uint32_t ar_enc, uint32_t at_enc, uint8_t *data,
 *   FALSE is tag uses HARDEND prng (ie hardnested attack possible, with known key)
 */
 int detect_classic_prng(void) {
+    return detect_classic_prng_ex(NULL);
+}
+
+// same, card gets the result of the select, if not NULL
+int detect_classic_prng_ex(iso14a_card_select_t *card) {
 
     PacketResponseNG resp, respA;
     uint8_t cmd[] = {MIFARE_AUTH_KEYA, 0x00};
@@ -933,6 +1223,8 @@ int detect_classic_prng(void) {
         PrintAndLogEx(ERR, "error:  selecting tag failed,  can't detect prng\n");
         return PM3_ERFTRANS;
     }
+    if (card)
+        memcpy(card, resp.data.asBytes, sizeof(iso14a_card_select_t));
     if (!WaitForResponseTimeout(CMD_ACK, &respA, 2500)) {
         PrintAndLogEx(WARNING, "PRNG data: Reply timeout.");
         return PM3_ETIMEOUT;
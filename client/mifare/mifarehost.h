@@ -13,6 +13,7 @@
 #include "common.h"
 
 #include "util.h"       // FILE_PATH_SIZE
+#include "mifare.h"     // iso14a_card_select_t
 
 #define MIFARE_SECTOR_RETRY     10
 
@@ -41,8 +42,11 @@ typedef struct {
     uint32_t keyType;
     uint32_t nt;
     uint32_t ks1;
+    uint32_t *buckets;  // first state of every 16 bit bucket, NESTED_BUCKETS + 1 entries
 } StateList_t;
 
+#define NESTED_BUCKETS  0x10000
+
 typedef struct {
     uint64_t Key[2];
     uint8_t foundKey[2];
@@ -58,10 +62,15 @@ extern char logHexFileName[FILE_PATH_SIZE];
 #define KEYS_IN_BLOCK   ((PM3_CMD_DATA_SIZE - 4) / 6)
 #define KEYBLOCK_SIZE   (KEYS_IN_BLOCK * 6)
 #define CANDIDATE_SIZE  (0xFFFF * 6)
+// Number of key blocks mfKeyBrute keeps queued towards the device
+#define KEYBRUTE_PIPELINE_DEPTH 4
+// Number of key blocks mfCheckKeysList keeps queued towards the device
+#define KEYCHECK_PIPELINE_DEPTH 4
 
 int mfDarkside(uint8_t blockno, uint8_t key_type, uint64_t *key);
-int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *resultKey, bool calibrate);
+int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *resultKey, bool calibrate, bool filter);
 int mfCheckKeys(uint8_t blockNo, uint8_t keyType, bool clear_trace, uint8_t keycnt, uint8_t *keyBlock, uint64_t *key);
+int mfCheckKeysList(uint8_t blockNo, uint8_t keyType, bool clear_trace, uint32_t keycnt, uint8_t *keys, uint64_t *key);
 int mfCheckKeys_fast(uint8_t sectorsCnt, uint8_t firstChunk, uint8_t lastChunk,
                      uint8_t strategy, uint32_t size, uint8_t *keyBlock, sector_t *e_sector, bool use_flashmemory);
 int mfKeyBrute(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint64_t *resultkey);
@@ -87,6 +96,7 @@ int saveTraceCard(void);
 int tryDecryptWord(uint32_t nt, uint32_t ar_enc, uint32_t at_enc, uint8_t *data, int len);
 
 int detect_classic_prng(void);
+int detect_classic_prng_ex(iso14a_card_select_t *card);
 int detect_classic_nackbug(bool verbose);
 void detect_classic_magic(void);
 void mf_crypto1_decrypt(struct Crypto1State *pcs, uint8_t *data, int len, bool isEncrypted);
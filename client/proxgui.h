@@ -18,6 +18,7 @@ extern "C" {
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include "graph.h"      // GraphBuffer, DemodBuffer of the default LF workspace
 
 void ShowGraphWindow(void);
 void HideGraphWindow(void);
@@ -25,12 +26,6 @@ void RepaintGraphWindow(void);
 void MainGraphics(void);
 void InitGraphics(int argc, char **argv, char *script_cmds_file, char *script_cmd, bool stayInCommandLoop);
 void ExitGraphics(void);
-#ifndef MAX_GRAPH_TRACE_LEN
-#define MAX_GRAPH_TRACE_LEN (40000 * 8)
-#endif
-extern int GraphBuffer[MAX_GRAPH_TRACE_LEN];
-extern size_t GraphTraceLen;
-extern int s_Buff[MAX_GRAPH_TRACE_LEN];
 
 extern double CursorScaleFactor;
 extern int PlotGridX, PlotGridY, PlotGridXdefault, PlotGridYdefault, GridOffset;
@@ -44,14 +39,7 @@ extern bool GridLocked;
 int AskEdgeDetect(const int *in, int *out, int len, int threshold);
 int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveGrph, bool verbose);
 int directionalThreshold(const int *in, int *out, size_t len, int8_t up, int8_t down);
-void save_restoreGB(uint8_t saveOpt);
-
-#define GRAPH_SAVE 1
-#define GRAPH_RESTORE 0
-#define MAX_DEMOD_BUF_LEN (1024*128)
-extern uint8_t DemodBuffer[MAX_DEMOD_BUF_LEN];
-extern size_t DemodBufferLen;
-extern size_t g_DemodStartIdx;
+
 extern bool showDemod;
 extern uint8_t g_debugMode;
 
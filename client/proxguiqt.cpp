@@ -29,6 +29,7 @@
 
 extern "C" {
 #include "util_darwin.h"
+#include "pm3_cmd.h"    // PM3_SUCCESS
 }
 
 bool g_useOverlays = false;
@@ -129,32 +130,72 @@ ProxGuiQT::~ProxGuiQT(void) {
 }
 
 //--------------------
+// copy of the graph before an operation was applied, restored by stickOperation
+static int *SavedGB = NULL;
+static size_t SavedGBlen = 0;
+static int SavedGridOffsetAdj = 0;
+
+static void saveGraph(void) {
+    // the length may change as soon as the lock is released, size and copy with one snapshot
+    GraphLock();
+    size_t len = GraphTraceLen;
+    int *gb = (int *)realloc(SavedGB, (len + 1) * sizeof(int));
+    if (gb == NULL) {
+        GraphUnlock();
+        return;
+    }
+    memcpy(gb, GraphBuffer, sizeof(int) * len);
+    GraphUnlock();
+    SavedGB = gb;
+    SavedGBlen = len;
+    SavedGridOffsetAdj = GridOffset;
+}
+
+static void restoreGraph(void) {
+    if (SavedGB == NULL || GraphReserve(SavedGBlen) != PM3_SUCCESS)
+        return;
+    GraphLock();
+    memcpy(GraphBuffer, SavedGB, sizeof(int) * SavedGBlen);
+    GraphTraceLen = SavedGBlen;
+    GraphUnlock();
+    GridOffset = SavedGridOffsetAdj;
+    RepaintGraphWindow();
+}
+
 void ProxWidget::applyOperation() {
     //printf("ApplyOperation()");
-    save_restoreGB(GRAPH_SAVE);
+    saveGraph();
+    GraphLock();
     memcpy(GraphBuffer, s_Buff, sizeof(int) * GraphTraceLen);
+    GraphUnlock();
     RepaintGraphWindow();
 }
 void ProxWidget::stickOperation() {
-    save_restoreGB(GRAPH_RESTORE);
+    restoreGraph();
     //printf("stickOperation()");
 }
 void ProxWidget::vchange_autocorr(int v) {
+    GraphLock();
     int ans = AutoCorrelate(GraphBuffer, s_Buff, GraphTraceLen, v, true, false);
+    GraphUnlock();
     if (g_debugMode) printf("vchange_autocorr(w:%d): %d\n", v, ans);
     g_useOverlays = true;
     RepaintGraphWindow();
 }
 void ProxWidget::vchange_askedge(int v) {
     //extern int AskEdgeDetect(const int *in, int *out, int len, int threshold);
+    GraphLock();
     int ans = AskEdgeDetect(GraphBuffer, s_Buff, GraphTraceLen, v);
+    GraphUnlock();
     if (g_debugMode) printf("vchange_askedge(w:%d)%d\n", v, ans);
     g_useOverlays = true;
     RepaintGraphWindow();
 }
 void ProxWidget::vchange_dthr_up(int v) {
     int down = opsController->horizontalSlider_dirthr_down->value();
+    GraphLock();
     directionalThreshold(GraphBuffer, s_Buff, GraphTraceLen, v, down);
+    GraphUnlock();
     //printf("vchange_dthr_up(%d)", v);
     g_useOverlays = true;
     RepaintGraphWindow();
@@ -162,7 +203,9 @@ void ProxWidget::vchange_dthr_up(int v) {
 void ProxWidget::vchange_dthr_down(int v) {
     //printf("vchange_dthr_down(%d)", v);
     int up = opsController->horizontalSlider_dirthr_up->value();
+    GraphLock();
     directionalThreshold(GraphBuffer, s_Buff, GraphTraceLen, v, up);
+    GraphUnlock();
     g_useOverlays = true;
     RepaintGraphWindow();
 }
@@ -490,6 +533,9 @@ void Plot::paintEvent(QPaintEvent *event) {
     //Black foreground
     painter.fillRect(plotRect, QColor(0, 0, 0));
 
+    // GraphReserve must not swap the buffers while they are drawn
+    GraphLock();
+
     //init graph variables
     setMaxAndStart(GraphBuffer, GraphTraceLen, plotRect);
 
@@ -510,6 +556,7 @@ void Plot::paintEvent(QPaintEvent *event) {
         setMaxAndStart(s_Buff, GraphTraceLen, plotRect);
         PlotGraph(s_Buff, GraphTraceLen, plotRect, infoRect, &painter, 1);
     }
+    GraphUnlock();
     // End graph drawing
 
     //Draw the cursors
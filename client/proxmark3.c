@@ -54,7 +54,7 @@ static void showBanner(void) {
 
 int check_comm(void) {
     // If communications thread goes down. Device disconnected then this should hook up PM3 again.
-    if (IsCommunicationThreadDead() && session.pm3_present) {
+    if (IsCommunicationThreadDead() && IsPm3Present()) {
         rl_set_prompt(PROXPROMPT_OFFLINE);
         rl_forced_update_display();
         CloseProxmark();
@@ -85,7 +85,7 @@ main_loop(char *script_cmds_file, char *script_cmd, bool stayInCommandLoop) {
 
     PrintAndLogEx(DEBUG, "ISATTY/STDIN_FILENO == %s\n", (stdinOnPipe) ? "true" : "false");
 
-    if (session.pm3_present) {
+    if (IsPm3Present()) {
         // cache Version information now:
         if (execCommand || script_cmds_file || stdinOnPipe)
             pm3_version(false, false);
@@ -164,8 +164,8 @@ main_loop(char *script_cmds_file, char *script_cmd, bool stayInCommandLoop) {
 
                 } else {
                     rl_event_hook = check_comm;
-                    if (session.pm3_present) {
-                        if (conn.send_via_fpc_usart == false)
+                    if (IsPm3Present()) {
+                        if (GetConn()->send_via_fpc_usart == false)
                             cmd = readline(PROXPROMPT_USB);
                         else
                             cmd = readline(PROXPROMPT_FPC);
@@ -310,7 +310,6 @@ static void show_help(bool showFullHelp, char *exec_name) {
 int main(int argc, char *argv[]) {
     srand(time(0));
 
-    session.pm3_present = false;
     session.help_dump_mode = false;
     bool waitCOMPort = false;
     bool addLuaExec = false;
@@ -523,15 +522,15 @@ int main(int argc, char *argv[]) {
         OpenProxmark(port, waitCOMPort, 20, false, speed);
     }
 
-    if (session.pm3_present && (TestProxmark() != PM3_SUCCESS)) {
+    if (IsPm3Present() && (TestProxmark() != PM3_SUCCESS)) {
         PrintAndLogEx(ERR, _RED_("ERROR:") "cannot communicate with the Proxmark\n");
         CloseProxmark();
     }
 
-    if ((port != NULL) && (!session.pm3_present))
+    if ((port != NULL) && (!IsPm3Present()))
         exit(EXIT_FAILURE);
 
-    if (!session.pm3_present)
+    if (!IsPm3Present())
         PrintAndLogEx(INFO, "Running in " _YELLOW_("OFFLINE") "mode. Check \"%s -h\" if it's not what you want.\n", exec_name);
 
 #ifdef HAVE_GUI
@@ -555,7 +554,7 @@ int main(int argc, char *argv[]) {
 #endif
 
     // Clean up the port
-    if (session.pm3_present) {
+    if (IsPm3Present()) {
         CloseProxmark();
     }
 
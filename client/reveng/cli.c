@@ -63,6 +63,7 @@
 #endif /* _WIN32 */
 
 #include "reveng.h"
+#include "fastcrc.h"
 
 static FILE *oread(const char *);
 static poly_t rdpoly(const char *, int, int);
@@ -460,7 +461,7 @@ ipqx:
             }
             pass = 0;
             do {
-                mptr = candmods = reveng(&model, qpoly, rflags, args, apolys);
+                mptr = candmods = fastcrc_reveng(&model, qpoly, rflags, args, apolys);
                 if (mptr && plen(mptr->spoly))
                     uflags |= C_RESULT;
                 while (mptr && plen(mptr->spoly)) {
@@ -0,0 +1,439 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Native word CRC engine for models up to 64 bits wide:
+//  - slice-by-8 table driven calculation on raw bytes
+//  - multi-threaded drop-in for reveng()'s polynomial search
+//-----------------------------------------------------------------------------
+#include "fastcrc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// polys handed to a worker at a time
+#define FASTCRC_BLOCK (1UL << 16)
+
+static uint64_t width_mask(int width) {
+    return (width >= 64) ? UINT64_MAX : ((UINT64_C(1) << width) - 1);
+}
+
+uint64_t fastcrc_reflect(uint64_t v, int width) {
+    uint64_t r = 0;
+    for (int i = 0; i < width; i++) {
+        r = (r << 1) | (v & 1);
+        v >>= 1;
+    }
+    return r;
+}
+
+uint64_t fastcrc_ptou(const poly_t poly) {
+    uint64_t v = 0;
+    for (unsigned long j = 0; j < poly.length; j++) {
+        bmp_t word = poly.bitmap[j / BMP_BIT];
+        v = (v << 1) | ((word >> (BMP_BIT - 1 - (j % BMP_BIT))) & 1);
+    }
+    return v;
+}
+
+poly_t fastcrc_utop(uint64_t v, unsigned long width) {
+    poly_t poly = PZERO;
+    palloc(&poly, width);
+    for (unsigned long j = 0; j < width; j++) {
+        if ((v >> (width - 1 - j)) & 1)
+            poly.bitmap[j / BMP_BIT] |= BMP_C(1) << (BMP_BIT - 1 - (j % BMP_BIT));
+    }
+    return poly;
+}
+
+bool fastcrc_init(fastcrc_t *crc, int width, uint64_t poly, uint64_t init, uint64_t xorout, bool refin, bool refout) {
+    if (width < 1 || width > FASTCRC_MAXWIDTH)
+        return false;
+
+    uint64_t mask = width_mask(width);
+    crc->width = width;
+    crc->poly = poly & mask;
+    crc->init = init & mask;
+    crc->xorout = xorout & mask;
+    crc->refin = refin;
+    crc->refout = refout;
+
+    if (refin) {
+        // register kept reflected in the low bits
+        uint64_t rpoly = fastcrc_reflect(crc->poly, width);
+        for (int b = 0; b < 256; b++) {
+            uint64_t r = b;
+            for (int i = 0; i < 8; i++)
+                r = (r & 1) ? (r >> 1) ^ rpoly : (r >> 1);
+            crc->table[0][b] = r;
+        }
+        for (int k = 1; k < 8; k++) {
+            for (int b = 0; b < 256; b++) {
+                uint64_t r = crc->table[k - 1][b];
+                crc->table[k][b] = (r >> 8) ^ crc->table[0][r & 0xFF];
+            }
+        }
+    } else {
+        // register kept left aligned in the 64 bit word
+        uint64_t apoly = crc->poly << (64 - width);
+        for (int b = 0; b < 256; b++) {
+            uint64_t r = (uint64_t)b << 56;
+            for (int i = 0; i < 8; i++)
+                r = (r >> 63) ? (r << 1) ^ apoly : (r << 1);
+            crc->table[0][b] = r;
+        }
+        for (int k = 1; k < 8; k++) {
+            for (int b = 0; b < 256; b++) {
+                uint64_t r = crc->table[k - 1][b];
+                crc->table[k][b] = (r << 8) ^ crc->table[0][r >> 56];
+            }
+        }
+    }
+    return true;
+}
+
+bool fastcrc_init_model(fastcrc_t *crc, const model_t *model) {
+    unsigned long width = plen(model->spoly);
+    if (width < 1 || width > FASTCRC_MAXWIDTH)
+        return false;
+
+    return fastcrc_init(crc, (int)width,
+                        fastcrc_ptou(model->spoly),
+                        plen(model->init) ? fastcrc_ptou(model->init) : 0,
+                        plen(model->xorout) ? fastcrc_ptou(model->xorout) : 0,
+                        model->flags & P_REFIN, model->flags & P_REFOUT);
+}
+
+uint64_t fastcrc_calc(const fastcrc_t *crc, const uint8_t *data, size_t len) {
+    const uint64_t (*t)[256] = crc->table;
+    int width = crc->width;
+    uint64_t r;
+
+    if (crc->refin) {
+        r = fastcrc_reflect(crc->init, width);
+        for (; len >= 8; len -= 8, data += 8) {
+            uint64_t x = r ^ ((uint64_t)data[0] | (uint64_t)data[1] << 8 | (uint64_t)data[2] << 16 | (uint64_t)data[3] << 24 |
+                              (uint64_t)data[4] << 32 | (uint64_t)data[5] << 40 | (uint64_t)data[6] << 48 | (uint64_t)data[7] << 56);
+            r = t[7][x & 0xFF] ^ t[6][(x >> 8) & 0xFF] ^ t[5][(x >> 16) & 0xFF] ^ t[4][(x >> 24) & 0xFF] ^
+                t[3][(x >> 32) & 0xFF] ^ t[2][(x >> 40) & 0xFF] ^ t[1][(x >> 48) & 0xFF] ^ t[0][x >> 56];
+        }
+        while (len--)
+            r = (r >> 8) ^ t[0][(r ^ *data++) & 0xFF];
+        if (!crc->refout)
+            r = fastcrc_reflect(r, width);
+    } else {
+        r = crc->init << (64 - width);
+        for (; len >= 8; len -= 8, data += 8) {
+            uint64_t x = r ^ ((uint64_t)data[0] << 56 | (uint64_t)data[1] << 48 | (uint64_t)data[2] << 40 | (uint64_t)data[3] << 32 |
+                              (uint64_t)data[4] << 24 | (uint64_t)data[5] << 16 | (uint64_t)data[6] << 8 | (uint64_t)data[7]);
+            r = t[7][x >> 56] ^ t[6][(x >> 48) & 0xFF] ^ t[5][(x >> 40) & 0xFF] ^ t[4][(x >> 32) & 0xFF] ^
+                t[3][(x >> 24) & 0xFF] ^ t[2][(x >> 16) & 0xFF] ^ t[1][(x >> 8) & 0xFF] ^ t[0][x & 0xFF];
+        }
+        while (len--)
+            r = (r << 8) ^ t[0][(r >> 56) ^ *data++];
+        r >>= (64 - width);
+        if (crc->refout)
+            r = fastcrc_reflect(r, width);
+    }
+    return (r ^ crc->xorout) & width_mask(width);
+}
+
+//-----------------------------------------------------------------------------
+// polynomial search
+//-----------------------------------------------------------------------------
+
+// difference of two equal length arguments, MSB first, zero padded at the front
+// to whole words. Leading zero words are dropped, they leave the remainder at zero.
+typedef struct {
+    uint64_t *words;
+    unsigned long len;
+} fastcrc_diff_t;
+
+typedef struct {
+    const fastcrc_diff_t *diffs;
+    int ndiffs;
+    int width;
+    int flags;
+    uint64_t first;         // first odd poly
+    uint64_t count;         // number of odd polys to try
+    uint64_t next;          // next index to hand out
+    pthread_mutex_t lock;
+} fastcrc_search_t;
+
+typedef struct {
+    fastcrc_search_t *search;
+    uint64_t *found;
+    size_t nfound;
+    size_t size;
+    bool failed;
+} fastcrc_worker_t;
+
+static int fastcrc_threads(void) {
+#if defined(_WIN32)
+    SYSTEM_INFO sysinfo;
+    GetSystemInfo(&sysinfo);
+    return sysinfo.dwNumberOfProcessors;
+#else
+    int count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? count : 1;
+#endif
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// The register runs modulo x^(64-w) * (x^w + poly), so 64 message bits go in per word.
+// As poly is odd, x is invertible modulo x^w + poly and the multiplication by x^64 of
+// this non augmented division does not change whether the remainder is zero.
+static bool divides(const fastcrc_diff_t *d, uint64_t apoly) {
+    uint64_t r = 0;
+    for (unsigned long j = 0; j < d->len; j++) {
+        r ^= d->words[j];
+        for (int i = 0; i < 64; i++)
+            r = (r << 1) ^ (apoly & (0 - (r >> 63)));
+    }
+    return r == 0;
+}
+
+static void *fastcrc_worker(void *arg) {
+    fastcrc_worker_t *w = (fastcrc_worker_t *)arg;
+    fastcrc_search_t *s = w->search;
+    int shift = 64 - s->width;
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        uint64_t start = s->next;
+        if (start < s->count) {
+            s->next += FASTCRC_BLOCK;
+            // same cadence as reveng()
+            if ((start & R_SPMASK) == 0) {
+                poly_t gpoly = fastcrc_utop(s->first + 2 * start, s->width);
+                uprog(gpoly, s->flags, start / (R_SPMASK + 1UL));
+                pfree(&gpoly);
+            }
+        }
+        pthread_mutex_unlock(&s->lock);
+        if (start >= s->count)
+            break;
+
+        uint64_t end = start + FASTCRC_BLOCK;
+        if (end > s->count || end < start)
+            end = s->count;
+
+        for (uint64_t i = start; i < end; i++) {
+            uint64_t poly = s->first + 2 * i;
+            int k = 0;
+            while (k < s->ndiffs && divides(&s->diffs[k], poly << shift))
+                k++;
+            if (k < s->ndiffs)
+                continue;
+
+            if (w->nfound == w->size) {
+                size_t size = w->size ? w->size * 2 : 64;
+                uint64_t *tmp = realloc(w->found, size * sizeof(uint64_t));
+                if (tmp == NULL) {
+                    w->failed = true;
+                    return NULL;
+                }
+                w->found = tmp;
+                w->size = size;
+            }
+            w->found[w->nfound++] = poly;
+        }
+    }
+    return NULL;
+}
+
+static int cmp_diff(const void *a, const void *b) {
+    unsigned long x = ((const fastcrc_diff_t *)a)->len, y = ((const fastcrc_diff_t *)b)->len;
+    return (x > y) - (x < y);
+}
+
+// equal length pairs only, these do not depend on Init or XorOut
+static int build_diffs(int args, const poly_t *argpolys, fastcrc_diff_t **out) {
+    int n = 0;
+    fastcrc_diff_t *diffs = calloc((size_t)(args * (args - 1) / 2 + 1), sizeof(fastcrc_diff_t));
+    if (diffs == NULL)
+        return -1;
+
+    for (int a = 0; a < args; a++) {
+        for (int b = a + 1; b < args; b++) {
+            unsigned long len = plen(argpolys[a]);
+            if (len == 0 || len != plen(argpolys[b]))
+                continue;
+
+            poly_t work = pclone(argpolys[a]);
+            psum(&work, argpolys[b], 0UL);
+
+            unsigned long first = pfirst(work);
+            if (first >= len) {
+                pfree(&work);
+                continue;
+            }
+
+            unsigned long nwords = (len - first + 63) / 64;
+            uint64_t *words = calloc(nwords, sizeof(uint64_t));
+            if (words == NULL) {
+                pfree(&work);
+                for (int i = 0; i < n; i++)
+                    free(diffs[i].words);
+                free(diffs);
+                return -1;
+            }
+            // bit j of the argument ends up at position len - 1 - j of the padded words
+            for (unsigned long j = first; j < len; j++) {
+                if ((work.bitmap[j / BMP_BIT] >> (BMP_BIT - 1 - (j % BMP_BIT))) & 1) {
+                    unsigned long pos = len - 1 - j;
+                    words[nwords - 1 - pos / 64] |= UINT64_C(1) << (pos % 64);
+                }
+            }
+            pfree(&work);
+            diffs[n].words = words;
+            diffs[n].len = nwords;
+            n++;
+        }
+    }
+    // shortest first, they are the cheapest to reject a poly with
+    qsort(diffs, n, sizeof(fastcrc_diff_t), cmp_diff);
+    *out = diffs;
+    return n;
+}
+
+model_t *fastcrc_reveng(const model_t *guess, const poly_t qpoly, int rflags, int args, const poly_t *argpolys) {
+
+    unsigned long width = plen(guess->spoly);
+    if (rflags & R_HAVEP || width < 1 || width > FASTCRC_MAXWIDTH || (rflags & R_HAVEQ && plen(qpoly) != width))
+        return reveng(guess, qpoly, rflags, args, argpolys);
+
+    fastcrc_diff_t *diffs = NULL;
+    int ndiffs = build_diffs(args, argpolys, &diffs);
+    if (ndiffs <= 0) {
+        free(diffs);
+        return reveng(guess, qpoly, rflags, args, argpolys);
+    }
+
+    // odd polys from the starting value up to, not including, qpoly
+    uint64_t mask = width_mask((int)width);
+    uint64_t first = (fastcrc_ptou(guess->spoly) & ~UINT64_C(1)) + 1;
+    uint64_t last = mask;
+    if (rflags & R_HAVEQ) {
+        uint64_t q = fastcrc_ptou(qpoly);
+        last = (q == 0) ? 0 : ((q - 1) | 1);
+        if (last >= q)
+            last = (q >= 2) ? q - 2 : 0;
+    }
+
+    fastcrc_search_t search = {
+        .diffs = diffs,
+        .ndiffs = ndiffs,
+        .width = (int)width,
+        .flags = guess->flags,
+        .first = first,
+        .count = (last >= first && (last & 1)) ? ((last - first) >> 1) + 1 : 0,
+        .next = 0,
+    };
+    pthread_mutex_init(&search.lock, NULL);
+
+    int nthreads = fastcrc_threads();
+    fastcrc_worker_t *workers = calloc(nthreads, sizeof(fastcrc_worker_t));
+    pthread_t *threads = calloc(nthreads, sizeof(pthread_t));
+    if (workers == NULL || threads == NULL) {
+        uerror("cannot allocate memory for search threads");
+        nthreads = 0;
+    }
+    int started = 0;
+    for (int i = 0; i < nthreads; i++) {
+        workers[i].search = &search;
+        if (pthread_create(&threads[i], NULL, fastcrc_worker, &workers[i]) != 0)
+            break;
+        started++;
+    }
+    // no thread could be started, search here
+    if (started == 0 && workers != NULL)
+        fastcrc_worker(&workers[0]);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&search.lock);
+
+    for (int i = 0; i < ndiffs; i++)
+        free(diffs[i].words);
+    free(diffs);
+
+    // collect the candidates in ascending order, like the serial search finds them
+    size_t ncand = 0;
+    bool failed = false;
+    for (int i = 0; i < nthreads && workers != NULL; i++) {
+        ncand += workers[i].nfound;
+        failed |= workers[i].failed;
+    }
+    uint64_t *cand = calloc(ncand + 1, sizeof(uint64_t));
+    if (cand == NULL || failed)
+        uerror("cannot allocate memory for candidate polynomials");
+
+    ncand = 0;
+    for (int i = 0; i < nthreads && workers != NULL; i++) {
+        if (cand != NULL && workers[i].nfound)
+            memcpy(cand + ncand, workers[i].found, workers[i].nfound * sizeof(uint64_t));
+        ncand += workers[i].nfound;
+        free(workers[i].found);
+    }
+    free(workers);
+    free(threads);
+    if (cand == NULL)
+        ncand = 0;
+    qsort(cand, ncand, sizeof(uint64_t), cmp_u64);
+
+    // reveng() completes Init / XorOut for each candidate and reports the models
+    model_t *result = NULL;
+    int resc = 0;
+    for (size_t i = 0; i < ncand; i++) {
+        model_t cmodel = *guess;
+        cmodel.spoly = fastcrc_utop(cand[i], width);
+
+        model_t *found = reveng(&cmodel, qpoly, rflags | R_HAVEP, args, argpolys);
+        pfree(&cmodel.spoly);
+        if (found == NULL)
+            continue;
+
+        int n = 0;
+        while (plen(found[n].spoly))
+            n++;
+        if (n) {
+            model_t *tmp = realloc(result, (resc + n) * sizeof(model_t));
+            if (tmp == NULL) {
+                uerror("cannot reallocate result array");
+                for (int k = 0; k < n; k++)
+                    mfree(&found[k]);
+            } else {
+                result = tmp;
+                memcpy(result + resc, found, n * sizeof(model_t));
+                resc += n;
+            }
+        }
+        free(found);
+    }
+    free(cand);
+
+    // terminating entry, see reveng()
+    model_t *tmp = realloc(result, (resc + 1) * sizeof(model_t));
+    if (tmp == NULL) {
+        uerror("cannot reallocate result array");
+        for (int k = 0; k < resc; k++)
+            mfree(&result[k]);
+        free(result);
+        return NULL;
+    }
+    result = tmp;
+    memset(&result[resc], 0, sizeof(model_t));
+    return result;
+}
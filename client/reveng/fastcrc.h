@@ -0,0 +1,50 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Native word CRC engine for models up to 64 bits wide:
+//  - slice-by-8 table driven calculation on raw bytes
+//  - multi-threaded drop-in for reveng()'s polynomial search
+//-----------------------------------------------------------------------------
+
+#ifndef FASTCRC_H
+#define FASTCRC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "reveng.h"
+
+#define FASTCRC_MAXWIDTH 64
+
+typedef struct {
+    int width;
+    uint64_t poly;      // Williams parameters, normal orientation
+    uint64_t init;
+    uint64_t xorout;
+    bool refin;
+    bool refout;
+    uint64_t table[8][256];
+} fastcrc_t;
+
+uint64_t fastcrc_reflect(uint64_t v, int width);
+
+// poly_t <-> native word, the poly_t must not be longer than 64 bits
+uint64_t fastcrc_ptou(const poly_t poly);
+poly_t fastcrc_utop(uint64_t v, unsigned long width);
+
+// returns false if the width is not in 1..64
+bool fastcrc_init(fastcrc_t *crc, int width, uint64_t poly, uint64_t init, uint64_t xorout, bool refin, bool refout);
+bool fastcrc_init_model(fastcrc_t *crc, const model_t *model);
+
+// Williams model CRC of len bytes
+uint64_t fastcrc_calc(const fastcrc_t *crc, const uint8_t *data, size_t len);
+
+// Same contract as reveng(). Unknown polynomials of up to 64 bits are searched
+// on all cores, with native word arithmetic, against the differences of equal
+// length arguments. Surviving polynomials, and every other case, go through reveng().
+model_t *fastcrc_reveng(const model_t *guess, const poly_t qpoly, int rflags, int args, const poly_t *argpolys);
+
+#endif /* FASTCRC_H */
@@ -63,7 +63,7 @@ static int l_fast_push_mode(lua_State *L) {
 
     bool enable = lua_toboolean(L, 1);
 
-    conn.block_after_ACK = enable;
+    GetConn()->block_after_ACK = enable;
 
     // Disable fast mode and send a dummy command to make it effective
     if (enable == false) {
@@ -299,6 +299,47 @@ static int l_GetFromFlashMem(lua_State *L) {
 }
 
 
+// Pushes a PacketResponseNG as a binary string on the lua stack
+static void pushResponse(lua_State *L, PacketResponseNG *resp) {
+
+    char foo[sizeof(PacketResponseNG)];
+    int n = 0;
+
+    memcpy(foo + n, &resp->cmd, sizeof(resp->cmd));
+    n += sizeof(resp->cmd);
+
+    memcpy(foo + n, &resp->length, sizeof(resp->length));
+    n += sizeof(resp->length);
+
+    memcpy(foo + n, &resp->magic, sizeof(resp->magic));
+    n += sizeof(resp->magic);
+
+    memcpy(foo + n, &resp->status, sizeof(resp->status));
+    n += sizeof(resp->status);
+
+    memcpy(foo + n, &resp->crc, sizeof(resp->crc));
+    n += sizeof(resp->crc);
+
+    memcpy(foo + n, &resp->oldarg[0], sizeof(resp->oldarg[0]));
+    n += sizeof(resp->oldarg[0]);
+
+    memcpy(foo + n, &resp->oldarg[1], sizeof(resp->oldarg[1]));
+    n += sizeof(resp->oldarg[1]);
+
+    memcpy(foo + n, &resp->oldarg[2], sizeof(resp->oldarg[2]));
+    n += sizeof(resp->oldarg[2]);
+
+    memcpy(foo + n, resp->data.asBytes, sizeof(resp->data));
+    n += sizeof(resp->data);
+
+    memcpy(foo + n, &resp->ng, sizeof(resp->ng));
+    n += sizeof(resp->ng);
+    (void) n;
+
+    //Push it as a string
+    lua_pushlstring(L, (const char *)&foo, sizeof(foo));
+}
+
 /**
  * @brief The following params expected:
  * uint32_t cmd
@@ -328,44 +369,73 @@ static int l_WaitForResponseTimeout(lua_State *L) {
     if (WaitForResponseTimeout(cmd, &resp, ms_timeout) == false)
         return returnToLuaWithError(L, "No response from the device");
 
-    char foo[sizeof(PacketResponseNG)];
-    n = 0;
+    pushResponse(L, &resp);
+    return 1;
+}
 
-    memcpy(foo + n, &resp.cmd, sizeof(resp.cmd));
-    n += sizeof(resp.cmd);
+/**
+ * @brief Queues a NG command without waiting for the reply, see SubmitCommandNG
+ *  Only for commands whose device handler doesn't poll data_available(), e.g. not sniff or sim
+ * @param cmd  command
+ * @param data  must be hexstring less than 1024 chars(512bytes)
+ * @param reply_cmd  optional, command of the reply. Defaults to cmd
+ * @return request id
+ */
+static int l_SubmitCommandNG(lua_State *L) {
 
-    memcpy(foo + n, &resp.length, sizeof(resp.length));
-    n += sizeof(resp.length);
+    uint8_t data[PM3_CMD_DATA_SIZE] = {0};
+    size_t len = 0, size;
 
-    memcpy(foo + n, &resp.magic, sizeof(resp.magic));
-    n += sizeof(resp.magic);
+    int n = lua_gettop(L);
+    if (n < 2)
+        return returnToLuaWithError(L, "You need to supply at least two parameters");
 
-    memcpy(foo + n, &resp.status, sizeof(resp.status));
-    n += sizeof(resp.status);
+    uint16_t cmd = luaL_checknumber(L, 1);
+    uint16_t reply_cmd = cmd;
+    if (n >= 3)
+        reply_cmd = luaL_checknumber(L, 3);
 
-    memcpy(foo + n, &resp.crc, sizeof(resp.crc));
-    n += sizeof(resp.crc);
+    const char *p_data = luaL_checklstring(L, 2, &size);
+    if (size) {
+        if (size > 1024)
+            size = 1024;
 
-    memcpy(foo + n, &resp.oldarg[0], sizeof(resp.oldarg[0]));
-    n += sizeof(resp.oldarg[0]);
+        uint32_t tmp;
+        for (int i = 0; i < size; i += 2) {
+            sscanf(&p_data[i], "%02x", &tmp);
+            data[i >> 1] = tmp & 0xFF;
+            len++;
+        }
+    }
 
-    memcpy(foo + n, &resp.oldarg[1], sizeof(resp.oldarg[1]));
-    n += sizeof(resp.oldarg[1]);
+    uint32_t request_id = 0;
+    int res = SubmitCommandNG(cmd, data, len, reply_cmd, &request_id);
+    if (res != PM3_SUCCESS)
+        return returnToLuaWithError(L, "Failed to queue command, error %d", res);
 
-    memcpy(foo + n, &resp.oldarg[2], sizeof(resp.oldarg[2]));
-    n += sizeof(resp.oldarg[2]);
+    lua_pushunsigned(L, request_id);
+    return 1;
+}
 
-    memcpy(foo + n, resp.data.asBytes, sizeof(resp.data));
-    n += sizeof(resp.data);
+/**
+ * @brief Waits for the reply of the oldest submitted command
+ * @param ms_timeout
+ * @return struct of PacketResponseNG, request id
+ */
+static int l_ReapResponseTimeout(lua_State *L) {
 
-    memcpy(foo + n, &resp.ng, sizeof(resp.ng));
-    n += sizeof(resp.ng);
-    (void) n;
+    size_t ms_timeout = -1;
+    if (lua_gettop(L) >= 1)
+        ms_timeout = luaL_checkunsigned(L, 1);
 
-    //Push it as a string
-    lua_pushlstring(L, (const char *)&foo, sizeof(foo));
+    uint32_t request_id = 0;
+    PacketResponseNG resp;
+    if (ReapResponseTimeout(&request_id, &resp, ms_timeout) == false)
+        return returnToLuaWithError(L, "No response from the device");
 
-    return 1;
+    pushResponse(L, &resp);
+    lua_pushunsigned(L, request_id);
+    return 2;
 }
 
 static int l_mfDarkside(lua_State *L) {
@@ -821,6 +891,7 @@ static int l_hardnested(lua_State *L) {
     }
 
     uint64_t foundkey = 0;
+    SetBitflipCache(false);
     int retval = mfnestedhard(blockNo, keyType, key, trgBlockNo, trgKeyType, haveTarget ? trgkey : NULL, nonce_file_read,  nonce_file_write,  slow,  tests, &foundkey, filename);
     DropField();
 
@@ -1084,6 +1155,8 @@ int set_pm3_libraries(lua_State *L) {
         {"GetFromBigBuf",               l_GetFromBigBuf},
         {"GetFromFlashMem",             l_GetFromFlashMem},
         {"WaitForResponseTimeout",      l_WaitForResponseTimeout},
+        {"SubmitCommandNG",             l_SubmitCommandNG},
+        {"ReapResponseTimeout",         l_ReapResponseTimeout},
         {"mfDarkside",                  l_mfDarkside},
         {"foobar",                      l_foobar},
         {"kbd_enter_pressed",               l_kbd_enter_pressed},
@@ -87,8 +87,8 @@ bool uart_set_speed(serial_port sp, const uint32_t uiPortSpeed);
  */
 uint32_t uart_get_speed(const serial_port sp);
 
-/* Reconfigure timeouts
+/* Reconfigure timeouts of the serial port, applied by the next uart_receive
  */
-int uart_reconfigure_timeouts(uint32_t value);
+int uart_reconfigure_timeouts(serial_port sp, uint32_t value);
 #endif // _UART_H_
 
@@ -61,20 +61,16 @@ typedef struct {
     int fd;           // Serial port file descriptor
     term_info tiOld;  // Terminal info before using the port
     term_info tiNew;  // Terminal info during the transaction
+    struct timeval timeout;      // see pm3_cmd.h
+    uint32_t newtimeout_value;
+    bool newtimeout_pending;
 } serial_port_unix;
 
-// see pm3_cmd.h
-struct timeval timeout = {
-    .tv_sec  = 0, // 0 second
-    .tv_usec = UART_FPC_CLIENT_RX_TIMEOUT_MS * 1000
-};
-
-uint32_t newtimeout_value = 0;
-bool newtimeout_pending = false;
-
-int uart_reconfigure_timeouts(uint32_t value) {
-    newtimeout_value = value;
-    newtimeout_pending = true;
+int uart_reconfigure_timeouts(serial_port sp, uint32_t value) {
+    if (sp == NULL) return PM3_EINVARG;
+    serial_port_unix *spu = (serial_port_unix *)sp;
+    spu->newtimeout_value = value;
+    __atomic_store_n(&spu->newtimeout_pending, true, __ATOMIC_RELEASE);
     return PM3_SUCCESS;
 }
 
@@ -83,7 +79,8 @@ serial_port uart_open(const char *pcPortName, uint32_t speed) {
     if (sp == 0) return INVALID_SERIAL_PORT;
 
     // init timeouts
-    timeout.tv_usec = UART_FPC_CLIENT_RX_TIMEOUT_MS * 1000;
+    sp->timeout.tv_sec = 0;
+    sp->timeout.tv_usec = UART_FPC_CLIENT_RX_TIMEOUT_MS * 1000;
 
     if (memcmp(pcPortName, "tcp:", 4) == 0) {
         struct addrinfo *addr = NULL, *rp;
@@ -95,7 +92,7 @@ serial_port uart_open(const char *pcPortName, uint32_t speed) {
             return INVALID_SERIAL_PORT;
         }
 
-        timeout.tv_usec = UART_TCP_CLIENT_RX_TIMEOUT_MS * 1000;
+        sp->timeout.tv_usec = UART_TCP_CLIENT_RX_TIMEOUT_MS * 1000;
 
         char *colon = strrchr(addrstr, ':');
         const char *portstr;
@@ -216,7 +213,7 @@ serial_port uart_open(const char *pcPortName, uint32_t speed) {
             return INVALID_SERIAL_PORT;
         }
     }
-    conn.uart_speed = uart_get_speed(sp);
+    GetConn()->uart_speed = uart_get_speed(sp);
     return sp;
 }
 
@@ -246,9 +243,10 @@ int uart_receive(const serial_port sp, uint8_t *pbtRx, uint32_t pszMaxRxLen, uin
     fd_set rfds;
     struct timeval tv;
 
-    if (newtimeout_pending) {
-        timeout.tv_usec = newtimeout_value * 1000;
-        newtimeout_pending = false;
+    serial_port_unix *spu = (serial_port_unix *)sp;
+    if (__atomic_load_n(&spu->newtimeout_pending, __ATOMIC_ACQUIRE)) {
+        spu->timeout.tv_usec = spu->newtimeout_value * 1000;
+        spu->newtimeout_pending = false;
     }
     // Reset the output count
     *pszRxLen = 0;
@@ -256,7 +254,7 @@ int uart_receive(const serial_port sp, uint8_t *pbtRx, uint32_t pszMaxRxLen, uin
         // Reset file descriptor
         FD_ZERO(&rfds);
         FD_SET(((serial_port_unix *)sp)->fd, &rfds);
-        tv = timeout;
+        tv = spu->timeout;
         int res = select(((serial_port_unix *)sp)->fd + 1, &rfds, NULL, NULL, &tv);
 
         // Read error
@@ -314,7 +312,7 @@ int uart_send(const serial_port sp, const uint8_t *pbtTx, const uint32_t len) {
         // Reset file descriptor
         FD_ZERO(&rfds);
         FD_SET(((serial_port_unix *)sp)->fd, &rfds);
-        tv = timeout;
+        tv = ((serial_port_unix *)sp)->timeout;
         int res = select(((serial_port_unix *)sp)->fd + 1, NULL, &rfds, NULL, &tv);
 
         // Write error
@@ -434,7 +432,7 @@ bool uart_set_speed(serial_port sp, const uint32_t uiPortSpeed) {
     cfsetospeed(&ti, stPortSpeed);
     bool result = tcsetattr(spu->fd, TCSANOW, &ti) != -1;
     if (result)
-        conn.uart_speed = uiPortSpeed;
+        GetConn()->uart_speed = uiPortSpeed;
     return result;
 }
 
@@ -52,28 +52,29 @@ typedef struct {
     HANDLE hPort;     // Serial port handle
     DCB dcb;          // Device control settings
     COMMTIMEOUTS ct;  // Serial port time-out configuration
+    uint32_t newtimeout_value;
+    bool newtimeout_pending;
 } serial_port_windows;
 
-uint32_t newtimeout_value = 0;
-bool newtimeout_pending = false;
-
-int uart_reconfigure_timeouts(uint32_t value) {
-    newtimeout_value = value;
-    newtimeout_pending = true;
+int uart_reconfigure_timeouts(serial_port sp, uint32_t value) {
+    if (sp == NULL) return PM3_EINVARG;
+    serial_port_windows *spw = (serial_port_windows *)sp;
+    spw->newtimeout_value = value;
+    __atomic_store_n(&spw->newtimeout_pending, true, __ATOMIC_RELEASE);
     return PM3_SUCCESS;
 }
 
 static int uart_reconfigure_timeouts_polling(serial_port sp) {
-    if (newtimeout_pending == false)
-        return PM3_SUCCESS;
-    newtimeout_pending = false;
-
     serial_port_windows *spw;
     spw = (serial_port_windows *)sp;
-    spw->ct.ReadIntervalTimeout         = newtimeout_value;
+    if (__atomic_load_n(&spw->newtimeout_pending, __ATOMIC_ACQUIRE) == false)
+        return PM3_SUCCESS;
+    spw->newtimeout_pending = false;
+
+    spw->ct.ReadIntervalTimeout         = spw->newtimeout_value;
     spw->ct.ReadTotalTimeoutMultiplier  = 0;
-    spw->ct.ReadTotalTimeoutConstant    = newtimeout_value;
-    spw->ct.WriteTotalTimeoutMultiplier = newtimeout_value;
+    spw->ct.ReadTotalTimeoutConstant    = spw->newtimeout_value;
+    spw->ct.WriteTotalTimeoutMultiplier = spw->newtimeout_value;
     spw->ct.WriteTotalTimeoutConstant   = 0;
 
     if (!SetCommTimeouts(spw->hPort, &spw->ct)) {
@@ -122,7 +123,7 @@ serial_port uart_open(const char *pcPortName, uint32_t speed) {
         return INVALID_SERIAL_PORT;
     }
 
-    uart_reconfigure_timeouts(UART_FPC_CLIENT_RX_TIMEOUT_MS);
+    uart_reconfigure_timeouts(sp, UART_FPC_CLIENT_RX_TIMEOUT_MS);
     uart_reconfigure_timeouts_polling(sp);
 
     if (!uart_set_speed(sp, speed)) {
@@ -134,7 +135,7 @@ serial_port uart_open(const char *pcPortName, uint32_t speed) {
             return INVALID_SERIAL_PORT;
         }
     }
-    conn.uart_speed = uart_get_speed(sp);
+    GetConn()->uart_speed = uart_get_speed(sp);
     return sp;
 }
 
@@ -168,7 +169,7 @@ bool uart_set_speed(serial_port sp, const uint32_t uiPortSpeed) {
     bool result = SetCommState(spw->hPort, &spw->dcb);
     PurgeComm(spw->hPort, PURGE_RXABORT | PURGE_RXCLEAR);
     if (result)
-        conn.uart_speed = uiPortSpeed;
+        GetConn()->uart_speed = uiPortSpeed;
 
     return result;
 }
@@ -43,6 +43,11 @@ bool showDemod = true;
 
 pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
 
+// per thread, so workers can pick up their own output
+static __thread char *capture_buf = NULL;
+static __thread size_t capture_size = 0;
+static __thread size_t capture_len = 0;
+
 static void fPrintAndLog(FILE *stream, const char *fmt, ...);
 
 // needed by flasher, so let's put it here instead of fileutils.c
@@ -122,6 +127,16 @@ void PrintAndLogOptions(const char *str[][2], size_t size, size_t space) {
 
 uint8_t PrintAndLogEx_spinidx = 0;
 
+// Send PrintAndLogEx output of the calling thread to buf instead of stdout and the session log, NULL stops it.
+// Output beyond size - 1 is dropped, buf stays NUL terminated.
+void PrintAndLogCapture(char *buf, size_t size) {
+    capture_buf = (size) ? buf : NULL;
+    capture_size = size;
+    capture_len = 0;
+    if (capture_buf)
+        capture_buf[0] = '\0';
+}
+
 void PrintAndLogEx(logLevel_t level, const char *fmt, ...) {
 
     // skip debug messages if client debugging is turned off i.e. 'DATA SETDEBUG 0'
@@ -201,7 +216,7 @@ void PrintAndLogEx(logLevel_t level, const char *fmt, ...) {
         fPrintAndLog(stream, "%s", buffer2);
     } else {
         snprintf(buffer2, sizeof(buffer2), "%s%s", prefix, buffer);
-        if (level == INPLACE) {
+        if (level == INPLACE && capture_buf == NULL) {
             char buffer3[MAX_PRINT_BUFFER + 20] = {0};
             memcpy_filter_ansi(buffer3, buffer2, sizeof(buffer2), !session.supports_colors);
             fprintf(stream, "\r%s", buffer3);
@@ -223,6 +238,18 @@ static void fPrintAndLog(FILE *stream, const char *fmt, ...) {
     // lock this section to avoid interlacing prints from different threads
     pthread_mutex_lock(&print_lock);
 
+    if (capture_buf) {
+        va_start(argptr, fmt);
+        vsnprintf(buffer, sizeof(buffer), fmt, argptr);
+        va_end(argptr);
+        memcpy_filter_ansi(buffer2, buffer, sizeof(buffer), true);
+        int n = snprintf(capture_buf + capture_len, capture_size - capture_len, "%s\n", buffer2);
+        if (n > 0)
+            capture_len += ((size_t)n < capture_size - capture_len) ? (size_t)n : capture_size - capture_len - 1;
+        pthread_mutex_unlock(&print_lock);
+        return;
+    }
+
     if (logging && !logfile) {
         char *my_logfile_path = NULL;
         char filename[40];
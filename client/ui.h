@@ -21,7 +21,6 @@ typedef struct {
     bool stdinOnTTY;
     bool stdoutOnTTY;
     bool supports_colors;
-    bool pm3_present;
     bool help_dump_mode;
 } session_arg_t;
 
@@ -39,6 +38,7 @@ void ShowGraphWindow(void);
 void RepaintGraphWindow(void);
 void PrintAndLogOptions(const char *str[][2], size_t size, size_t space);
 void PrintAndLogEx(logLevel_t level, const char *fmt, ...);
+void PrintAndLogCapture(char *buf, size_t size);
 void SetFlushAfterWrite(bool value);
 void memcpy_filter_ansi(void *dest, const void *src, size_t n, bool filter);
 
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h> // Mingw
+#include <pthread.h>
 
 #include "ui.h"     // PrintAndLog
 
@@ -39,7 +40,7 @@ uint8_t g_debugMode = 0;
 #include <unistd.h>
 #include <fcntl.h>
 
-int kbd_enter_pressed(void) {
+static int kbd_poll_enter(void) {
     int flags;
     if ((flags = fcntl(STDIN_FILENO, F_GETFL, 0)) < 0) {
         PrintAndLogEx(ERR, "fcntl failed in kbd_enter_pressed");
@@ -69,7 +70,7 @@ int kbd_enter_pressed(void) {
 #else
 
 #include <conio.h>
-int kbd_enter_pressed(void) {
+static int kbd_poll_enter(void) {
     int ret = 0;
     while (kbhit()) {
         ret |= getch() == '\r';
@@ -78,6 +79,28 @@ int kbd_enter_pressed(void) {
 }
 #endif
 
+// one thread at a time toggles and drains stdin
+static pthread_mutex_t kbd_lock = PTHREAD_MUTEX_INITIALIZER;
+// set by hw fanout workers, one Enter press aborts all of them
+static __thread bool *kbd_shared_enter = NULL;
+
+void kbd_share_enter(bool *pressed) {
+    kbd_shared_enter = pressed;
+}
+
+int kbd_enter_pressed(void) {
+    pthread_mutex_lock(&kbd_lock);
+    int ret = kbd_poll_enter();
+    if (kbd_shared_enter) {
+        if (ret > 0)
+            *kbd_shared_enter = true;
+        if (*kbd_shared_enter)
+            ret = 1;
+    }
+    pthread_mutex_unlock(&kbd_lock);
+    return ret;
+}
+
 // log files functions
 
 // open, appped and close logfile
@@ -240,13 +263,13 @@ void print_hex_break(const uint8_t *data, const size_t len, uint8_t breaks) {
 }
 
 char *sprint_hex(const uint8_t *data, const size_t len) {
-    static char buf[UTIL_BUFFER_SIZE_SPRINT - 3] = {0};
+    static __thread char buf[UTIL_BUFFER_SIZE_SPRINT - 3] = {0};
     hex_to_buffer((uint8_t *)buf, data, len, sizeof(buf) - 1, 0, 1, true);
     return buf;
 }
 
 char *sprint_hex_inrow_ex(const uint8_t *data, const size_t len, const size_t min_str_len) {
-    static char buf[UTIL_BUFFER_SIZE_SPRINT] = {0};
+    static __thread char buf[UTIL_BUFFER_SIZE_SPRINT] = {0};
     hex_to_buffer((uint8_t *)buf, data, len, sizeof(buf) - 1, min_str_len, 0, true);
     return buf;
 }
@@ -255,7 +278,7 @@ char *sprint_hex_inrow(const uint8_t *data, const size_t len) {
     return sprint_hex_inrow_ex(data, len, 0);
 }
 char *sprint_hex_inrow_spaces(const uint8_t *data, const size_t len, size_t spaces_between) {
-    static char buf[UTIL_BUFFER_SIZE_SPRINT] = {0};
+    static __thread char buf[UTIL_BUFFER_SIZE_SPRINT] = {0};
     hex_to_buffer((uint8_t *)buf, data, len, sizeof(buf) - 1, 0, spaces_between, true);
     return buf;
 }
@@ -272,7 +295,7 @@ char *sprint_bin_break(const uint8_t *data, const size_t len, const uint8_t brea
 
     //printf("(sprint_bin_break) rowlen %d\n", rowlen);
 
-    static char buf[MAX_BIN_BREAK_LENGTH]; // 3072 + end of line characters if broken at 8 bits
+    static __thread char buf[MAX_BIN_BREAK_LENGTH]; // 3072 + end of line characters if broken at 8 bits
     //clear memory
     memset(buf, 0x00, sizeof(buf));
     char *tmp = buf;
@@ -339,7 +362,7 @@ char *sprint_bin(const uint8_t *data, const size_t len) {
 }
 
 char *sprint_hex_ascii(const uint8_t *data, const size_t len) {
-    static char buf[UTIL_BUFFER_SIZE_SPRINT];
+    static __thread char buf[UTIL_BUFFER_SIZE_SPRINT];
     char *tmp = buf;
     memset(buf, 0x00, UTIL_BUFFER_SIZE_SPRINT);
     size_t max_len = (len > 1010) ? 1010 : len;
@@ -359,7 +382,7 @@ char *sprint_hex_ascii(const uint8_t *data, const size_t len) {
 }
 
 char *sprint_ascii_ex(const uint8_t *data, const size_t len, const size_t min_str_len) {
-    static char buf[UTIL_BUFFER_SIZE_SPRINT];
+    static __thread char buf[UTIL_BUFFER_SIZE_SPRINT];
     char *tmp = buf;
     memset(buf, 0x00, UTIL_BUFFER_SIZE_SPRINT);
     size_t max_len = (len > 1010) ? 1010 : len;
@@ -413,7 +436,7 @@ void num_to_bytebitsLSBF(uint64_t n, size_t len, uint8_t *dest) {
 // hh,gg,ff,ee,dd,cc,bb,aa, pp,oo,nn,mm,ll,kk,jj,ii
 // up to 64 bytes or 512 bits
 uint8_t *SwapEndian64(const uint8_t *src, const size_t len, const uint8_t blockSize) {
-    static uint8_t buf[64];
+    static __thread uint8_t buf[64];
     memset(buf, 0x00, 64);
     uint8_t *tmp = buf;
     for (uint8_t block = 0; block < (uint8_t)(len / blockSize); block++) {
@@ -22,6 +22,8 @@
 #include "bucketsort.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include "parity.h"
 
 #if !defined LOWMEM && defined __GNUC__
@@ -50,12 +52,14 @@ static inline void update_contribution(uint32_t *item, const uint32_t mask1, con
  */
 static inline void extend_table(uint32_t *tbl, uint32_t **end, int bit, int m1, int m2, uint32_t in) {
     in <<= 24;
-    for (*tbl <<= 1; tbl <= *end; *++tbl <<= 1)
-        if (filter(*tbl) ^ filter(*tbl | 1)) {
-            *tbl |= filter(*tbl) ^ bit;
+    for (*tbl <<= 1; tbl <= *end; *++tbl <<= 1) {
+        // look up both successors once, the table is modified in place below
+        int f0 = filter(*tbl), f1 = filter(*tbl | 1);
+        if (f0 ^ f1) {
+            *tbl |= f0 ^ bit;
             update_contribution(tbl, m1, m2);
             *tbl ^= in;
-        } else if (filter(*tbl) == bit) {
+        } else if (f0 == bit) {
             *++*end = tbl[1];
             tbl[1] = tbl[0] | 1;
             update_contribution(tbl, m1, m2);
@@ -64,15 +68,17 @@ static inline void extend_table(uint32_t *tbl, uint32_t **end, int bit, int m1,
             *tbl ^= in;
         } else
             *tbl-- = *(*end)--;
+    }
 }
 /** extend_table_simple
  * using a bit of the keystream extend the table of possible lfsr states
  */
 static inline void extend_table_simple(uint32_t *tbl, uint32_t **end, int bit) {
     for (*tbl <<= 1; tbl <= *end; *++tbl <<= 1) {
-        if (filter(*tbl) ^ filter(*tbl | 1)) { // replace
-            *tbl |= filter(*tbl) ^ bit;
-        } else if (filter(*tbl) == bit) {     // insert
+        int f0 = filter(*tbl), f1 = filter(*tbl | 1);
+        if (f0 ^ f1) {                        // replace
+            *tbl |= f0 ^ bit;
+        } else if (f0 == bit) {               // insert
             *++*end = *++tbl;
             *tbl = tbl[-1] | 1;
         } else {                              // drop
@@ -80,6 +86,26 @@ static inline void extend_table_simple(uint32_t *tbl, uint32_t **end, int bit) {
         }
     }
 }
+/** recover_extend
+ * extend both tables by the next (up to) 4 bits of keystream.
+ * returns false if one of the tables ran empty
+ */
+static bool recover_extend(uint32_t *o_head, uint32_t **o_tail, uint32_t *oks,
+                           uint32_t *e_head, uint32_t **e_tail, uint32_t *eks, int *rem, uint32_t *in) {
+    for (uint32_t i = 0; i < 4 && (*rem)--; i++) {
+        *oks >>= 1;
+        *eks >>= 1;
+        *in >>= 2;
+        extend_table(o_head, o_tail, *oks & 1, LF_POLY_EVEN << 1 | 1, LF_POLY_ODD << 1, 0);
+        if (o_head > *o_tail)
+            return false;
+
+        extend_table(e_head, e_tail, *eks & 1, LF_POLY_ODD, LF_POLY_EVEN << 1 | 1, *in & 3);
+        if (e_head > *e_tail)
+            return false;
+    }
+    return true;
+}
 /** recover
  * recursively narrow down the search space, 4 bits of keystream at a time
  */
@@ -101,18 +127,8 @@ recover(uint32_t *o_head, uint32_t *o_tail, uint32_t oks,
         return sl;
     }
 
-    for (uint32_t i = 0; i < 4 && rem--; i++) {
-        oks >>= 1;
-        eks >>= 1;
-        in >>= 2;
-        extend_table(o_head, &o_tail, oks & 1, LF_POLY_EVEN << 1 | 1, LF_POLY_ODD << 1, 0);
-        if (o_head > o_tail)
-            return sl;
-
-        extend_table(e_head, &e_tail, eks & 1, LF_POLY_ODD, LF_POLY_EVEN << 1 | 1, in & 3);
-        if (e_head > e_tail)
-            return sl;
-    }
+    if (!recover_extend(o_head, &o_tail, &oks, e_head, &e_tail, &eks, &rem, &in))
+        return sl;
 
     bucket_sort_intersect(e_head, e_tail, o_head, o_tail, &bucket_info, bucket);
 
@@ -124,6 +140,57 @@ recover(uint32_t *o_head, uint32_t *o_tail, uint32_t oks,
 
     return sl;
 }
+/** alloc_buckets
+ * allocate memory for out of place bucket_sort
+ */
+static bool alloc_buckets(bucket_array_t bucket) {
+    memset(bucket, 0, sizeof(bucket_array_t));
+    for (uint32_t i = 0; i < 2; i++) {
+        for (uint32_t j = 0; j <= 0xff; j++) {
+            bucket[i][j].head = malloc(sizeof(uint32_t) << 14);
+            if (!bucket[i][j].head)
+                return false;
+        }
+    }
+    return true;
+}
+static void free_buckets(bucket_array_t bucket) {
+    for (uint32_t i = 0; i < 2; i++)
+        for (uint32_t j = 0; j <= 0xff; j++)
+            free(bucket[i][j].head);
+}
+/** init_recovery32_tables
+ * split the keystream into an odd and even part and fill both tables (1 << 21 entries each)
+ * with all states which could have generated the last 10 bits of the keystream
+ */
+static void init_recovery32_tables(uint32_t ks2, uint32_t *odd_head, uint32_t **odd_tail, uint32_t *oks,
+                                   uint32_t *even_head, uint32_t **even_tail, uint32_t *eks) {
+    int i;
+
+    // split the keystream into an odd and even part
+    *oks = *eks = 0;
+    for (i = 31; i >= 0; i -= 2)
+        *oks = *oks << 1 | BEBIT(ks2, i);
+    for (i = 30; i >= 0; i -= 2)
+        *eks = *eks << 1 | BEBIT(ks2, i);
+
+    *odd_tail = odd_head - 1;
+    *even_tail = even_head - 1;
+
+    // initialize statelists: add all possible states which would result into the rightmost 2 bits of the keystream
+    for (i = 1 << 20; i >= 0; --i) {
+        if (filter(i) == (*oks & 1))
+            *++*odd_tail = i;
+        if (filter(i) == (*eks & 1))
+            *++*even_tail = i;
+    }
+
+    // extend the statelists. Look at the next 8 Bits of the keystream (4 Bit each odd and even):
+    for (i = 0; i < 4; i++) {
+        extend_table_simple(odd_head,  odd_tail, (*oks >>= 1) & 1);
+        extend_table_simple(even_head, even_tail, (*eks >>= 1) & 1);
+    }
+}
 /** lfsr_recovery
  * recover the state of the lfsr given 32 bits of the keystream
  * additionally you can use the in parameter to specify the value
@@ -131,20 +198,15 @@ recover(uint32_t *o_head, uint32_t *o_tail, uint32_t oks,
  */
 struct Crypto1State *lfsr_recovery32(uint32_t ks2, uint32_t in) {
     struct Crypto1State *statelist;
-    uint32_t *odd_head = 0, *odd_tail = 0, oks = 0;
-    uint32_t *even_head = 0, *even_tail = 0, eks = 0;
-    int i;
-
-    // split the keystream into an odd and even part
-    for (i = 31; i >= 0; i -= 2)
-        oks = oks << 1 | BEBIT(ks2, i);
-    for (i = 30; i >= 0; i -= 2)
-        eks = eks << 1 | BEBIT(ks2, i);
+    uint32_t *odd_head, *odd_tail, oks;
+    uint32_t *even_head, *even_tail, eks;
+    bucket_array_t bucket;
 
-    odd_head = odd_tail = malloc(sizeof(uint32_t) << 21);
-    even_head = even_tail = malloc(sizeof(uint32_t) << 21);
+    bool buckets_ok = alloc_buckets(bucket);
+    odd_head = malloc(sizeof(uint32_t) << 21);
+    even_head = malloc(sizeof(uint32_t) << 21);
     statelist =  malloc(sizeof(struct Crypto1State) << 18);
-    if (!odd_tail-- || !even_tail-- || !statelist) {
+    if (!buckets_ok || !odd_head || !even_head || !statelist) {
         free(statelist);
         statelist = 0;
         goto out;
@@ -152,42 +214,169 @@ struct Crypto1State *lfsr_recovery32(uint32_t ks2, uint32_t in) {
 
     statelist->odd = statelist->even = 0;
 
-    // allocate memory for out of place bucket_sort
-    bucket_array_t bucket;
+    init_recovery32_tables(ks2, odd_head, &odd_tail, &oks, even_head, &even_tail, &eks);
 
-    for (i = 0; i < 2; i++) {
-        for (uint32_t j = 0; j <= 0xff; j++) {
-            bucket[i][j].head = malloc(sizeof(uint32_t) << 14);
-            if (!bucket[i][j].head) {
-                goto out;
-            }
-        }
-    }
+    // the statelists now contain all states which could have generated the last 10 Bits of the keystream.
+    // 22 bits to go to recover 32 bits in total. From now on, we need to take the "in"
+    // parameter into account.
+    in = (in >> 16 & 0xff) | (in << 16) | (in & 0xff00); // Byte swapping
+    recover(odd_head, odd_tail, oks, even_head, even_tail, eks, 11, statelist, in << 1, bucket);
 
-    // initialize statelists: add all possible states which would result into the rightmost 2 bits of the keystream
-    for (i = 1 << 20; i >= 0; --i) {
-        if (filter(i) == (oks & 1))
-            *++odd_tail = i;
-        if (filter(i) == (eks & 1))
-            *++even_tail = i;
+out:
+    free_buckets(bucket);
+    free(odd_head);
+    free(even_head);
+    return statelist;
+}
+
+typedef struct {
+    const bucket_info_t *bucket_info;   // top level buckets, shared by all workers
+    struct Crypto1State **bucket_head;  // per top level bucket: first state found
+    struct Crypto1State **bucket_tail;  // per top level bucket: one past the last state found
+    uint32_t *next_bucket;
+    uint32_t oks, eks, in;
+    int rem;
+    bucket_t (*bucket)[0x100];          // bucket sort scratch to reuse, NULL to allocate one
+    struct Crypto1State *statelist;     // private to the worker
+} recovery32_worker_t;
+
+// every worker needs ~50 MB (scratch buckets, private copies of the odd/even tables and
+// its statelist), more threads than this only add memory, not much speed
+#define RECOVERY32_MAX_THREADS 8
+
+static void
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+*recovery32_worker(void *arg) {
+    recovery32_worker_t *w = arg;
+    const bucket_info_t *bi = w->bucket_info;
+    bucket_array_t own;
+    bucket_t (*bucket)[0x100] = w->bucket;
+
+    bool buckets_ok = true;
+    if (bucket == NULL) {
+        buckets_ok = alloc_buckets(own);
+        bucket = own;
     }
+    uint32_t *odd = malloc(sizeof(uint32_t) << 21);
+    uint32_t *even = malloc(sizeof(uint32_t) << 21);
+    w->statelist = malloc(sizeof(struct Crypto1State) << 18);
+    if (!buckets_ok || !odd || !even || !w->statelist)
+        goto out;
 
-    // extend the statelists. Look at the next 8 Bits of the keystream (4 Bit each odd and even):
-    for (i = 0; i < 4; i++) {
-        extend_table_simple(odd_head,  &odd_tail, (oks >>= 1) & 1);
-        extend_table_simple(even_head, &even_tail, (eks >>= 1) & 1);
+    struct Crypto1State *sl = w->statelist;
+    uint32_t k;
+    while ((k = __atomic_fetch_add(w->next_bucket, 1, __ATOMIC_SEQ_CST)) < bi->numbuckets) {
+        // same order as recover() would take them, so the result is identical to lfsr_recovery32()
+        uint32_t i = bi->numbuckets - 1 - k;
+        // recover() extends the tables in place beyond their tail, work on private copies
+        size_t o_len = bi->bucket_info[1][i].tail - bi->bucket_info[1][i].head + 1;
+        size_t e_len = bi->bucket_info[0][i].tail - bi->bucket_info[0][i].head + 1;
+        memcpy(odd, bi->bucket_info[1][i].head, o_len * sizeof(uint32_t));
+        memcpy(even, bi->bucket_info[0][i].head, e_len * sizeof(uint32_t));
+        w->bucket_head[i] = sl;
+        sl = recover(odd, odd + o_len - 1, w->oks, even, even + e_len - 1, w->eks, w->rem, sl, w->in, bucket);
+        w->bucket_tail[i] = sl;
     }
 
-    // the statelists now contain all states which could have generated the last 10 Bits of the keystream.
-    // 22 bits to go to recover 32 bits in total. From now on, we need to take the "in"
-    // parameter into account.
+out:
+    if (w->bucket == NULL)
+        free_buckets(own);
+    free(odd);
+    free(even);
+    return NULL;
+}
+/** lfsr_recovery32_mt
+ * same as lfsr_recovery32(), but the buckets of the first recursion level are
+ * distributed over num_threads (at most RECOVERY32_MAX_THREADS) worker threads.
+ * Returns the same list in the same order.
+ */
+struct Crypto1State *lfsr_recovery32_mt(uint32_t ks2, uint32_t in, int num_threads) {
+    if (num_threads <= 1)
+        return lfsr_recovery32(ks2, in);
+    if (num_threads > RECOVERY32_MAX_THREADS)
+        num_threads = RECOVERY32_MAX_THREADS;
+
+    struct Crypto1State *statelist = 0;
+    struct Crypto1State *bucket_head[0x100] = {0};
+    struct Crypto1State *bucket_tail[0x100] = {0};
+    uint32_t *odd_head, *odd_tail, oks;
+    uint32_t *even_head, *even_tail, eks;
+    bucket_array_t bucket;
+    bucket_info_t bucket_info;
+    recovery32_worker_t worker[RECOVERY32_MAX_THREADS];
+    pthread_t thread_id[RECOVERY32_MAX_THREADS];
+    bool thread_running[RECOVERY32_MAX_THREADS];
+    uint32_t next_bucket = 0;
+    int i;
+
+    bool buckets_ok = alloc_buckets(bucket);
+    odd_head = malloc(sizeof(uint32_t) << 21);
+    even_head = malloc(sizeof(uint32_t) << 21);
+    if (!buckets_ok || !odd_head || !even_head)
+        goto out;
+
+    init_recovery32_tables(ks2, odd_head, &odd_tail, &oks, even_head, &even_tail, &eks);
+
     in = (in >> 16 & 0xff) | (in << 16) | (in & 0xff00); // Byte swapping
-    recover(odd_head, odd_tail, oks, even_head, even_tail, eks, 11, statelist, in << 1, bucket);
+    in <<= 1;
+
+    // first level of recover(), split the search space into buckets
+    int rem = 11;
+    if (!recover_extend(odd_head, &odd_tail, &oks, even_head, &even_tail, &eks, &rem, &in)) {
+        statelist = calloc(1, sizeof(struct Crypto1State));
+        goto out;
+    }
+    bucket_sort_intersect(even_head, even_tail, odd_head, odd_tail, &bucket_info, bucket);
+
+    for (i = 0; i < num_threads; i++) {
+        worker[i].bucket_info = &bucket_info;
+        worker[i].bucket_head = bucket_head;
+        worker[i].bucket_tail = bucket_tail;
+        worker[i].next_bucket = &next_bucket;
+        worker[i].oks = oks;
+        worker[i].eks = eks;
+        worker[i].in = in;
+        worker[i].rem = rem;
+        worker[i].bucket = NULL;
+        worker[i].statelist = 0;
+    }
+    // the tables are sorted, the calling thread's scratch buckets are free again
+    worker[0].bucket = bucket;
+
+    // the calling thread is worker 0. Threads which fail to start just leave their share to the others
+    for (i = 1; i < num_threads; i++)
+        thread_running[i] = (pthread_create(&thread_id[i], NULL, recovery32_worker, &worker[i]) == 0);
+    recovery32_worker(&worker[0]);
+    for (i = 1; i < num_threads; i++)
+        if (thread_running[i])
+            pthread_join(thread_id[i], NULL);
+
+    // concatenate the per bucket results in the order of the single threaded version
+    size_t num_states = 0;
+    for (uint32_t b = 0; b < bucket_info.numbuckets; b++) {
+        if (!bucket_tail[b])
+            goto out_free;
+        num_states += bucket_tail[b] - bucket_head[b];
+    }
+    statelist = malloc(sizeof(struct Crypto1State) * (num_states + 1));
+    if (statelist) {
+        struct Crypto1State *sl = statelist;
+        for (int b = bucket_info.numbuckets - 1; b >= 0; b--) {
+            memcpy(sl, bucket_head[b], (bucket_tail[b] - bucket_head[b]) * sizeof(struct Crypto1State));
+            sl += bucket_tail[b] - bucket_head[b];
+        }
+        sl->odd = sl->even = 0;
+    }
 
+out_free:
+    for (i = 0; i < num_threads; i++)
+        free(worker[i].statelist);
 out:
-    for (i = 0; i < 2; i++)
-        for (uint32_t j = 0; j <= 0xff; j++)
-            free(bucket[i][j].head);
+    free_buckets(bucket);
     free(odd_head);
     free(even_head);
     return statelist;
@@ -38,6 +38,7 @@ uint32_t crypto1_word(struct Crypto1State *, uint32_t, int);
 uint32_t prng_successor(uint32_t x, uint32_t n);
 
 struct Crypto1State *lfsr_recovery32(uint32_t ks2, uint32_t in);
+struct Crypto1State *lfsr_recovery32_mt(uint32_t ks2, uint32_t in, int num_threads);
 struct Crypto1State *lfsr_recovery64(uint32_t ks2, uint32_t ks3);
 uint32_t *lfsr_prefix_ks(uint8_t ks[8], int isodd);
 struct Crypto1State *
@@ -11,8 +11,7 @@
 //-----------------------------------------------------------------------------
 #include "hitag2_crypto.h"
 
-#include "util.h"
-#include "string.h"
+#include <string.h>
 
 /* Following is a modified version of cryptolib.com/ciphers/hitag2/ */
 // Software optimized 48-bit Philips/NXP Mifare Hitag2 PCF7936/46/47/52 stream cipher algorithm by I.C. Wiener 2006-2007.
@@ -83,24 +82,6 @@ uint32_t _hitag2_byte(uint64_t *x) {
     return c;
 }
 
-void hitag2_cipher_reset(struct hitag2_tag *tag, const uint8_t *iv) {
-    uint64_t key = ((uint64_t)tag->sectors[2][2]) |
-                   ((uint64_t)tag->sectors[2][3] << 8) |
-                   ((uint64_t)tag->sectors[1][0] << 16) |
-                   ((uint64_t)tag->sectors[1][1] << 24) |
-                   ((uint64_t)tag->sectors[1][2] << 32) |
-                   ((uint64_t)tag->sectors[1][3] << 40);
-    uint32_t uid = ((uint32_t)tag->sectors[0][0]) |
-                   ((uint32_t)tag->sectors[0][1] << 8) |
-                   ((uint32_t)tag->sectors[0][2] << 16) |
-                   ((uint32_t)tag->sectors[0][3] << 24);
-    uint32_t iv_ = (((uint32_t)(iv[0]))) |
-                   (((uint32_t)(iv[1])) << 8) |
-                   (((uint32_t)(iv[2])) << 16) |
-                   (((uint32_t)(iv[3])) << 24);
-    tag->cs = _hitag2_init(REV64(key), REV32(uid), REV32(iv_));
-}
-
 int hitag2_cipher_authenticate(uint64_t *cs, const uint8_t *authenticator_is) {
     uint8_t authenticator_should[4];
     authenticator_should[0] = ~_hitag2_byte(cs);
@@ -0,0 +1,16 @@
+#ifndef __HITAG2_CRYPTO_H
+#define __HITAG2_CRYPTO_H
+
+#include "common.h"
+
+// Hitag2 cipher, shared by the firmware and the client key recovery.
+// Values are in cipher bit order, see REV32 / REV64 on the firmware side.
+
+uint32_t _f20(const uint64_t x);
+uint64_t _hitag2_init(const uint64_t key, const uint32_t serial, const uint32_t IV);
+uint64_t _hitag2_round(uint64_t *state);
+uint32_t _hitag2_byte(uint64_t *x);
+int hitag2_cipher_authenticate(uint64_t *cs, const uint8_t *authenticator_is);
+int hitag2_cipher_transcrypt(uint64_t *cs, uint8_t *data, uint16_t bytes, uint16_t bits) ;
+
+#endif
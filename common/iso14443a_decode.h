@@ -0,0 +1,138 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// ISO 14443 type A Miller / Manchester decoders
+//-----------------------------------------------------------------------------
+
+#ifndef ISO14443A_DECODE_H__
+#define ISO14443A_DECODE_H__
+
+#include "common.h"
+
+#ifdef ON_DEVICE
+# define ISO14A_DECODE_FUNC RAMFUNC
+#else
+# define ISO14A_DECODE_FUNC
+#endif
+
+// When the PM acts as sniffer and is receiving tag data, it takes
+// 3 ticks A/D conversion
+// 14 ticks to complete the modulation detection
+// 8 ticks (on average) until the result is stored in to_arm
+// + the delays in transferring data - which is the same for
+// sniffing reader and tag data and therefore not relevant
+#define DELAY_TAG_AIR2ARM_AS_SNIFFER (3 + 14 + 8)
+
+// When the PM acts as sniffer and is receiving reader data, it takes
+// 2 ticks delay in analogue RF receiver (for the falling edge of the
+// start bit, which marks the start of the communication)
+// 3 ticks A/D conversion
+// 8 ticks on average until the data is stored in to_arm.
+// + the delays in transferring data - which is the same for
+// sniffing reader and tag data and therefore not relevant
+#define DELAY_READER_AIR2ARM_AS_SNIFFER (2 + 3 + 8)
+
+typedef struct {
+    enum {
+        DEMOD_14A_UNSYNCD,
+        // DEMOD_14A_HALF_SYNCD,
+        // DEMOD_14A_MOD_FIRST_HALF,
+        // DEMOD_14A_NOMOD_FIRST_HALF,
+        DEMOD_14A_MANCHESTER_DATA
+    } state;
+    uint16_t twoBits;
+    uint16_t highCnt;
+    uint16_t bitCount;
+    uint16_t collisionPos;
+    uint16_t syncBit;
+    uint8_t  parityBits;
+    uint8_t  parityLen;
+    uint16_t shiftReg;
+    uint16_t samples;
+    uint16_t len;
+    uint32_t startTime, endTime;
+    uint8_t  *output;
+    uint8_t  *parity;
+} tDemod14a;
+/*
+typedef enum {
+    MOD_NOMOD = 0,
+    MOD_SECOND_HALF,
+    MOD_FIRST_HALF,
+    MOD_BOTH_HALVES
+    } Modulation_t;
+*/
+
+typedef struct {
+    enum {
+        STATE_14A_UNSYNCD,
+        STATE_14A_START_OF_COMMUNICATION,
+        STATE_14A_MILLER_X,
+        STATE_14A_MILLER_Y,
+        STATE_14A_MILLER_Z,
+        // DROP_NONE,
+        // DROP_FIRST_HALF,
+    } state;
+    uint16_t shiftReg;
+    int16_t bitCount;
+    uint16_t len;
+    //uint16_t byteCntMax;
+    uint16_t posCnt;
+    uint16_t syncBit;
+    uint8_t  parityBits;
+    uint8_t  parityLen;
+    uint32_t fourBits;
+    uint32_t startTime, endTime;
+    uint8_t *output;
+    uint8_t *parity;
+} tUart14a;
+
+extern const bool Mod_Miller_LUT[];
+extern const bool Mod_Manchester_LUT[];
+
+#define IsMillerModulationNibble1(b) (Mod_Miller_LUT[(b & 0x000000F0) >> 4])
+#define IsMillerModulationNibble2(b) (Mod_Miller_LUT[(b & 0x0000000F)])
+#define IsManchesterModulationNibble1(b) (Mod_Manchester_LUT[(b & 0x00F0) >> 4])
+#define IsManchesterModulationNibble2(b) (Mod_Manchester_LUT[(b & 0x000F)])
+
+void Uart14aResetEx(tUart14a *uart);
+void Uart14aInitEx(tUart14a *uart, uint8_t *data, uint8_t *par);
+// returns true when a complete reader frame has been decoded into uart->output
+ISO14A_DECODE_FUNC bool MillerDecodingEx(tUart14a *uart, uint8_t bit, uint32_t non_real_time);
+
+void Demod14aResetEx(tDemod14a *demod);
+void Demod14aInitEx(tDemod14a *demod, uint8_t *data, uint8_t *par);
+// returns true when a complete tag frame has been decoded into demod->output
+ISO14A_DECODE_FUNC int ManchesterDecodingEx(tDemod14a *demod, uint8_t bit, uint16_t offset, uint32_t non_real_time);
+
+// Sniffer main loop, one call per sample byte from the FPGA sniffer DMA
+// stream. Completed frames go to log(), which has the LogTrace() arguments
+// and returns false when it could not store the frame.
+typedef bool (*sniff14a_log_t)(void *ctx, const uint8_t *data, uint16_t len, uint32_t start, uint32_t end, uint8_t *par, bool reader);
+
+typedef struct {
+    tUart14a *uart;
+    tDemod14a *demod;
+    uint16_t max_len;       // size of the frame buffers, longer frames are noise
+    uint8_t param;          // bit 0 - trigger on the first tag answer, bit 1 - on the first 7 bit reader request
+    bool triggered;
+    bool reader_active;
+    bool tag_active;
+    uint8_t previous;
+    uint32_t rx_samples;
+    sniff14a_log_t log;
+    void *log_ctx;
+} tSniff14a;
+
+// Sniff14aDecode() results
+#define SNIFF14A_READER_FRAME   0x01
+#define SNIFF14A_TAG_FRAME      0x02
+#define SNIFF14A_LOG_FAILED     0x80
+
+// uart and demod must be initialised with their frame buffers
+void Sniff14aInit(tSniff14a *sniff, tUart14a *uart, tDemod14a *demod, uint16_t max_len, uint8_t param, sniff14a_log_t log, void *log_ctx);
+ISO14A_DECODE_FUNC uint8_t Sniff14aDecode(tSniff14a *sniff, uint8_t data);
+
+#endif
@@ -58,48 +58,62 @@ uint8_t g_debugMode = 0;
 # define prnt Dbprintf
 #endif
 
-signal_t signalprop = { 255, -255, 0, 0, true };
+// context used by the non _ctx api, kept for the single threaded callers
+static lfdemod_ctx_t lfdemod_default = { { 255, -255, 0, 0, true } };
+
 signal_t *getSignalProperties(void) {
-    return &signalprop;
+    return &lfdemod_default.signal;
+}
+
+signal_t *getSignalProperties_ctx(lfdemod_ctx_t *ctx) {
+    return &ctx->signal;
 }
 
-static void resetSignal(void) {
-    signalprop.low = 255;
-    signalprop.high = -255;
-    signalprop.mean = 0;
-    signalprop.amplitude = 0;
-    signalprop.isnoise = true;
+static void resetSignal(lfdemod_ctx_t *ctx) {
+    ctx->signal.low = 255;
+    ctx->signal.high = -255;
+    ctx->signal.mean = 0;
+    ctx->signal.amplitude = 0;
+    ctx->signal.isnoise = true;
 }
 
-static void printSignal(void) {
+static void printSignal(lfdemod_ctx_t *ctx) {
     prnt("LF signal properties:");
-    prnt("  high..........%d", signalprop.high);
-    prnt("  low...........%d", signalprop.low);
-    prnt("  mean..........%d", signalprop.mean);
-    prnt("  amplitude.....%d", signalprop.amplitude);
-    prnt("  is Noise......%s", (signalprop.isnoise) ? _RED_("Yes") : _GREEN_("No"));
+    prnt("  high..........%d", ctx->signal.high);
+    prnt("  low...........%d", ctx->signal.low);
+    prnt("  mean..........%d", ctx->signal.mean);
+    prnt("  amplitude.....%d", ctx->signal.amplitude);
+    prnt("  is Noise......%s", (ctx->signal.isnoise) ? _RED_("Yes") : _GREEN_("No"));
     prnt("  THRESHOLD noise amplitude......%d", NOISE_AMPLITUDE_THRESHOLD);
 }
 
-void computeSignalProperties(uint8_t *samples, uint32_t size) {
-    resetSignal();
+void lfdemod_ctx_init(lfdemod_ctx_t *ctx) {
+    resetSignal(ctx);
+}
+
+void computeSignalProperties_ctx(lfdemod_ctx_t *ctx, uint8_t *samples, uint32_t size) {
+    resetSignal(ctx);
 
     uint32_t sum = 0;
     for (uint32_t i = 0; i < size; i++) {
-        if (samples[i] < signalprop.low) signalprop.low = samples[i];
-        if (samples[i] > signalprop.high) signalprop.high = samples[i];
+        if (samples[i] < ctx->signal.low) ctx->signal.low = samples[i];
+        if (samples[i] > ctx->signal.high) ctx->signal.high = samples[i];
         sum += samples[i];
     }
 
     // measure amplitude of signal
-    signalprop.mean = sum / size;
-    signalprop.amplitude = signalprop.high - signalprop.mean;
+    ctx->signal.mean = sum / size;
+    ctx->signal.amplitude = ctx->signal.high - ctx->signal.mean;
     // By measuring mean and look at amplitude of signal from HIGH / LOW,
     // we can detect noise
-    signalprop.isnoise =  signalprop.amplitude < NOISE_AMPLITUDE_THRESHOLD;
+    ctx->signal.isnoise =  ctx->signal.amplitude < NOISE_AMPLITUDE_THRESHOLD;
 
     if (g_debugMode)
-        printSignal();
+        printSignal(ctx);
+}
+
+void computeSignalProperties(uint8_t *samples, uint32_t size) {
+    computeSignalProperties_ctx(&lfdemod_default, samples, size);
 }
 
 void removeSignalOffset(uint8_t *samples, uint32_t size) {
@@ -124,26 +138,30 @@ void removeSignalOffset(uint8_t *samples, uint32_t size) {
 //by marshmellow
 //get high and low values of a wave with passed in fuzz factor. also return noise test = 1 for passed or 0 for only noise
 //void getHiLo(uint8_t *bits, size_t size, int *high, int *low, uint8_t fuzzHi, uint8_t fuzzLo) {
-void getHiLo(int *high, int *low, uint8_t fuzzHi, uint8_t fuzzLo) {
+void getHiLo_ctx(lfdemod_ctx_t *ctx, int *high, int *low, uint8_t fuzzHi, uint8_t fuzzLo) {
     // add fuzz.
-    *high = (signalprop.high * fuzzHi) / 100;
-    if (signalprop.low < 0) {
-        *low = (signalprop.low * fuzzLo) / 100;
+    *high = (ctx->signal.high * fuzzHi) / 100;
+    if (ctx->signal.low < 0) {
+        *low = (ctx->signal.low * fuzzLo) / 100;
     } else {
-        uint8_t range = signalprop.high - signalprop.low;
+        uint8_t range = ctx->signal.high - ctx->signal.low;
 
-        *low =  signalprop.low + ((range * (100 - fuzzLo)) / 100);
+        *low =  ctx->signal.low + ((range * (100 - fuzzLo)) / 100);
     }
 
     // if fuzzing to great and overlap
     if (*high < *low) {
-        *high = signalprop.high;
-        *low =  signalprop.low;
+        *high = ctx->signal.high;
+        *low =  ctx->signal.low;
     }
 
     prnt("getHiLo fuzzed: High %d | Low %d", *high, *low);
 }
 
+void getHiLo(int *high, int *low, uint8_t fuzzHi, uint8_t fuzzLo) {
+    getHiLo_ctx(&lfdemod_default, high, low, fuzzHi, fuzzLo);
+}
+
 // by marshmellow
 // pass bits to be tested in bits, length bits passed in bitLen, and parity type (even=0 | odd=1) in pType
 // returns 1 if passed
@@ -281,18 +299,18 @@ bool preambleSearchEx(uint8_t *bits, uint8_t *preamble, size_t pLen, size_t *siz
 }
 
 // find start of modulating data (for fsk and psk) in case of beginning noise or slow chip startup.
-static size_t findModStart(uint8_t *src, size_t size, uint8_t expWaveSize) {
+static size_t findModStart(lfdemod_ctx_t *ctx, uint8_t *src, size_t size, uint8_t expWaveSize) {
     size_t i = 0;
     size_t waveSizeCnt = 0;
     uint8_t thresholdCnt = 0;
-    bool isAboveThreshold = src[i++] >= signalprop.mean; //FSK_PSK_THRESHOLD;
+    bool isAboveThreshold = src[i++] >= ctx->signal.mean; //FSK_PSK_THRESHOLD;
     for (; i < size - 20; i++) {
-        if (src[i] < signalprop.mean && isAboveThreshold) {
+        if (src[i] < ctx->signal.mean && isAboveThreshold) {
             thresholdCnt++;
             if (thresholdCnt > 2 && waveSizeCnt < expWaveSize + 1) break;
             isAboveThreshold = false;
             waveSizeCnt = 0;
-        } else if (src[i] >= signalprop.mean && !isAboveThreshold) {
+        } else if (src[i] >= ctx->signal.mean && !isAboveThreshold) {
             thresholdCnt++;
             if (thresholdCnt > 2 && waveSizeCnt < expWaveSize + 1) break;
             isAboveThreshold = true;
@@ -328,17 +346,17 @@ void getNextHigh(uint8_t *samples, size_t size, int high, size_t *i) {
 }
 
 // load wave counters
-bool loadWaveCounters(uint8_t *samples, size_t size, int lowToLowWaveLen[], int highToLowWaveLen[], int *waveCnt, int *skip, int *minClk, int *high, int *low) {
+bool loadWaveCounters_ctx(lfdemod_ctx_t *ctx, uint8_t *samples, size_t size, int lowToLowWaveLen[], int highToLowWaveLen[], int *waveCnt, int *skip, int *minClk, int *high, int *low) {
     size_t i = 0;
     //size_t testsize = (size < 512) ? size : 512;
 
     // just noise - no super good detection. good enough
-    if (signalprop.isnoise) {
+    if (ctx->signal.isnoise) {
         if (g_debugMode == 2) prnt("DEBUG STT: just noise detected - quitting");
         return false;
     }
 
-    getHiLo(high, low, 80, 80);
+    getHiLo_ctx(ctx, high, low, 80, 80);
 
     // get to first full low to prime loop and skip incomplete first pulse
     getNextHigh(samples, size, *high, &i);
@@ -368,6 +386,10 @@ bool loadWaveCounters(uint8_t *samples, size_t size, int lowToLowWaveLen[], int
     return true;
 }
 
+bool loadWaveCounters(uint8_t *samples, size_t size, int lowToLowWaveLen[], int highToLowWaveLen[], int *waveCnt, int *skip, int *minClk, int *high, int *low) {
+    return loadWaveCounters_ctx(&lfdemod_default, samples, size, lowToLowWaveLen, highToLowWaveLen, waveCnt, skip, minClk, high, low);
+}
+
 size_t pskFindFirstPhaseShift(uint8_t *samples, size_t size, uint8_t *curPhase, size_t waveStart, uint16_t fc, uint16_t *fullWaveLen) {
     uint16_t loopCnt = (size + 3 < 4096) ? size : 4096; //don't need to loop through entire array...
 
@@ -559,7 +581,7 @@ int DetectStrongAskClock(uint8_t *dest, size_t size, int high, int low, int *clo
 // not perfect especially with lower clocks or VERY good antennas (heavy wave clipping)
 // maybe somehow adjust peak trimming value based on samples to fix?
 // return start index of best starting position for that clock and return clock (by reference)
-int DetectASKClock(uint8_t *dest, size_t size, int *clock, int maxErr) {
+int DetectASKClock_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t size, int *clock, int maxErr) {
 
     //don't need to loop through entire array. (cotag has clock of 384)
     uint16_t loopCnt = 2000;
@@ -571,7 +593,7 @@ int DetectASKClock(uint8_t *dest, size_t size, int *clock, int maxErr) {
     }
 
     // just noise - no super good detection. good enough
-    if (signalprop.isnoise) {
+    if (ctx->signal.isnoise) {
         if (g_debugMode == 2) prnt("DEBUG DetectASKClock: just noise detected - aborting");
         return -2;
     }
@@ -595,7 +617,7 @@ int DetectASKClock(uint8_t *dest, size_t size, int *clock, int maxErr) {
 
     // threshold 75% of high, low peak
     int peak_hi, peak_low;
-    getHiLo(&peak_hi, &peak_low, 75, 75);
+    getHiLo_ctx(ctx, &peak_hi, &peak_low, 75, 75);
 
     // test for large clean, STRONG, CLIPPED peaks
 
@@ -698,6 +720,10 @@ int DetectASKClock(uint8_t *dest, size_t size, int *clock, int maxErr) {
     return bestStart[best];
 }
 
+int DetectASKClock(uint8_t *dest, size_t size, int *clock, int maxErr) {
+    return DetectASKClock_ctx(&lfdemod_default, dest, size, clock, maxErr);
+}
+
 int DetectStrongNRZClk(uint8_t *dest, size_t size, int peak, int low, bool *strong) {
     //find shortest transition from high to low
     *strong = false;
@@ -743,7 +769,7 @@ int DetectStrongNRZClk(uint8_t *dest, size_t size, int peak, int low, bool *stro
 
 //by marshmellow
 //detect nrz clock by reading #peaks vs no peaks(or errors)
-int DetectNRZClock(uint8_t *dest, size_t size, int clock, size_t *clockStartIdx) {
+int DetectNRZClock_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t size, int clock, size_t *clockStartIdx) {
     size_t i = 0;
     uint8_t clk[] = {8, 16, 32, 40, 50, 64, 100, 128, 255};
     size_t loopCnt = 4096;  //don't need to loop through entire array...
@@ -758,7 +784,7 @@ int DetectNRZClock(uint8_t *dest, size_t size, int clock, size_t *clockStartIdx)
 
 
     // just noise - no super good detection. good enough
-    if (signalprop.isnoise) {
+    if (ctx->signal.isnoise) {
         if (g_debugMode == 2) prnt("DEBUG DetectNZRClock: just noise detected - quitting");
         return 0;
     }
@@ -766,7 +792,7 @@ int DetectNRZClock(uint8_t *dest, size_t size, int clock, size_t *clockStartIdx)
     //get high and low peak
     int peak, low;
     //getHiLo(dest, loopCnt, &peak, &low, 90, 90);
-    getHiLo(&peak, &low, 90, 90);
+    getHiLo_ctx(ctx, &peak, &low, 90, 90);
 
     bool strong = false;
     int lowestTransition = DetectStrongNRZClk(dest, size - 20, peak, low, &strong);
@@ -869,6 +895,10 @@ int DetectNRZClock(uint8_t *dest, size_t size, int clock, size_t *clockStartIdx)
     return clk[best];
 }
 
+int DetectNRZClock(uint8_t *dest, size_t size, int clock, size_t *clockStartIdx) {
+    return DetectNRZClock_ctx(&lfdemod_default, dest, size, clock, clockStartIdx);
+}
+
 //by marshmellow
 //countFC is to detect the field clock lengths.
 //counts and returns the 2 most common wave lengths
@@ -963,7 +993,7 @@ uint16_t countFC(uint8_t *bits, size_t size, bool fskAdj) {
 //by marshmellow
 //detect psk clock by reading each phase shift
 // a phase shift is determined by measuring the sample length of each wave
-int DetectPSKClock(uint8_t *dest, size_t size, int clock, size_t *firstPhaseShift, uint8_t *curPhase, uint8_t *fc) {
+int DetectPSKClock_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t size, int clock, size_t *firstPhaseShift, uint8_t *curPhase, uint8_t *fc) {
     uint8_t clk[] = {255, 16, 32, 40, 50, 64, 100, 128, 255}; //255 is not a valid clock
     uint16_t loopCnt = 4096;  //don't need to loop through entire array...
 
@@ -990,7 +1020,7 @@ int DetectPSKClock(uint8_t *dest, size_t size, int clock, size_t *firstPhaseShif
     uint16_t peaksdet[] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
 
     //find start of modulating data in trace
-    size_t i = findModStart(dest, size, *fc);
+    size_t i = findModStart(ctx, dest, size, *fc);
 
     firstFullWave = pskFindFirstPhaseShift(dest, size, curPhase, i, *fc, &fullWaveLen);
     if (firstFullWave == 0) {
@@ -1054,6 +1084,10 @@ int DetectPSKClock(uint8_t *dest, size_t size, int clock, size_t *firstPhaseShif
     return clk[best];
 }
 
+int DetectPSKClock(uint8_t *dest, size_t size, int clock, size_t *firstPhaseShift, uint8_t *curPhase, uint8_t *fc) {
+    return DetectPSKClock_ctx(&lfdemod_default, dest, size, clock, firstPhaseShift, curPhase, fc);
+}
+
 //by marshmellow
 //detects the bit clock for FSK given the high and low Field Clocks
 uint8_t detectFSKClk(uint8_t *bits, size_t size, uint8_t fcHigh, uint8_t fcLow, int *firstClockEdge) {
@@ -1190,7 +1224,7 @@ static bool findST(int *stStopLoc, int *stStartIdx, int lowToLowWaveLen[], int h
 }
 //by marshmellow
 //attempt to identify a Sequence Terminator in ASK modulated raw wave
-bool DetectST(uint8_t *buffer, size_t *size, int *foundclock, size_t *ststart, size_t *stend) {
+bool DetectST_ctx(lfdemod_ctx_t *ctx, uint8_t *buffer, size_t *size, int *foundclock, size_t *ststart, size_t *stend) {
     size_t bufsize = *size;
     //need to loop through all samples and identify our clock, look for the ST pattern
     int clk = 0;
@@ -1206,7 +1240,7 @@ bool DetectST(uint8_t *buffer, size_t *size, int *foundclock, size_t *ststart, s
     memset(tmpbuff, 0, sizeof(tmpbuff));
     memset(waveLen, 0, sizeof(waveLen));
 
-    if (!loadWaveCounters(buffer, bufsize, tmpbuff, waveLen, &j, &skip, &minClk, &high, &low)) return false;
+    if (!loadWaveCounters_ctx(ctx, buffer, bufsize, tmpbuff, waveLen, &j, &skip, &minClk, &high, &low)) return false;
     // set clock  - might be able to get this externally and remove this work...
     clk = getClosestClock(minClk);
     // clock not found - ERROR
@@ -1312,6 +1346,10 @@ bool DetectST(uint8_t *buffer, size_t *size, int *foundclock, size_t *ststart, s
     return true;
 }
 
+bool DetectST(uint8_t *buffer, size_t *size, int *foundclock, size_t *ststart, size_t *stend) {
+    return DetectST_ctx(&lfdemod_default, buffer, size, foundclock, ststart, stend);
+}
+
 //by marshmellow
 //take 11 10 01 11 00 and make 01100 ... miller decoding
 //check for phase errors - should never have half a 1 or 0 by itself and should never exceed 1111 or 0000 in a row
@@ -1533,16 +1571,16 @@ static uint16_t cleanAskRawDemod(uint8_t *bits, size_t *size, int clk, int inver
 
 //by marshmellow
 //attempts to demodulate ask modulations, askType == 0 for ask/raw, askType==1 for ask/manchester
-int askdemod_ext(uint8_t *bits, size_t *size, int *clk, int *invert, int maxErr, uint8_t amp, uint8_t askType, int *startIdx) {
+int askdemod_ext_ctx(lfdemod_ctx_t *ctx, uint8_t *bits, size_t *size, int *clk, int *invert, int maxErr, uint8_t amp, uint8_t askType, int *startIdx) {
 
     if (*size == 0) return -1;
 
-    if (signalprop.isnoise) {
+    if (ctx->signal.isnoise) {
         if (g_debugMode == 2) prnt("DEBUG (askdemod_ext) just noise detected - aborting");
         return -2;
     }
 
-    int start = DetectASKClock(bits, *size, clk, maxErr);
+    int start = DetectASKClock_ctx(ctx, bits, *size, clk, maxErr);
     if (*clk == 0 || start < 0) return -3;
 
     if (*invert != 1) *invert = 0;
@@ -1556,7 +1594,7 @@ int askdemod_ext(uint8_t *bits, size_t *size, int *clk, int *invert, int maxErr,
     // Detect high and lows
     //25% clip in case highs and lows aren't clipped [marshmellow]
     int high, low;
-    getHiLo(&high, &low, 75, 75);
+    getHiLo_ctx(ctx, &high, &low, 75, 75);
 
     size_t errCnt = 0;
     // if clean clipped waves detected run alternate demod
@@ -1625,6 +1663,10 @@ int askdemod_ext(uint8_t *bits, size_t *size, int *clk, int *invert, int maxErr,
     return errCnt;
 }
 
+int askdemod_ext(uint8_t *bits, size_t *size, int *clk, int *invert, int maxErr, uint8_t amp, uint8_t askType, int *startIdx) {
+    return askdemod_ext_ctx(&lfdemod_default, bits, size, clk, invert, maxErr, amp, askType, startIdx);
+}
+
 int askdemod(uint8_t *bits, size_t *size, int *clk, int *invert, int maxErr, uint8_t amp, uint8_t askType) {
     int start = 0;
     return askdemod_ext(bits, size, clk, invert, maxErr, amp, askType, &start);
@@ -1632,22 +1674,22 @@ int askdemod(uint8_t *bits, size_t *size, int *clk, int *invert, int maxErr, uin
 
 // by marshmellow - demodulate NRZ wave - requires a read with strong signal
 // peaks invert bit (high=1 low=0) each clock cycle = 1 bit determined by last peak
-int nrzRawDemod(uint8_t *dest, size_t *size, int *clk, int *invert, int *startIdx) {
+int nrzRawDemod_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t *size, int *clk, int *invert, int *startIdx) {
 
-    if (signalprop.isnoise) {
+    if (ctx->signal.isnoise) {
         if (g_debugMode == 2) prnt("DEBUG nrzRawDemod: just noise detected - quitting");
         return -1;
     }
 
     size_t clkStartIdx = 0;
-    *clk = DetectNRZClock(dest, *size, *clk, &clkStartIdx);
+    *clk = DetectNRZClock_ctx(ctx, dest, *size, *clk, &clkStartIdx);
     if (*clk == 0) return -2;
 
     size_t i;
     int high, low;
 
-    getHiLo(&high, &low, 75, 75);
-    getHiLo(&high, &low, 75, 75);
+    getHiLo_ctx(ctx, &high, &low, 75, 75);
+    getHiLo_ctx(ctx, &high, &low, 75, 75);
 
     uint8_t bit = 0;
     //convert wave samples to 1's and 0's
@@ -1675,8 +1717,12 @@ int nrzRawDemod(uint8_t *dest, size_t *size, int *clk, int *invert, int *startId
     return 0;
 }
 
+int nrzRawDemod(uint8_t *dest, size_t *size, int *clk, int *invert, int *startIdx) {
+    return nrzRawDemod_ctx(&lfdemod_default, dest, size, clk, invert, startIdx);
+}
+
 //translate wave to 11111100000 (1 for each short wave [higher freq] 0 for each long wave [lower freq])
-static size_t fsk_wave_demod(uint8_t *dest, size_t size, uint8_t fchigh, uint8_t fclow, int *startIdx) {
+static size_t fsk_wave_demod(lfdemod_ctx_t *ctx, uint8_t *dest, size_t size, uint8_t fchigh, uint8_t fclow, int *startIdx) {
 
     if (size < 1024) return 0;   // not enough samples
 
@@ -1689,9 +1735,9 @@ static size_t fsk_wave_demod(uint8_t *dest, size_t size, uint8_t fchigh, uint8_t
     size_t idx, numBits = 0;
 
     //find start of modulating data in trace
-    idx = findModStart(dest, size, fchigh);
+    idx = findModStart(ctx, dest, size, fchigh);
     // Need to threshold first sample
-    dest[idx] = (dest[idx] < signalprop.mean) ? 0 : 1;
+    dest[idx] = (dest[idx] < ctx->signal.mean) ? 0 : 1;
 
     last_transition = idx;
     idx++;
@@ -1729,7 +1775,7 @@ static size_t fsk_wave_demod(uint8_t *dest, size_t size, uint8_t fchigh, uint8_t
     for (; idx < size - 20; idx++) {
 
         // threshold current value
-        dest[idx] = (dest[idx] < signalprop.mean) ? 0 : 1;
+        dest[idx] = (dest[idx] < ctx->signal.mean) ? 0 : 1;
 
         // Check for 0->1 transition
         if (dest[idx - 1] < dest[idx]) {
@@ -1831,16 +1877,20 @@ static size_t aggregate_bits(uint8_t *dest, size_t size, uint8_t clk, uint8_t in
 
 //by marshmellow  (from holiman's base)
 // full fsk demod from GraphBuffer wave to decoded 1s and 0s (no mandemod)
-size_t fskdemod(uint8_t *dest, size_t size, uint8_t rfLen, uint8_t invert, uint8_t fchigh, uint8_t fclow, int *start_idx) {
-    if (signalprop.isnoise) return 0;
+size_t fskdemod_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t size, uint8_t rfLen, uint8_t invert, uint8_t fchigh, uint8_t fclow, int *start_idx) {
+    if (ctx->signal.isnoise) return 0;
     // FSK demodulator
-    size = fsk_wave_demod(dest, size, fchigh, fclow, start_idx);
+    size = fsk_wave_demod(ctx, dest, size, fchigh, fclow, start_idx);
     if (g_debugMode == 2) prnt("DEBUG (fskdemod) got %zu bits", size);
     size = aggregate_bits(dest, size, rfLen, invert, fchigh, fclow, start_idx);
     if (g_debugMode == 2) prnt("DEBUG (fskdemod) got %zu bits", size);
     return size;
 }
 
+size_t fskdemod(uint8_t *dest, size_t size, uint8_t rfLen, uint8_t invert, uint8_t fchigh, uint8_t fclow, int *start_idx) {
+    return fskdemod_ctx(&lfdemod_default, dest, size, rfLen, invert, fchigh, fclow, start_idx);
+}
+
 // by marshmellow
 // convert psk1 demod to psk2 demod
 // only transition waves are 1s
@@ -1876,7 +1926,7 @@ void psk2TOpsk1(uint8_t *bits, size_t size) {
 //by marshmellow - demodulate PSK1 wave
 //uses wave lengths (# Samples)
 //TODO: Iceman - hard coded value 7,  should be #define
-int pskRawDemod_ext(uint8_t *dest, size_t *size, int *clock, int *invert, int *startIdx) {
+int pskRawDemod_ext_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t *size, int *clock, int *invert, int *startIdx) {
 
     // sanity check
     if (*size < 170) return -1;
@@ -1887,13 +1937,13 @@ int pskRawDemod_ext(uint8_t *dest, size_t *size, int *clock, int *invert, int *s
     uint16_t fullWaveLen = 0, waveLenCnt, avgWaveVal = 0;
     uint16_t errCnt = 0, errCnt2 = 0;
 
-    *clock = DetectPSKClock(dest, *size, *clock, &firstFullWave, &curPhase, &fc);
+    *clock = DetectPSKClock_ctx(ctx, dest, *size, *clock, &firstFullWave, &curPhase, &fc);
     if (*clock <= 0) return -1;
     //if clock detect found firstfullwave...
     uint16_t tol = fc / 2;
     if (firstFullWave == 0) {
         //find start of modulating data in trace
-        i = findModStart(dest, *size, fc);
+        i = findModStart(ctx, dest, *size, fc);
         //find first phase shift
         firstFullWave = pskFindFirstPhaseShift(dest, *size, &curPhase, i, fc, &fullWaveLen);
         if (firstFullWave == 0) {
@@ -1967,6 +2017,10 @@ int pskRawDemod_ext(uint8_t *dest, size_t *size, int *clock, int *invert, int *s
     return errCnt;
 }
 
+int pskRawDemod_ext(uint8_t *dest, size_t *size, int *clock, int *invert, int *startIdx) {
+    return pskRawDemod_ext_ctx(&lfdemod_default, dest, size, clock, invert, startIdx);
+}
+
 int pskRawDemod(uint8_t *dest, size_t *size, int *clock, int *invert) {
     int start_idx = 0;
     return pskRawDemod_ext(dest, size, clock, invert, &start_idx);
@@ -1980,14 +2034,14 @@ int pskRawDemod(uint8_t *dest, size_t *size, int *clock, int *invert) {
 
 // by marshmellow
 // FSK Demod then try to locate an AWID ID
-int detectAWID(uint8_t *dest, size_t *size, int *waveStartIdx) {
+int detectAWID_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t *size, int *waveStartIdx) {
     //make sure buffer has enough data (96bits * 50clock samples)
     if (*size < 96 * 50) return -1;
 
-    if (signalprop.isnoise) return -2;
+    if (ctx->signal.isnoise) return -2;
 
     // FSK2a demodulator  clock 50, invert 1, fcHigh 10, fcLow 8
-    *size = fskdemod(dest, *size, 50, 1, 10, 8, waveStartIdx); //awid fsk2a
+    *size = fskdemod_ctx(ctx, dest, *size, 50, 1, 10, 8, waveStartIdx); //awid fsk2a
 
     //did we get a good demod?
     if (*size < 96) return -3;
@@ -2003,6 +2057,10 @@ int detectAWID(uint8_t *dest, size_t *size, int *waveStartIdx) {
     return (int)start_idx;
 }
 
+int detectAWID(uint8_t *dest, size_t *size, int *waveStartIdx) {
+    return detectAWID_ctx(&lfdemod_default, dest, size, waveStartIdx);
+}
+
 //by marshmellow
 //takes 1s and 0s and searches for EM410x format - output EM ID
 int Em410xDecode(uint8_t *bits, size_t *size, size_t *start_idx, uint32_t *hi, uint64_t *lo) {
@@ -2046,14 +2104,14 @@ int Em410xDecode(uint8_t *bits, size_t *size, size_t *start_idx, uint32_t *hi, u
 
 
 // loop to get raw HID waveform then FSK demodulate the TAG ID from it
-int HIDdemodFSK(uint8_t *dest, size_t *size, uint32_t *hi2, uint32_t *hi, uint32_t *lo, int *waveStartIdx) {
+int HIDdemodFSK_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t *size, uint32_t *hi2, uint32_t *hi, uint32_t *lo, int *waveStartIdx) {
     //make sure buffer has data
     if (*size < 96 * 50) return -1;
 
-    if (signalprop.isnoise) return -2;
+    if (ctx->signal.isnoise) return -2;
 
     // FSK demodulator  fsk2a so invert and fc/10/8
-    *size = fskdemod(dest, *size, 50, 1, 10, 8, waveStartIdx); //hid fsk2a
+    *size = fskdemod_ctx(ctx, dest, *size, 50, 1, 10, 8, waveStartIdx); //hid fsk2a
 
     //did we get a good demod?
     if (*size < 96 * 2) return -3;
@@ -2085,13 +2143,17 @@ int HIDdemodFSK(uint8_t *dest, size_t *size, uint32_t *hi2, uint32_t *hi, uint32
     return (int)start_idx;
 }
 
+int HIDdemodFSK(uint8_t *dest, size_t *size, uint32_t *hi2, uint32_t *hi, uint32_t *lo, int *waveStartIdx) {
+    return HIDdemodFSK_ctx(&lfdemod_default, dest, size, hi2, hi, lo, waveStartIdx);
+}
+
 // Find IDTEC PSK1, RF  Preamble == 0x4944544B, Demodsize 64bits
 // by iceman
-int detectIdteck(uint8_t *dest, size_t *size) {
+int detectIdteck_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t *size) {
     //make sure buffer has data
     if (*size < 64 * 2) return -1;
 
-    if (signalprop.isnoise) return -2;
+    if (ctx->signal.isnoise) return -2;
 
     size_t start_idx = 0;
     uint8_t preamble[] = {0, 1, 0, 0, 1, 0, 0, 1, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 1, 0, 1, 0, 0, 0, 1, 0, 0, 1, 0, 1, 1};
@@ -2105,14 +2167,18 @@ int detectIdteck(uint8_t *dest, size_t *size) {
     return (int)start_idx;
 }
 
-int detectIOProx(uint8_t *dest, size_t *size, int *waveStartIdx) {
+int detectIdteck(uint8_t *dest, size_t *size) {
+    return detectIdteck_ctx(&lfdemod_default, dest, size);
+}
+
+int detectIOProx_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t *size, int *waveStartIdx) {
     //make sure buffer has data
     if (*size < 66 * 64) return -1;
 
-    if (signalprop.isnoise) return -2;
+    if (ctx->signal.isnoise) return -2;
 
     // FSK demodulator  RF/64, fsk2a so invert, and fc/10/8
-    *size = fskdemod(dest, *size, 64, 1, 10, 8, waveStartIdx);  //io fsk2a
+    *size = fskdemod_ctx(ctx, dest, *size, 64, 1, 10, 8, waveStartIdx);  //io fsk2a
 
     //did we get enough demod data?
     if (*size < 64) return -3;
@@ -2146,3 +2212,7 @@ int detectIOProx(uint8_t *dest, size_t *size, int *waveStartIdx) {
     }
     return -6;
 }
+
+int detectIOProx(uint8_t *dest, size_t *size, int *waveStartIdx) {
+    return detectIOProx_ctx(&lfdemod_default, dest, size, waveStartIdx);
+}
@@ -33,6 +33,31 @@ typedef struct {
 } signal_t;
 signal_t *getSignalProperties(void);
 
+// demodulation state of one sample buffer.
+// The plain functions below share one static context, the _ctx variants
+// let independent buffers be demodulated at the same time (e.g. one context per thread).
+typedef struct {
+    signal_t signal;
+} lfdemod_ctx_t;
+
+void     lfdemod_ctx_init(lfdemod_ctx_t *ctx);
+signal_t *getSignalProperties_ctx(lfdemod_ctx_t *ctx);
+void     computeSignalProperties_ctx(lfdemod_ctx_t *ctx, uint8_t *samples, uint32_t size);
+void     getHiLo_ctx(lfdemod_ctx_t *ctx, int *high, int *low, uint8_t fuzzHi, uint8_t fuzzLo);
+bool     loadWaveCounters_ctx(lfdemod_ctx_t *ctx, uint8_t *samples, size_t size, int lowToLowWaveLen[], int highToLowWaveLen[], int *waveCnt, int *skip, int *minClk, int *high, int *low);
+int      askdemod_ext_ctx(lfdemod_ctx_t *ctx, uint8_t *bits, size_t *size, int *clk, int *invert, int maxErr, uint8_t amp, uint8_t askType, int *startIdx);
+int      DetectASKClock_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t size, int *clock, int maxErr);
+int      DetectNRZClock_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t size, int clock, size_t *clockStartIdx);
+int      DetectPSKClock_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t size, int clock, size_t *firstPhaseShift, uint8_t *curPhase, uint8_t *fc);
+bool     DetectST_ctx(lfdemod_ctx_t *ctx, uint8_t *buffer, size_t *size, int *foundclock, size_t *ststart, size_t *stend);
+size_t   fskdemod_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t size, uint8_t rfLen, uint8_t invert, uint8_t fchigh, uint8_t fclow, int *start_idx);
+int      nrzRawDemod_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t *size, int *clk, int *invert, int *startIdx);
+int      pskRawDemod_ext_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t *size, int *clock, int *invert, int *startIdx);
+int      detectAWID_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t *size, int *waveStartIdx);
+int      HIDdemodFSK_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t *size, uint32_t *hi2, uint32_t *hi, uint32_t *lo, int *waveStartIdx);
+int      detectIdteck_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t *size);
+int      detectIOProx_ctx(lfdemod_ctx_t *ctx, uint8_t *dest, size_t *size, int *waveStartIdx);
+
 void computeSignalProperties(uint8_t *samples, uint32_t size);
 void removeSignalOffset(uint8_t *samples, uint32_t size);
 void getNextLow(uint8_t *samples, size_t size, int low, size_t *i);
@@ -0,0 +1,60 @@
+#include "radixsort.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+uint64_t *radixSort(uint64_t *array, uint32_t size) {
+    rscounts_t counts;
+    memset(&counts, 0, 256 * 8 * sizeof(uint32_t));
+    if (size < 2)
+        return array;
+
+    uint64_t *cpy = (uint64_t *)calloc(size * sizeof(uint64_t), sizeof(uint8_t));
+    if (cpy == NULL)
+        return NULL;
+
+    // calculate counts, c8 is the lowest byte
+    uint32_t x;
+    for (x = 0; x < size; ++x) {
+        uint64_t v = array[x];
+        counts.c8[v & 0xff]++;
+        counts.c7[(v >> 8) & 0xff]++;
+        counts.c6[(v >> 16) & 0xff]++;
+        counts.c5[(v >> 24) & 0xff]++;
+        counts.c4[(v >> 32) & 0xff]++;
+        counts.c3[(v >> 40) & 0xff]++;
+        counts.c2[(v >> 48) & 0xff]++;
+        counts.c1[(v >> 56) & 0xff]++;
+    }
+
+    uint64_t *src = array, *dst = cpy;
+    for (uint8_t pass = 0; pass < 8; pass++) {
+        uint32_t *c = counts.counts + (256 * pass);
+        uint8_t shift = pass * 8;
+
+        // a byte that is equal in all values doesn't change the order
+        if (c[(src[0] >> shift) & 0xff] == size)
+            continue;
+
+        // convert counts to offsets
+        uint32_t o = 0;
+        for (x = 0; x < 256; ++x) {
+            uint32_t t = o + c[x];
+            c[x] = o;
+            o = t;
+        }
+        // radix
+        for (x = 0; x < size; ++x) {
+            uint32_t t = (src[x] >> shift) & 0xff;
+            dst[c[t]++] = src[x];
+        }
+        uint64_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != array)
+        memcpy(array, src, size * sizeof(uint64_t));
+    free(cpy);
+    return array;
+}
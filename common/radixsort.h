@@ -17,6 +17,8 @@ typedef union {
     uint32_t counts[256 * 8];
 } rscounts_t;
 
+// LSD radix sort, ascending. Bytes that are the same in every value are skipped.
+// Returns array, or NULL when the scratch buffer can't be allocated.
 uint64_t *radixSort(uint64_t *array, uint32_t size);
 
 #endif // RADIXSORT_H__
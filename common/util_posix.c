@@ -135,3 +135,33 @@ uint64_t msclock(void) {
 #endif
 }
 
+// a microseconds timer for latency measurement
+uint64_t usclock(void) {
+#if defined(_WIN32)
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (uint64_t)(count.QuadPart / freq.QuadPart) * 1000000 + (uint64_t)(count.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (1000000 * (uint64_t)t.tv_sec + t.tv_nsec / 1000);
+#endif
+}
+
+// absolute wall clock time, ms milliseconds from now, e.g. for pthread_cond_timedwait()
+void msdeadline(struct timespec *ts, uint32_t ms) {
+#if defined(_WIN32)
+    uint64_t now = msclock() + ms;
+    ts->tv_sec = now / 1000;
+    ts->tv_nsec = (now % 1000) * 1000000;
+#else
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+#endif
+}
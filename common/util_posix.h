@@ -22,5 +22,8 @@ void msleep(uint32_t n); // sleep n milliseconds
 #endif // _WIN32
 
 uint64_t msclock(void);      // a milliseconds clock
+uint64_t usclock(void);      // a microseconds clock
+struct timespec;
+void msdeadline(struct timespec *ts, uint32_t ms); // wall clock deadline ms milliseconds from now
 
 #endif
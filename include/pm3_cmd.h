@@ -187,7 +187,6 @@ typedef struct {
     bool hw_available_smartcard        : 1;
 } PACKED capabilities_t;
 #define CAPABILITIES_VERSION 3
-extern capabilities_t pm3_capabilities;
 
 // For CMD_LF_T55XX_WRITEBL
 typedef struct {
@@ -392,6 +391,7 @@ typedef struct {
 #define CMD_HF_ISO14443B_SNIFF                                            0x0382
 
 #define CMD_HF_ISO14443A_SNIFF                                            0x0383
+#define CMD_HF_ISO14443A_SNIFF_STREAM                                     0x0386
 #define CMD_HF_ISO14443A_SIMULATE                                         0x0384
 
 #define CMD_HF_ISO14443A_READER                                           0x0385
@@ -504,6 +504,10 @@ typedef struct {
 #define FLAG_FORCED_ATQA        0x800
 #define FLAG_FORCED_SAK         0x1000
 
+//Mifare nested flags (arg2)
+#define NESTED_CALIBRATE        0x01
+#define NESTED_EXTRA_NONCE      0x02
+
 //Iclass reader flags
 #define FLAG_ICLASS_READER_ONLY_ONCE   0x01
 #define FLAG_ICLASS_READER_CC          0x02
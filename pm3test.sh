@@ -92,11 +92,15 @@ while true; do
 
   printf "\n${C_BLUE}Testing LF:${C_NC}\n"
   if ! CheckExecute "lf em4x05 test" "./client/proxmark3 -c 'data load traces/em4x05.pm3;lf search'" "FDX-B ID found"; then break; fi
+  if ! CheckExecute "lf classify test" "./client/proxmark3 -c 'lf classify d traces t 4'" "identified 23 "; then break; fi
+  if ! CheckExecute "lf classify keeps graph" "./client/proxmark3 -c 'data load traces/em4x05.pm3;lf classify d traces t 4;lf search'" "FDX-B ID found"; then break; fi
+  if ! CheckExecute "lf hitag crack test" "./client/proxmark3 -c 'lf hitag crack u 49435769 n 656E457228DC8031 n 12345678B0C4A17B p 4F4E4D'" "found valid key \[ 4F4E4D494B52 \]"; then break; fi
 
   printf "\n${C_BLUE}Testing HF:${C_NC}\n"
   if ! CheckExecute "hf mf offline text" "./client/proxmark3 -c 'hf mf'" "at_enc"; then break; fi
   if ! CheckExecute "hf mf hardnested test" "./client/proxmark3 -c 'hf mf hardnested t 1 000000000000'" "found:" "repeat" "ignore"; then break; fi
   if ! CheckExecute "hf iclass test" "./client/proxmark3 -c 'hf iclass loclass t'" "verified ok"; then break; fi
+  if ! CheckExecute "dictionary test" "./client/proxmark3 -c 'analyse dict t'" "dictionary tests ok"; then break; fi
   if ! CheckExecute "emv test" "./client/proxmark3 -c 'emv test'" "Test(s) \[ OK"; then break; fi
 
   printf "\n${C_BLUE}Testing tools:${C_NC}\n"
@@ -104,7 +108,28 @@ while true; do
   if ! CheckExecute "mfkey32v2 test" "tools/mfkey/mfkey32v2 12345678 1AD8DF2B 1D316024 620EF048 30D6CB07 C52077E2 837AC61A" "Found Key: \[a0a1a2a3a4a5\]"; then break; fi
   if ! CheckExecute "mfkey64 test" "tools/mfkey/mfkey64 9c599b32 82a4166c a1e458ce 6eea41e0 5cadf439" "Found Key: \[ffffffffffff\]"; then break; fi
   if ! CheckExecute "mfkey64 long trace test" "tools/mfkey/./mfkey64 14579f69 ce844261 f8049ccb 0525c84f 9431cc40 7093df99 9972428ce2e8523f456b99c831e769dced09 8ca6827b ab797fd369e8b93a86776b40dae3ef686efd c3c381ba 49e2c9def4868d1777670e584c27230286f4 fbdcd7c1 4abd964b07d3563aa066ed0a2eac7f6312bf 9f9149ea" "Found Key: \[091e639cb715\]"; then break; fi
+  if ! CheckExecute "mfkey_batch test" "printf '12345678 1AD8DF2B 1D316024 620EF048 30D6CB07 C52077E2 837AC61A\\n9c599b32 82a4166c a1e458ce 6eea41e0 5cadf439\\n' | tools/mfkey/mfkey_batch -" "Recovered 2 of 2 keys"; then break; fi
   if ! CheckExecute "nonce2key test" "tools/nonce2key/nonce2key e9cadd9c a8bf4a12 a020a8285858b090 050f010607060e07 5693be6c00000000" "key recovered: fc00018778f7"; then break; fi
+
+  printf "\n${C_BLUE}Testing with a virtual device:${C_NC}\n"
+  if ! CheckFileExist "pm3vdev exists" "./tools/pm3vdev/pm3vdev"; then break; fi
+  # 100 REQA records, streamed by `hf 14a sniff s` in chunks that split records
+  for I in $(seq 100); do printf '\x00\x00\x00\x00\x10\x00\x01\x00\x26\x00'; done > /tmp/pm3vdev-sniff.trace
+  rm -f /tmp/pm3vdev-sniff-out.trace
+  ./tools/pm3vdev/pm3vdev -l /tmp/pm3vdev-test -t /tmp/pm3vdev-sniff.trace > /dev/null &
+  VDEV_PID=$!
+  sleep 1
+  if ! CheckExecute "virtual device ping" "./client/proxmark3 /tmp/pm3vdev-test -c 'hw ping'" "Ping response received"; then kill -INT $VDEV_PID; break; fi
+  if ! CheckExecute "virtual device fchk" "./client/proxmark3 /tmp/pm3vdev-test -c 'hf mf fchk 1'" "found 32/32 keys"; then kill -INT $VDEV_PID; break; fi
+  if ! CheckExecute "virtual device chk" "./client/proxmark3 /tmp/pm3vdev-test -c 'hf mf chk *1 ? client/dictionaries/mfc_default_keys.dic'" "|015|  ffffffffffff  | 1 |  ffffffffffff  | 1 |"; then kill -INT $VDEV_PID; break; fi
+  if ! CheckExecute "virtual device sniff stream" "./client/proxmark3 /tmp/pm3vdev-test -c 'hf 14a sniff s /tmp/pm3vdev-sniff-out.trace'; cmp /tmp/pm3vdev-sniff.trace /tmp/pm3vdev-sniff-out.trace && echo 'stream ok'" "stream ok"; then kill -INT $VDEV_PID; break; fi
+  if ! CheckExecute "virtual device link stats" "./client/proxmark3 /tmp/pm3vdev-test -c 'hw ping; hw stats j'" "p50_us"; then kill -INT $VDEV_PID; break; fi
+  ./tools/pm3vdev/pm3vdev -l /tmp/pm3vdev-test2 > /dev/null &
+  VDEV2_PID=$!
+  sleep 1
+  if ! CheckExecute "virtual device fanout" "./client/proxmark3 /tmp/pm3vdev-test -c 'hw attach p /tmp/pm3vdev-test2; hw fanout hf mf fchk 1'" "1 | *ok"; then kill -INT $VDEV_PID $VDEV2_PID; break; fi
+  if ! CheckExecute "virtual device fanout refuses select" "./client/proxmark3 /tmp/pm3vdev-test -c 'hw attach p /tmp/pm3vdev-test2; hw fanout hw select 0'" "can't run in hw fanout"; then kill -INT $VDEV_PID $VDEV2_PID; break; fi
+  kill -INT $VDEV_PID $VDEV2_PID
   printf "\n${C_GREEN}Tests [OK]${C_NC}\n\n"
   exit 0
 done
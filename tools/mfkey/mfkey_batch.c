@@ -0,0 +1,675 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// MIFARE Classic batch key recovery (mfkey32 / mfkey32v2 / mfkey64)
+//
+// Reads any number of text files containing
+//  - nonce sets, one per line, 8 hex digit words separated by blanks, commas or semicolons
+//      [<sector>:<A|B>] <uid> <nt> <{nr}> <{ar}> <{at}>                      (mfkey64)
+//      [<sector>:<A|B>] <uid> <nt> <{nr_0}> <{ar_0}> <{nr_1}> <{ar_1}>       (mfkey32)
+//      [<sector>:<A|B>] <uid> <nt> <{nr_0}> <{ar_0}> <nt1> <{nr_1}> <{ar_1}> (mfkey32v2)
+//    leading words like "./mfkey32v2" or "[=]" are skipped, so tool command lines
+//    and client logs (hf mf sim v) can be fed directly.
+//  - text traces ("RDR .." / "TAG .." lines, the ":: TRACE" format and the
+//    "hf list mf" table). Every plain authentication in them becomes a mfkey64 set.
+//
+// Identical sets are dropped and sets are grouped per uid / sector / key type,
+// so every key is solved once, cheapest method first. The candidates of a solve
+// are checked against the other sets of the group. Groups are solved on a pool
+// of worker threads, spare threads split the state recovery of each key.
+//-----------------------------------------------------------------------------
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "crapto1/crapto1.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define UNKNOWN             0xff
+#define MAX_LINE_LEN        1024
+#define MAX_CANDIDATES      20      // mfkey32 candidates kept per set
+#define MAX_THREADS         64
+// every lfsr_recovery32 worker needs ~50 MB, at most this many run at once over all targets
+#define MAX_RECOVERY_WORKERS 8
+
+typedef enum {
+    METHOD_MFKEY64 = 0,     // cheapest first
+    METHOD_MFKEY32,
+    METHOD_MFKEY32V2,
+} method_t;
+
+static const char *method_names[] = {"mfkey64", "mfkey32", "mfkey32v2"};
+
+typedef struct {
+    uint8_t method;
+    uint8_t sector;         // UNKNOWN if not given
+    uint8_t keytype;        // 0 = A, 1 = B, UNKNOWN if not given
+    uint32_t uid;
+    uint32_t nt0, nr0, ar0;
+    uint32_t nt1, nr1, ar1; // mfkey32 / mfkey32v2
+    uint32_t at;            // mfkey64
+} nonce_set_t;
+
+typedef struct {
+    nonce_set_t *first;     // sets of one uid / sector / key type, sorted by method
+    uint32_t count;
+    bool found;
+    uint64_t key;
+    uint8_t method;
+    uint32_t verified;      // sets matching the key
+} target_t;
+
+static nonce_set_t *sets = NULL;
+static uint32_t num_sets = 0;
+static uint32_t max_sets = 0;
+
+static target_t *targets = NULL;
+static uint32_t num_targets = 0;
+static uint32_t next_target = 0;
+
+static int num_CPUs(void) {
+#if defined(_WIN32)
+    SYSTEM_INFO sysinfo;
+    GetSystemInfo(&sysinfo);
+    return sysinfo.dwNumberOfProcessors;
+#else
+    int count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count <= 0)
+        count = 1;
+    return count;
+#endif
+}
+
+static bool add_set(const nonce_set_t *set) {
+    if (num_sets == max_sets) {
+        uint32_t new_max = max_sets ? max_sets * 2 : 1024;
+        nonce_set_t *tmp = realloc(sets, new_max * sizeof(nonce_set_t));
+        if (tmp == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return false;
+        }
+        sets = tmp;
+        max_sets = new_max;
+    }
+    sets[num_sets++] = *set;
+    return true;
+}
+
+static uint8_t block_to_sector(uint8_t block) {
+    if (block < 128)
+        return block / 4;
+    return 32 + (block - 128) / 16;
+}
+
+//-----------------------------------------------------------------------------
+// key recovery, same as client/mifare/mfkey.c
+//-----------------------------------------------------------------------------
+// true if key gives the encrypted reader answer {ar} (and tag answer {at}) of this authentication
+static bool check_auth(uint64_t key, uint32_t uid, uint32_t nt, uint32_t nr, uint32_t ar, const uint32_t *at) {
+    struct Crypto1State *s = crypto1_create(key);
+    if (s == NULL)
+        return false;
+
+    crypto1_word(s, uid ^ nt, 0);
+    crypto1_word(s, nr, 1);
+    bool ok = (ar == (crypto1_word(s, 0, 0) ^ prng_successor(nt, 64)));
+    if (ok && at)
+        ok = (*at == (crypto1_word(s, 0, 0) ^ prng_successor(nt, 96)));
+    crypto1_destroy(s);
+    return ok;
+}
+
+// true if key is the one of every authentication in the set
+static bool check_set(const nonce_set_t *n, uint64_t key) {
+    if (n->method == METHOD_MFKEY64)
+        return check_auth(key, n->uid, n->nt0, n->nr0, n->ar0, &n->at);
+    return check_auth(key, n->uid, n->nt0, n->nr0, n->ar0, NULL) && check_auth(key, n->uid, n->nt1, n->nr1, n->ar1, NULL);
+}
+
+// threads lfsr_recovery32_mt may use per target, the spare ones when there are fewer targets than threads
+static int recovery_threads = 1;
+
+// recovery workers running, bounded by MAX_RECOVERY_WORKERS
+static pthread_mutex_t recovery_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t recovery_done = PTHREAD_COND_INITIALIZER;
+static int recovery_workers = 0;
+
+static void recovery_acquire(int workers) {
+    pthread_mutex_lock(&recovery_lock);
+    while (recovery_workers + workers > MAX_RECOVERY_WORKERS)
+        pthread_cond_wait(&recovery_done, &recovery_lock);
+    recovery_workers += workers;
+    pthread_mutex_unlock(&recovery_lock);
+}
+
+static void recovery_release(int workers) {
+    pthread_mutex_lock(&recovery_lock);
+    recovery_workers -= workers;
+    pthread_cond_broadcast(&recovery_done);
+    pthread_mutex_unlock(&recovery_lock);
+}
+
+// candidates matching both authentications of the set, up to MAX_CANDIDATES
+static uint32_t solve_mfkey32(const nonce_set_t *n, uint64_t *keys) {
+    struct Crypto1State *s, *t;
+    uint64_t key = 0;
+    uint32_t counter = 0;
+    uint32_t p640 = prng_successor(n->nt0, 64);
+    uint32_t p641 = prng_successor(n->nt1, 64);
+
+    recovery_acquire(recovery_threads);
+    s = lfsr_recovery32_mt(n->ar0 ^ p640, 0, recovery_threads);
+    recovery_release(recovery_threads);
+    if (s == NULL)
+        return 0;
+
+    for (t = s; t->odd | t->even; ++t) {
+        lfsr_rollback_word(t, 0, 0);
+        lfsr_rollback_word(t, n->nr0, 1);
+        lfsr_rollback_word(t, n->uid ^ n->nt0, 0);
+        crypto1_get_lfsr(t, &key);
+        crypto1_word(t, n->uid ^ n->nt1, 0);
+        crypto1_word(t, n->nr1, 1);
+        if (n->ar1 == (crypto1_word(t, 0, 0) ^ p641)) {
+            keys[counter] = key;
+            if (++counter == MAX_CANDIDATES)
+                break;
+        }
+    }
+    free(s);
+    return counter;
+}
+
+static uint32_t solve_mfkey64(const nonce_set_t *n, uint64_t *keys) {
+    uint32_t ks2 = n->ar0 ^ prng_successor(n->nt0, 64);
+    uint32_t ks3 = n->at ^ prng_successor(n->nt0, 96);
+    struct Crypto1State *revstate = lfsr_recovery64(ks2, ks3);
+    if (revstate == NULL)
+        return 0;
+
+    lfsr_rollback_word(revstate, 0, 0);
+    lfsr_rollback_word(revstate, 0, 0);
+    lfsr_rollback_word(revstate, n->nr0, 1);
+    lfsr_rollback_word(revstate, n->uid ^ n->nt0, 0);
+    crypto1_get_lfsr(revstate, &keys[0]);
+    crypto1_destroy(revstate);
+
+    // the rollback must lead to a key which gives {ar} and {at} again
+    return check_set(n, keys[0]) ? 1 : 0;
+}
+
+// Solves one set of the target, cheapest first, and checks its candidates against the
+// other sets instead of solving those too. A key is taken if it is the only candidate
+// matching the most sets. A single mfkey32 set needs a single candidate.
+static void solve_target(target_t *target) {
+    uint64_t keys[MAX_CANDIDATES];
+
+    for (uint32_t j = 0; j < target->count && !target->found; j++) {
+        const nonce_set_t *n = &target->first[j];
+        uint32_t num_keys = (n->method == METHOD_MFKEY64) ? solve_mfkey64(n, keys) : solve_mfkey32(n, keys);
+
+        uint32_t best = 0, best_count = 0;
+        for (uint32_t k = 0; k < num_keys; k++) {
+            uint32_t matches = 1;
+            for (uint32_t m = 0; m < target->count; m++) {
+                if (m != j && check_set(&target->first[m], keys[k]))
+                    matches++;
+            }
+            if (matches > best) {
+                best = matches;
+                best_count = 1;
+                target->key = keys[k];
+            } else if (matches == best) {
+                best_count++;
+            }
+        }
+
+        if (best_count == 1) {
+            target->found = true;
+            target->verified = best;
+            target->method = n->method;
+        }
+    }
+}
+
+static void
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+*solve_worker(void *arg) {
+    (void)arg;
+    uint32_t i;
+    while ((i = __atomic_fetch_add(&next_target, 1, __ATOMIC_SEQ_CST)) < num_targets)
+        solve_target(&targets[i]);
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// input parsing
+//-----------------------------------------------------------------------------
+static bool parse_word(const char *s, uint32_t *value) {
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+        s += 2;
+    if (strlen(s) != 8)
+        return false;
+    for (int i = 0; i < 8; i++)
+        if (!isxdigit((unsigned char)s[i]))
+            return false;
+    *value = strtoul(s, NULL, 16);
+    return true;
+}
+
+// "<sector>:<A|B>"
+static bool parse_sector_key(const char *s, uint8_t *sector, uint8_t *keytype) {
+    char *end;
+    unsigned long sec = strtoul(s, &end, 10);
+    if (end == s || *end != ':' || sec > 39 || end[1] == '\0' || end[2] != '\0')
+        return false;
+    char kt = toupper((unsigned char)end[1]);
+    if (kt != 'A' && kt != 'B')
+        return false;
+    *sector = sec;
+    *keytype = (kt == 'B');
+    return true;
+}
+
+static bool parse_nonce_line(char *line, nonce_set_t *set) {
+    uint32_t w[8];
+    int num_words = 0;
+    int forced = -1;
+
+    memset(set, 0, sizeof(nonce_set_t));
+    set->sector = set->keytype = UNKNOWN;
+
+    for (char *tok = strtok(line, " ,;\t\r\n"); tok != NULL; tok = strtok(NULL, " ,;\t\r\n")) {
+        if (num_words < 8 && parse_word(tok, &w[num_words])) {
+            num_words++;
+            continue;
+        }
+        if (num_words)
+            break;
+        if (parse_sector_key(tok, &set->sector, &set->keytype))
+            continue;
+        // tool names select the method, e.g. "./mfkey64 <uid> <nt> <nr> <ar> <at> [enc...]"
+        size_t len = strlen(tok);
+        if (len >= 9 && strcmp(tok + len - 9, "mfkey32v2") == 0)
+            forced = METHOD_MFKEY32V2;
+        else if (len >= 7 && strcmp(tok + len - 7, "mfkey32") == 0)
+            forced = METHOD_MFKEY32;
+        else if (len >= 7 && strcmp(tok + len - 7, "mfkey64") == 0)
+            forced = METHOD_MFKEY64;
+    }
+
+    static const int words_needed[] = {5, 6, 7};
+    if (forced >= 0) {
+        if (num_words < words_needed[forced])
+            return false;
+        set->method = forced;
+    } else if (num_words >= 5 && num_words <= 7) {
+        set->method = num_words - 5;
+    } else {
+        return false;
+    }
+
+    set->uid = w[0];
+    set->nt0 = w[1];
+    set->nr0 = w[2];
+    set->ar0 = w[3];
+    switch (set->method) {
+        case METHOD_MFKEY64:
+            set->at = w[4];
+            break;
+        case METHOD_MFKEY32:
+            set->nt1 = w[1];
+            set->nr1 = w[4];
+            set->ar1 = w[5];
+            break;
+        case METHOD_MFKEY32V2:
+            set->nt1 = w[4];
+            set->nr1 = w[5];
+            set->ar1 = w[6];
+            break;
+    }
+    return true;
+}
+
+typedef struct {
+    bool have_uid;
+    bool crypto;            // after an authentication everything is encrypted
+    bool anticol;           // last reader frame was an anticollision request
+    int stage;              // 0 idle, 1 auth sent, 2 got nt, 3 got nr/ar
+    nonce_set_t set;
+} trace_state_t;
+
+static void trace_reset(trace_state_t *ts) {
+    memset(ts, 0, sizeof(trace_state_t));
+}
+
+static void trace_frame(trace_state_t *ts, bool is_tag, const uint8_t *d, int len) {
+    if (!is_tag) {
+        ts->anticol = (len == 2 && (d[0] == 0x93 || d[0] == 0x95 || d[0] == 0x97) && d[1] == 0x20);
+        if (len == 1 || ts->anticol) {                              // REQA / WUPA / anticollision
+            ts->crypto = false;
+            ts->stage = 0;
+        } else if (len == 9 && !ts->crypto && (d[0] == 0x93 || d[0] == 0x95 || d[0] == 0x97) && d[1] == 0x70) {
+            if (d[2] != 0x88) {                                     // select, skip cascade tag
+                ts->set.uid = (uint32_t)d[2] << 24 | d[3] << 16 | d[4] << 8 | d[5];
+                ts->have_uid = true;
+            }
+            ts->stage = 0;
+        } else if (len == 4 && !ts->crypto && (d[0] == 0x60 || d[0] == 0x61)) {
+            ts->set.sector = block_to_sector(d[1]);
+            ts->set.keytype = d[0] & 1;
+            ts->stage = 1;
+        } else if (len == 8 && ts->stage == 2) {
+            ts->set.nr0 = (uint32_t)d[0] << 24 | d[1] << 16 | d[2] << 8 | d[3];
+            ts->set.ar0 = (uint32_t)d[4] << 24 | d[5] << 16 | d[6] << 8 | d[7];
+            ts->stage = 3;
+        } else {
+            ts->stage = 0;
+        }
+        return;
+    }
+
+    if (len == 5 && ts->anticol && d[0] != 0x88) {
+        ts->set.uid = (uint32_t)d[0] << 24 | d[1] << 16 | d[2] << 8 | d[3];
+        ts->have_uid = true;
+    } else if (len == 4 && ts->stage == 1) {
+        ts->set.nt0 = (uint32_t)d[0] << 24 | d[1] << 16 | d[2] << 8 | d[3];
+        ts->stage = 2;
+        return;
+    } else if (len == 4 && ts->stage == 3) {
+        ts->set.at = (uint32_t)d[0] << 24 | d[1] << 16 | d[2] << 8 | d[3];
+        ts->set.method = METHOD_MFKEY64;
+        if (ts->have_uid)
+            add_set(&ts->set);
+        ts->crypto = true;
+    }
+    ts->anticol = false;
+    ts->stage = 0;
+}
+
+// returns true if the line was a trace frame
+static bool parse_trace_line(trace_state_t *ts, char *line) {
+    bool is_tag;
+    char *data;
+    char *p;
+
+    while (*line == ' ' || *line == '\t')
+        line++;
+
+    if ((p = strstr(line, "| Tag |")) != NULL || (p = strstr(line, "| Rdr |")) != NULL) {
+        // hf list mf table: time | time | Rdr | data | crc | annotation
+        is_tag = (p[2] == 'T');
+        data = p + 7;
+        if ((p = strchr(data, '|')) != NULL)
+            *p = '\0';
+    } else if (strncmp(line, "TAG ", 4) == 0 || strncmp(line, "RDR ", 4) == 0) {
+        is_tag = (line[0] == 'T');
+        data = line + 4;
+    } else if (line[0] == '+') {
+        // ":: TRACE" format: "+ <time>: <..>: [TAG] data"
+        if ((p = strstr(line, "TAG ")) != NULL) {
+            is_tag = true;
+            data = p + 4;
+        } else if ((p = strrchr(line, ':')) != NULL) {
+            is_tag = false;
+            data = p + 1;
+        } else {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    uint8_t frame[64];
+    int len = 0;
+    for (char *tok = strtok(data, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n")) {
+        // parity errors and crc markers
+        char hex[3] = {0};
+        int n = 0;
+        for (char *c = tok; *c && n < 2; c++)
+            if (isxdigit((unsigned char)*c))
+                hex[n++] = *c;
+        if (n != 2 || len == sizeof(frame))
+            return true;
+        frame[len++] = strtoul(hex, NULL, 16);
+    }
+    if (len)
+        trace_frame(ts, is_tag, frame, len);
+    return true;
+}
+
+static int read_file(const char *filename) {
+    FILE *f = (strcmp(filename, "-") == 0) ? stdin : fopen(filename, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Could not open %s\n", filename);
+        return -1;
+    }
+
+    char line[MAX_LINE_LEN];
+    trace_state_t ts;
+    nonce_set_t set;
+    uint32_t before = num_sets;
+    trace_reset(&ts);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#')
+            continue;
+        if (parse_trace_line(&ts, line))
+            continue;
+        if (parse_nonce_line(line, &set) && !add_set(&set)) {
+            break;
+        }
+    }
+    if (f != stdin)
+        fclose(f);
+    return num_sets - before;
+}
+
+//-----------------------------------------------------------------------------
+// dedupe and group
+//-----------------------------------------------------------------------------
+static int compare_sets(const void *a, const void *b) {
+    const nonce_set_t *x = a, *y = b;
+#define CMP(f) if (x->f != y->f) return (x->f > y->f) ? 1 : -1
+    CMP(uid);
+    CMP(sector);
+    CMP(keytype);
+    CMP(method);
+    CMP(nt0);
+    CMP(nr0);
+    CMP(ar0);
+    CMP(nt1);
+    CMP(nr1);
+    CMP(ar1);
+    CMP(at);
+#undef CMP
+    return 0;
+}
+
+static bool same_target(const nonce_set_t *a, const nonce_set_t *b) {
+    // without sector information we can't tell whether two sets share a key
+    if (a->sector == UNKNOWN || a->keytype == UNKNOWN)
+        return false;
+    return a->uid == b->uid && a->sector == b->sector && a->keytype == b->keytype;
+}
+
+static bool build_targets(void) {
+    qsort(sets, num_sets, sizeof(nonce_set_t), compare_sets);
+
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < num_sets; i++) {
+        if (unique && compare_sets(&sets[unique - 1], &sets[i]) == 0)
+            continue;
+        sets[unique++] = sets[i];
+    }
+    num_sets = unique;
+
+    targets = calloc(num_sets ? num_sets : 1, sizeof(target_t));
+    if (targets == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    for (uint32_t i = 0; i < num_sets; i++) {
+        if (num_targets && same_target(targets[num_targets - 1].first, &sets[i])) {
+            targets[num_targets - 1].count++;
+            continue;
+        }
+        targets[num_targets].first = &sets[i];
+        targets[num_targets].count = 1;
+        num_targets++;
+    }
+    return true;
+}
+
+static int compare_keys(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int write_keys(const char *filename) {
+    uint64_t *keys = calloc(num_targets ? num_targets : 1, sizeof(uint64_t));
+    if (keys == NULL)
+        return -1;
+    uint32_t num_keys = 0;
+    for (uint32_t i = 0; i < num_targets; i++)
+        if (targets[i].found)
+            keys[num_keys++] = targets[i].key;
+    qsort(keys, num_keys, sizeof(uint64_t), compare_keys);
+
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Could not create %s\n", filename);
+        free(keys);
+        return -1;
+    }
+    uint32_t written = 0;
+    for (uint32_t i = 0; i < num_keys; i++) {
+        if (i && keys[i] == keys[i - 1])
+            continue;
+        fprintf(f, "%012" PRIx64 "\n", keys[i]);
+        written++;
+    }
+    fclose(f);
+    free(keys);
+    return written;
+}
+
+static void usage(const char *name) {
+    printf("syntax: %s [-t <threads>] [-o <keyfile>] <file> [<file> ...]\n\n", name);
+    printf("    -t <threads>   number of worker threads, 1..%d (default: number of CPUs)\n", MAX_THREADS);
+    printf("    -o <keyfile>   write the unique recovered keys as dictionary (.dic)\n");
+    printf("    <file>         nonce sets and / or text traces, '-' reads stdin\n\n");
+    printf("nonce set lines, 8 hex digit words:\n");
+    printf("    [<sector>:<A|B>] <uid> <nt> <nr> <ar> <at>                 (mfkey64)\n");
+    printf("    [<sector>:<A|B>] <uid> <nt> <nr_0> <ar_0> <nr_1> <ar_1>      (mfkey32)\n");
+    printf("    [<sector>:<A|B>] <uid> <nt> <nr_0> <ar_0> <nt1> <nr_1> <ar_1> (mfkey32v2)\n");
+}
+
+int main(int argc, char *argv[]) {
+    int num_threads = 0;
+    const char *keyfile = NULL;
+    int i;
+
+    printf("MIFARE Classic batch key recovery - mfkey32 / mfkey32v2 / mfkey64\n\n");
+
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            char *end;
+            long n = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || n < 1) {
+                printf("invalid thread count '%s'\n\n", argv[i]);
+                usage(argv[0]);
+                return 1;
+            }
+            num_threads = (n > MAX_THREADS) ? MAX_THREADS : n;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            keyfile = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (i == argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (num_threads == 0)
+        num_threads = num_CPUs();
+    if (num_threads < 1)
+        num_threads = 1;
+    if (num_threads > MAX_THREADS)
+        num_threads = MAX_THREADS;
+
+    int num_files = 0;
+    for (; i < argc; i++) {
+        int n = read_file(argv[i]);
+        if (n < 0)
+            return 1;
+        num_files++;
+    }
+    uint32_t num_read = num_sets;
+    if (!build_targets())
+        return 1;
+    // fewer keys than threads, the spare ones split the state recovery of each key
+    int requested = num_threads;
+    if ((uint32_t)num_threads > num_targets)
+        num_threads = num_targets ? num_targets : 1;
+    recovery_threads = requested / num_threads;
+    if (recovery_threads > MAX_RECOVERY_WORKERS)
+        recovery_threads = MAX_RECOVERY_WORKERS;
+
+    printf("Read %u nonce sets from %d file(s), %u unique, %u keys to recover with %d thread(s)\n\n",
+           num_read, num_files, num_sets, num_targets, num_threads);
+
+    // the calling thread works too. Threads which fail to start leave their share to the others
+    pthread_t thread_id[MAX_THREADS];
+    bool started[MAX_THREADS];
+    for (i = 1; i < num_threads; i++)
+        started[i] = (pthread_create(&thread_id[i], NULL, solve_worker, NULL) == 0);
+    solve_worker(NULL);
+    for (i = 1; i < num_threads; i++)
+        if (started[i])
+            pthread_join(thread_id[i], NULL);
+
+    uint32_t found = 0;
+    printf("   uid   | sec | key |      key     | method    | verified sets\n");
+    printf("---------+-----+-----+--------------+-----------+--------------\n");
+    for (uint32_t t = 0; t < num_targets; t++) {
+        const target_t *target = &targets[t];
+        char sector[4] = " --";
+        if (target->first->sector != UNKNOWN)
+            sprintf(sector, "%3u", target->first->sector);
+        const char *kt = (target->first->keytype == UNKNOWN) ? "-" : (target->first->keytype ? "B" : "A");
+        if (target->found) {
+            printf("%08x | %s |  %s  | %012" PRIx64 " | %-9s | %u / %u\n", target->first->uid, sector, kt, target->key, method_names[target->method], target->verified, target->count);
+            found++;
+        } else {
+            printf("%08x | %s |  %s  |   not found  |           | 0 / %u\n", target->first->uid, sector, kt, target->count);
+        }
+    }
+    printf("\nRecovered %u of %u keys\n", found, num_targets);
+
+    if (keyfile != NULL) {
+        int written = write_keys(keyfile);
+        if (written < 0)
+            return 1;
+        printf("Saved %d unique keys to %s\n", written, keyfile);
+    }
+
+    free(targets);
+    free(sets);
+    return 0;
+}
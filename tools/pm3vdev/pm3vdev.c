@@ -0,0 +1,906 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Virtual Proxmark3 device on a pseudo terminal
+//
+// Opens a pty the client connects to like to a real device (-p /dev/pts/N)
+// and answers OLD, MIX and NG frames the way armsrc/cmd.c and appmain.c do.
+// Built in:
+//  - ping, capabilities, version, status (incl. the transfer speed test), quit
+//  - BigBuf / trace download from a file saved with `trace save`
+//  - MIFARE emulator memory get / set / clear / download, from a binary dump
+//  - hf 14a connect, key check (chk) and fast key check (fchk) answered from the emulator memory
+//  - hf 14a sniff s, streams the loaded trace
+// Any other command, or a built in one to override, is answered from a file of
+// canned responses. Reply latency and a serial link speed can be emulated to
+// benchmark the client without hardware.
+//-----------------------------------------------------------------------------
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pm3_cmd.h"
+#include "mifare.h"
+#include "crc16.h"
+#include "commonutil.h"
+#include "ansi.h"
+
+#define BIGBUF_SIZE             40000   // as armsrc/BigBuf.h
+#define CARD_MEMORY_SIZE        4096
+#define MAX_SECTORS             40
+#define MAX_CANNED              1024
+#define MAX_LINE_LEN            4096
+#define CONN_SPEED_TEST_MIN_TIME 500    // in milliseconds, as armsrc printConnSpeed
+
+#define PRINT_BUFFER_LEN        (PM3_CMD_DATA_SIZE - sizeof(uint16_t))
+
+typedef struct {
+    uint16_t cmd;           // request it answers
+    bool ng;                // NG frame, MIX otherwise
+    bool old;               // OLD frame
+    uint16_t reply;
+    int16_t status;         // NG
+    uint64_t arg[3];        // MIX / OLD
+    uint16_t len;
+    uint8_t data[PM3_CMD_DATA_SIZE];
+} canned_t;
+
+typedef struct {
+    uint64_t frames_in[3];  // OLD, MIX, NG
+    uint64_t frames_out[3];
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t crc_errors;
+    uint64_t unknown;
+    uint32_t per_cmd[0x10000];
+} stats_t;
+
+enum { FRAME_OLD = 0, FRAME_MIX, FRAME_NG };
+static const char *frame_names[] = {"OLD", "MIX", "NG"};
+
+static int master_fd = -1;
+static volatile sig_atomic_t stop = 0;
+
+// options
+static uint32_t latency_ms = 0;
+static uint32_t baudrate = 0;       // 0 = USB-CDC, no wire time, no CRC
+static bool verbose = false;
+
+// device state
+static uint8_t bigbuf[BIGBUF_SIZE];
+static uint32_t tracelen = 0;
+static uint8_t eml[CARD_MEMORY_SIZE];
+static canned_t *canned = NULL;
+static uint32_t num_canned = 0;
+static stats_t stats;
+
+// fchk state kept over key chunks, as the firmware does
+static uint8_t chk_found[80];
+static uint8_t chk_keys[MAX_SECTORS][12];
+static uint8_t chk_foundkeys = 0;
+
+static uint64_t msclock(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+static void msleep(uint32_t ms) {
+    struct timespec t = { ms / 1000, (ms % 1000) * 1000000L };
+    while (nanosleep(&t, &t) == -1 && errno == EINTR && !stop);
+}
+
+// time the bytes take on a 8N1 serial link
+static void wire_time(size_t len) {
+    if (baudrate == 0)
+        return;
+    uint64_t us = (uint64_t)len * 10 * 1000000 / baudrate;
+    struct timespec t = { us / 1000000, (us % 1000000) * 1000 };
+    while (nanosleep(&t, &t) == -1 && errno == EINTR && !stop);
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+//-----------------------------------------------------------------------------
+// Link
+//-----------------------------------------------------------------------------
+
+// blocks until len bytes are read, false on stop
+static bool read_exact(uint8_t *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        struct pollfd p = { master_fd, POLLIN, 0 };
+        int res = poll(&p, 1, 200);
+        if (stop)
+            return false;
+        if (res <= 0)
+            continue;
+        ssize_t n = read(master_fd, buf + got, len - got);
+        if (n > 0) {
+            got += n;
+        } else if (n < 0 && errno != EAGAIN && errno != EINTR && errno != EIO) {
+            perror("read");
+            stop = 1;
+            return false;
+        } else {
+            // EIO: no client on the other side right now
+            msleep(50);
+        }
+    }
+    stats.bytes_in += len;
+    return true;
+}
+
+static int write_frame(const uint8_t *buf, size_t len, int type) {
+    wire_time(len);
+    size_t done = 0;
+    while (done < len && !stop) {
+        ssize_t n = write(master_fd, buf + done, len - done);
+        if (n > 0) {
+            done += n;
+        } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            return PM3_EIO;
+        } else {
+            struct pollfd p = { master_fd, POLLOUT, 0 };
+            poll(&p, 1, 200);
+        }
+    }
+    stats.frames_out[type]++;
+    stats.bytes_out += len;
+    return (done == len) ? PM3_SUCCESS : PM3_EIO;
+}
+
+//-----------------------------------------------------------------------------
+// Replies, framed as armsrc/cmd.c
+//-----------------------------------------------------------------------------
+
+static int reply_old(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, const void *data, size_t len) {
+    PacketResponseOLD txcmd;
+    memset(&txcmd, 0, sizeof(txcmd));
+    txcmd.cmd = cmd;
+    txcmd.arg[0] = arg0;
+    txcmd.arg[1] = arg1;
+    txcmd.arg[2] = arg2;
+    if (data && len)
+        memcpy(txcmd.d.asBytes, data, MIN(len, PM3_CMD_DATA_SIZE));
+
+    if (verbose)
+        printf("  -> OLD cmd 0x%04" PRIx64 " arg %" PRIx64 " %" PRIx64 " %" PRIx64 "\n", cmd, arg0, arg1, arg2);
+    return write_frame((uint8_t *)&txcmd, sizeof(txcmd), FRAME_OLD);
+}
+
+static int reply_ng_internal(uint16_t cmd, int16_t status, const uint8_t *data, size_t len, bool ng) {
+    PacketResponseNGRaw txBufferNG;
+
+    txBufferNG.pre.magic = RESPONSENG_PREAMBLE_MAGIC;
+    txBufferNG.pre.cmd = cmd;
+    txBufferNG.pre.status = status;
+    txBufferNG.pre.ng = ng;
+    if (len > PM3_CMD_DATA_SIZE) {
+        len = PM3_CMD_DATA_SIZE;
+        txBufferNG.pre.status = PM3_EOVFLOW;
+    }
+    txBufferNG.pre.length = len;
+    if (data && len)
+        memcpy(txBufferNG.data, data, len);
+
+    PacketResponseNGPostamble *tx_post = (PacketResponseNGPostamble *)((uint8_t *)&txBufferNG + sizeof(PacketResponseNGPreamble) + len);
+    // the firmware adds a CRC on FPC only
+    if (baudrate) {
+        uint8_t first, second;
+        compute_crc(CRC_14443_A, (uint8_t *)&txBufferNG, sizeof(PacketResponseNGPreamble) + len, &first, &second);
+        tx_post->crc = (first << 8) + second;
+    } else {
+        tx_post->crc = RESPONSENG_POSTAMBLE_MAGIC;
+    }
+
+    if (verbose)
+        printf("  -> %s cmd 0x%04x status %d len %zu\n", ng ? "NG" : "MIX", cmd, status, len);
+    return write_frame((uint8_t *)&txBufferNG, sizeof(PacketResponseNGPreamble) + len + sizeof(PacketResponseNGPostamble), ng ? FRAME_NG : FRAME_MIX);
+}
+
+static int reply_ng(uint16_t cmd, int16_t status, const uint8_t *data, size_t len) {
+    return reply_ng_internal(cmd, status, data, len, true);
+}
+
+static int reply_mix(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, const void *data, size_t len) {
+    int16_t status = PM3_SUCCESS;
+    uint64_t arg[3] = {arg0, arg1, arg2};
+    if (len > PM3_CMD_DATA_SIZE - sizeof(arg)) {
+        len = PM3_CMD_DATA_SIZE - sizeof(arg);
+        status = PM3_EOVFLOW;
+    }
+    uint8_t cmddata[PM3_CMD_DATA_SIZE];
+    memcpy(cmddata, arg, sizeof(arg));
+    if (len && data)
+        memcpy(cmddata + sizeof(arg), data, len);
+    return reply_ng_internal(cmd, status, cmddata, len + sizeof(arg), false);
+}
+
+static void Dbprintf(const char *fmt, ...) {
+    struct {
+        uint16_t flag;
+        uint8_t buf[PRINT_BUFFER_LEN];
+    } PACKED data;
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf((char *)data.buf, sizeof(data.buf), fmt, ap);
+    va_end(ap);
+    if (len < 0)
+        return;
+    data.flag = FLAG_LOG;
+    reply_ng(CMD_DEBUG_PRINT_STRING, PM3_SUCCESS, (uint8_t *)&data, sizeof(data.flag) + MIN((size_t)len, sizeof(data.buf) - 1));
+}
+
+//-----------------------------------------------------------------------------
+// Commands
+//-----------------------------------------------------------------------------
+
+static uint16_t trailer_of_sector(uint8_t sector) {
+    return (sector < 32) ? sector * 4 + 3 : 32 * 4 + (sector - 32) * 16 + 15;
+}
+
+static void eml_clear(void) {
+    const uint8_t trailer[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x07, 0x80, 0x69, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    const uint8_t uid[]   =   {0xe6, 0x84, 0x87, 0xf3, 0x16, 0x88, 0x04, 0x00, 0x46, 0x8e, 0x45, 0x55, 0x4d, 0x70, 0x41, 0x04};
+    memset(eml, 0, sizeof(eml));
+    for (uint8_t s = 0; s < MAX_SECTORS; s++)
+        memcpy(eml + trailer_of_sector(s) * 16, trailer, sizeof(trailer));
+    memcpy(eml, uid, sizeof(uid));
+}
+
+static void send_version(void) {
+    struct p {
+        uint32_t id;
+        uint32_t section_size;
+        uint32_t versionstr_len;
+        char versionstr[PM3_CMD_DATA_SIZE - 12];
+    } PACKED payload;
+    memset(&payload, 0, sizeof(payload));
+    payload.id = 0x270B0A40;    // AT91SAM7S512 Rev A
+    payload.section_size = 0;
+    snprintf(payload.versionstr, sizeof(payload.versionstr),
+             " [ ARM ]\n  bootrom: pm3vdev\n       os: pm3vdev, virtual device on a pty\n\n [ FPGA ]\n none");
+    payload.versionstr_len = strlen(payload.versionstr) + 1;
+    reply_ng(CMD_VERSION, PM3_SUCCESS, (uint8_t *)&payload, 12 + payload.versionstr_len);
+}
+
+static void send_capabilities(void) {
+    capabilities_t capabilities;
+    memset(&capabilities, 0, sizeof(capabilities));
+    capabilities.version = CAPABILITIES_VERSION;
+    capabilities.via_fpc = (baudrate != 0);
+    capabilities.via_usb = (baudrate == 0);
+    capabilities.baudrate = baudrate;
+    capabilities.compiled_with_lf = true;
+    capabilities.compiled_with_iso14443a = true;
+    reply_ng(CMD_CAPABILITIES, PM3_SUCCESS, (uint8_t *)&capabilities, sizeof(capabilities));
+}
+
+static void send_status(void) {
+    Dbprintf("Memory");
+    Dbprintf("  BigBuf_size.............%d", BIGBUF_SIZE);
+    Dbprintf("  Trace length............%u", tracelen);
+    Dbprintf("Virtual device");
+    Dbprintf("  Link....................%s", baudrate ? "FPC UART" : "USB-CDC");
+    if (baudrate)
+        Dbprintf("  Baudrate................%u", baudrate);
+    Dbprintf("  Reply latency...........%u ms", latency_ms);
+
+    Dbprintf("Transfer Speed");
+    Dbprintf("  Sending packets to client...");
+    uint64_t start_time = msclock();
+    uint64_t delta_time = 0;
+    uint32_t bytes_transferred = 0;
+    while (delta_time < CONN_SPEED_TEST_MIN_TIME && !stop) {
+        reply_ng(CMD_DOWNLOADED_BIGBUF, PM3_SUCCESS, bigbuf, PM3_CMD_DATA_SIZE);
+        bytes_transferred += PM3_CMD_DATA_SIZE;
+        delta_time = msclock() - start_time;
+    }
+    Dbprintf("  Time elapsed............%" PRIu64 "ms", delta_time);
+    Dbprintf("  Bytes transferred.......%u", bytes_transferred);
+    Dbprintf("  Transfer Speed PM3 -> Client = " _YELLOW_("%" PRIu64) "bytes/s", 1000 * (uint64_t)bytes_transferred / (delta_time ? delta_time : 1));
+    reply_old(CMD_ACK, 1, 0, 0, NULL, 0);
+}
+
+static void download(uint16_t reply, const uint8_t *mem, uint32_t memlen, const PacketCommandNG *packet, uint64_t arg2) {
+    uint32_t startidx = packet->oldarg[0];
+    uint32_t numofbytes = packet->oldarg[1];
+    if (startidx > memlen)
+        startidx = memlen;
+    if (numofbytes > memlen - startidx)
+        numofbytes = memlen - startidx;
+
+    for (uint32_t i = 0; i < numofbytes && !stop; i += PM3_CMD_DATA_SIZE) {
+        uint32_t len = MIN(numofbytes - i, PM3_CMD_DATA_SIZE);
+        reply_old(reply, i, len, arg2, mem + startidx + i, len);
+    }
+}
+
+static void hf14a_reader(const PacketCommandNG *packet) {
+    uint64_t param = packet->oldarg[0];
+    if ((param & ISO14A_CONNECT) == 0 || (param & ISO14A_NO_SELECT))
+        return;
+
+    // the card in emulator memory: uid, sak and atqa from block 0
+    iso14a_card_select_t card;
+    memset(&card, 0, sizeof(card));
+    memcpy(card.uid, eml, 4);
+    card.uidlen = 4;
+    card.sak = eml[5];
+    card.atqa[0] = eml[6];
+    card.atqa[1] = eml[7];
+    reply_mix(CMD_ACK, 1, card.uidlen, 0, &card, sizeof(card));
+}
+
+// a streaming sniff (param bit 2) sends the loaded trace in chunks as BigBuf_stream_trace does,
+// then ends as if stopped. A plain sniff only ends on the button, it gets no reply.
+static void hf14a_sniff(const PacketCommandNG *packet) {
+    if (packet->length < 1 || (packet->data.asBytes[0] & 0x04) == 0)
+        return;
+
+    for (uint32_t offset = 0; offset < tracelen && !stop; offset += PM3_CMD_DATA_SIZE_MIX) {
+        uint32_t len = MIN(tracelen - offset, PM3_CMD_DATA_SIZE_MIX);
+        reply_mix(CMD_HF_ISO14443A_SNIFF_STREAM, offset, 0, 0, bigbuf + offset, len);
+    }
+    reply_ng(CMD_HF_ISO14443A_SNIFF, PM3_SUCCESS, NULL, 0);
+}
+
+// as MifareChkKeys, a key is valid when it matches the emulator trailer of the block's sector
+static void mifare_chkkeys(const PacketCommandNG *packet) {
+    struct {
+        uint8_t key[6];
+        bool found;
+    } PACKED keyresult;
+    memset(&keyresult, 0, sizeof(keyresult));
+
+    uint8_t keyType = packet->data.asBytes[0] & 1;
+    uint8_t blockNo = packet->data.asBytes[1];
+    uint8_t keyCount = MIN(packet->data.asBytes[3], (packet->length - 4) / 6);
+    const uint8_t *datain = packet->data.asBytes + 4;
+
+    uint8_t sector = (blockNo < 128) ? blockNo / 4 : 32 + (blockNo - 128) / 16;
+    const uint8_t *trailer = eml + trailer_of_sector(sector) * 16;
+    for (uint8_t i = 0; i < keyCount; i++) {
+        if (memcmp(datain + i * 6, trailer + keyType * 10, 6) == 0) {
+            memcpy(keyresult.key, datain + i * 6, 6);
+            keyresult.found = true;
+            break;
+        }
+    }
+    reply_ng(CMD_HF_MIFARE_CHKKEYS, PM3_SUCCESS, (uint8_t *)&keyresult, sizeof(keyresult));
+}
+
+// same chunk protocol as MifareChkKeys_fast, keys are valid when they match the emulator trailers
+static void mifare_chkkeys_fast(const PacketCommandNG *packet) {
+    uint8_t sectorcnt = MIN(packet->oldarg[0] & 0xFF, MAX_SECTORS);
+    uint8_t firstchunk = (packet->oldarg[0] >> 8) & 0xF;
+    uint8_t lastchunk = (packet->oldarg[0] >> 12) & 0xF;
+    uint16_t keyCount = packet->oldarg[2] & 0xFF;
+    uint8_t allkeys = sectorcnt << 1;
+    const uint8_t *datain = packet->data.asBytes;
+
+    if (firstchunk) {
+        memset(chk_found, 0, sizeof(chk_found));
+        memset(chk_keys, 0, sizeof(chk_keys));
+        chk_foundkeys = 0;
+    }
+
+    keyCount = MIN(keyCount, packet->length / 6);
+    for (uint16_t i = 0; i < keyCount && chk_foundkeys < allkeys; i++) {
+        for (uint8_t s = 0; s < sectorcnt; s++) {
+            const uint8_t *trailer = eml + trailer_of_sector(s) * 16;
+            for (uint8_t t = 0; t < 2; t++) {
+                if (chk_found[s * 2 + t] || memcmp(datain + i * 6, trailer + t * 10, 6) != 0)
+                    continue;
+                memcpy(chk_keys[s] + t * 6, datain + i * 6, 6);
+                chk_found[s * 2 + t] = 1;
+                chk_foundkeys++;
+            }
+        }
+    }
+
+    if (chk_foundkeys == allkeys || lastchunk) {
+        uint64_t foo = 0;
+        for (uint8_t m = 0; m < 64; m++)
+            foo |= ((uint64_t)(chk_found[m] & 1) << m);
+
+        uint16_t bar = 0;
+        uint8_t j = 0;
+        for (uint8_t m = 64; m < ARRAYLEN(chk_found); m++)
+            bar |= ((uint16_t)(chk_found[m] & 1) << j++);
+
+        uint8_t tmp[480 + 10] = {0};
+        memcpy(tmp, chk_keys, sectorcnt * 12);
+        for (uint8_t i = 0; i < 8; i++)
+            tmp[480 + i] = (foo >> (56 - 8 * i)) & 0xFF;
+        tmp[488] = bar & 0xFF;
+        tmp[489] = bar >> 8 & 0xFF;
+        reply_old(CMD_ACK, chk_foundkeys, 0, 0, tmp, sizeof(tmp));
+    } else {
+        reply_mix(CMD_ACK, chk_foundkeys, 0, 0, NULL, 0);
+    }
+}
+
+static bool reply_canned(uint16_t cmd) {
+    bool found = false;
+    for (uint32_t i = 0; i < num_canned; i++) {
+        canned_t *c = &canned[i];
+        if (c->cmd != cmd)
+            continue;
+        found = true;
+        if (c->old)
+            reply_old(c->reply, c->arg[0], c->arg[1], c->arg[2], c->data, c->len);
+        else if (c->ng)
+            reply_ng(c->reply, c->status, c->data, c->len);
+        else
+            reply_mix(c->reply, c->arg[0], c->arg[1], c->arg[2], c->data, c->len);
+    }
+    return found;
+}
+
+static void process(const PacketCommandNG *packet) {
+
+    stats.per_cmd[packet->cmd]++;
+
+    if (latency_ms)
+        msleep(latency_ms);
+
+    if (reply_canned(packet->cmd))
+        return;
+
+    switch (packet->cmd) {
+        case CMD_PING: {
+            reply_ng(CMD_PING, PM3_SUCCESS, packet->data.asBytes, packet->length);
+            break;
+        }
+        case CMD_CAPABILITIES: {
+            send_capabilities();
+            break;
+        }
+        case CMD_VERSION: {
+            send_version();
+            break;
+        }
+        case CMD_STATUS: {
+            send_status();
+            break;
+        }
+        case CMD_QUIT_SESSION:
+        case CMD_FPGA_MAJOR_MODE_OFF: {
+            break;
+        }
+        case CMD_BUFF_CLEAR: {
+            memset(bigbuf, 0, sizeof(bigbuf));
+            tracelen = 0;
+            break;
+        }
+        case CMD_DOWNLOAD_BIGBUF: {
+            download(CMD_DOWNLOADED_BIGBUF, bigbuf, sizeof(bigbuf), packet, tracelen);
+            sample_config config = { 1, 8, true, 95, 0 };
+            reply_old(CMD_ACK, 1, 0, tracelen, &config, sizeof(config));
+            break;
+        }
+        case CMD_DOWNLOAD_EML_BIGBUF: {
+            download(CMD_DOWNLOADED_EML_BIGBUF, eml, sizeof(eml), packet, 0);
+            reply_old(CMD_ACK, 1, 0, 0, NULL, 0);
+            break;
+        }
+        case CMD_HF_MIFARE_EML_MEMCLR: {
+            eml_clear();
+            reply_ng(CMD_HF_MIFARE_EML_MEMCLR, PM3_SUCCESS, NULL, 0);
+            break;
+        }
+        case CMD_HF_MIFARE_EML_MEMSET: {
+            struct p {
+                uint8_t blockno;
+                uint8_t blockcnt;
+                uint8_t blockwidth;
+                uint8_t data[];
+            } PACKED;
+            const struct p *payload = (const struct p *)packet->data.asBytes;
+            uint8_t width = payload->blockwidth ? payload->blockwidth : 16;
+            size_t offset = (size_t)payload->blockno * width;
+            size_t len = (size_t)payload->blockcnt * width;
+            if (offset + len <= sizeof(eml) && len <= PM3_CMD_DATA_SIZE - 3)
+                memcpy(eml + offset, payload->data, len);
+            break;
+        }
+        case CMD_HF_MIFARE_EML_MEMGET: {
+            struct p {
+                uint8_t blockno;
+                uint8_t blockcnt;
+            } PACKED;
+            const struct p *payload = (const struct p *)packet->data.asBytes;
+            size_t size = payload->blockcnt * 16;
+            if (size > PM3_CMD_DATA_SIZE || payload->blockno * 16 + size > sizeof(eml)) {
+                reply_ng(CMD_HF_MIFARE_EML_MEMGET, PM3_EMALLOC, NULL, 0);
+                break;
+            }
+            reply_ng(CMD_HF_MIFARE_EML_MEMGET, PM3_SUCCESS, eml + payload->blockno * 16, size);
+            break;
+        }
+        case CMD_HF_ISO14443A_READER: {
+            hf14a_reader(packet);
+            break;
+        }
+        case CMD_HF_ISO14443A_SNIFF: {
+            hf14a_sniff(packet);
+            break;
+        }
+        case CMD_HF_MIFARE_CHKKEYS: {
+            mifare_chkkeys(packet);
+            break;
+        }
+        case CMD_HF_MIFARE_CHKKEYS_FAST: {
+            mifare_chkkeys_fast(packet);
+            break;
+        }
+        default: {
+            stats.unknown++;
+            if (verbose)
+                printf("  no reply for cmd 0x%04x\n", packet->cmd);
+            break;
+        }
+    }
+}
+
+// one frame from the client, parsed like receive_ng_internal() in armsrc/cmd.c
+static int receive(PacketCommandNG *rx) {
+    PacketCommandNGRaw rx_raw;
+    if (!read_exact((uint8_t *)&rx_raw.pre, sizeof(PacketCommandNGPreamble)))
+        return PM3_EOPABORTED;
+
+    rx->magic = rx_raw.pre.magic;
+    rx->ng = rx_raw.pre.ng;
+    uint16_t length = rx_raw.pre.length;
+    rx->cmd = rx_raw.pre.cmd;
+
+    if (rx->magic == COMMANDNG_PREAMBLE_MAGIC) {
+        if (length > PM3_CMD_DATA_SIZE)
+            return PM3_EOVFLOW;
+        if (!read_exact(rx_raw.data, length))
+            return PM3_EOPABORTED;
+
+        if (rx->ng) {
+            memcpy(rx->data.asBytes, rx_raw.data, length);
+            rx->length = length;
+        } else {
+            uint64_t arg[3];
+            if (length < sizeof(arg))
+                return PM3_EIO;
+            memcpy(arg, rx_raw.data, sizeof(arg));
+            rx->oldarg[0] = arg[0];
+            rx->oldarg[1] = arg[1];
+            rx->oldarg[2] = arg[2];
+            memcpy(rx->data.asBytes, rx_raw.data + sizeof(arg), length - sizeof(arg));
+            rx->length = length - sizeof(arg);
+        }
+        if (!read_exact((uint8_t *)&rx_raw.foopost, sizeof(PacketCommandNGPostamble)))
+            return PM3_EOPABORTED;
+
+        rx->crc = rx_raw.foopost.crc;
+        if (rx->crc != COMMANDNG_POSTAMBLE_MAGIC) {
+            uint8_t first, second;
+            compute_crc(CRC_14443_A, (uint8_t *)&rx_raw, sizeof(PacketCommandNGPreamble) + length, &first, &second);
+            if ((first << 8) + second != rx->crc) {
+                stats.crc_errors++;
+                return PM3_EIO;
+            }
+        }
+        wire_time(sizeof(PacketCommandNGPreamble) + length + sizeof(PacketCommandNGPostamble));
+        stats.frames_in[rx->ng ? FRAME_NG : FRAME_MIX]++;
+    } else {
+        PacketCommandOLD rx_old;
+        memcpy(&rx_old, &rx_raw.pre, sizeof(PacketCommandNGPreamble));
+        if (!read_exact(((uint8_t *)&rx_old) + sizeof(PacketCommandNGPreamble), sizeof(PacketCommandOLD) - sizeof(PacketCommandNGPreamble)))
+            return PM3_EOPABORTED;
+
+        rx->ng = false;
+        rx->magic = 0;
+        rx->crc = 0;
+        rx->cmd = rx_old.cmd;
+        rx->oldarg[0] = rx_old.arg[0];
+        rx->oldarg[1] = rx_old.arg[1];
+        rx->oldarg[2] = rx_old.arg[2];
+        rx->length = PM3_CMD_DATA_SIZE;
+        memcpy(&rx->data, &rx_old.d.asBytes, rx->length);
+        wire_time(sizeof(PacketCommandOLD));
+        stats.frames_in[FRAME_OLD]++;
+    }
+    return PM3_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+// Files
+//-----------------------------------------------------------------------------
+
+static long load_file(const char *filename, uint8_t *dest, size_t maxlen) {
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Could not open file %s\n", filename);
+        return -1;
+    }
+    size_t len = fread(dest, 1, maxlen, f);
+    bool more = (fgetc(f) != EOF);
+    fclose(f);
+    if (more)
+        fprintf(stderr, "Warning: %s is larger than %zu bytes, truncated\n", filename, maxlen);
+    return len;
+}
+
+// <request cmd> ng <reply cmd> <status> [hex data]
+// <request cmd> mix|old <reply cmd> <arg0> <arg1> <arg2> [hex data]
+static int load_canned(const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Could not open file %s\n", filename);
+        return -1;
+    }
+
+    canned = calloc(MAX_CANNED, sizeof(canned_t));
+    if (canned == NULL) {
+        fclose(f);
+        return -1;
+    }
+
+    char line[MAX_LINE_LEN];
+    uint32_t lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+
+        char *tok[8] = {NULL};
+        int ntok = 0;
+        for (char *t = strtok(line, " \t\r\n"); t && ntok < 8; t = strtok(NULL, " \t\r\n"))
+            tok[ntok++] = t;
+        if (ntok == 0)
+            continue;
+
+        if (num_canned == MAX_CANNED) {
+            fprintf(stderr, "%s:%u: more than %u responses\n", filename, lineno, MAX_CANNED);
+            break;
+        }
+        canned_t *c = &canned[num_canned];
+        memset(c, 0, sizeof(canned_t));
+
+        int nargs = 0;
+        if (ntok >= 4 && strcmp(tok[1], "ng") == 0) {
+            c->ng = true;
+            nargs = 1;
+        } else if (ntok >= 6 && (strcmp(tok[1], "mix") == 0 || strcmp(tok[1], "old") == 0)) {
+            c->old = (tok[1][0] == 'o');
+            nargs = 3;
+        } else {
+            fprintf(stderr, "%s:%u: expected <cmd> ng <reply> <status> [data] or <cmd> mix|old <reply> <arg0> <arg1> <arg2> [data]\n", filename, lineno);
+            fclose(f);
+            return -1;
+        }
+        c->cmd = strtoul(tok[0], NULL, 0);
+        c->reply = strtoul(tok[2], NULL, 0);
+        if (c->ng)
+            c->status = strtol(tok[3], NULL, 0);
+        else
+            for (int i = 0; i < 3; i++)
+                c->arg[i] = strtoull(tok[3 + i], NULL, 0);
+
+        const char *hex = (ntok > 3 + nargs) ? tok[3 + nargs] : "";
+        size_t hexlen = strlen(hex);
+        size_t maxlen = c->ng ? PM3_CMD_DATA_SIZE : (c->old ? PM3_CMD_DATA_SIZE : PM3_CMD_DATA_SIZE_MIX);
+        if ((hexlen & 1) || hexlen / 2 > maxlen) {
+            fprintf(stderr, "%s:%u: data must be an even number of hex digits, at most %zu bytes\n", filename, lineno, maxlen);
+            fclose(f);
+            return -1;
+        }
+        for (size_t i = 0; i < hexlen; i += 2) {
+            if (!isxdigit((unsigned char)hex[i]) || !isxdigit((unsigned char)hex[i + 1])) {
+                fprintf(stderr, "%s:%u: invalid hex data\n", filename, lineno);
+                fclose(f);
+                return -1;
+            }
+            char b[3] = {hex[i], hex[i + 1], '\0'};
+            c->data[i / 2] = strtoul(b, NULL, 16);
+        }
+        c->len = hexlen / 2;
+        num_canned++;
+    }
+    fclose(f);
+    return num_canned;
+}
+
+//-----------------------------------------------------------------------------
+
+static int open_pty(const char *link) {
+    master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master_fd < 0 || grantpt(master_fd) != 0 || unlockpt(master_fd) != 0) {
+        perror("posix_openpt");
+        return -1;
+    }
+    const char *name = ptsname(master_fd);
+    if (name == NULL) {
+        perror("ptsname");
+        return -1;
+    }
+
+    // keep the slave open ourselves, the master does not see a hangup when the client disconnects
+    int slave_fd = open(name, O_RDWR | O_NOCTTY);
+    if (slave_fd < 0) {
+        perror(name);
+        return -1;
+    }
+    struct termios ti;
+    if (tcgetattr(slave_fd, &ti) == 0) {
+        cfmakeraw(&ti);
+        tcsetattr(slave_fd, TCSANOW, &ti);
+    }
+
+    if (link) {
+        // only ever replace a stale link of an earlier run
+        struct stat st;
+        if (lstat(link, &st) == 0) {
+            if (!S_ISLNK(st.st_mode)) {
+                fprintf(stderr, "%s exists and is not a symlink\n", link);
+                return -1;
+            }
+            unlink(link);
+        }
+        if (symlink(name, link) != 0) {
+            perror(link);
+            return -1;
+        }
+        printf("Virtual Proxmark3 on %s -> %s\n", link, name);
+    } else {
+        printf("Virtual Proxmark3 on %s\n", name);
+    }
+    printf("Connect with: ./client/proxmark3 %s\n\n", link ? link : name);
+    fflush(stdout);
+    return 0;
+}
+
+static void print_stats(uint64_t elapsed) {
+    printf("\n%" PRIu64 ".%03" PRIu64 " s, in %" PRIu64 " bytes, out %" PRIu64 " bytes\n",
+           elapsed / 1000, elapsed % 1000, stats.bytes_in, stats.bytes_out);
+    for (int i = 0; i < 3; i++)
+        printf("  %-4s frames in %8" PRIu64 "  out %8" PRIu64 "\n", frame_names[i], stats.frames_in[i], stats.frames_out[i]);
+    if (stats.crc_errors)
+        printf("  CRC errors %" PRIu64 "\n", stats.crc_errors);
+    if (stats.unknown)
+        printf("  commands without reply %" PRIu64 "\n", stats.unknown);
+    printf("  commands:");
+    for (uint32_t cmd = 0; cmd < 0x10000; cmd++)
+        if (stats.per_cmd[cmd])
+            printf(" 0x%04x:%u", cmd, stats.per_cmd[cmd]);
+    printf("\n");
+}
+
+static void usage(const char *name) {
+    printf("Virtual Proxmark3 device on a pseudo terminal, for client tests and benchmarks\n\n");
+    printf("Usage: %s [-l <link>] [-b <baudrate>] [-d <ms>] [-t <trace>] [-e <dump>] [-r <responses>] [-v]\n", name);
+    printf("  -l <link>       also create a symlink to the pty, e.g. /tmp/pm3vdev\n");
+    printf("  -b <baudrate>   act as FPC UART: emulate the serial link speed, replies with CRC\n");
+    printf("                  default USB-CDC without wire time\n");
+    printf("  -d <ms>         latency before the reply to each command\n");
+    printf("  -t <trace>      BigBuf content for `trace list` / `data samples`, as from `trace save`\n");
+    printf("                  `hf 14a sniff s` streams it\n");
+    printf("  -e <dump>       MIFARE emulator memory, a binary dump (up to 4096 bytes)\n");
+    printf("                  `hf 14a reader`, `hf mf chk` and `hf mf fchk` see this card\n");
+    printf("  -r <responses>  canned replies, one frame per line, several lines per command are sent in order:\n");
+    printf("                    <cmd> ng <reply cmd> <status> [hex data]\n");
+    printf("                    <cmd> mix|old <reply cmd> <arg0> <arg1> <arg2> [hex data]\n");
+    printf("                  they override the built in commands\n");
+    printf("  -v              log every frame\n\n");
+    printf("Statistics are printed on exit (Ctrl-C).\n\n");
+    printf("Example: %s -l /tmp/pm3vdev -b 115200 -d 5 -e hf-mf-01020304-data.bin\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    const char *link = NULL;
+
+    eml_clear();
+
+    int i;
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        char opt = argv[i][1];
+        if (opt == 'v' && argv[i][2] == '\0') {
+            verbose = true;
+            continue;
+        }
+        if (argv[i][2] != '\0' || i + 1 >= argc || strchr("lbdter", opt) == NULL) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *val = argv[++i];
+        switch (opt) {
+            case 'l':
+                link = val;
+                break;
+            case 'b':
+                baudrate = strtoul(val, NULL, 0);
+                break;
+            case 'd':
+                latency_ms = strtoul(val, NULL, 0);
+                break;
+            case 't': {
+                long len = load_file(val, bigbuf, sizeof(bigbuf));
+                if (len < 0)
+                    return 1;
+                tracelen = len;
+                printf("Loaded %ld bytes of trace from %s\n", len, val);
+                break;
+            }
+            case 'e': {
+                long len = load_file(val, eml, sizeof(eml));
+                if (len < 0)
+                    return 1;
+                printf("Loaded %ld bytes of emulator memory from %s\n", len, val);
+                break;
+            }
+            case 'r': {
+                int n = load_canned(val);
+                if (n < 0)
+                    return 1;
+                printf("Loaded %d canned responses from %s\n", n, val);
+                break;
+            }
+        }
+    }
+    if (i != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (open_pty(link) != 0)
+        return 1;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    uint64_t start = msclock();
+    PacketCommandNG rx;
+    while (!stop) {
+        memset(&rx, 0, sizeof(rx));
+        int res = receive(&rx);
+        if (res == PM3_EOPABORTED)
+            break;
+        if (res != PM3_SUCCESS) {
+            if (verbose)
+                printf("  dropped a frame (%d)\n", res);
+            continue;
+        }
+        if (verbose)
+            printf("<- %s cmd 0x%04x len %u\n", rx.magic ? (rx.ng ? "NG" : "MIX") : "OLD", rx.cmd, rx.length);
+        process(&rx);
+        fflush(stdout);
+    }
+
+    print_stats(msclock() - start);
+    if (link)
+        unlink(link);
+    free(canned);
+    return 0;
+}